@@ -0,0 +1,265 @@
+#include "analyticsReader.hpp"
+
+#include <string.h>
+#include <iomanip>
+#include "bitStream.hpp"
+#include "cobs.hpp"
+#include "modemPacket.hpp"
+
+static uint32_t get32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+AnalyticsReceiver::Status AnalyticsReceiver::feed(const uint8_t *data, size_t length) {
+    stats.bytes += length;
+    for (size_t i = 0; i < length && status != Status::Complete; i++) {
+        if (data[i] != 0) {
+            if (pending.size() < AnalyticsExport::ENCODED_SIZE) {
+                pending.push_back(data[i]);
+            } else {
+                overflow = true;
+            }
+            continue;
+        }
+        if (overflow) {
+            stats.badFrames++;
+        } else if (!pending.empty()) {
+            frame();
+        }
+        pending.clear();
+        overflow = false;
+    }
+    return status;
+}
+
+void AnalyticsReceiver::frame() {
+    decoded.resize(pending.size());
+    size_t length = cobsDecode(pending.data(), pending.size(), decoded.data());
+    if (length < 5 ||
+        ModemPacket::crc16(decoded.data(), length - 2) != (uint16_t)(decoded[length - 2] | decoded[length - 1] << 8)) {
+        stats.badFrames++;
+        return;
+    }
+    stats.frames++;
+    auto type = (AnalyticsExport::FrameType)decoded[0];
+    size_t index = decoded[1] | decoded[2] << 8;
+    const uint8_t *body = &decoded[3];
+    size_t bodyLength = length - 5;
+
+    if (type == AnalyticsExport::FrameType::Start && bodyLength >= 6) {
+        // A new export starts over, also after a failed one
+        session.assign(get32(body), 0);
+        chunkSize = body[4] | body[5] << 8;
+        received.assign(chunkSize > 0 ? (session.size() + chunkSize - 1) / chunkSize : 0, false);
+        status = chunkSize > 0 ? Status::Receiving : Status::Failed;
+        error = chunkSize > 0 ? "" : "chunk size 0";
+    } else if (type == AnalyticsExport::FrameType::Data && status == Status::Receiving) {
+        size_t offset = index * chunkSize;
+        if (index < received.size() && offset + bodyLength <= session.size()) {
+            memcpy(&session[offset], body, bodyLength);
+            received[index] = true;
+        }
+    } else if (type == AnalyticsExport::FrameType::End && status == Status::Receiving && bodyLength >= 8) {
+        stats.missingChunks = 0;
+        for (bool chunk : received) {
+            stats.missingChunks += chunk ? 0 : 1;
+        }
+        if (get32(body) != session.size()) {
+            status = Status::Failed;
+            error = "size differs from the start frame";
+        } else if (stats.missingChunks > 0) {
+            status = Status::Failed;
+            error = std::to_string(stats.missingChunks) + " chunks missing";
+        } else if (analyticsCrc32(session.data(), session.size()) != get32(body + 4)) {
+            status = Status::Failed;
+            error = "CRC-32 of the session is wrong";
+        } else {
+            status = Status::Complete;
+        }
+    }
+}
+
+// A column of a coding this reader knows, false when its data ends early
+static bool decodeColumn(AnalyticsColumnId id, BitReader &bits, uint32_t count, AnalyticsSession &session) {
+    uint32_t value = 0;
+    if (id == AnalyticsColumnId::Vad) {
+        VadState state = VadState::Silence;
+        session.states.reserve(count);
+        while (session.states.size() < count) {
+            if (session.states.empty()) {
+                if (!bits.read(2, value)) {
+                    return false;
+                }
+                state = (VadState)value;
+            } else {
+                VadState previous = state;
+                if (!bits.read(1, value)) {
+                    return false;
+                }
+                state = analyticsExpectedState(previous);
+                if (value != 0) {
+                    uint32_t choice = 0;
+                    if (!bits.read(1, choice)) {
+                        return false;
+                    }
+                    for (uint8_t s = 0; s < 4; s++) {
+                        if ((VadState)s == previous || (VadState)s == analyticsExpectedState(previous)) {
+                            continue;
+                        }
+                        if (choice-- == 0) {
+                            state = (VadState)s;
+                            break;
+                        }
+                    }
+                }
+            }
+            uint32_t run = 0;
+            if (!bits.gamma(run) || run > count - session.states.size()) {
+                return false;
+            }
+            session.states.insert(session.states.end(), run, state);
+        }
+    } else if (id == AnalyticsColumnId::Level) {
+        session.levels.reserve(count);
+        while (session.levels.size() < count) {
+            uint32_t base = 0;
+            uint32_t width = 0;
+            if (!bits.read(16, base) || !bits.read(5, width) || width > 17) {
+                return false;
+            }
+            int32_t level = (int16_t)base;
+            session.levels.push_back((int16_t)level);
+            size_t block = count - session.levels.size() + 1;
+            block = block < AnalyticsWriter::LEVEL_BLOCK ? block : AnalyticsWriter::LEVEL_BLOCK;
+            for (size_t i = 1; i < block; i++) {
+                if (!bits.read(width, value)) {
+                    return false;
+                }
+                level += (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+                session.levels.push_back((int16_t)level);
+            }
+        }
+    } else if (id == AnalyticsColumnId::Words) {
+        uint32_t frame = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t delta = 0;
+            if (!bits.gamma(delta) || !bits.gamma(value)) {
+                return false;
+            }
+            frame += delta - 1;
+            session.windows.push_back({frame, (uint16_t)(value - 1)});
+        }
+    } else if (id == AnalyticsColumnId::Events) {
+        uint32_t frame = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t delta = 0;
+            uint32_t type = 0;
+            if (!bits.gamma(delta) || !bits.read(4, type) || !bits.read(8, value)) {
+                return false;
+            }
+            frame += delta - 1;
+            session.events.push_back({frame, (AnalyticsEventType)type, (uint8_t)value});
+        }
+    }
+    return true;
+}
+
+bool decodeAnalytics(const uint8_t *data, size_t length, AnalyticsSession &session, std::string &error) {
+    session = AnalyticsSession();
+    if (length < sizeof(AnalyticsHeader) + 4) {
+        error = "too short for a session";
+        return false;
+    }
+    AnalyticsHeader &header = session.header;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, AnalyticsWriter::MAGIC, sizeof(header.magic)) != 0) {
+        error = "not a session, wrong magic";
+        return false;
+    }
+    if (header.version != AnalyticsWriter::VERSION) {
+        error = "version " + std::to_string(header.version) + " is not supported";
+        return false;
+    }
+    if (header.headerSize < sizeof(AnalyticsHeader) || (size_t)header.headerSize + header.dataSize + 4 != length) {
+        error = "length does not match the header";
+        return false;
+    }
+    if (analyticsCrc32(data, length - 4) != get32(data + length - 4)) {
+        error = "CRC-32 is wrong";
+        return false;
+    }
+
+    size_t directory = header.headerSize;
+    size_t offset = directory + (size_t)header.columnCount * sizeof(AnalyticsColumnEntry);
+    for (size_t c = 0; c < header.columnCount; c++) {
+        AnalyticsColumnEntry entry;
+        if (offset > length - 4) {
+            error = "directory runs past the end";
+            return false;
+        }
+        memcpy(&entry, data + directory + c * sizeof(entry), sizeof(entry));
+        if (offset + entry.size > length - 4) {
+            error = "column " + std::to_string(entry.id) + " runs past the end";
+            return false;
+        }
+        // Unknown columns and codings are skipped, they come from a newer firmware
+        if (entry.coding == AnalyticsWriter::CODING) {
+            BitReader bits(data + offset, entry.size);
+            if (!decodeColumn((AnalyticsColumnId)entry.id, bits, entry.count, session)) {
+                error = "column " + std::to_string(entry.id) + " is damaged";
+                return false;
+            }
+        }
+        offset += entry.size;
+    }
+    return true;
+}
+
+const char *vadStateName(VadState state) {
+    switch (state) {
+        case VadState::Silence: return "silence";
+        case VadState::Speech: return "speech";
+        case VadState::Modem: return "modem";
+        case VadState::Skipped: return "skipped";
+    }
+    return "?";
+}
+
+void writeAnalyticsCsv(const AnalyticsSession &session, std::ostream &out) {
+    static const char *const BUTTONS[] = {"start", "stop", "patient_pause", "research_pause", "code_scanner",
+                                          "audio_data", "recorder_fault"};
+    const AnalyticsHeader &header = session.header;
+    out << "frame,seconds,state,level_db,words,events\n";
+    size_t window = 0;
+    size_t event = 0;
+    for (size_t f = 0; f < session.states.size(); f++) {
+        out << f << ',' << std::fixed << std::setprecision(2) << f * header.framePeriodMs / 1000.0 << ','
+            << vadStateName(session.states[f]) << ',';
+        size_t level = f / header.levelFrames;
+        if (level < session.levels.size()) {
+            out << session.levels[level];
+        }
+        out << ',';
+        // Windows and events belong to the last frame before them
+        bool first = true;
+        while (window < session.windows.size() && session.windows[window].frame <= f + 1) {
+            out << (first ? "" : ";") << session.windows[window++].words;
+            first = false;
+        }
+        out << ',';
+        first = true;
+        while (event < session.events.size() && session.events[event].frame <= f + 1) {
+            const AnalyticsSession::Event &e = session.events[event++];
+            out << (first ? "" : ";");
+            first = false;
+            if (e.type == AnalyticsEventType::Button && e.value < sizeof(BUTTONS) / sizeof(BUTTONS[0])) {
+                out << BUTTONS[e.value];
+            } else if (e.type == AnalyticsEventType::Fault) {
+                out << "fault " << (unsigned)e.value;
+            } else {
+                out << "event " << (unsigned)e.type << ' ' << (unsigned)e.value;
+            }
+        }
+        out << '\n';
+    }
+}
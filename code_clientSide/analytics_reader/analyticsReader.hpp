@@ -0,0 +1,109 @@
+/**
+ * @file analyticsReader.hpp
+ * @brief Host side of the session analytics: reassembles an export and decodes the columns.
+ *
+ * AnalyticsReceiver takes the raw bytes of "analytics export" as they come
+ * from the serial port, in any piece size, and rebuilds the session from the
+ * COBS frames of analyticsExport.hpp. Text before or between the frames is
+ * ignored. decodeAnalytics() turns the session into vectors, one entry per
+ * frame, level entry, window and event (format in analyticsFormat.hpp).
+ */
+
+#ifndef ANALYTICS_READER_HPP
+#define ANALYTICS_READER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "analyticsExport.hpp"
+#include "analyticsFormat.hpp"
+
+/**
+ * @class AnalyticsReceiver
+ * @brief Collects the frames of one export.
+ */
+class AnalyticsReceiver {
+public:
+    enum class Status { Waiting, Receiving, Complete, Failed };
+
+    struct Stats {
+        size_t bytes = 0;          ///< Bytes fed in
+        size_t frames = 0;         ///< Frames with a good CRC
+        size_t badFrames = 0;      ///< Delimited pieces that were no valid frame (text, damage)
+        size_t missingChunks = 0;  ///< Chunks not received when the last End frame came
+    };
+
+    /**
+     * @brief Feed received bytes.
+     * @return Status after them.
+     */
+    Status feed(const uint8_t *data, size_t length);
+
+    Status getStatus() const { return status; }
+    const std::string &getError() const { return error; }
+    const Stats &getStats() const { return stats; }
+
+    /**
+     * @brief The session, valid once the status is Complete.
+     */
+    const std::vector<uint8_t> &getSession() const { return session; }
+
+private:
+    Status status = Status::Waiting;
+    std::string error;
+    Stats stats;
+    std::vector<uint8_t> pending;       ///< Encoded bytes since the last delimiter
+    std::vector<uint8_t> decoded;
+    std::vector<uint8_t> session;
+    std::vector<bool> received;
+    size_t chunkSize = 0;
+    bool overflow = false;              ///< pending outgrew any frame, wait for the next delimiter
+
+    void frame();
+};
+
+/**
+ * @struct AnalyticsSession
+ * @brief A decoded session.
+ */
+struct AnalyticsSession {
+    struct Window {
+        uint32_t frame;     ///< Frames in the timeline when the window closed
+        uint16_t words;
+    };
+
+    struct Event {
+        uint32_t frame;     ///< Frames in the timeline when it happened
+        AnalyticsEventType type;
+        uint8_t value;
+    };
+
+    AnalyticsHeader header = {};
+    std::vector<VadState> states;   ///< One per frame
+    std::vector<int16_t> levels;    ///< Peak dB, one per header.levelFrames frames
+    std::vector<Window> windows;
+    std::vector<Event> events;
+
+    bool isTruncated() const { return (header.flags & AnalyticsWriter::FLAG_TRUNCATED) != 0; }
+};
+
+/**
+ * @brief Decode a session.
+ * @param data The session as AnalyticsWriter wrote it.
+ * @param length Its length.
+ * @param session Result.
+ * @param error Reason when it fails.
+ * @return false when the data is damaged or of an unknown version.
+ */
+bool decodeAnalytics(const uint8_t *data, size_t length, AnalyticsSession &session, std::string &error);
+
+/**
+ * @brief One CSV line per frame: frame, seconds, state, level, words of a window closing there, events.
+ */
+void writeAnalyticsCsv(const AnalyticsSession &session, std::ostream &out);
+
+const char *vadStateName(VadState state);
+
+#endif // ANALYTICS_READER_HPP
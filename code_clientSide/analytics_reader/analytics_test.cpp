@@ -0,0 +1,303 @@
+// Round trip of the session analytics: made up sessions through the firmware
+// encoder (analyticsFormat.hpp) and the COBS export (analyticsExport.hpp),
+// received in random pieces with console text around them, decoded by the
+// reader and compared frame by frame. Also every VAD state change, extreme
+// levels, a full buffer, damaged exports and sessions, and COBS edge cases.
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "analyticsReader.hpp"
+#include "cobs.hpp"
+#include "syntheticSession.hpp"
+
+static constexpr uint32_t FRAMES_PER_HOUR = 14400;   // 250 ms frames
+static constexpr size_t HOUR_BUDGET = 8192;          // "An hour fits in a few KB"
+
+static bool appendBytes(const uint8_t *data, size_t length, void *context) {
+    auto *out = static_cast<std::vector<uint8_t> *>(context);
+    out->insert(out->end(), data, data + length);
+    return true;
+}
+
+static std::vector<uint8_t> exportSession(const AnalyticsWriter &writer) {
+    std::vector<uint8_t> wire;
+    AnalyticsWriter::Segment segments[AnalyticsWriter::SEGMENT_COUNT];
+    size_t count = writer.getSegments(segments);
+    AnalyticsExport exporter(appendBytes, &wire);
+    exporter.send(segments, count);
+    return wire;
+}
+
+static std::vector<uint8_t> sessionBytes(const AnalyticsWriter &writer) {
+    std::vector<uint8_t> data;
+    AnalyticsWriter::Segment segments[AnalyticsWriter::SEGMENT_COUNT];
+    size_t count = writer.getSegments(segments);
+    for (size_t s = 0; s < count; s++) {
+        data.insert(data.end(), segments[s].data, segments[s].data + segments[s].length);
+    }
+    return data;
+}
+
+// What the decoder must give back for the first frames of a made up session
+static bool matches(const AnalyticsSession &decoded, const SyntheticSession &expected, uint32_t frames,
+                    uint8_t levelFrames) {
+    if (decoded.states.size() != frames || decoded.header.frameCount != frames) {
+        printf("  %zu frames decoded, %u expected\n", decoded.states.size(), frames);
+        return false;
+    }
+    for (uint32_t f = 0; f < frames; f++) {
+        if (decoded.states[f] != expected.states[f]) {
+            printf("  frame %u: state %d, expected %d\n", f, (int)decoded.states[f], (int)expected.states[f]);
+            return false;
+        }
+    }
+    size_t levelCount = (frames + levelFrames - 1) / levelFrames;
+    if (decoded.levels.size() != levelCount) {
+        printf("  %zu levels decoded, %zu expected\n", decoded.levels.size(), levelCount);
+        return false;
+    }
+    for (size_t l = 0; l < levelCount; l++) {
+        float peak = -1e9f;
+        for (uint32_t f = l * levelFrames; f < std::min<uint32_t>(frames, (l + 1) * levelFrames); f++) {
+            peak = std::max(peak, expected.levels[f]);
+        }
+        float clamped = std::min(32767.0f, std::max(-32767.0f, roundf(peak)));
+        if (decoded.levels[l] != (int16_t)clamped) {
+            printf("  level %zu: %d, expected %.0f\n", l, decoded.levels[l], clamped);
+            return false;
+        }
+    }
+    size_t windows = 0;
+    while (windows < expected.windows.size() && expected.windows[windows].frame <= frames) {
+        windows++;
+    }
+    if (decoded.windows.size() != windows) {
+        printf("  %zu windows decoded, %zu expected\n", decoded.windows.size(), windows);
+        return false;
+    }
+    for (size_t w = 0; w < windows; w++) {
+        if (decoded.windows[w].frame != expected.windows[w].frame ||
+            decoded.windows[w].words != expected.windows[w].words) {
+            printf("  window %zu differs\n", w);
+            return false;
+        }
+    }
+    if (decoded.events.size() != expected.events.size()) {
+        printf("  %zu events decoded, %zu expected\n", decoded.events.size(), expected.events.size());
+        return false;
+    }
+    for (size_t e = 0; e < expected.events.size(); e++) {
+        const AnalyticsSession::Event &got = decoded.events[e];
+        if (got.frame != expected.events[e].frame || got.type != expected.events[e].type ||
+            got.value != expected.events[e].value) {
+            printf("  event %zu differs\n", e);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool testHourRoundTrip() {
+    auto writer = std::make_unique<AnalyticsWriter>();
+    SyntheticSession session = SyntheticSession::conversation(FRAMES_PER_HOUR, 1);
+    session.encode(*writer, 7);
+
+    // The line the console prints before the export, and a log line after it
+    std::string before = "analytics export 1234 bytes at 921600 baud\n";
+    std::vector<uint8_t> wire(before.begin(), before.end());
+    std::vector<uint8_t> frames = exportSession(*writer);
+    wire.insert(wire.end(), frames.begin(), frames.end());
+    std::string after = "I (1234) Tascam: status ok\n";
+    wire.insert(wire.end(), after.begin(), after.end());
+
+    AnalyticsReceiver receiver;
+    std::mt19937 random(2);
+    for (size_t offset = 0; offset < wire.size();) {
+        size_t piece = std::min<size_t>(wire.size() - offset, 1 + random() % 700);
+        receiver.feed(&wire[offset], piece);
+        offset += piece;
+    }
+    AnalyticsSession decoded;
+    std::string error;
+    bool ok = receiver.getStatus() == AnalyticsReceiver::Status::Complete &&
+              receiver.getSession() == sessionBytes(*writer) &&
+              decodeAnalytics(receiver.getSession().data(), receiver.getSession().size(), decoded, error) &&
+              matches(decoded, session, FRAMES_PER_HOUR, 4) && decoded.header.sessionId == 7 &&
+              !decoded.isTruncated() && writer->getSize() <= HOUR_BUDGET;
+    std::vector<uint8_t> bytes = sessionBytes(*writer);
+    AnalyticsColumnEntry columns[AnalyticsWriter::COLUMN_COUNT];
+    memcpy(columns, &bytes[sizeof(AnalyticsHeader)], sizeof(columns));
+    printf("one hour of conversation, %zu bytes (VAD %u, level %u, words %u, events %u), %zu on the wire: %s\n",
+           writer->getSize(), (unsigned)columns[0].size, (unsigned)columns[1].size, (unsigned)columns[2].size,
+           (unsigned)columns[3].size, frames.size(), ok ? "PASS" : "FAIL");
+    if (!ok && !error.empty()) {
+        printf("  %s\n", error.c_str());
+    }
+    return ok;
+}
+
+static bool testEveryStateChange() {
+    // Any state after any other, and levels over the whole 16 bit range
+    SyntheticSession session;
+    std::mt19937 random(3);
+    for (uint32_t f = 0; f < 3000; f++) {
+        session.states.push_back((VadState)(random() % 4));
+        bool wild = (f / 100) % 10 == 0;
+        float level = wild ? (float)(int)(random() % 70000) - 35000.0f : (float)(int)(random() % 40) - 20.0f;
+        session.levels.push_back(level);
+    }
+    session.events.push_back({0, AnalyticsEventType::Fault, 3});
+    session.events.push_back({0, AnalyticsEventType::Button, 1});
+    session.events.push_back({3000, AnalyticsEventType::Button, 255});
+
+    auto writer = std::make_unique<AnalyticsWriter>();
+    bool ok = true;
+    for (uint8_t levelFrames : {1, 3, 4}) {
+        writer->begin(1, 2, 250, levelFrames);
+        writer->event(AnalyticsEventType::Fault, 3);
+        writer->event(AnalyticsEventType::Button, 1);
+        for (uint32_t f = 0; f < 3000; f++) {
+            writer->frame(session.states[f], session.levels[f]);
+        }
+        writer->event(AnalyticsEventType::Button, 255);
+        writer->finish();
+        std::vector<uint8_t> bytes = sessionBytes(*writer);
+        AnalyticsSession decoded;
+        std::string error;
+        ok = decodeAnalytics(bytes.data(), bytes.size(), decoded, error) &&
+             matches(decoded, session, 3000, levelFrames) && decoded.header.levelFrames == levelFrames && ok;
+    }
+    printf("every state change, levels from -35000 to 35000 dB, 1 to 4 frames per level: %s\n", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+static bool testEmptySession() {
+    auto writer = std::make_unique<AnalyticsWriter>();
+    writer->begin(5, 6);
+    writer->finish();
+    std::vector<uint8_t> bytes = sessionBytes(*writer);
+    AnalyticsSession decoded;
+    std::string error;
+    bool ok = decodeAnalytics(bytes.data(), bytes.size(), decoded, error) && decoded.states.empty() &&
+              decoded.levels.empty() && decoded.header.startTime == 6 &&
+              bytes.size() == sizeof(AnalyticsHeader) + 4 * sizeof(AnalyticsColumnEntry) + 4;
+
+    // Nothing is appended outside a session
+    ok = !writer->frame(VadState::Speech, 1.0f) && !writer->words(1) && ok;
+    printf("a session without frames, %zu bytes: %s\n", bytes.size(), ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+static bool testTruncation() {
+    // A state change every frame and wild levels fill the buffers long before the clock does
+    SyntheticSession session;
+    std::mt19937 random(4);
+    auto writer = std::make_unique<AnalyticsWriter>();
+    writer->begin(9, 0);
+    uint32_t accepted = 0;
+    for (uint32_t f = 0; f < 200000; f++) {
+        session.states.push_back((VadState)(random() % 4));
+        session.levels.push_back((float)(int)(random() % 60000) - 30000.0f);
+        if (writer->frame(session.states.back(), session.levels.back())) {
+            accepted++;
+        }
+    }
+    writer->finish();
+    std::vector<uint8_t> bytes = sessionBytes(*writer);
+    AnalyticsSession decoded;
+    std::string error;
+    bool ok = writer->isTruncated() && accepted < 200000 && accepted == writer->getFrameCount() &&
+              decodeAnalytics(bytes.data(), bytes.size(), decoded, error) && decoded.isTruncated() &&
+              matches(decoded, session, accepted, 4);
+    printf("full buffers end the timeline cleanly after %u of 200000 frames: %s\n", accepted, ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+static bool testDamage() {
+    auto writer = std::make_unique<AnalyticsWriter>();
+    SyntheticSession::conversation(2000, 5).encode(*writer, 3);
+    std::vector<uint8_t> wire = exportSession(*writer);
+
+    // Drop the third Data frame: the receiver names the gap
+    std::vector<size_t> ends;
+    for (size_t i = 1; i < wire.size(); i++) {
+        if (wire[i] == 0) {
+            ends.push_back(i);
+        }
+    }
+    std::vector<uint8_t> lost(wire.begin(), wire.begin() + ends[2] + 1);
+    lost.insert(lost.end(), wire.begin() + ends[3] + 1, wire.end());
+    AnalyticsReceiver receiver;
+    receiver.feed(lost.data(), lost.size());
+    bool ok = receiver.getStatus() == AnalyticsReceiver::Status::Failed && receiver.getStats().missingChunks == 1;
+
+    // A damaged byte makes its frame fail the CRC, then the chunk is missing
+    std::vector<uint8_t> flipped = wire;
+    flipped[ends[4] - 10] ^= 0x10;
+    AnalyticsReceiver damaged;
+    damaged.feed(flipped.data(), flipped.size());
+    ok = damaged.getStatus() == AnalyticsReceiver::Status::Failed && damaged.getStats().badFrames == 1 && ok;
+
+    // The same receiver takes a good export after a failed one
+    damaged.feed(wire.data(), wire.size());
+    ok = damaged.getStatus() == AnalyticsReceiver::Status::Complete && ok;
+
+    // The session CRC catches what the frame CRCs cannot, and unknown versions are refused
+    std::vector<uint8_t> bytes = sessionBytes(*writer);
+    AnalyticsSession decoded;
+    std::string error;
+    std::vector<uint8_t> corrupt = bytes;
+    corrupt[bytes.size() / 2] ^= 0x01;
+    ok = !decodeAnalytics(corrupt.data(), corrupt.size(), decoded, error) && ok;
+    std::vector<uint8_t> newer = bytes;
+    newer[4] = AnalyticsWriter::VERSION + 1;
+    ok = !decodeAnalytics(newer.data(), newer.size(), decoded, error) &&
+         error.find("version") != std::string::npos && ok;
+    printf("a lost frame, a damaged frame, a damaged session and a newer version are reported: %s\n",
+           ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+static bool testCobs() {
+    std::mt19937 random(6);
+    uint8_t encoded[CobsEncoder::encodedSize(800)];
+    uint8_t decoded[800];
+    bool ok = true;
+    for (size_t length = 1; length <= 800 && ok; length++) {
+        for (int pattern = 0; pattern < 4; pattern++) {
+            std::vector<uint8_t> data(length);
+            for (size_t i = 0; i < length; i++) {
+                data[i] = pattern == 0   ? 0
+                          : pattern == 1 ? 0xFF
+                          : pattern == 2 ? (uint8_t)(random() % 4)
+                                         : (uint8_t)random();
+            }
+            CobsEncoder cobs(encoded);
+            cobs.begin();
+            cobs.put(data.data(), length);
+            size_t size = cobs.end();
+            bool clean = std::find(encoded, encoded + size - 1, 0) == encoded + size - 1 && encoded[size - 1] == 0;
+            size_t back = cobsDecode(encoded, size - 1, decoded);
+            ok = clean && size <= CobsEncoder::encodedSize(length) && back == length &&
+                 memcmp(decoded, data.data(), length) == 0 && ok;
+        }
+    }
+    printf("COBS of 1 to 800 bytes of zeros, 0xFF, few and random values: %s\n", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+int main() {
+    bool ok = testHourRoundTrip();
+    ok = testEveryStateChange() && ok;
+    ok = testEmptySession() && ok;
+    ok = testTruncation() && ok;
+    ok = testDamage() && ok;
+    ok = testCobs() && ok;
+    printf("%s\n", ok ? "ALL PASSED" : "FAILED");
+    return ok ? 0 : 1;
+}
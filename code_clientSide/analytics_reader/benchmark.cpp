@@ -0,0 +1,107 @@
+// Throughput of the session analytics on made up one hour sessions: the
+// firmware encoder per frame, the COBS export, the receiver and the decoder,
+// and the wire time of the export at the console and the export baud rates.
+// Host figures; the encoder work per frame is a few bit writes, small next to
+// the FFT of the same frame on the recorder.
+//
+//   analytics_benchmark [--sessions 100] [--hours 1]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include "analyticsReader.hpp"
+#include "syntheticSession.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(Clock::time_point begin) {
+    return std::chrono::duration<double>(Clock::now() - begin).count();
+}
+
+static bool appendBytes(const uint8_t *data, size_t length, void *context) {
+    auto *out = static_cast<std::vector<uint8_t> *>(context);
+    out->insert(out->end(), data, data + length);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    size_t sessions = 100;
+    double hours = 1.0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--sessions" && i + 1 < argc) {
+            sessions = (size_t)atoi(argv[++i]);
+        } else if (arg == "--hours" && i + 1 < argc) {
+            hours = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: analytics_benchmark [--sessions 100] [--hours 1]\n");
+            return 2;
+        }
+    }
+    uint32_t frames = (uint32_t)(hours * 14400);
+    std::vector<SyntheticSession> inputs;
+    for (size_t s = 0; s < sessions; s++) {
+        inputs.push_back(SyntheticSession::conversation(frames, (uint32_t)s + 1));
+    }
+
+    auto writer = std::make_unique<AnalyticsWriter>();
+    std::vector<std::vector<uint8_t>> wires(sessions);
+    double encodeSeconds = 0.0;
+    double exportSeconds = 0.0;
+    size_t sessionBytes = 0;
+    size_t wireBytes = 0;
+    for (size_t s = 0; s < sessions; s++) {
+        auto begin = Clock::now();
+        inputs[s].encode(*writer, (uint32_t)s);
+        encodeSeconds += secondsSince(begin);
+
+        begin = Clock::now();
+        AnalyticsWriter::Segment segments[AnalyticsWriter::SEGMENT_COUNT];
+        size_t count = writer->getSegments(segments);
+        wires[s].reserve(writer->getSize() * 2);
+        AnalyticsExport exporter(appendBytes, &wires[s]);
+        exporter.send(segments, count);
+        exportSeconds += secondsSince(begin);
+        sessionBytes += writer->getSize();
+        wireBytes += wires[s].size();
+    }
+
+    double receiveSeconds = 0.0;
+    double decodeSeconds = 0.0;
+    size_t decodedFrames = 0;
+    bool ok = true;
+    for (size_t s = 0; s < sessions; s++) {
+        auto begin = Clock::now();
+        AnalyticsReceiver receiver;
+        receiver.feed(wires[s].data(), wires[s].size());
+        receiveSeconds += secondsSince(begin);
+
+        begin = Clock::now();
+        AnalyticsSession session;
+        std::string error;
+        ok = receiver.getStatus() == AnalyticsReceiver::Status::Complete &&
+             decodeAnalytics(receiver.getSession().data(), receiver.getSession().size(), session, error) && ok;
+        decodeSeconds += secondsSince(begin);
+        decodedFrames += session.states.size();
+    }
+    ok = decodedFrames == sessions * frames && ok;
+
+    double totalFrames = (double)sessions * frames;
+    double meanSession = (double)sessionBytes / sessions;
+    double meanWire = (double)wireBytes / sessions;
+    printf("%zu sessions of %.1f h: %.0f bytes per session, %.0f bytes per hour, %.0f on the wire\n", sessions, hours,
+           meanSession, meanSession / hours, meanWire);
+    printf("encode  %8.1f ns per frame\n", encodeSeconds / totalFrames * 1e9);
+    printf("export  %8.1f MB/s\n", sessionBytes / exportSeconds / 1e6);
+    printf("receive %8.1f MB/s\n", wireBytes / receiveSeconds / 1e6);
+    printf("decode  %8.1f Mframes/s\n", totalFrames / decodeSeconds / 1e6);
+    // 10 bits per byte on the UART: start, 8 data, stop
+    for (unsigned long baud : {115200ul, 921600ul, 2000000ul}) {
+        printf("one session at %7lu baud: %6.3f s\n", baud, meanWire * 10.0 / baud);
+    }
+    printf("%s\n", ok ? "ALL PASSED" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,240 @@
+// Command line front end of the analytics reader: exports the last session of
+// a recorder over its console at a high baud rate, or reads a capture or a
+// saved session, and writes it as CSV.
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "analyticsReader.hpp"
+
+static void usage() {
+    fprintf(stderr,
+            "usage: analytics_to_csv [options] (--port <device> | --capture <file> | <session file>)\n"
+            "  --port <device>    ask the recorder on this serial port for its last session\n"
+            "  --baud <rate>      baud rate of the export, default 921600\n"
+            "  --capture <file>   read a raw capture of an export instead of a port\n"
+            "  --save <file>      also write the session as received, it can be read again later\n"
+            "  -o <file>          write the CSV to a file instead of stdout\n");
+}
+
+static bool baudToSpeed(unsigned long baud, speed_t &speed) {
+    static const struct {
+        unsigned long baud;
+        speed_t speed;
+    } SPEEDS[] = {
+        {115200, B115200}, {230400, B230400},
+#ifdef B460800
+        {460800, B460800},
+#endif
+#ifdef B921600
+        {921600, B921600},
+#endif
+#ifdef B1000000
+        {1000000, B1000000},
+#endif
+#ifdef B1500000
+        {1500000, B1500000},
+#endif
+#ifdef B2000000
+        {2000000, B2000000},
+#endif
+#ifdef B3000000
+        {3000000, B3000000},
+#endif
+    };
+    for (const auto &entry : SPEEDS) {
+        if (entry.baud == baud) {
+            speed = entry.speed;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool setSpeed(int fd, speed_t speed) {
+    struct termios tty;
+    if (tcgetattr(fd, &tty) != 0) {
+        return false;
+    }
+    cfmakeraw(&tty);
+    tty.c_cflag |= CLOCAL | CREAD;
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 1;   // Reads return after 100 ms without data
+    cfsetispeed(&tty, speed);
+    cfsetospeed(&tty, speed);
+    return tcsetattr(fd, TCSANOW, &tty) == 0;
+}
+
+// Asks for the export at 115200, switches to the export rate once the recorder announced it
+static bool exportFromPort(const char *port, unsigned long baud, AnalyticsReceiver &receiver) {
+    speed_t console = B115200;
+    speed_t fast;
+    if (!baudToSpeed(baud, fast)) {
+        fprintf(stderr, "baud rate %lu is not supported here\n", baud);
+        return false;
+    }
+    int fd = open(port, O_RDWR | O_NOCTTY);
+    if (fd < 0 || !setSpeed(fd, console)) {
+        fprintf(stderr, "cannot open %s: %s\n", port, strerror(errno));
+        return false;
+    }
+    tcflush(fd, TCIOFLUSH);
+    std::string command = "analytics export " + std::to_string(baud) + "\n";
+    if (write(fd, command.data(), command.size()) != (ssize_t)command.size()) {
+        fprintf(stderr, "cannot write to %s: %s\n", port, strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    std::string text;
+    uint8_t buffer[4096];
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+    size_t announced = std::string::npos;
+    while (std::chrono::steady_clock::now() < deadline) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            text.append((const char *)buffer, n);
+        }
+        announced = text.find("analytics export ");
+        if (announced != std::string::npos && text.find('\n', announced) != std::string::npos) {
+            break;
+        }
+    }
+    size_t endOfLine = announced != std::string::npos ? text.find('\n', announced) : std::string::npos;
+    if (endOfLine == std::string::npos) {
+        fprintf(stderr, "no answer from the recorder\n");
+        close(fd);
+        return false;
+    }
+    std::string line = text.substr(announced, endOfLine - announced);
+    fprintf(stderr, "%s\n", line.c_str());
+    if (line.find("failed") != std::string::npos) {
+        close(fd);
+        return false;
+    }
+
+    // The recorder switches after this line; bytes at the wrong rate are dropped by the receiver
+    tcdrain(fd);
+    setSpeed(fd, fast);
+    auto lastData = std::chrono::steady_clock::now();
+    while (receiver.getStatus() != AnalyticsReceiver::Status::Complete &&
+           receiver.getStatus() != AnalyticsReceiver::Status::Failed &&
+           std::chrono::steady_clock::now() - lastData < std::chrono::seconds(3)) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            receiver.feed(buffer, n);
+            lastData = std::chrono::steady_clock::now();
+        }
+    }
+    setSpeed(fd, console);
+    close(fd);
+    return true;
+}
+
+static bool readFile(const char *path, std::vector<uint8_t> &data) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const char *port = nullptr;
+    const char *capturePath = nullptr;
+    const char *savePath = nullptr;
+    const char *outPath = nullptr;
+    const char *sessionPath = nullptr;
+    unsigned long baud = 921600;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--port" && hasValue) {
+            port = argv[++i];
+        } else if (arg == "--baud" && hasValue) {
+            baud = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--capture" && hasValue) {
+            capturePath = argv[++i];
+        } else if (arg == "--save" && hasValue) {
+            savePath = argv[++i];
+        } else if (arg == "-o" && hasValue) {
+            outPath = argv[++i];
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            usage();
+            return 2;
+        } else {
+            sessionPath = argv[i];
+        }
+    }
+    if ((port != nullptr) + (capturePath != nullptr) + (sessionPath != nullptr) != 1) {
+        usage();
+        return 2;
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<uint8_t> data;
+    if (sessionPath != nullptr) {
+        if (!readFile(sessionPath, data)) {
+            return 1;
+        }
+    } else {
+        AnalyticsReceiver receiver;
+        if (capturePath != nullptr) {
+            std::vector<uint8_t> capture;
+            if (!readFile(capturePath, capture)) {
+                return 1;
+            }
+            receiver.feed(capture.data(), capture.size());
+        } else if (!exportFromPort(port, baud, receiver)) {
+            return 1;
+        }
+        const AnalyticsReceiver::Stats &stats = receiver.getStats();
+        if (receiver.getStatus() != AnalyticsReceiver::Status::Complete) {
+            fprintf(stderr, "export incomplete: %s (%zu frames, %zu bad)\n",
+                    receiver.getStatus() == AnalyticsReceiver::Status::Failed ? receiver.getError().c_str()
+                                                                               : "no end frame",
+                    stats.frames, stats.badFrames);
+            return 1;
+        }
+        data = receiver.getSession();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        fprintf(stderr, "received %zu bytes in %zu frames, %.2f s\n", data.size(), stats.frames, seconds);
+    }
+    if (savePath != nullptr) {
+        std::ofstream file(savePath, std::ios::binary);
+        file.write((const char *)data.data(), (std::streamsize)data.size());
+    }
+
+    AnalyticsSession session;
+    std::string error;
+    if (!decodeAnalytics(data.data(), data.size(), session, error)) {
+        fprintf(stderr, "cannot decode the session: %s\n", error.c_str());
+        return 1;
+    }
+    if (outPath != nullptr) {
+        std::ofstream out(outPath);
+        if (!out) {
+            fprintf(stderr, "cannot write %s: %s\n", outPath, strerror(errno));
+            return 1;
+        }
+        writeAnalyticsCsv(session, out);
+    } else {
+        writeAnalyticsCsv(session, std::cout);
+    }
+    const AnalyticsHeader &header = session.header;
+    fprintf(stderr, "session %u: %u frames of %u ms, %zu windows, %zu events%s\n", (unsigned)header.sessionId,
+            (unsigned)header.frameCount, (unsigned)header.framePeriodMs, session.windows.size(),
+            session.events.size(), session.isTruncated() ? ", truncated on the recorder" : "");
+    return 0;
+}
@@ -0,0 +1,103 @@
+/**
+ * @file syntheticSession.hpp
+ * @brief Made up sessions for the analytics test and benchmark.
+ *
+ * Speech and silence alternate with the lengths of a conversation, the modem
+ * sends a beacon burst every minute and now and then a frame is skipped.
+ * Levels wander around a silence and a speech level. Window word counts are
+ * counted the way the audio task does it.
+ */
+
+#ifndef SYNTHETIC_SESSION_HPP
+#define SYNTHETIC_SESSION_HPP
+
+#include <stdint.h>
+#include <random>
+#include <vector>
+#include "analyticsFormat.hpp"
+
+struct SyntheticSession {
+    struct Window {
+        uint32_t frame;
+        uint16_t words;
+    };
+    struct Event {
+        uint32_t frame;
+        AnalyticsEventType type;
+        uint8_t value;
+    };
+
+    std::vector<VadState> states;
+    std::vector<float> levels;   ///< Per frame
+    std::vector<Window> windows;
+    std::vector<Event> events;
+
+    static SyntheticSession conversation(uint32_t frames, uint32_t seed) {
+        SyntheticSession session;
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+        std::normal_distribution<float> noise(0.0f, 1.0f);
+        bool speaking = false;
+        float speech = 62.0f;
+        uint8_t consecutive = 0;
+        uint16_t words = 0;
+        for (uint32_t f = 0; f < frames; f++) {
+            // Speech bursts of 1.5 s and pauses of 2 s on average
+            if (uniform(random) < (speaking ? 1.0f / 6 : 1.0f / 8)) {
+                speaking = !speaking;
+            }
+            VadState state = speaking ? VadState::Speech : VadState::Silence;
+            if (f % 240 < 2) {
+                state = VadState::Modem;
+            } else if (uniform(random) < 0.0005f) {
+                state = VadState::Skipped;
+            }
+            float level = 38.0f + 2.0f * noise(random);
+            if (state == VadState::Speech) {
+                speech += 1.5f * noise(random) + 0.05f * (62.0f - speech);
+                level = speech + 4.0f * noise(random);
+            } else if (state == VadState::Modem) {
+                level = 74.0f + noise(random);
+            }
+            session.states.push_back(state);
+            session.levels.push_back(level);
+
+            if (state == VadState::Speech && ++consecutive == 2) {
+                words++;
+                consecutive = 0;
+            } else if (state == VadState::Silence) {
+                consecutive = 0;
+            }
+            if ((f + 1) % 240 == 0) {
+                session.windows.push_back({f + 1, words});
+                words = 0;
+            }
+            if (uniform(random) < 0.001f) {
+                session.events.push_back({f + 1, AnalyticsEventType::Button, (uint8_t)(random() % 7)});
+            }
+        }
+        return session;
+    }
+
+    /**
+     * @brief Feed the session to a writer, windows and events where they happened.
+     */
+    void encode(AnalyticsWriter &writer, uint32_t sessionId) const {
+        writer.begin(sessionId, 1700000000 + sessionId);
+        size_t window = 0;
+        size_t event = 0;
+        for (size_t f = 0; f < states.size(); f++) {
+            writer.frame(states[f], levels[f]);
+            while (window < windows.size() && windows[window].frame == f + 1) {
+                writer.words(windows[window++].words);
+            }
+            while (event < events.size() && events[event].frame == f + 1) {
+                writer.event(events[event].type, events[event].value);
+                event++;
+            }
+        }
+        writer.finish();
+    }
+};
+
+#endif // SYNTHETIC_SESSION_HPP
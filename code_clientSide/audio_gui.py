@@ -10,6 +10,7 @@ import glob
 from pathlib import Path
 import threading
 import decoder_audiomodem as DecoderNew
+import modem_packet
 import audacity_launcher
 from audacity_concatenator import concatenate_audio_files_for_group
 
@@ -274,11 +275,17 @@ class AudioDecoderGUI:
                                 number = sum(bit * (2 ** idx) for idx, bit in enumerate(byte_bits))
                                 numbers.append(number)
                         
-                        # Validate first three numbers should be 1, 2, 3
-                        is_valid = len(numbers) >= 3 and numbers[0] == 1 and numbers[1] == 2 and numbers[2] == 3
-                        
-                        # Extract session ID (4th number) if available
-                        session_id = numbers[3] if len(numbers) >= 4 else None
+                        metadata = modem_packet.decode_session_metadata(decoded_bits)
+                        if metadata is not None:
+                            # Packet format, CRC checked
+                            is_valid = True
+                            session_id = metadata['session_id']
+                        else:
+                            # Old recordings: first three numbers should be 1, 2, 3
+                            is_valid = len(numbers) >= 3 and numbers[0] == 1 and numbers[1] == 2 and numbers[2] == 3
+                            
+                            # Extract session ID (4th number) if available
+                            session_id = numbers[3] if len(numbers) >= 4 else None
                         
                         all_decoded_bits.append({
                             'file': file_to_decode,
@@ -0,0 +1,206 @@
+#include "batchDecoder.hpp"
+
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <thread>
+#include "wavFile.hpp"
+
+static constexpr size_t CONVERT_FRAMES = 8192;
+static constexpr size_t PREFETCH_FRAMES = 16 * CONVERT_FRAMES; // Disk reads run ahead of the conversion
+
+/**
+ * @brief Converts a file on demand into one float buffer.
+ */
+class SampleBuffer {
+public:
+    SampleBuffer(const WavFile &wav, size_t limit, int channel)
+        : wav(wav), limit(limit), channel(channel), samples(new float[limit]), converted(0) {}
+
+    /**
+     * @brief Make sure the first count samples are converted.
+     * @return Samples available, less than count at the end of the scan window.
+     */
+    size_t ensure(size_t count) {
+        count = std::min(count, limit);
+        while (converted < count) {
+            if (converted % PREFETCH_FRAMES == 0) {
+                wav.prefetch(converted + PREFETCH_FRAMES, PREFETCH_FRAMES);
+            }
+            size_t frames = std::min(CONVERT_FRAMES, limit - converted);
+            converted += wav.read(converted, frames, channel, samples.get() + converted);
+        }
+        return converted;
+    }
+
+    const float *data() const { return samples.get(); }
+    size_t available() const { return converted; }
+
+private:
+    const WavFile &wav;
+    size_t limit;
+    int channel;
+    std::unique_ptr<float[]> samples;
+    size_t converted;
+};
+
+/**
+ * @brief Fill a result from a valid packet, false for a type this tool does not index.
+ */
+static bool takePacket(const ModemPacket::Decoded &decoded, FileResult &result) {
+    result.type = decoded.type;
+    result.correctedBits = decoded.correctedBits;
+    switch (decoded.type) {
+        case ModemPacket::Type::SessionMetadata:
+            return result.metadata.deserialize(decoded.payload, decoded.length);
+        case ModemPacket::Type::Beacon:
+            return result.beacon.deserialize(decoded.payload, decoded.length);
+        case ModemPacket::Type::Config:
+            // Played to the device, not by it
+            return false;
+    }
+    return false;
+}
+
+FileResult decodeFile(const std::string &path, const DecoderOptions &options) {
+    auto begin = std::chrono::steady_clock::now();
+    FileResult result;
+    result.path = path;
+
+    WavFile wav;
+    if (!wav.open(path)) {
+        result.status = FileResult::Status::Error;
+        result.error = wav.getError();
+        return result;
+    }
+    result.fileBytes = wav.getFileBytes();
+    uint32_t rate = wav.getSampleRate();
+    if (options.highFreq * 2 >= rate) {
+        result.status = FileResult::Status::Error;
+        result.error = "sample rate too low for the modem tones";
+        return result;
+    }
+
+    ModemCodec codec(rate, options.symbolUs, options.bitsPerSymbol, options.lowFreq, options.highFreq);
+    MfskBurstDetector detector(codec.getDemodulator(), options.thresholdDb, options.riseDb);
+    size_t limit = std::min(wav.getFrameCount(), (size_t)(options.scanSeconds * rate));
+
+    SampleBuffer buffer(wav, limit, options.channel);
+    for (size_t position = 0; position + detector.getBlock() <= limit; position += detector.getStride()) {
+        buffer.ensure(position + detector.getBlock());
+        if (!detector.update(buffer.data() + position)) {
+            continue;
+        }
+        size_t available = buffer.ensure(position + codec.acquisitionSamples());
+        ModemPacket::Decoded decoded;
+        size_t packetStart = 0;
+        if (codec.decodeAt(buffer.data(), available, position, decoded, &packetStart) == ModemPacket::Status::Ok &&
+            takePacket(decoded, result)) {
+            result.status = FileResult::Status::Ok;
+            result.startSeconds = packetStart / (double)rate;
+            break;
+        }
+    }
+
+    result.bytesScanned = (uint64_t)buffer.available() * wav.getFrameBytes();
+    result.decodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    return result;
+}
+
+std::vector<FileResult> decodeFiles(const std::vector<std::string> &paths, const DecoderOptions &options,
+                                    unsigned threads) {
+    std::vector<FileResult> results(paths.size());
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::min<unsigned>(threads, std::max<size_t>(1, paths.size()));
+
+    // Workers take the next file until none are left, a slow file does not hold up the others
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < paths.size(); i = next++) {
+            results[i] = decodeFile(paths[i], options);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (std::thread &thread : pool) {
+        thread.join();
+    }
+    return results;
+}
+
+std::vector<std::string> findWavFiles(const std::string &path) {
+    namespace fs = std::filesystem;
+    std::vector<std::string> files;
+    std::error_code error;
+    if (!fs::is_directory(path, error)) {
+        files.push_back(path);
+        return files;
+    }
+    for (const fs::directory_entry &entry : fs::directory_iterator(path, error)) {
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        if (entry.is_regular_file(error) && extension == ".wav") {
+            files.push_back(entry.path().string());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+static void writeString(FILE *out, const std::string &text) {
+    fputc('"', out);
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20 || c >= 0x7F) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+void writeJson(FILE *out, const std::vector<FileResult> &results) {
+    fprintf(out, "[\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const FileResult &r = results[i];
+        fprintf(out, "  {\"file\": ");
+        writeString(out, r.path);
+        if (r.status == FileResult::Status::Error) {
+            fprintf(out, ", \"status\": \"error\", \"error\": ");
+            writeString(out, r.error);
+        } else if (r.status == FileResult::Status::NotFound) {
+            fprintf(out, ", \"status\": \"not_found\"");
+        } else if (r.type == ModemPacket::Type::SessionMetadata) {
+            const SessionMetadata &m = r.metadata;
+            fprintf(out, ", \"status\": \"ok\", \"type\": \"session_metadata\", \"session_id\": %u", m.sessionId);
+            fprintf(out, ", \"timestamp\": \"%04d-%02d-%02dT%02d:%02d\"", 1900 + m.year, m.month + 1, m.day, m.hour,
+                    m.minute);
+            fprintf(out, ", \"patient\": ");
+            if (m.flags & SessionMetadata::FLAG_PATIENT) {
+                writeString(out, std::string((const char *)m.patient, sizeof(m.patient)));
+            } else {
+                fprintf(out, "null");
+            }
+        } else {
+            const BeaconPayload &b = r.beacon;
+            fprintf(out, ", \"status\": \"ok\", \"type\": \"beacon\", \"session_id\": %u, \"sequence\": %u", b.sessionId,
+                    b.sequence);
+            fprintf(out, ", \"elapsed_ms\": %u", b.elapsedMs);
+        }
+        if (r.status == FileResult::Status::Ok) {
+            fprintf(out, ", \"start_s\": %.4f, \"corrected_bits\": %u", r.startSeconds, r.correctedBits);
+        }
+        fprintf(out, "}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "]\n");
+}
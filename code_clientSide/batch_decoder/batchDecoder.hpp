@@ -0,0 +1,88 @@
+/**
+ * @file batchDecoder.hpp
+ * @brief Finds and decodes the modem packet at the start of recorder WAV files, many files in parallel.
+ *
+ * Each file is memory-mapped and converted block by block. A Goertzel
+ * detector looks for the rising edge of a burst: the power at the modem tones
+ * rises above the noise floor of the tone band. The burst is demodulated and
+ * checked with the codec of the firmware (modemCodec.hpp). The scan stops at the first valid packet, so normally
+ * only the first seconds of a file are read. A file that was split from a
+ * longer session has no metadata at its start; the scan window is long
+ * enough to reach the next timestamp beacon instead.
+ */
+
+#ifndef BATCH_DECODER_HPP
+#define BATCH_DECODER_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "modemCodec.hpp"
+
+/**
+ * @struct DecoderOptions
+ * @brief Modem settings and scan limits, the defaults match the firmware.
+ */
+struct DecoderOptions {
+    uint32_t lowFreq = ModemCodec::LOW_FREQ;
+    uint32_t highFreq = ModemCodec::HIGH_FREQ;
+    uint32_t symbolUs = ModemCodec::DEFAULT_SYMBOL_US;
+    uint8_t bitsPerSymbol = ModemCodec::DEFAULT_BITS_PER_SYMBOL;
+    float scanSeconds = 70.0f;   ///< One beacon interval and a beacon
+    float thresholdDb = ModemCodec::DEFAULT_MINIMUM_DB; ///< Lowest tone amplitude in dBFS that starts a burst
+    float riseDb = ModemCodec::DEFAULT_RISE_DB;         ///< Rise of the tone band over its noise floor that starts a burst
+    int channel = -1;            ///< Channel with the modem, -1 for the mean of all channels
+};
+
+/**
+ * @struct FileResult
+ * @brief What was found in one file.
+ */
+struct FileResult {
+    enum class Status { Ok, NotFound, Error };
+
+    std::string path;
+    Status status = Status::NotFound;
+    std::string error;
+    ModemPacket::Type type = ModemPacket::Type::SessionMetadata;
+    SessionMetadata metadata = {};
+    BeaconPayload beacon = {};
+    double startSeconds = 0.0;   ///< Start of the burst in the file
+    uint32_t correctedBits = 0;
+    uint64_t bytesScanned = 0;   ///< PCM bytes read from the file
+    uint64_t fileBytes = 0;
+    double decodeMs = 0.0;
+};
+
+/**
+ * @brief Scan one file.
+ * @param path WAV file.
+ * @param options Modem settings and scan limits.
+ */
+FileResult decodeFile(const std::string &path, const DecoderOptions &options);
+
+/**
+ * @brief Scan files on a pool of worker threads.
+ * @param paths WAV files.
+ * @param options Modem settings and scan limits.
+ * @param threads Worker threads, 0 for one per core.
+ * @return One result per path, in the order of paths.
+ */
+std::vector<FileResult> decodeFiles(const std::vector<std::string> &paths, const DecoderOptions &options,
+                                    unsigned threads);
+
+/**
+ * @brief WAV files given on the command line, folders are listed (not recursively) and sorted.
+ * @param path File or folder.
+ */
+std::vector<std::string> findWavFiles(const std::string &path);
+
+/**
+ * @brief Write the results as a JSON array, one object per file.
+ * @param out Destination.
+ * @param results Results of decodeFiles().
+ */
+void writeJson(FILE *out, const std::vector<FileResult> &results);
+
+#endif // BATCH_DECODER_HPP
@@ -0,0 +1,302 @@
+// Benchmark of the batch decoder on a synthetic corpus of recorder files.
+// Every file is 24-bit stereo like the Tascam recordings: speech-like noise on
+// both channels and the modem burst on channel 0. Nine in ten files start
+// with the session metadata of startRecording(), every tenth file only holds
+// a timestamp beacon, like a file split from a longer session. The decoder
+// must find every packet, and its throughput is compared with only reading
+// the same bytes from the files.
+//
+//   batch_decoder_benchmark [--files 100] [--seconds 60] [--rate 48000] [--dir corpus]
+//                           [--keep] [--reuse] [--cold]
+//
+// --keep leaves the corpus for a later --reuse run. --cold drops the page
+// cache before every pass (needs root), so the files are read from disk.
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+#include "batchDecoder.hpp"
+
+static constexpr float BURST_AMPLITUDE = 0.1f;   // -20 dBFS on the line input
+static constexpr float SPEECH_AMPLITUDE = 0.2f;
+static constexpr float NOISE_AMPLITUDE = 0.003f;
+
+struct Settings {
+    size_t files = 100;
+    float seconds = 60.0f;
+    uint32_t sampleRate = 48000;
+    std::string folder = "corpus";
+    bool generate = true;
+    bool cold = false;
+    bool keep = false;
+};
+
+struct Expected {
+    bool beacon;
+    SessionMetadata metadata;
+    BeaconPayload payload;
+    double startSeconds;
+};
+
+static uint32_t nextRandom(uint32_t &state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static float uniform(uint32_t &state) {
+    return (float)(nextRandom(state) >> 8) / 8388608.0f - 1.0f;
+}
+
+static void writeLe(uint8_t *p, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        p[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+/**
+ * @brief Expected packet of file i, the same on every run so a corpus can be reused.
+ */
+static Expected expectedPacket(size_t i, const Settings &settings) {
+    Expected expected = {};
+    struct tm time = {};
+    time.tm_min = (int)(i % 60);
+    time.tm_hour = (int)(8 + i % 10);
+    time.tm_mday = 18;
+    time.tm_mon = 9;
+    time.tm_year = 126;
+    const uint8_t patient[] = {(uint8_t)('A' + i % 26), (uint8_t)('0' + i % 10)};
+    expected.metadata = ModemCodec::sessionMetadata(1000 + i, time, i % 2 == 0 ? patient : nullptr);
+    expected.beacon = i % 10 == 9;
+    expected.payload = {(uint16_t)(1000 + i), (uint16_t)(i / 10), (uint32_t)(60000 * (i / 10 + 1))};
+    // Beacons are mid-file, metadata follows the start of the recording within a second
+    double burstSeconds = ModemCodec(settings.sampleRate).sampleCount(ModemPacket::encodedSize(BeaconPayload::SIZE)) /
+                          (double)settings.sampleRate;
+    expected.startSeconds = expected.beacon ? std::max(0.5, std::min(30.0, settings.seconds - burstSeconds - 1.0))
+                                            : 0.3 + 0.1 * (i % 10);
+    return expected;
+}
+
+static bool writeFile(const std::string &path, size_t index, const Settings &settings) {
+    Expected expected = expectedPacket(index, settings);
+    uint8_t frame[ModemPacket::encodedSize(SessionMetadata::SIZE)];
+    size_t length = expected.beacon ? ModemCodec::encodeBeacon(expected.payload, frame, sizeof(frame))
+                                    : ModemCodec::encodeSessionMetadata(expected.metadata, frame, sizeof(frame));
+    ModemCodec codec(settings.sampleRate);
+    size_t frames = (size_t)(settings.seconds * settings.sampleRate);
+    std::vector<float> burst(frames, 0.0f);
+    size_t start = (size_t)(expected.startSeconds * settings.sampleRate);
+    if (start + codec.sampleCount(length) > frames) {
+        return false;
+    }
+    codec.modulate(frame, length, BURST_AMPLITUDE, burst.data() + start);
+
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    uint32_t dataBytes = (uint32_t)(frames * 6);
+    uint8_t header[44];
+    memcpy(header, "RIFF", 4);
+    writeLe(header + 4, 36 + dataBytes, 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    writeLe(header + 16, 16, 4);
+    writeLe(header + 20, 1, 2);                           // PCM
+    writeLe(header + 22, 2, 2);                           // Stereo
+    writeLe(header + 24, settings.sampleRate, 4);
+    writeLe(header + 28, settings.sampleRate * 6, 4);
+    writeLe(header + 32, 6, 2);
+    writeLe(header + 34, 24, 2);
+    memcpy(header + 36, "data", 4);
+    writeLe(header + 40, dataBytes, 4);
+    fwrite(header, 1, sizeof(header), file);
+
+    // Low-passed noise with a slow envelope stands in for speech
+    uint32_t state = 0x9E3779B9u ^ (uint32_t)index;
+    float lowPass[2] = {0.0f, 0.0f};
+    std::vector<uint8_t> block(4096 * 6);
+    for (size_t first = 0; first < frames; first += 4096) {
+        size_t count = std::min<size_t>(4096, frames - first);
+        for (size_t i = 0; i < count; i++) {
+            float envelope = 0.5f + 0.5f * sinf(2.0f * (float)M_PI * 3.0f * (first + i) / settings.sampleRate);
+            for (int c = 0; c < 2; c++) {
+                lowPass[c] += 0.05f * (uniform(state) - lowPass[c]);
+                float sample = SPEECH_AMPLITUDE * 4.0f * envelope * lowPass[c] + NOISE_AMPLITUDE * uniform(state);
+                if (c == 0) {
+                    sample += burst[first + i];
+                }
+                sample = std::max(-1.0f, std::min(sample, 0.999999f));
+                writeLe(block.data() + i * 6 + c * 3, (uint32_t)(int32_t)lrintf(sample * 8388607.0f), 3);
+            }
+        }
+        fwrite(block.data(), 1, count * 6, file);
+    }
+    return fclose(file) == 0;
+}
+
+static bool checkResult(const FileResult &result, const Expected &expected) {
+    if (result.status != FileResult::Status::Ok || fabs(result.startSeconds - expected.startSeconds) > 0.005) {
+        return false;
+    }
+    if (expected.beacon) {
+        return result.type == ModemPacket::Type::Beacon && result.beacon.sessionId == expected.payload.sessionId &&
+               result.beacon.sequence == expected.payload.sequence && result.beacon.elapsedMs == expected.payload.elapsedMs;
+    }
+    uint8_t a[SessionMetadata::SIZE], b[SessionMetadata::SIZE];
+    result.metadata.serialize(a);
+    expected.metadata.serialize(b);
+    return result.type == ModemPacket::Type::SessionMetadata && memcmp(a, b, sizeof(a)) == 0;
+}
+
+/**
+ * @brief Empty the page cache so the next pass reads from the disk, needs root.
+ */
+static bool dropCaches() {
+    sync();
+    FILE *file = fopen("/proc/sys/vm/drop_caches", "w");
+    if (file == nullptr) {
+        return false;
+    }
+    bool ok = fputs("3", file) >= 0;
+    return fclose(file) == 0 && ok;
+}
+
+/**
+ * @brief Read the first bytes of every file with plain read() calls, the lower bound of any decoder.
+ * @return Seconds taken.
+ */
+static double readOnly(const std::vector<std::string> &paths, const std::vector<uint64_t> &bytes, unsigned threads) {
+    auto begin = std::chrono::steady_clock::now();
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        std::vector<uint8_t> buffer(1 << 20);
+        for (size_t i = next++; i < paths.size(); i = next++) {
+            int fd = open(paths[i].c_str(), O_RDONLY);
+            for (uint64_t done = 0; fd >= 0 && done < bytes[i];) {
+                ssize_t got = read(fd, buffer.data(), std::min<uint64_t>(buffer.size(), bytes[i] - done));
+                if (got <= 0) {
+                    break;
+                }
+                done += (uint64_t)got;
+            }
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (std::thread &thread : pool) {
+        thread.join();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+int main(int argc, char **argv) {
+    Settings settings;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--files") == 0 && hasValue) {
+            settings.files = (size_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seconds") == 0 && hasValue) {
+            settings.seconds = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--rate") == 0 && hasValue) {
+            settings.sampleRate = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--dir") == 0 && hasValue) {
+            settings.folder = argv[++i];
+        } else if (strcmp(argv[i], "--reuse") == 0) {
+            settings.generate = false; // Keep an existing corpus
+        } else if (strcmp(argv[i], "--keep") == 0) {
+            settings.keep = true; // Leave a generated corpus for --reuse
+        } else if (strcmp(argv[i], "--cold") == 0) {
+            settings.cold = true;
+        }
+    }
+
+    std::vector<std::string> paths;
+    std::filesystem::create_directories(settings.folder);
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < settings.files; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "/file%03zu.wav", i);
+        paths.push_back(settings.folder + name);
+        if (settings.generate && !writeFile(paths.back(), i, settings)) {
+            fprintf(stderr, "cannot write %s\n", paths.back().c_str());
+            return 1;
+        }
+    }
+    uint64_t corpusBytes = 0;
+    for (const std::string &path : paths) {
+        corpusBytes += std::filesystem::file_size(path);
+    }
+    printf("corpus: %zu files of %.0f s, 24-bit stereo %u Hz, %.0f MB (%s in %.1f s)\n", settings.files,
+           settings.seconds, settings.sampleRate, corpusBytes / 1e6, settings.generate ? "generated" : "reused",
+           std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+
+    DecoderOptions options;
+    // Twice as many threads as cores lets one thread compute while another waits for the disk
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned> threadCounts = {1};
+    if (cores > 1) {
+        threadCounts.push_back(cores);
+    }
+    threadCounts.push_back(2 * cores);
+
+    if (settings.cold && !dropCaches()) {
+        printf("cannot drop the page cache, the numbers below are for files in memory\n");
+        settings.cold = false;
+    }
+
+    bool ok = true;
+    for (unsigned threads : threadCounts) {
+        if (settings.cold) {
+            dropCaches();
+        }
+        begin = std::chrono::steady_clock::now();
+        std::vector<FileResult> results = decodeFiles(paths, options, threads);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        size_t correct = 0;
+        uint64_t scanned = 0;
+        std::vector<uint64_t> bytes;
+        for (size_t i = 0; i < results.size(); i++) {
+            if (checkResult(results[i], expectedPacket(i, settings))) {
+                correct++;
+            } else {
+                printf("wrong result for %s: status %d, start %.4f s\n", paths[i].c_str(), (int)results[i].status,
+                       results[i].startSeconds);
+            }
+            scanned += results[i].bytesScanned;
+            bytes.push_back(results[i].bytesScanned + 44);
+        }
+        if (settings.cold) {
+            dropCaches();
+        }
+        double readSeconds = readOnly(paths, bytes, threads);
+        printf("%s, %u thread(s): %zu/%zu packets correct, %.2f s, %.0f files/s, %.1f MB/s of %.0f MB read"
+               " (read only: %.2f s, %.1f MB/s, decoder at %.0f%% of read speed)\n",
+               settings.cold ? "cold" : "cached", threads, correct, results.size(), seconds, results.size() / seconds, scanned / 1e6 / seconds,
+               scanned / 1e6, readSeconds, scanned / 1e6 / readSeconds, 100.0 * readSeconds / seconds);
+        ok = ok && correct == results.size();
+    }
+    if (settings.generate && !settings.keep) {
+        for (const std::string &path : paths) {
+            std::filesystem::remove(path);
+        }
+    }
+    printf("%s\n", ok ? "ALL PASSED" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+// Command line front end of the batch decoder: scans WAV files or folders
+// and writes a JSON index of the session metadata found in each file.
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "batchDecoder.hpp"
+
+static void usage() {
+    fprintf(stderr,
+            "usage: batch_decoder [options] <file or folder>...\n"
+            "  -j <threads>           worker threads, default one per core\n"
+            "  -o <file>              write the JSON index to a file instead of stdout\n"
+            "  --scan-seconds <s>     seconds scanned per file without a packet, default 70\n"
+            "  --threshold-db <dB>    lowest tone level in dBFS that starts a burst, default -60\n"
+            "  --rise-db <dB>         rise of the tone band over its noise floor that starts a burst, default 10\n"
+            "  --channel <n>          channel with the modem, default the mean of all channels\n"
+            "  --bits-per-symbol <n>  1 to 4, as CONFIG_YOD_MODEM_BITS_PER_SYMBOL, default 1\n"
+            "  --symbol-us <us>       as CONFIG_YOD_MODEM_SYMBOL_US, default 20000\n");
+}
+
+int main(int argc, char **argv) {
+    DecoderOptions options;
+    unsigned threads = 0;
+    const char *outPath = nullptr;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "-j" && hasValue) {
+            threads = (unsigned)atoi(argv[++i]);
+        } else if (arg == "-o" && hasValue) {
+            outPath = argv[++i];
+        } else if (arg == "--scan-seconds" && hasValue) {
+            options.scanSeconds = (float)atof(argv[++i]);
+        } else if (arg == "--threshold-db" && hasValue) {
+            options.thresholdDb = (float)atof(argv[++i]);
+        } else if (arg == "--rise-db" && hasValue) {
+            options.riseDb = (float)atof(argv[++i]);
+        } else if (arg == "--channel" && hasValue) {
+            options.channel = atoi(argv[++i]);
+        } else if (arg == "--bits-per-symbol" && hasValue) {
+            options.bitsPerSymbol = (uint8_t)atoi(argv[++i]);
+        } else if (arg == "--symbol-us" && hasValue) {
+            options.symbolUs = (uint32_t)atoi(argv[++i]);
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            usage();
+            return 2;
+        } else {
+            std::vector<std::string> found = findWavFiles(arg);
+            files.insert(files.end(), found.begin(), found.end());
+        }
+    }
+    if (files.empty()) {
+        usage();
+        return 2;
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<FileResult> results = decodeFiles(files, options, threads);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    FILE *out = outPath != nullptr ? fopen(outPath, "w") : stdout;
+    if (out == nullptr) {
+        fprintf(stderr, "cannot write %s: %s\n", outPath, strerror(errno));
+        return 1;
+    }
+    writeJson(out, results);
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    size_t found = 0;
+    double scannedMb = 0.0, totalMb = 0.0;
+    for (const FileResult &result : results) {
+        found += result.status == FileResult::Status::Ok;
+        scannedMb += result.bytesScanned / 1e6;
+        totalMb += result.fileBytes / 1e6;
+    }
+    fprintf(stderr, "%zu files, %zu with a packet, %.1f of %.1f MB read in %.2f s (%.1f MB/s)\n", results.size(),
+            found, scannedMb, totalMb, seconds, scannedMb / seconds);
+    return 0;
+}
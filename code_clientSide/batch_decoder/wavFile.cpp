@@ -0,0 +1,184 @@
+#include "wavFile.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+
+static constexpr uint16_t FORMAT_PCM = 1;
+static constexpr uint16_t FORMAT_FLOAT = 3;
+static constexpr uint16_t FORMAT_EXTENSIBLE = 0xFFFE;
+
+static uint32_t readLe(const uint8_t *p, int bytes) {
+    uint32_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint32_t)p[i] << (8 * i);
+    }
+    return value;
+}
+
+WavFile::~WavFile() {
+    close();
+}
+
+bool WavFile::open(const std::string &path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = std::string("cannot open: ") + strerror(errno);
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < 44) {
+        error = "not a WAV file";
+        ::close(fd);
+        return false;
+    }
+    fileBytes = (size_t)info.st_size;
+    void *mapped = mmap(nullptr, fileBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        error = std::string("cannot map: ") + strerror(errno);
+        fileBytes = 0;
+        return false;
+    }
+    map = static_cast<const uint8_t *>(mapped);
+    // The samples are read front to back, let the kernel read ahead
+    madvise(mapped, fileBytes, MADV_SEQUENTIAL);
+    if (!parse()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void WavFile::close() {
+    if (map != nullptr) {
+        munmap(const_cast<uint8_t *>(map), fileBytes);
+    }
+    map = nullptr;
+    data = nullptr;
+    fileBytes = 0;
+    frameCount = 0;
+}
+
+bool WavFile::parse() {
+    if (memcmp(map, "RIFF", 4) != 0 || memcmp(map + 8, "WAVE", 4) != 0) {
+        error = "not a RIFF/WAVE file";
+        return false;
+    }
+    bool haveFormat = false;
+    size_t position = 12;
+    while (position + 8 <= fileBytes) {
+        const uint8_t *chunk = map + position;
+        size_t size = readLe(chunk + 4, 4);
+        if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16 && position + 8 + size <= fileBytes) {
+            uint16_t format = (uint16_t)readLe(chunk + 8, 2);
+            channels = (uint16_t)readLe(chunk + 10, 2);
+            sampleRate = readLe(chunk + 12, 4);
+            frameBytes = readLe(chunk + 20, 2);
+            bitsPerSample = (uint16_t)readLe(chunk + 22, 2);
+            if (format == FORMAT_EXTENSIBLE && size >= 40) {
+                format = (uint16_t)readLe(chunk + 32, 2); // First bytes of the sub format GUID
+            }
+            isFloat = format == FORMAT_FLOAT;
+            bool supported = (format == FORMAT_PCM && (bitsPerSample == 16 || bitsPerSample == 24 || bitsPerSample == 32)) ||
+                             (isFloat && bitsPerSample == 32);
+            if (!supported || channels == 0 || frameBytes != (size_t)channels * bitsPerSample / 8) {
+                error = "unsupported sample format";
+                return false;
+            }
+            haveFormat = true;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!haveFormat) {
+                error = "data before fmt chunk";
+                return false;
+            }
+            data = chunk + 8;
+            // A recording cut short by a power loss has a size that runs past the end
+            size_t available = fileBytes - (position + 8);
+            frameCount = (size < available ? size : available) / frameBytes;
+            return true;
+        }
+        position += 8 + size + (size & 1);
+    }
+    error = "no data chunk";
+    return false;
+}
+
+void WavFile::prefetch(size_t firstFrame, size_t frames) const {
+    if (firstFrame >= frameCount) {
+        return;
+    }
+    frames = std::min(frames, frameCount - firstFrame);
+    // madvise() wants a page aligned start
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t begin = (size_t)(data - map) + firstFrame * frameBytes;
+    size_t end = begin + frames * frameBytes;
+    begin -= begin % page;
+    madvise(const_cast<uint8_t *>(map) + begin, end - begin, MADV_WILLNEED);
+}
+
+/**
+ * @brief Convert frames with a sample decoder that is known at compile time.
+ */
+template <typename Decode>
+static void convert(const uint8_t *p, size_t frames, size_t frameBytes, size_t sampleBytes, uint16_t channels,
+                    int channel, float *out, Decode decode) {
+    if (channel >= 0 && channel < channels) {
+        p += (size_t)channel * sampleBytes;
+        for (size_t i = 0; i < frames; i++, p += frameBytes) {
+            out[i] = decode(p);
+        }
+        return;
+    }
+    float scale = 1.0f / channels;
+    for (size_t i = 0; i < frames; i++) {
+        float sum = 0.0f;
+        for (uint16_t c = 0; c < channels; c++, p += sampleBytes) {
+            sum += decode(p);
+        }
+        out[i] = sum * scale;
+    }
+}
+
+size_t WavFile::read(size_t firstFrame, size_t frames, int channel, float *out) const {
+    if (firstFrame >= frameCount) {
+        return 0;
+    }
+    if (frames > frameCount - firstFrame) {
+        frames = frameCount - firstFrame;
+    }
+    size_t sampleBytes = bitsPerSample / 8;
+    const uint8_t *p = data + firstFrame * frameBytes;
+    switch (bitsPerSample) {
+        case 16:
+            convert(p, frames, frameBytes, sampleBytes, channels, channel, out, [](const uint8_t *s) {
+                return (float)(int16_t)(s[0] | s[1] << 8) * (1.0f / 32768.0f);
+            });
+            break;
+        case 24:
+            convert(p, frames, frameBytes, sampleBytes, channels, channel, out, [](const uint8_t *s) {
+                return (float)((int32_t)((uint32_t)s[0] << 8 | (uint32_t)s[1] << 16 | (uint32_t)s[2] << 24) >> 8) *
+                       (1.0f / 8388608.0f);
+            });
+            break;
+        default:
+            if (isFloat) {
+                convert(p, frames, frameBytes, sampleBytes, channels, channel, out, [](const uint8_t *s) {
+                    float value;
+                    memcpy(&value, s, sizeof(value));
+                    return value;
+                });
+            } else {
+                convert(p, frames, frameBytes, sampleBytes, channels, channel, out, [](const uint8_t *s) {
+                    return (float)(int32_t)readLe(s, 4) * (1.0f / 2147483648.0f);
+                });
+            }
+            break;
+    }
+    return frames;
+}
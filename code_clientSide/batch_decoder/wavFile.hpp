@@ -0,0 +1,80 @@
+/**
+ * @file wavFile.hpp
+ * @brief Read-only, memory-mapped access to the PCM samples of a WAV file.
+ *
+ * Only the pages that are converted are read from disk, so looking at the
+ * first seconds of a multi-GB recording costs as much as reading those
+ * seconds. RIFF files with 16, 24 or 32-bit integer or 32-bit float PCM are
+ * supported, also in WAVE_FORMAT_EXTENSIBLE form. Chunks other than fmt and
+ * data, like the bext chunk of the Tascam recorders, are skipped.
+ */
+
+#ifndef WAV_FILE_HPP
+#define WAV_FILE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/**
+ * @class WavFile
+ * @brief A memory-mapped WAV file.
+ */
+class WavFile {
+public:
+    WavFile() = default;
+    ~WavFile();
+    WavFile(const WavFile &) = delete;
+    WavFile &operator=(const WavFile &) = delete;
+
+    /**
+     * @brief Map a file and parse its header.
+     * @param path File to open.
+     * @return false with getError() set when the file cannot be used.
+     */
+    bool open(const std::string &path);
+
+    /** @brief Unmap the file, also done by the destructor. */
+    void close();
+
+    /**
+     * @brief Convert frames to float samples in [-1, 1).
+     * @param firstFrame First frame to convert.
+     * @param frames Number of frames, clipped to the end of the file.
+     * @param channel Channel to take, or -1 for the mean of all channels.
+     * @param[out] out Destination of frames samples.
+     * @return Frames converted.
+     */
+    size_t read(size_t firstFrame, size_t frames, int channel, float *out) const;
+
+    /**
+     * @brief Ask the kernel to start reading frames from disk, returns at once.
+     * @param firstFrame First frame.
+     * @param frames Number of frames, clipped to the end of the file.
+     */
+    void prefetch(size_t firstFrame, size_t frames) const;
+
+    uint32_t getSampleRate() const { return sampleRate; }
+    uint16_t getChannels() const { return channels; }
+    uint16_t getBitsPerSample() const { return bitsPerSample; }
+    size_t getFrameCount() const { return frameCount; }
+    size_t getFrameBytes() const { return frameBytes; }
+    size_t getFileBytes() const { return fileBytes; }
+    const std::string &getError() const { return error; }
+
+private:
+    const uint8_t *map = nullptr;
+    size_t fileBytes = 0;
+    const uint8_t *data = nullptr;
+    size_t frameCount = 0;
+    size_t frameBytes = 0;
+    uint32_t sampleRate = 0;
+    uint16_t channels = 0;
+    uint16_t bitsPerSample = 0;
+    bool isFloat = false;
+    std::string error;
+
+    bool parse();
+};
+
+#endif // WAV_FILE_HPP
@@ -0,0 +1,183 @@
+// Command line encoder of configuration uploads: writes a WAV file to play
+// from a laptop speaker next to the recorder while it is not recording.
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "configPacket.hpp"
+
+static constexpr uint32_t WAV_RATE = 48000;
+static constexpr float AMPLITUDE = 0.5f;      ///< -6 dBFS, leaves room for the speaker
+static constexpr uint32_t RAMP_US = 1000;     ///< Fade in and out of a burst, avoids a click
+static constexpr uint32_t GAP_MS = 500;       ///< Silence before, between and after the bursts
+
+static void usage() {
+    fprintf(stderr,
+            "usage: config_encoder [options] -o <file.wav>\n"
+            "  --key <hex>              64 hex digits, as CONFIG_YOD_CONFIG_KEY, default $YOD_CONFIG_KEY\n"
+            "  --counter <n>            replay counter, must grow with every upload, default the unix time\n"
+            "  --clock <now|YYYY-MM-DD HH:MM:SS>  set the clock\n"
+            "  --word-level <dB>        lowest spectral peak that counts as a word\n"
+            "  --word-band <low> <high> peak frequency range of a word in Hz\n"
+            "  --session <n>            session counter, the next recording gets n + 1\n"
+            "  --beacon-interval <s>    seconds between timestamp beacons, 0 disables them\n"
+            "  --repeat <n>             bursts in the file, default 2\n"
+            "\n"
+            "--word-level and --word-band go together, as do --session and --beacon-interval.\n");
+}
+
+static bool parseClock(const char *text, ConfigPayload &config) {
+    struct tm time = {};
+    if (strcmp(text, "now") == 0) {
+        time_t now = ::time(nullptr);
+        localtime_r(&now, &time);
+    } else if (sscanf(text, "%d-%d-%d %d:%d:%d", &time.tm_year, &time.tm_mon, &time.tm_mday, &time.tm_hour,
+                      &time.tm_min, &time.tm_sec) == 6) {
+        time.tm_year -= 1900;
+        time.tm_mon -= 1;
+    } else {
+        return false;
+    }
+    // Past 2155 does not fit the byte of years since 1900
+    if (time.tm_year < 0 || time.tm_year > 255) {
+        return false;
+    }
+    config.year = (uint8_t)time.tm_year;
+    config.month = (uint8_t)time.tm_mon;
+    config.day = (uint8_t)time.tm_mday;
+    config.hour = (uint8_t)time.tm_hour;
+    config.minute = (uint8_t)time.tm_min;
+    config.second = (uint8_t)time.tm_sec;
+    config.flags |= ConfigPayload::FLAG_CLOCK;
+    return true;
+}
+
+static bool writeWav(const char *path, const std::vector<float> &samples) {
+    FILE *out = fopen(path, "wb");
+    if (out == nullptr) {
+        fprintf(stderr, "cannot write %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    auto put32 = [out](uint32_t value) {
+        uint8_t bytes[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+        fwrite(bytes, 1, sizeof(bytes), out);
+    };
+    auto put16 = [out](uint16_t value) {
+        uint8_t bytes[2] = {(uint8_t)value, (uint8_t)(value >> 8)};
+        fwrite(bytes, 1, sizeof(bytes), out);
+    };
+    uint32_t dataBytes = (uint32_t)(samples.size() * 2);
+    fwrite("RIFF", 1, 4, out);
+    put32(36 + dataBytes);
+    fwrite("WAVEfmt ", 1, 8, out);
+    put32(16);
+    put16(1);
+    put16(1);
+    put32(WAV_RATE);
+    put32(WAV_RATE * 2);
+    put16(2);
+    put16(16);
+    fwrite("data", 1, 4, out);
+    put32(dataBytes);
+    for (float sample : samples) {
+        put16((uint16_t)(int16_t)lrintf(fmaxf(-1.0f, fminf(1.0f, sample)) * 32767.0f));
+    }
+    bool ok = ferror(out) == 0;
+    fclose(out);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    ConfigPayload config = {};
+    config.counter = (uint32_t)::time(nullptr);
+    const char *keyText = getenv("YOD_CONFIG_KEY");
+    const char *outPath = nullptr;
+    int repeat = 2;
+    bool hasLevel = false, hasBand = false, hasSession = false, hasInterval = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--key" && hasValue) {
+            keyText = argv[++i];
+        } else if (arg == "--counter" && hasValue) {
+            config.counter = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--clock" && hasValue) {
+            if (!parseClock(argv[++i], config)) {
+                fprintf(stderr, "bad clock %s\n", argv[i]);
+                return 2;
+            }
+        } else if (arg == "--word-level" && hasValue) {
+            config.wordLevelDb = (int8_t)atoi(argv[++i]);
+            hasLevel = true;
+        } else if (arg == "--word-band" && i + 2 < argc) {
+            config.wordLowHz = (uint16_t)atoi(argv[++i]);
+            config.wordHighHz = (uint16_t)atoi(argv[++i]);
+            hasBand = true;
+        } else if (arg == "--session" && hasValue) {
+            config.sessionId = (uint16_t)atoi(argv[++i]);
+            hasSession = true;
+        } else if (arg == "--beacon-interval" && hasValue) {
+            config.beaconIntervalS = (uint16_t)atoi(argv[++i]);
+            hasInterval = true;
+        } else if (arg == "--repeat" && hasValue) {
+            repeat = atoi(argv[++i]);
+        } else if (arg == "-o" && hasValue) {
+            outPath = argv[++i];
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    uint8_t key[ConfigLink::KEY_SIZE];
+    if (!parseConfigKey(keyText, key)) {
+        fprintf(stderr, "the key must be %zu hex digits, from --key or $YOD_CONFIG_KEY\n", 2 * ConfigLink::KEY_SIZE);
+        return 2;
+    }
+    if (hasLevel != hasBand || hasSession != hasInterval) {
+        usage();
+        return 2;
+    }
+    if (hasLevel) {
+        config.flags |= ConfigPayload::FLAG_THRESHOLDS;
+    }
+    if (hasSession) {
+        config.flags |= ConfigPayload::FLAG_SESSION;
+    }
+    if (outPath == nullptr || config.flags == 0 || repeat < 1) {
+        usage();
+        return 2;
+    }
+
+    config.sign(key);
+    uint8_t packet[ModemPacket::encodedSize(ConfigPayload::SIZE)];
+    size_t length = config.encode(packet, sizeof(packet));
+
+    // The device refuses the repeats as replays, they only cover a burst lost in noise
+    MfskTonePlan plan(ConfigLink::LOW_FREQ, ConfigLink::HIGH_FREQ, ConfigLink::BITS_PER_SYMBOL);
+    MfskModulator modulator(plan, WAV_RATE, ConfigLink::SYMBOL_US);
+    size_t burst = modulator.sampleCount(length);
+    size_t gap = (size_t)WAV_RATE * GAP_MS / 1000;
+    size_t ramp = (size_t)((uint64_t)RAMP_US * WAV_RATE / 1000000);
+    std::vector<float> samples(gap + repeat * (burst + gap), 0.0f);
+    for (int r = 0; r < repeat; r++) {
+        float *begin = samples.data() + gap + r * (burst + gap);
+        modulator.modulate(packet, length, AMPLITUDE, begin);
+        for (size_t i = 0; i < ramp; i++) {
+            float gain = (float)i / ramp;
+            begin[i] *= gain;
+            begin[burst - 1 - i] *= gain;
+        }
+    }
+    if (!writeWav(outPath, samples)) {
+        return 1;
+    }
+    fprintf(stderr, "%s: counter %lu, flags 0x%02x, %d bursts of %.2f s, %.1f s in total\n", outPath,
+            (unsigned long)config.counter, config.flags, repeat, (double)burst / WAV_RATE,
+            (double)samples.size() / WAV_RATE);
+    return 0;
+}
@@ -2,6 +2,11 @@ import numpy as np
 from scipy.io import wavfile
 from scipy.signal import butter, filtfilt
 
+# Tones of the modem, the same as ModemCodec in
+# code_esp32/components/modem_codec/include/modemCodec.hpp
+LOW_FREQ = 21_000   # bit 0
+HIGH_FREQ = 23_000  # bit 1
+
 # Function to apply a bandpass filter to the audio data
 def _bandpass_filter(data, lowcut, highcut, samplerate, order=5):
     nyquist = 0.5 * samplerate
@@ -63,8 +68,8 @@ def analyze_audio(
     audio_data=None, 
     samplerate=None, 
     chunk_duration=0.05, 
-    freq1=3000, 
-    freq2=4000, 
+    freq1=LOW_FREQ, 
+    freq2=HIGH_FREQ, 
     verbose=True,
     use_normalization=True,
     norm_type="rms",
@@ -153,8 +158,8 @@ if __name__ == "__main__":
     decoded_bits = analyze_audio(
         filename="audio_files/250905_0124S34.wav", 
         chunk_duration=0.004, 
-        freq1=21_000, 
-        freq2=23_000,
+        freq1=LOW_FREQ, 
+        freq2=HIGH_FREQ,
         use_normalization=True,
         norm_type="max",
         normalization_target=5.0,
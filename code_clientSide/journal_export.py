@@ -0,0 +1,174 @@
+"""
+Export of the session journal of code_esp32/main/headers/journalLog.hpp.
+
+Sends "journal export [from]" on the console of the recorder and decodes the
+binary frames that follow (SessionJournal::exportBinary()), or decodes a raw
+capture of them. Log lines between the frames are skipped. Writes one CSV line
+per record; records after a session start also get the clock time, counted on
+from the start with the uptime.
+
+    python journal_export.py /dev/ttyUSB0 journal.csv [--from SEQUENCE]
+    python journal_export.py --capture export.bin journal.csv
+"""
+
+import argparse
+import csv
+import struct
+import sys
+import time
+from datetime import datetime
+
+from modem_packet import crc16
+
+FRAME_SYNC = b"\xa5\x5a"
+FRAME_VERSION = 1
+FRAME_TYPE_JOURNAL = 0x02
+FRAME_TYPE_JOURNAL_END = 0x03
+RECORD_SIZE = 32
+
+TYPE_NAMES = {1: "boot", 2: "session_start", 3: "session_stop", 4: "patient", 5: "speech", 6: "button", 7: "fault"}
+BUTTONS = ["start", "stop", "patient_pause", "research_pause", "code_scanner", "audio_data", "recorder_fault"]
+FAULT_SOURCES = {1: "recorder", 2: "storage"}
+
+
+def crc16_le(data):
+    """esp_rom_crc16_le(0, data), the CRC of the console frames."""
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0x8408 if crc & 1 else crc >> 1
+    return crc ^ 0xFFFF
+
+
+def read_frames(data):
+    """Yield (type, payload) of every frame with a good CRC in data."""
+    pos = 0
+    while True:
+        pos = data.find(FRAME_SYNC, pos)
+        if pos < 0 or pos + 8 > len(data):
+            return
+        version, frame_type, length = struct.unpack_from("<BBH", data, pos + 2)
+        end = pos + 6 + length + 2
+        if version == FRAME_VERSION and end <= len(data):
+            payload = data[pos + 6:pos + 6 + length]
+            if struct.unpack_from("<H", data, end - 2)[0] == crc16_le(payload):
+                yield frame_type, payload
+                pos = end
+                continue
+        pos += 1
+
+
+def decode_record(raw):
+    """Dict of one 32 byte record, None when its CRC is wrong."""
+    if crc16(raw[:30]) != struct.unpack_from("<H", raw, 30)[0]:
+        return None
+    sequence, uptime_ms, record_type, length = struct.unpack_from("<IIBB", raw)
+    payload = raw[10:10 + length]
+    record = {"sequence": sequence, "uptime_ms": uptime_ms, "type": TYPE_NAMES.get(record_type, str(record_type))}
+    if record_type == 1:
+        record["detail"] = "reset reason %d" % payload[0]
+    elif record_type == 2:
+        record["session"], record["start_time"] = struct.unpack_from("<II", payload)
+    elif record_type in (3, 4):
+        record["session"] = struct.unpack_from("<I", payload)[0]
+        if record_type == 4:
+            record["detail"] = payload[4:].split(b"\0")[0].decode("ascii", "replace")
+    elif record_type == 5:
+        words, frames, modem_frames, window_ms = struct.unpack_from("<HHHI", payload)
+        record["words"], record["frames"], record["modem_frames"], record["window_ms"] = words, frames, modem_frames, window_ms
+        record["ratio"] = "%.3f" % (words / frames * 2) if frames else ""
+    elif record_type == 6:
+        record["detail"] = BUTTONS[payload[0]] if payload[0] < len(BUTTONS) else str(payload[0])
+    elif record_type == 7:
+        source, code = struct.unpack_from("<Bi", payload)
+        record["detail"] = "%s %d" % (FAULT_SOURCES.get(source, str(source)), code)
+    return record
+
+
+def decode(data):
+    """Records of an export, oldest first, and the (oldest, next, dropped) of its end frame."""
+    records = []
+    end = None
+    bad = 0
+    for frame_type, payload in read_frames(data):
+        if frame_type == FRAME_TYPE_JOURNAL:
+            for offset in range(0, len(payload) - RECORD_SIZE + 1, RECORD_SIZE):
+                record = decode_record(payload[offset:offset + RECORD_SIZE])
+                if record is None:
+                    bad += 1
+                else:
+                    records.append(record)
+        elif frame_type == FRAME_TYPE_JOURNAL_END:
+            end = struct.unpack_from("<III", payload)
+    if bad:
+        print("%d records with a bad CRC skipped" % bad, file=sys.stderr)
+    return records, end
+
+
+def add_clock_time(records):
+    """Clock time from the last session start of the same boot."""
+    anchor = None
+    for record in records:
+        if record["type"] == "boot":
+            anchor = None
+        elif record["type"] == "session_start":
+            anchor = (record["start_time"], record["uptime_ms"])
+        if anchor is not None:
+            seconds = anchor[0] + (record["uptime_ms"] - anchor[1]) / 1000.0
+            record["time"] = datetime.fromtimestamp(seconds).isoformat(timespec="seconds")
+
+
+def capture(port, first, timeout_s=600):
+    """Ask the recorder for an export and return the bytes up to its end frame."""
+    import serial  # pyserial, only needed on a live port
+
+    with serial.Serial(port, 115200, timeout=0.5) as link:
+        link.reset_input_buffer()
+        link.write(("journal export %d\n" % first).encode())
+        data = bytearray()
+        deadline = time.time() + timeout_s
+        while time.time() < deadline:
+            data += link.read(4096)
+            if any(frame_type == FRAME_TYPE_JOURNAL_END for frame_type, _ in read_frames(bytes(data[-64:]))):
+                break
+        return bytes(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Export the session journal of a YOD recorder to CSV")
+    parser.add_argument("port", nargs="?", help="serial port of the recorder")
+    parser.add_argument("output", help="CSV file to write")
+    parser.add_argument("--capture", help="decode a raw capture of an export instead of a port")
+    parser.add_argument("--from", dest="first", type=int, default=0, help="first sequence number wanted")
+    args = parser.parse_args()
+    if args.capture is None and args.port is None:
+        parser.error("give a serial port or --capture")
+
+    started = time.time()
+    if args.capture is not None:
+        with open(args.capture, "rb") as file:
+            data = file.read()
+    else:
+        data = capture(args.port, args.first)
+    records, end = decode(data)
+    add_clock_time(records)
+
+    columns = ["sequence", "uptime_ms", "time", "type", "session", "start_time", "words", "frames",
+               "modem_frames", "window_ms", "ratio", "detail"]
+    with open(args.output, "w", newline="") as file:
+        writer = csv.DictWriter(file, fieldnames=columns)
+        writer.writeheader()
+        writer.writerows(records)
+
+    print("%d records in %.1f s" % (len(records), time.time() - started))
+    if end is None:
+        print("No end frame, the export is incomplete", file=sys.stderr)
+        return 1
+    oldest, next_sequence, dropped = end
+    print("Journal holds %d to %d, %d records dropped on the recorder" % (oldest, next_sequence - 1, dropped))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,137 @@
+"""
+Decoder for the audio modem packet format of code_esp32/main/headers/modemPacket.hpp.
+
+Works on the bit list returned by decoder_audiomodem.analyze_audio(), bits in
+the order they were sent (LSB first per byte).
+"""
+
+VERSION = 1
+TYPE_SESSION_METADATA = 1
+TYPE_BEACON = 2
+MAX_PAYLOAD = 64
+PREAMBLE = [1, 1, 1, 1, 1, 0, 0, 1, 1, 0, 1, 0, 1]  # Barker-13, followed by three 0 bits
+PREAMBLE_BITS = 16
+HEADER_BITS = 32
+MAX_PREAMBLE_ERRORS = 1
+
+
+def _hamming_encode(nibble):
+    d1, d2, d3, d4 = (nibble >> 0) & 1, (nibble >> 1) & 1, (nibble >> 2) & 1, (nibble >> 3) & 1
+    p1, p2, p3 = d1 ^ d2 ^ d4, d1 ^ d3 ^ d4, d2 ^ d3 ^ d4
+    word = p1 | p2 << 1 | d1 << 2 | p3 << 3 | d2 << 4 | d3 << 5 | d4 << 6
+    return word | (p1 ^ p2 ^ d1 ^ p3 ^ d2 ^ d3 ^ d4) << 7
+
+
+def _build_decode_table():
+    # Nibble for every received byte within one bit of a code word, None otherwise
+    table = [None] * 256
+    for nibble in range(16):
+        word = _hamming_encode(nibble)
+        table[word] = nibble
+        for bit in range(8):
+            table[word ^ (1 << bit)] = nibble
+    return table
+
+
+_DECODE_TABLE = _build_decode_table()
+
+
+def crc16(data, crc=0xFFFF):
+    """CRC-16/CCITT-FALSE, the same as ModemPacket::crc16()."""
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def _read_block(bits, start, code_words, count):
+    """Deinterleave a block and return count bytes, or None when a code word is uncorrectable."""
+    nibbles = []
+    for word in range(2 * count):
+        received = 0
+        for bit in range(8):
+            received |= bits[start + bit * code_words + word] << bit
+        nibble = _DECODE_TABLE[received]
+        if nibble is None:
+            return None
+        nibbles.append(nibble)
+    return [nibbles[2 * i] | nibbles[2 * i + 1] << 4 for i in range(count)]
+
+
+def _decode_at(bits, position):
+    header_start = position + PREAMBLE_BITS
+    if header_start + HEADER_BITS > len(bits):
+        return None
+    header = _read_block(bits, header_start, 4, 2)
+    if header is None or header[0] >> 4 != VERSION or header[1] > MAX_PAYLOAD:
+        return None
+    length = header[1]
+    code_words = 2 * (length + 2)
+    body_start = header_start + HEADER_BITS
+    if body_start + 8 * code_words > len(bits):
+        return None
+    body = _read_block(bits, body_start, code_words, length + 2)
+    if body is None:
+        return None
+    payload = body[:length]
+    if crc16(payload, crc16(header)) != body[length] | body[length + 1] << 8:
+        return None
+    return {'type': header[0] & 0x0F, 'payload': payload, 'start_bit': position,
+            'end_bit': body_start + 8 * code_words}
+
+
+def decode_packet(bits):
+    """Return the first valid packet in the bit list as a dict, or None."""
+    for position in range(len(bits) - PREAMBLE_BITS + 1):
+        errors = sum(1 for i in range(len(PREAMBLE)) if bits[position + i] != PREAMBLE[i])
+        if errors <= MAX_PREAMBLE_ERRORS:
+            packet = _decode_at(bits, position)
+            if packet is not None:
+                return packet
+    return None
+
+
+def decode_session_metadata(bits):
+    """Return the session metadata of the first SessionMetadata packet as a dict, or None."""
+    packet = decode_packet(bits)
+    if packet is None or packet['type'] != TYPE_SESSION_METADATA or len(packet['payload']) < 10:
+        return None
+    p = packet['payload']
+    return {
+        'session_id': p[0] | p[1] << 8,
+        'minute': p[2],
+        'hour': p[3],
+        'day': p[4],
+        'month': p[5],
+        'year': 1900 + p[6],
+        'patient': bytes(p[8:10]).decode('ascii', errors='replace') if p[7] & 0x01 else None,
+    }
+
+
+def decode_packets(bits):
+    """Return every valid packet in the bit list, in order."""
+    packets = []
+    position = 0
+    while position <= len(bits) - PREAMBLE_BITS:
+        errors = sum(1 for i in range(len(PREAMBLE)) if bits[position + i] != PREAMBLE[i])
+        packet = _decode_at(bits, position) if errors <= MAX_PREAMBLE_ERRORS else None
+        if packet is None:
+            position += 1
+        else:
+            packets.append(packet)
+            position = packet['end_bit']
+    return packets
+
+
+def decode_beacon(packet):
+    """Return the fields of a Beacon packet from decode_packet() as a dict, or None."""
+    if packet is None or packet['type'] != TYPE_BEACON or len(packet['payload']) < 8:
+        return None
+    p = packet['payload']
+    return {
+        'session_id': p[0] | p[1] << 8,
+        'sequence': p[2] | p[3] << 8,
+        'elapsed_ms': p[4] | p[5] << 8 | p[6] << 16 | p[7] << 24,
+    }
@@ -0,0 +1,244 @@
+/**
+ * @file configPacket.hpp
+ * @brief Authenticated configuration packet, played from a laptop speaker to the device microphone.
+ *
+ * The packet is a normal modem packet of Type::Config. It uses its own tone
+ * plan in the band a laptop speaker and the microphone path both pass, and
+ * is sampled by the ADC at its lowest DMA rate.
+ *
+ * The payload ends in a truncated HMAC-SHA256 over the fields before it,
+ * with a key shared by the device and the host tool. The counter must be
+ * higher than the last accepted one, so a recorded upload cannot be played
+ * again. The CRC of the packet only protects against noise, the MAC against
+ * somebody else with a speaker.
+ */
+
+#ifndef CONFIG_PACKET_HPP
+#define CONFIG_PACKET_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include "modemCodec.hpp"
+#include "sha256.hpp"
+
+/**
+ * @brief Modem settings of the configuration link, shared by the device and the host encoder.
+ */
+namespace ConfigLink {
+constexpr uint32_t SAMPLE_RATE = 20000;   ///< ADC DMA rate on the device, the lowest the ESP32 supports
+constexpr uint32_t LOW_FREQ = 2000;       ///< Tone of symbol 0 in Hz
+constexpr uint32_t HIGH_FREQ = 3500;      ///< Tone of symbol 3 in Hz
+constexpr uint32_t SYMBOL_US = 10000;
+constexpr uint8_t BITS_PER_SYMBOL = 2;    ///< 4-FSK, 500 Hz between the tones
+constexpr size_t KEY_SIZE = 32;           ///< HMAC key bytes
+} // namespace ConfigLink
+
+/**
+ * @struct ConfigPayload
+ * @brief Payload of a Type::Config packet. A field group is only applied when its flag is set.
+ */
+struct ConfigPayload {
+    static constexpr size_t SIGNED_SIZE = 20;                   ///< Bytes covered by the MAC
+    static constexpr size_t MAC_SIZE = 16;                      ///< HMAC-SHA256 truncated to 128 bits
+    static constexpr size_t SIZE = SIGNED_SIZE + MAC_SIZE;      ///< Bytes on air
+    static constexpr uint8_t FLAG_CLOCK = 0x01;                 ///< Set the RTC
+    static constexpr uint8_t FLAG_THRESHOLDS = 0x02;            ///< Word detection thresholds
+    static constexpr uint8_t FLAG_SESSION = 0x04;               ///< Session counter and beacon interval
+
+    uint32_t counter;          ///< Must be higher than the last accepted counter
+    uint8_t flags;
+    uint8_t year;              ///< Years since 1900, like tm_year
+    uint8_t month;             ///< 0-11, like tm_mon
+    uint8_t day;               ///< 1-31
+    uint8_t hour;
+    uint8_t minute;
+    uint8_t second;
+    int8_t wordLevelDb;        ///< Lowest spectral peak that counts as a word
+    uint16_t wordLowHz;        ///< Lowest peak frequency that counts as a word
+    uint16_t wordHighHz;       ///< Highest peak frequency that counts as a word
+    uint16_t sessionId;        ///< Session number, the next recording gets sessionId + 1
+    uint16_t beaconIntervalS;  ///< Seconds between timestamp beacons, 0 disables them
+    uint8_t mac[MAC_SIZE];
+
+    /**
+     * @brief Write the payload, multi-byte fields low byte first.
+     * @param out Destination of SIZE bytes.
+     */
+    void serialize(uint8_t *out) const {
+        for (int i = 0; i < 4; i++) {
+            out[i] = (uint8_t)(counter >> (8 * i));
+        }
+        out[4] = flags;
+        out[5] = year;
+        out[6] = month;
+        out[7] = day;
+        out[8] = hour;
+        out[9] = minute;
+        out[10] = second;
+        out[11] = (uint8_t)wordLevelDb;
+        out[12] = (uint8_t)(wordLowHz & 0xFF);
+        out[13] = (uint8_t)(wordLowHz >> 8);
+        out[14] = (uint8_t)(wordHighHz & 0xFF);
+        out[15] = (uint8_t)(wordHighHz >> 8);
+        out[16] = (uint8_t)(sessionId & 0xFF);
+        out[17] = (uint8_t)(sessionId >> 8);
+        out[18] = (uint8_t)(beaconIntervalS & 0xFF);
+        out[19] = (uint8_t)(beaconIntervalS >> 8);
+        memcpy(out + SIGNED_SIZE, mac, MAC_SIZE);
+    }
+
+    /**
+     * @brief Read a payload written by serialize().
+     * @param in Payload bytes.
+     * @param length Payload length.
+     * @return false when the payload is too short.
+     */
+    bool deserialize(const uint8_t *in, size_t length) {
+        if (length < SIZE) {
+            return false;
+        }
+        counter = (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+        flags = in[4];
+        year = in[5];
+        month = in[6];
+        day = in[7];
+        hour = in[8];
+        minute = in[9];
+        second = in[10];
+        wordLevelDb = (int8_t)in[11];
+        wordLowHz = (uint16_t)(in[12] | in[13] << 8);
+        wordHighHz = (uint16_t)(in[14] | in[15] << 8);
+        sessionId = (uint16_t)(in[16] | in[17] << 8);
+        beaconIntervalS = (uint16_t)(in[18] | in[19] << 8);
+        memcpy(mac, in + SIGNED_SIZE, MAC_SIZE);
+        return true;
+    }
+
+    /**
+     * @brief Compute the MAC over the signed fields and store it.
+     * @param key ConfigLink::KEY_SIZE key bytes.
+     */
+    void sign(const uint8_t *key) {
+        computeMac(key, mac);
+    }
+
+    /**
+     * @brief Check the MAC, in time independent of where it differs.
+     * @param key ConfigLink::KEY_SIZE key bytes.
+     */
+    bool verify(const uint8_t *key) const {
+        uint8_t expected[MAC_SIZE];
+        computeMac(key, expected);
+        uint8_t difference = 0;
+        for (size_t i = 0; i < MAC_SIZE; i++) {
+            difference |= (uint8_t)(expected[i] ^ mac[i]);
+        }
+        return difference == 0;
+    }
+
+    /**
+     * @brief Calendar time of the clock fields, for RealTimeClock::setTime().
+     */
+    struct tm clockTime() const {
+        struct tm time = {};
+        time.tm_year = year;
+        time.tm_mon = month;
+        time.tm_mday = day;
+        time.tm_hour = hour;
+        time.tm_min = minute;
+        time.tm_sec = second;
+        return time;
+    }
+
+    /**
+     * @brief Build the packet.
+     * @param[out] out Destination, ModemPacket::encodedSize(SIZE) bytes.
+     * @param outSize Size of out.
+     * @return Bytes written, 0 when out is too small.
+     */
+    size_t encode(uint8_t *out, size_t outSize) const {
+        uint8_t payload[SIZE];
+        serialize(payload);
+        return ModemPacket::encode(ModemPacket::Type::Config, payload, sizeof(payload), out, outSize);
+    }
+
+private:
+    void computeMac(const uint8_t *key, uint8_t *out) const {
+        uint8_t payload[SIZE];
+        serialize(payload);
+        uint8_t digest[Sha256::DIGEST_SIZE];
+        hmacSha256(key, ConfigLink::KEY_SIZE, payload, SIGNED_SIZE, digest);
+        memcpy(out, digest, MAC_SIZE);
+    }
+};
+
+/**
+ * @class ConfigAuthenticator
+ * @brief Accepts a configuration packet only with a valid MAC and a new counter.
+ */
+class ConfigAuthenticator {
+public:
+    enum class Result : uint8_t {
+        Accepted,
+        NotConfig,  ///< Another packet type or a short payload
+        BadMac,     ///< Not signed with this key, or changed on the way
+        Replayed,   ///< Counter not higher than the last accepted one
+    };
+
+    /**
+     * @brief Constructs an authenticator.
+     * @param key ConfigLink::KEY_SIZE key bytes, copied.
+     * @param lastCounter Counter of the last accepted packet, from non-volatile storage.
+     */
+    ConfigAuthenticator(const uint8_t *key, uint32_t lastCounter) : lastCounter(lastCounter) {
+        memcpy(this->key, key, sizeof(this->key));
+    }
+
+    /**
+     * @brief Check a received packet. The caller stores getLastCounter() before applying it.
+     * @param packet Decoded packet.
+     * @param[out] config Payload, valid when Accepted.
+     */
+    Result check(const ModemPacket::Decoded &packet, ConfigPayload &config) {
+        if (packet.type != ModemPacket::Type::Config || !config.deserialize(packet.payload, packet.length)) {
+            return Result::NotConfig;
+        }
+        if (!config.verify(key)) {
+            return Result::BadMac;
+        }
+        if (config.counter <= lastCounter) {
+            return Result::Replayed;
+        }
+        lastCounter = config.counter;
+        return Result::Accepted;
+    }
+
+    uint32_t getLastCounter() const { return lastCounter; }
+
+private:
+    uint8_t key[ConfigLink::KEY_SIZE];
+    uint32_t lastCounter;
+};
+
+/**
+ * @brief Parse a hexadecimal key as it is stored in sdkconfig and passed to the host tool.
+ * @param hex ConfigLink::KEY_SIZE * 2 hex digits.
+ * @param[out] key ConfigLink::KEY_SIZE bytes.
+ * @return false when the text is not a key of the right length.
+ */
+inline bool parseConfigKey(const char *hex, uint8_t *key) {
+    if (hex == nullptr || strlen(hex) != 2 * ConfigLink::KEY_SIZE) {
+        return false;
+    }
+    for (size_t i = 0; i < 2 * ConfigLink::KEY_SIZE; i++) {
+        char c = hex[i];
+        int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (digit < 0) {
+            return false;
+        }
+        key[i / 2] = (uint8_t)(i % 2 == 0 ? digit << 4 : key[i / 2] | digit);
+    }
+    return true;
+}
+
+#endif // CONFIG_PACKET_HPP
@@ -0,0 +1,498 @@
+/**
+ * @file mfsk.hpp
+ * @brief Tone plan, symbol packing, modulator and Goertzel demodulator of the M-ary FSK modem.
+ *
+ * M = 2^bitsPerSymbol tones are spread evenly from lowFreq to highFreq, symbol
+ * value k is sent as tone lowFreq + k * spacing. Bytes are cut into symbols
+ * LSB first, a byte may span two symbols and the last symbol is padded with
+ * zero bits. With one bit per symbol this is the original binary FSK: bit 0
+ * on lowFreq and bit 1 on highFreq.
+ *
+ * AudioModem uses MfskTonePlan and MfskSymbolPacker on the target. The
+ * modulator and demodulator only depend on the C++ standard library and are
+ * used by the host tests to synthesise and decode WAV files.
+ */
+
+#ifndef MFSK_HPP
+#define MFSK_HPP
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <complex>
+
+// The firmware calls the symbol packer from an IRAM interrupt handler, which must not end up in flash
+#define MFSK_ALWAYS_INLINE inline __attribute__((always_inline))
+
+/**
+ * @class MfskTonePlan
+ * @brief Tone frequencies of an M-ary FSK mode.
+ */
+class MfskTonePlan {
+public:
+    static constexpr uint8_t MAX_BITS_PER_SYMBOL = 4;
+    static constexpr size_t MAX_TONES = 1 << MAX_BITS_PER_SYMBOL;
+
+    /**
+     * @brief Constructs a tone plan.
+     * @param lowFreq Tone of symbol 0 in Hz.
+     * @param highFreq Tone of symbol M-1 in Hz.
+     * @param bitsPerSymbol 1 to MAX_BITS_PER_SYMBOL, larger values are clamped.
+     */
+    constexpr MfskTonePlan(uint32_t lowFreq, uint32_t highFreq, uint8_t bitsPerSymbol)
+        : lowFreq(lowFreq), highFreq(highFreq),
+          bitsPerSymbol(bitsPerSymbol < 1 ? 1 : (bitsPerSymbol > MAX_BITS_PER_SYMBOL ? MAX_BITS_PER_SYMBOL : bitsPerSymbol)) {}
+
+    constexpr uint8_t getBitsPerSymbol() const { return bitsPerSymbol; }
+    constexpr size_t getToneCount() const { return (size_t)1 << bitsPerSymbol; }
+
+    /**
+     * @brief Frequency of a symbol value in Hz.
+     * @param symbol Symbol value, 0 to getToneCount() - 1.
+     */
+    constexpr float toneFrequency(uint8_t symbol) const {
+        return (float)lowFreq + ((float)highFreq - (float)lowFreq) * symbol / (float)(getToneCount() - 1);
+    }
+
+    /**
+     * @brief Symbols needed to send a number of bytes.
+     * @param bytes Number of bytes.
+     */
+    constexpr size_t symbolCount(size_t bytes) const {
+        return (bytes * 8 + bitsPerSymbol - 1) / bitsPerSymbol;
+    }
+
+private:
+    uint32_t lowFreq;
+    uint32_t highFreq;
+    uint8_t bitsPerSymbol;
+};
+
+/**
+ * @class MfskSymbolPacker
+ * @brief Cuts a byte stream into symbols, LSB first.
+ */
+class MfskSymbolPacker {
+public:
+    explicit constexpr MfskSymbolPacker(uint8_t bitsPerSymbol) : bitsPerSymbol(bitsPerSymbol), bits(0), bitCount(0) {}
+
+    /** @brief True when another byte is needed before the next symbol is complete. */
+    MFSK_ALWAYS_INLINE bool needsByte() const { return bitCount < bitsPerSymbol; }
+
+    /** @brief True when no bits are left. */
+    MFSK_ALWAYS_INLINE bool empty() const { return bitCount == 0; }
+
+    /**
+     * @brief Append a byte.
+     * @param byte Byte to send.
+     */
+    MFSK_ALWAYS_INLINE void push(uint8_t byte) {
+        bits |= (uint16_t)byte << bitCount;
+        bitCount += 8;
+    }
+
+    /**
+     * @brief Take the next symbol, the missing bits of a last partial symbol are zero.
+     */
+    MFSK_ALWAYS_INLINE uint8_t pop() {
+        uint8_t symbol = (uint8_t)(bits & ((1u << bitsPerSymbol) - 1));
+        bits >>= bitsPerSymbol;
+        bitCount = bitCount > bitsPerSymbol ? (uint8_t)(bitCount - bitsPerSymbol) : 0;
+        return symbol;
+    }
+
+    /** @brief Drop all buffered bits. */
+    void clear() {
+        bits = 0;
+        bitCount = 0;
+    }
+
+private:
+    uint8_t bitsPerSymbol;
+    uint16_t bits;
+    uint8_t bitCount;
+};
+
+/**
+ * @class MfskModulator
+ * @brief Reference modulator, synthesises the tones the modem sends as float samples.
+ */
+class MfskModulator {
+public:
+    /**
+     * @brief Constructs a modulator.
+     * @param plan Tone plan.
+     * @param sampleRate Samples per second.
+     * @param symbolUs Duration of one symbol in microseconds.
+     */
+    MfskModulator(const MfskTonePlan &plan, uint32_t sampleRate, uint32_t symbolUs)
+        : plan(plan), sampleRate(sampleRate), symbolUs(symbolUs) {}
+
+    /**
+     * @brief Samples needed for a number of bytes.
+     * @param bytes Number of bytes.
+     */
+    size_t sampleCount(size_t bytes) const {
+        return symbolStart(plan.symbolCount(bytes));
+    }
+
+    /**
+     * @brief Add the tones of a byte sequence to a sample buffer, phase continuous.
+     * @param data Bytes to send.
+     * @param length Number of bytes.
+     * @param amplitude Peak amplitude of the tone.
+     * @param[in,out] samples Buffer of at least sampleCount(length) samples, added to.
+     * @return Samples written.
+     */
+    size_t modulate(const uint8_t *data, size_t length, float amplitude, float *samples) const {
+        MfskSymbolPacker packer(plan.getBitsPerSymbol());
+        size_t next = 0;
+        size_t symbols = plan.symbolCount(length);
+        double phase = 0.0;
+        for (size_t s = 0; s < symbols; s++) {
+            while (packer.needsByte() && next < length) {
+                packer.push(data[next++]);
+            }
+            double step = 2.0 * M_PI * plan.toneFrequency(packer.pop()) / sampleRate;
+            for (size_t i = symbolStart(s); i < symbolStart(s + 1); i++) {
+                samples[i] += amplitude * (float)sin(phase);
+                phase += step;
+            }
+            phase = fmod(phase, 2.0 * M_PI);
+        }
+        return symbolStart(symbols);
+    }
+
+private:
+    MfskTonePlan plan;
+    uint32_t sampleRate;
+    uint32_t symbolUs;
+
+    size_t symbolStart(size_t symbol) const {
+        return (size_t)((uint64_t)symbol * symbolUs * sampleRate / 1000000);
+    }
+};
+
+/**
+ * @class MfskDemodulator
+ * @brief Non-coherent demodulator, picks the tone with the most Goertzel energy per symbol.
+ */
+class MfskDemodulator {
+public:
+    /**
+     * @brief Constructs a demodulator.
+     * @param plan Tone plan of the transmitter.
+     * @param sampleRate Samples per second of the recording.
+     * @param symbolUs Duration of one symbol in microseconds.
+     */
+    MfskDemodulator(const MfskTonePlan &plan, uint32_t sampleRate, uint32_t symbolUs)
+        : plan(plan), sampleRate(sampleRate), symbolUs(symbolUs) {
+        for (size_t k = 0; k < plan.getToneCount(); k++) {
+            coefficients[k] = 2.0f * cosf(2.0f * (float)M_PI * plan.toneFrequency((uint8_t)k) / sampleRate);
+        }
+    }
+
+    /**
+     * @brief Goertzel power of every tone in a window.
+     *
+     * A sine of amplitude A that fills the window gives (A * count / 2)^2.
+     * @param samples First sample of the window.
+     * @param count Samples in the window.
+     * @param[out] powers Power per symbol value, getToneCount() entries.
+     * @return Power of the strongest tone.
+     */
+    float tonePowers(const float *samples, size_t count, float *powers) const {
+        // All tones advance together, their filters do not wait on each other
+        size_t tones = plan.getToneCount();
+        float s1[MfskTonePlan::MAX_TONES] = {}, s2[MfskTonePlan::MAX_TONES] = {};
+        for (size_t i = 0; i < count; i++) {
+            for (size_t k = 0; k < tones; k++) {
+                float s0 = samples[i] + coefficients[k] * s1[k] - s2[k];
+                s2[k] = s1[k];
+                s1[k] = s0;
+            }
+        }
+        float strongest = 0.0f;
+        for (size_t k = 0; k < tones; k++) {
+            powers[k] = s1[k] * s1[k] + s2[k] * s2[k] - coefficients[k] * s1[k] * s2[k];
+            strongest = powers[k] > strongest ? powers[k] : strongest;
+        }
+        return strongest;
+    }
+
+    /**
+     * @brief Decide one symbol.
+     * @param samples First sample of the symbol.
+     * @param count Samples in the symbol.
+     * @return Symbol value with the strongest tone.
+     */
+    uint8_t detectSymbol(const float *samples, size_t count) const {
+        float powers[MfskTonePlan::MAX_TONES];
+        float strongest = tonePowers(samples, count, powers);
+        uint8_t best = 0;
+        while (powers[best] != strongest) {
+            best++;
+        }
+        return best;
+    }
+
+    /**
+     * @brief Power of one tone against everything else in a symbol.
+     *
+     * A sine and cosine of the tone are fitted to the samples by least
+     * squares, so a window that does not hold a whole number of periods does
+     * not count as noise. The residual is noise, harmonics and the other tones.
+     * @param samples First sample of the symbol.
+     * @param count Samples in the symbol.
+     * @param symbol Symbol value that was sent.
+     * @return Signal-to-noise ratio, linear.
+     */
+    float toneSnr(const float *samples, size_t count, uint8_t symbol) const {
+        double step = 2.0 * M_PI * plan.toneFrequency(symbol) / sampleRate;
+        double ss = 0, cc = 0, sc = 0, xs = 0, xc = 0, total = 0;
+        for (size_t i = 0; i < count; i++) {
+            double s = sin(step * i), c = cos(step * i), x = samples[i];
+            ss += s * s;
+            cc += c * c;
+            sc += s * c;
+            xs += x * s;
+            xc += x * c;
+            total += x * x;
+        }
+        double determinant = ss * cc - sc * sc;
+        if (determinant <= 0.0) {
+            return 0.0f;
+        }
+        double a = (xs * cc - xc * sc) / determinant;
+        double b = (xc * ss - xs * sc) / determinant;
+        double tone = a * xs + b * xc;
+        return (float)(tone / (total > tone ? total - tone : 1e-30));
+    }
+
+    /**
+     * @brief Decode bytes from a recording.
+     *
+     * A guard of 1/8 symbol is skipped at both ends of each symbol, so a small
+     * error in the start sample does not mix two tones.
+     * @param samples Recording.
+     * @param count Samples in the recording.
+     * @param start Sample where the first symbol starts.
+     * @param[out] out Decoded bytes.
+     * @param bytes Number of bytes to decode.
+     * @return Bytes decoded, less than requested when the recording ends.
+     */
+    size_t demodulate(const float *samples, size_t count, size_t start, uint8_t *out, size_t bytes) const {
+        uint8_t bitsPerSymbol = plan.getBitsPerSymbol();
+        uint32_t bits = 0;
+        uint8_t bitCount = 0;
+        size_t done = 0;
+        for (size_t s = 0; done < bytes; s++) {
+            size_t begin = start + symbolStart(s);
+            size_t end = start + symbolStart(s + 1);
+            size_t guard = (end - begin) / 8;
+            if (end > count) {
+                break;
+            }
+            bits |= (uint32_t)detectSymbol(samples + begin + guard, end - begin - 2 * guard) << bitCount;
+            bitCount += bitsPerSymbol;
+            while (bitCount >= 8 && done < bytes) {
+                out[done++] = (uint8_t)bits;
+                bits >>= 8;
+                bitCount -= 8;
+            }
+        }
+        return done;
+    }
+
+    /** @brief Samples in one symbol. */
+    size_t getSymbolSamples() const { return symbolStart(1); }
+
+    /**
+     * @brief First sample of a symbol, counted from the start of the burst.
+     * @param symbol Symbol index.
+     */
+    size_t symbolStart(size_t symbol) const {
+        return (size_t)((uint64_t)symbol * symbolUs * sampleRate / 1000000);
+    }
+
+    /**
+     * @brief Samples alignSymbols() reads, from half a symbol before the edge on.
+     */
+    size_t alignmentSamples() const { return alignBoundary(ALIGN_BLOCKS); }
+
+    /**
+     * @brief Symbol timing near the start of a burst.
+     *
+     * A window on the symbol grid holds one tone for its whole length, a
+     * window across a symbol edge splits the tone in two parts and the
+     * strongest one has less power. Start candidates one symbol wide around
+     * the edge are compared on the power of the strongest tone summed over
+     * the first ALIGN_SYMBOLS symbols.
+     *
+     * The candidates are one sub-block apart and a window is ALIGN_STEPS
+     * sub-blocks long. The sub-block edges are rounded from a fractional
+     * symbol grid, so ALIGN_STEPS of them always make one symbol even when
+     * the symbol length is not a multiple of ALIGN_STEPS. The DFT of each
+     * sub-block is computed once against a common phase, so a candidate
+     * costs ALIGN_STEPS additions per tone instead of a pass over the samples.
+     * @param samples Recording.
+     * @param available Samples in the recording.
+     * @param edge Rough start of the burst.
+     * @return Start sample on the symbol grid, edge when the recording is too short.
+     */
+    size_t alignSymbols(const float *samples, size_t available, size_t edge) const {
+        size_t symbolSamples = getSymbolSamples();
+        size_t first = edge > symbolSamples / 2 ? edge - symbolSamples / 2 : 0;
+        if (symbolSamples < ALIGN_STEPS || first + alignmentSamples() > available) {
+            return edge;
+        }
+
+        float strongest[ALIGN_STEPS][ALIGN_SYMBOLS] = {};
+        for (size_t k = 0; k < plan.getToneCount(); k++) {
+            double omega = 2.0 * M_PI * plan.toneFrequency((uint8_t)k) / sampleRate;
+            std::complex<float> step((float)cos(omega), (float)-sin(omega));
+            std::complex<float> dft[ALIGN_BLOCKS];
+            for (size_t j = 0; j < ALIGN_BLOCKS; j++) {
+                size_t begin = alignBoundary(j);
+                std::complex<float> phasor = std::polar(1.0f, (float)-fmod(omega * begin, 2.0 * M_PI));
+                std::complex<float> sum(0.0f, 0.0f);
+                for (size_t i = begin; i < alignBoundary(j + 1); i++) {
+                    sum += samples[first + i] * phasor;
+                    phasor *= step;
+                }
+                dft[j] = sum;
+            }
+            for (size_t candidate = 0; candidate < ALIGN_STEPS; candidate++) {
+                for (size_t s = 0; s < ALIGN_SYMBOLS; s++) {
+                    std::complex<float> window(0.0f, 0.0f);
+                    for (size_t m = 0; m < ALIGN_STEPS; m++) {
+                        window += dft[candidate + s * ALIGN_STEPS + m];
+                    }
+                    float &best = strongest[candidate][s];
+                    best = std::norm(window) > best ? std::norm(window) : best;
+                }
+            }
+        }
+
+        size_t best = 0;
+        float bestPower = -1.0f;
+        for (size_t candidate = 0; candidate < ALIGN_STEPS; candidate++) {
+            float power = 0.0f;
+            for (size_t s = 0; s < ALIGN_SYMBOLS; s++) {
+                power += strongest[candidate][s];
+            }
+            if (power > bestPower) {
+                bestPower = power;
+                best = candidate;
+            }
+        }
+        return first + alignBoundary(best);
+    }
+
+    /**
+     * @brief First sample where the short-term power rises above a threshold.
+     * @param samples Recording.
+     * @param count Samples in the recording.
+     * @param threshold Mean square power of a 1 ms block.
+     * @return Start sample, or count when nothing was found.
+     */
+    size_t detectStart(const float *samples, size_t count, float threshold) const {
+        size_t block = sampleRate / 1000;
+        for (size_t begin = 0; begin + block <= count; begin += block) {
+            float power = 0.0f;
+            for (size_t i = begin; i < begin + block; i++) {
+                power += samples[i] * samples[i];
+            }
+            if (power / block < threshold) {
+                continue;
+            }
+            // Refine inside the previous and this block on the first loud sample
+            size_t from = begin >= block ? begin - block : 0;
+            float level = sqrtf(threshold);
+            for (size_t i = from; i < begin + block; i++) {
+                if (fabsf(samples[i]) >= level) {
+                    return i;
+                }
+            }
+            return begin;
+        }
+        return count;
+    }
+
+private:
+    static constexpr size_t ALIGN_SYMBOLS = 16;
+    static constexpr size_t ALIGN_STEPS = 16;
+    static constexpr size_t ALIGN_BLOCKS = (ALIGN_SYMBOLS + 1) * ALIGN_STEPS;
+
+    /** @brief Start of alignment sub-block j, ALIGN_STEPS sub-blocks per symbol. */
+    size_t alignBoundary(size_t j) const {
+        return (size_t)((uint64_t)j * symbolUs * sampleRate / (1000000ull * ALIGN_STEPS));
+    }
+
+    MfskTonePlan plan;
+    uint32_t sampleRate;
+    uint32_t symbolUs;
+    float coefficients[MfskTonePlan::MAX_TONES];
+};
+
+/**
+ * @class MfskBurstDetector
+ * @brief Finds the rising edge of a burst in a stream of short blocks.
+ *
+ * The power of the strongest tone in a block is compared with the noise
+ * floor of the tone band, which follows the recording. An edge is a block
+ * that rises riseDb above the floor and above an absolute minimum after a
+ * block that did not. Feeding one block per half symbol is enough,
+ * MfskDemodulator::alignSymbols() then finds the exact start.
+ */
+class MfskBurstDetector {
+public:
+    /**
+     * @brief Constructs a detector.
+     * @param demodulator Demodulator of the tone plan.
+     * @param minimumDb Lowest tone amplitude in dBFS that starts a burst.
+     * @param riseDb Rise over the noise floor that starts a burst.
+     */
+    MfskBurstDetector(const MfskDemodulator &demodulator, float minimumDb, float riseDb)
+        : demodulator(demodulator),
+          block(demodulator.getSymbolSamples() / 2 > 16 ? demodulator.getSymbolSamples() / 2 : 16),
+          minimum(powf(10.0f, minimumDb / 10.0f) * block * block / 4.0f), rise(powf(10.0f, riseDb / 10.0f)),
+          floor(minimum), quiet(true) {}
+
+    /** @brief Samples in a block. */
+    size_t getBlock() const { return block; }
+
+    /** @brief Distance between the blocks to feed. */
+    size_t getStride() const {
+        size_t half = demodulator.getSymbolSamples() / 2;
+        return half > block ? half : block;
+    }
+
+    /**
+     * @brief Feed the next block.
+     * @param samples getBlock() samples.
+     * @return True when a burst starts in or just before this block.
+     */
+    bool update(const float *samples) {
+        float powers[MfskTonePlan::MAX_TONES];
+        float power = demodulator.tonePowers(samples, block, powers);
+        bool loud = power >= (floor * rise > minimum ? floor * rise : minimum);
+        // The floor follows the noise in the tone band, also inside something that did not decode
+        if (!loud || !quiet) {
+            floor += 0.1f * (power - floor);
+        }
+        bool edge = loud && quiet;
+        quiet = !loud;
+        return edge;
+    }
+
+private:
+    const MfskDemodulator &demodulator;
+    size_t block;
+    float minimum;
+    float rise;
+    float floor;
+    bool quiet;
+};
+
+#endif // MFSK_HPP
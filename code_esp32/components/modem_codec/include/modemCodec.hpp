@@ -0,0 +1,204 @@
+/**
+ * @file modemCodec.hpp
+ * @brief The audio modem codec as one piece: tone plan, frame layout, PCM modulator and demodulator.
+ *
+ * This component is the single source of truth for what the modem sends.
+ * The firmware builds its frames with it and plays the tone plan on the
+ * LEDC or DAC output. The host tests and tools compile the same headers to
+ * synthesise the burst as PCM and to decode recordings. The frequencies and
+ * symbol timing below are the defaults of the firmware; the Python decoder
+ * in code_clientSide uses the same values.
+ *
+ * Only the C++ standard library is needed, nothing here allocates.
+ */
+
+#ifndef MODEM_CODEC_HPP
+#define MODEM_CODEC_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "mfsk.hpp"
+#include "modemPacket.hpp"
+
+/**
+ * @class ModemCodec
+ * @brief Frames, modulates and demodulates modem packets at one sample rate.
+ */
+class ModemCodec {
+public:
+    static constexpr uint32_t LOW_FREQ = 21000;           ///< Tone of symbol 0 in Hz
+    static constexpr uint32_t HIGH_FREQ = 23000;          ///< Tone of the highest symbol in Hz
+    static constexpr uint32_t DEFAULT_SYMBOL_US = 20000;  ///< Symbol duration in microseconds
+    static constexpr uint8_t DEFAULT_BITS_PER_SYMBOL = 1; ///< Binary FSK
+    static constexpr float DEFAULT_MINIMUM_DB = -60.0f;   ///< Weakest tone that starts a burst, dBFS
+    static constexpr float DEFAULT_RISE_DB = 10.0f;       ///< Rise over the noise floor that starts a burst
+    /// Bytes demodulated at a burst: a metadata packet, the longest one, and two bytes of slack for an early start
+    static constexpr size_t SCAN_BYTES = ModemPacket::encodedSize(SessionMetadata::SIZE) + 2;
+
+    /**
+     * @brief Constructs a codec.
+     * @param sampleRate Samples per second of the PCM.
+     * @param symbolUs Duration of one symbol in microseconds.
+     * @param bitsPerSymbol 1 to MfskTonePlan::MAX_BITS_PER_SYMBOL.
+     * @param lowFreq Tone of symbol 0 in Hz.
+     * @param highFreq Tone of the highest symbol in Hz.
+     */
+    ModemCodec(uint32_t sampleRate, uint32_t symbolUs = DEFAULT_SYMBOL_US,
+               uint8_t bitsPerSymbol = DEFAULT_BITS_PER_SYMBOL, uint32_t lowFreq = LOW_FREQ,
+               uint32_t highFreq = HIGH_FREQ)
+        : plan(lowFreq, highFreq, bitsPerSymbol), modulator(plan, sampleRate, symbolUs),
+          demodulator(plan, sampleRate, symbolUs) {}
+
+    /**
+     * @brief Session metadata as MenuController::startRecording() sends it.
+     * @param sessionId Session number, only the low 16 bits are sent.
+     * @param time Calendar time of the RTC.
+     * @param patient Scanned patient code, nullptr when none. The first two bytes are sent.
+     */
+    static SessionMetadata sessionMetadata(uint64_t sessionId, const struct tm &time, const uint8_t *patient) {
+        SessionMetadata metadata = {};
+        metadata.sessionId = (uint16_t)sessionId;
+        metadata.minute = (uint8_t)time.tm_min;
+        metadata.hour = (uint8_t)time.tm_hour;
+        metadata.day = (uint8_t)time.tm_mday;
+        metadata.month = (uint8_t)time.tm_mon;
+        metadata.year = (uint8_t)time.tm_year;
+        if (patient != nullptr) {
+            metadata.flags |= SessionMetadata::FLAG_PATIENT;
+            metadata.patient[0] = patient[0];
+            metadata.patient[1] = patient[1];
+        }
+        return metadata;
+    }
+
+    /**
+     * @brief Build the frame sent at the start of a recording.
+     * @param metadata Session metadata.
+     * @param[out] out Destination, ModemPacket::encodedSize(SessionMetadata::SIZE) bytes.
+     * @param outSize Size of out.
+     * @return Bytes written, 0 when out is too small.
+     */
+    static size_t encodeSessionMetadata(const SessionMetadata &metadata, uint8_t *out, size_t outSize) {
+        uint8_t payload[SessionMetadata::SIZE];
+        metadata.serialize(payload);
+        return ModemPacket::encode(ModemPacket::Type::SessionMetadata, payload, sizeof(payload), out, outSize);
+    }
+
+    /**
+     * @brief Build a timestamp beacon frame.
+     * @param beacon Beacon fields.
+     * @param[out] out Destination, ModemPacket::encodedSize(BeaconPayload::SIZE) bytes.
+     * @param outSize Size of out.
+     * @return Bytes written, 0 when out is too small.
+     */
+    static size_t encodeBeacon(const BeaconPayload &beacon, uint8_t *out, size_t outSize) {
+        uint8_t payload[BeaconPayload::SIZE];
+        beacon.serialize(payload);
+        return ModemPacket::encode(ModemPacket::Type::Beacon, payload, sizeof(payload), out, outSize);
+    }
+
+    const MfskTonePlan &getTonePlan() const { return plan; }
+
+    /**
+     * @brief Samples of the burst of a frame.
+     * @param bytes Frame length in bytes.
+     */
+    size_t sampleCount(size_t bytes) const { return modulator.sampleCount(bytes); }
+
+    /**
+     * @brief Add the burst of a frame to a PCM buffer.
+     * @param frame Frame bytes, as passed to AudioModem::transmitFrame().
+     * @param length Frame length.
+     * @param amplitude Peak amplitude.
+     * @param[in,out] samples At least sampleCount(length) samples, added to.
+     * @return Samples written.
+     */
+    size_t modulate(const uint8_t *frame, size_t length, float amplitude, float *samples) const {
+        return modulator.modulate(frame, length, amplitude, samples);
+    }
+
+    /**
+     * @brief Samples decodeAt() reads from a burst edge on.
+     */
+    size_t acquisitionSamples() const {
+        return demodulator.getSymbolSamples() + modulator.sampleCount(SCAN_BYTES);
+    }
+
+    /**
+     * @brief Decode the packet of a burst found near a sample.
+     *
+     * The edge can be early when noise rose with the burst, or late when
+     * the burst is weak, so the symbol grid is found from the tones. The demodulator skips 1/8 symbol at both
+     * symbol edges, a start within 1/16 symbol of the grid decodes, and the
+     * neighbours at that distance are tried as well.
+     * @param samples Recording.
+     * @param available Samples in the recording, acquisitionSamples() after edge decode a metadata packet.
+     * @param edge Rough start of the burst.
+     * @param[out] out Decoded packet.
+     * @param[out] packetStart Sample where the preamble starts, may be nullptr.
+     * @return ModemPacket::Status::Ok, or why the burst did not decode.
+     */
+    ModemPacket::Status decodeAt(const float *samples, size_t available, size_t edge, ModemPacket::Decoded &out,
+                                 size_t *packetStart = nullptr) const {
+        size_t symbolSamples = demodulator.getSymbolSamples();
+        size_t aligned = demodulator.alignSymbols(samples, available, edge);
+        // In noise the edge can also be late, demodulation starts a few symbols
+        // earlier and the packet decoder skips the noise before the preamble
+        size_t early = aligned / symbolSamples < LATE_SYMBOLS ? aligned / symbolSamples : LATE_SYMBOLS;
+        aligned -= early * symbolSamples;
+        long nudge = (long)symbolSamples / 16;
+        ModemPacket::Status status = ModemPacket::Status::NoPreamble;
+        for (long offset : {0L, -nudge, nudge}) {
+            size_t start = (long)aligned + offset > 0 ? (size_t)((long)aligned + offset) : 0;
+            uint8_t frame[SCAN_BYTES];
+            size_t bytes = demodulator.demodulate(samples, available, start, frame, sizeof(frame));
+            status = ModemPacket::decode(frame, bytes * 8, out);
+            if (status != ModemPacket::Status::Ok) {
+                continue;
+            }
+            if (packetStart != nullptr) {
+                // Symbols before the preamble were noise, which also spoils the
+                // timing estimate. The grid is found again where the packet starts.
+                size_t first = start + out.startBit / plan.getBitsPerSymbol() * symbolSamples;
+                *packetStart = first == start ? start : demodulator.alignSymbols(samples, available, first);
+            }
+            break;
+        }
+        return status;
+    }
+
+    /**
+     * @brief Find the first burst in a recording that decodes.
+     * @param samples Recording.
+     * @param count Samples in the recording.
+     * @param[out] out Decoded packet.
+     * @param[out] packetStart Sample where the preamble starts, may be nullptr.
+     * @param minimumDb Lowest tone amplitude in dBFS that starts a burst.
+     * @param riseDb Rise over the noise floor that starts a burst.
+     * @return ModemPacket::Status::Ok, or NoPreamble when no burst decoded.
+     */
+    ModemPacket::Status decode(const float *samples, size_t count, ModemPacket::Decoded &out,
+                               size_t *packetStart = nullptr, float minimumDb = DEFAULT_MINIMUM_DB,
+                               float riseDb = DEFAULT_RISE_DB) const {
+        MfskBurstDetector detector(demodulator, minimumDb, riseDb);
+        for (size_t position = 0; position + detector.getBlock() <= count; position += detector.getStride()) {
+            if (detector.update(samples + position) &&
+                decodeAt(samples, count, position, out, packetStart) == ModemPacket::Status::Ok) {
+                return ModemPacket::Status::Ok;
+            }
+        }
+        return ModemPacket::Status::NoPreamble;
+    }
+
+    const MfskDemodulator &getDemodulator() const { return demodulator; }
+
+private:
+    static constexpr size_t LATE_SYMBOLS = 2; ///< Symbols demodulated before the found edge, SCAN_BYTES leaves room
+
+    MfskTonePlan plan;
+    MfskModulator modulator;
+    MfskDemodulator demodulator;
+};
+
+#endif // MODEM_CODEC_HPP
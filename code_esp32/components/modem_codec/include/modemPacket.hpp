@@ -0,0 +1,420 @@
+/**
+ * @file modemPacket.hpp
+ * @brief Versioned audio modem packet with preamble, length, CRC-16 and FEC.
+ *
+ * On air a packet is a bit stream, LSB first per byte like AudioModem sends it:
+ *
+ * | Part     | Bits        | Content                                              |
+ * |----------|-------------|------------------------------------------------------|
+ * | Preamble | 16          | Barker-13 followed by three 0 bits                   |
+ * | Header   | 32          | version/type byte and length byte, FEC coded         |
+ * | Body     | 16 * (n+2)  | n payload bytes and the CRC-16 (low byte first), FEC |
+ *
+ * The CRC-16/CCITT-FALSE covers the version/type byte, the length and the
+ * payload. Every nibble is sent as an extended Hamming (8,4) code word, which
+ * corrects one bit and detects two bit errors per code word. Header and body
+ * are each block interleaved, bit k of a block carries bit k / N of code word
+ * k % N, so a burst of up to N wrong bits hits every code word only once.
+ *
+ * The encoder writes into a caller supplied buffer and never allocates. The
+ * file only depends on the C++ standard library, so the decoder also runs on
+ * the host.
+ */
+
+#ifndef MODEM_PACKET_HPP
+#define MODEM_PACKET_HPP
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace modemPacketDetail {
+
+/** @brief Decode table entry: nibble in the low 4 bits, or one of these flags. */
+constexpr uint8_t CORRECTED = 0x10;
+constexpr uint8_t UNCORRECTABLE = 0x80;
+
+/** @brief Extended Hamming (8,4) code word of a nibble, layout p1 p2 d1 p3 d2 d3 d4 p0. */
+constexpr uint8_t hammingEncode(uint8_t nibble) {
+    uint8_t d1 = nibble & 1, d2 = (nibble >> 1) & 1, d3 = (nibble >> 2) & 1, d4 = (nibble >> 3) & 1;
+    uint8_t p1 = d1 ^ d2 ^ d4, p2 = d1 ^ d3 ^ d4, p3 = d2 ^ d3 ^ d4;
+    uint8_t word = (uint8_t)(p1 | p2 << 1 | d1 << 2 | p3 << 3 | d2 << 4 | d3 << 5 | d4 << 6);
+    uint8_t p0 = p1 ^ p2 ^ d1 ^ p3 ^ d2 ^ d3 ^ d4;
+    return (uint8_t)(word | p0 << 7);
+}
+
+constexpr int popCount(uint8_t value) {
+    int count = 0;
+    for (; value != 0; value &= (uint8_t)(value - 1)) {
+        count++;
+    }
+    return count;
+}
+
+/** @brief Nearest code word for every received byte, built at compile time. */
+constexpr std::array<uint8_t, 256> makeDecodeTable() {
+    std::array<uint8_t, 256> table = {};
+    for (int received = 0; received < 256; received++) {
+        uint8_t entry = UNCORRECTABLE;
+        for (uint8_t nibble = 0; nibble < 16; nibble++) {
+            int distance = popCount((uint8_t)(received ^ hammingEncode(nibble)));
+            if (distance == 0) {
+                entry = nibble;
+            } else if (distance == 1) {
+                entry = nibble | CORRECTED;
+            }
+        }
+        table[received] = entry;
+    }
+    return table;
+}
+
+inline constexpr std::array<uint8_t, 256> DECODE_TABLE = makeDecodeTable();
+
+} // namespace modemPacketDetail
+
+/**
+ * @class ModemPacket
+ * @brief Encoder and decoder of the audio modem packet format.
+ */
+class ModemPacket {
+public:
+    static constexpr uint8_t VERSION = 1;           ///< Format version, upper nibble of the first header byte
+    static constexpr size_t MAX_PAYLOAD = 64;       ///< Largest payload in bytes
+    static constexpr size_t PREAMBLE_BITS = 16;
+    static constexpr size_t BARKER_BITS = 13;
+    static constexpr uint16_t PREAMBLE = 0x159F;    ///< Barker-13 1111100110101, bit 0 is sent first
+    static constexpr uint32_t MAX_PREAMBLE_ERRORS = 1; ///< Wrong Barker bits still accepted as a preamble
+    static constexpr size_t HEADER_BITS = 2 * 2 * 8;
+
+    /** @brief Payload type, lower nibble of the first header byte. */
+    enum class Type : uint8_t {
+        SessionMetadata = 1,
+        Beacon = 2,
+        Config = 3,             ///< Configuration upload to the device, see configPacket.hpp
+    };
+
+    /** @brief Result of decode(). */
+    enum class Status : uint8_t {
+        Ok,
+        NoPreamble,   ///< No preamble found in the bit stream
+        BadHeader,    ///< Preamble found but the header was uncorrectable or invalid
+        Truncated,    ///< The bit stream ends inside the packet
+        BadCrc,       ///< Body uncorrectable or CRC mismatch
+    };
+
+    /**
+     * @struct Decoded
+     * @brief A received packet.
+     */
+    struct Decoded {
+        uint8_t version;
+        Type type;
+        uint8_t length;                  ///< Payload bytes
+        uint8_t payload[MAX_PAYLOAD];
+        size_t startBit;                 ///< Bit position of the preamble in the stream
+        size_t endBit;                   ///< First bit after the packet
+        uint32_t correctedBits;          ///< Bit errors corrected by the FEC
+    };
+
+    /**
+     * @brief Encoded size of a packet in bytes.
+     * @param payloadLength Payload bytes.
+     */
+    static constexpr size_t encodedSize(size_t payloadLength) {
+        return PREAMBLE_BITS / 8 + HEADER_BITS / 8 + 2 * (payloadLength + 2);
+    }
+
+    static constexpr size_t MAX_ENCODED_SIZE = PREAMBLE_BITS / 8 + HEADER_BITS / 8 + 2 * (MAX_PAYLOAD + 2);
+
+    /**
+     * @brief CRC-16/CCITT-FALSE, polynomial 0x1021.
+     * @param data Bytes to include.
+     * @param length Number of bytes.
+     * @param crc Value of the previous call when the data is split.
+     */
+    static uint16_t crc16(const uint8_t *data, size_t length, uint16_t crc = 0xFFFF) {
+        for (size_t i = 0; i < length; i++) {
+            crc ^= (uint16_t)data[i] << 8;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+            }
+        }
+        return crc;
+    }
+
+    /**
+     * @brief Encode a packet.
+     * @param type Payload type.
+     * @param payload Payload bytes.
+     * @param length Number of payload bytes, at most MAX_PAYLOAD.
+     * @param out Destination, bytes in the order AudioModem sends them.
+     * @param outSize Size of out, at least encodedSize(length).
+     * @return Bytes written, 0 when the payload is too long or out too small.
+     */
+    static size_t encode(Type type, const uint8_t *payload, size_t length, uint8_t *out, size_t outSize) {
+        size_t total = encodedSize(length);
+        if (length > MAX_PAYLOAD || outSize < total) {
+            return 0;
+        }
+        memset(out, 0, total);
+        out[0] = (uint8_t)(PREAMBLE & 0xFF);
+        out[1] = (uint8_t)(PREAMBLE >> 8);
+
+        uint8_t header[2] = {(uint8_t)((VERSION << 4) | ((uint8_t)type & 0x0F)), (uint8_t)length};
+        uint16_t crc = crc16(payload, length, crc16(header, 2));
+
+        uint8_t *block = out + PREAMBLE_BITS / 8;
+        size_t blockCodeWords = 4;
+        for (size_t i = 0; i < 2; i++) {
+            putByte(block, blockCodeWords, 2 * i, header[i]);
+        }
+
+        block += blockCodeWords;
+        blockCodeWords = 2 * (length + 2);
+        for (size_t i = 0; i < length; i++) {
+            putByte(block, blockCodeWords, 2 * i, payload[i]);
+        }
+        putByte(block, blockCodeWords, 2 * length, (uint8_t)(crc & 0xFF));
+        putByte(block, blockCodeWords, 2 * length + 2, (uint8_t)(crc >> 8));
+        return total;
+    }
+
+    /**
+     * @brief Find and decode the first valid packet in a bit stream.
+     *
+     * Every position where the preamble matches is tried, so a false preamble
+     * in noise or in a corrupted packet does not hide a later packet.
+     * @param bits Received bits, LSB first per byte.
+     * @param bitCount Number of valid bits in the stream.
+     * @param[out] packet Filled in when the result is Status::Ok.
+     * @param startBit First bit to search from.
+     * @return Status::Ok, or the reason of the last candidate that failed.
+     */
+    static Status decode(const uint8_t *bits, size_t bitCount, Decoded &packet, size_t startBit = 0) {
+        Status result = Status::NoPreamble;
+        for (size_t position = startBit; position + PREAMBLE_BITS <= bitCount; position++) {
+            if (preambleErrors(bits, position) > MAX_PREAMBLE_ERRORS) {
+                continue;
+            }
+            Status status = decodeAt(bits, bitCount, position, packet);
+            if (status == Status::Ok) {
+                return status;
+            }
+            result = status;
+        }
+        return result;
+    }
+
+private:
+    static bool getBit(const uint8_t *data, size_t index) {
+        return (data[index >> 3] >> (index & 7)) & 1;
+    }
+
+    static void setBit(uint8_t *data, size_t index) {
+        data[index >> 3] |= (uint8_t)(1 << (index & 7));
+    }
+
+    /**
+     * @brief Write a byte as two interleaved code words.
+     * @param block First byte of the interleaved block.
+     * @param codeWords Code words in the block.
+     * @param word Index of the code word of the low nibble.
+     * @param value Byte to write.
+     */
+    static void putByte(uint8_t *block, size_t codeWords, size_t word, uint8_t value) {
+        uint8_t words[2] = {modemPacketDetail::hammingEncode(value & 0x0F), modemPacketDetail::hammingEncode(value >> 4)};
+        for (size_t w = 0; w < 2; w++) {
+            for (size_t bit = 0; bit < 8; bit++) {
+                if ((words[w] >> bit) & 1) {
+                    setBit(block, bit * codeWords + word + w);
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Read a byte back from an interleaved block in a bit stream.
+     * @param bits Received bit stream.
+     * @param blockStart Bit position of the block.
+     * @param codeWords Code words in the block.
+     * @param word Index of the code word of the low nibble.
+     * @param[out] value Decoded byte.
+     * @param[in,out] corrected Incremented for every corrected bit.
+     * @return false when a code word is uncorrectable.
+     */
+    static bool getByte(const uint8_t *bits, size_t blockStart, size_t codeWords, size_t word, uint8_t &value,
+                        uint32_t &corrected) {
+        value = 0;
+        for (size_t w = 0; w < 2; w++) {
+            uint8_t received = 0;
+            for (size_t bit = 0; bit < 8; bit++) {
+                received |= (uint8_t)(getBit(bits, blockStart + bit * codeWords + word + w) << bit);
+            }
+            uint8_t entry = modemPacketDetail::DECODE_TABLE[received];
+            if (entry & modemPacketDetail::UNCORRECTABLE) {
+                return false;
+            }
+            if (entry & modemPacketDetail::CORRECTED) {
+                corrected++;
+            }
+            value |= (uint8_t)((entry & 0x0F) << (4 * w));
+        }
+        return true;
+    }
+
+    static uint32_t preambleErrors(const uint8_t *bits, size_t position) {
+        uint32_t errors = 0;
+        for (size_t i = 0; i < BARKER_BITS; i++) {
+            errors += getBit(bits, position + i) != (bool)((PREAMBLE >> i) & 1);
+        }
+        return errors;
+    }
+
+    static Status decodeAt(const uint8_t *bits, size_t bitCount, size_t position, Decoded &packet) {
+        size_t headerStart = position + PREAMBLE_BITS;
+        if (headerStart + HEADER_BITS > bitCount) {
+            return Status::Truncated;
+        }
+        uint32_t corrected = 0;
+        uint8_t header[2];
+        for (size_t i = 0; i < 2; i++) {
+            if (!getByte(bits, headerStart, 4, 2 * i, header[i], corrected)) {
+                return Status::BadHeader;
+            }
+        }
+        if ((header[0] >> 4) != VERSION || header[1] > MAX_PAYLOAD) {
+            return Status::BadHeader;
+        }
+
+        size_t length = header[1];
+        size_t codeWords = 2 * (length + 2);
+        size_t bodyStart = headerStart + HEADER_BITS;
+        if (bodyStart + 8 * codeWords > bitCount) {
+            return Status::Truncated;
+        }
+        for (size_t i = 0; i < length; i++) {
+            if (!getByte(bits, bodyStart, codeWords, 2 * i, packet.payload[i], corrected)) {
+                return Status::BadCrc;
+            }
+        }
+        uint8_t crcLow, crcHigh;
+        if (!getByte(bits, bodyStart, codeWords, 2 * length, crcLow, corrected) ||
+            !getByte(bits, bodyStart, codeWords, 2 * length + 2, crcHigh, corrected)) {
+            return Status::BadCrc;
+        }
+        if (crc16(packet.payload, length, crc16(header, 2)) != (uint16_t)(crcLow | crcHigh << 8)) {
+            return Status::BadCrc;
+        }
+
+        packet.version = header[0] >> 4;
+        packet.type = (Type)(header[0] & 0x0F);
+        packet.length = (uint8_t)length;
+        packet.startBit = position;
+        packet.endBit = bodyStart + 8 * codeWords;
+        packet.correctedBits = corrected;
+        return Status::Ok;
+    }
+};
+
+/**
+ * @struct SessionMetadata
+ * @brief Payload of a Type::SessionMetadata packet, sent when a recording starts.
+ */
+struct SessionMetadata {
+    static constexpr size_t SIZE = 10;            ///< Bytes on air
+    static constexpr uint8_t FLAG_PATIENT = 0x01; ///< patient holds a scanned patient number
+
+    uint16_t sessionId;
+    uint8_t minute;     ///< tm_min
+    uint8_t hour;       ///< tm_hour
+    uint8_t day;        ///< tm_mday
+    uint8_t month;      ///< tm_mon, 0 is January
+    uint8_t year;       ///< tm_year, years since 1900
+    uint8_t flags;
+    uint8_t patient[2]; ///< First two bytes of the scanned code
+
+    /**
+     * @brief Write the payload, multi-byte fields low byte first.
+     * @param out Destination of SIZE bytes.
+     */
+    void serialize(uint8_t *out) const {
+        out[0] = (uint8_t)(sessionId & 0xFF);
+        out[1] = (uint8_t)(sessionId >> 8);
+        out[2] = minute;
+        out[3] = hour;
+        out[4] = day;
+        out[5] = month;
+        out[6] = year;
+        out[7] = flags;
+        out[8] = patient[0];
+        out[9] = patient[1];
+    }
+
+    /**
+     * @brief Read a payload written by serialize().
+     * @param in Payload bytes.
+     * @param length Payload length, longer payloads of a newer version are accepted.
+     * @return false when the payload is too short.
+     */
+    bool deserialize(const uint8_t *in, size_t length) {
+        if (length < SIZE) {
+            return false;
+        }
+        sessionId = (uint16_t)(in[0] | in[1] << 8);
+        minute = in[2];
+        hour = in[3];
+        day = in[4];
+        month = in[5];
+        year = in[6];
+        flags = in[7];
+        patient[0] = in[8];
+        patient[1] = in[9];
+        return true;
+    }
+};
+
+/**
+ * @struct BeaconPayload
+ * @brief Payload of a Type::Beacon packet, sent periodically while recording.
+ */
+struct BeaconPayload {
+    static constexpr size_t SIZE = 8; ///< Bytes on air
+
+    uint16_t sessionId;   ///< Same as in the SessionMetadata of the recording
+    uint16_t sequence;    ///< 0 for the first beacon of a session
+    uint32_t elapsedMs;   ///< Monotonic time since the recording started
+
+    /**
+     * @brief Write the payload, multi-byte fields low byte first.
+     * @param out Destination of SIZE bytes.
+     */
+    void serialize(uint8_t *out) const {
+        out[0] = (uint8_t)(sessionId & 0xFF);
+        out[1] = (uint8_t)(sessionId >> 8);
+        out[2] = (uint8_t)(sequence & 0xFF);
+        out[3] = (uint8_t)(sequence >> 8);
+        for (int i = 0; i < 4; i++) {
+            out[4 + i] = (uint8_t)(elapsedMs >> (8 * i));
+        }
+    }
+
+    /**
+     * @brief Read a payload written by serialize().
+     * @param in Payload bytes.
+     * @param length Payload length.
+     * @return false when the payload is too short.
+     */
+    bool deserialize(const uint8_t *in, size_t length) {
+        if (length < SIZE) {
+            return false;
+        }
+        sessionId = (uint16_t)(in[0] | in[1] << 8);
+        sequence = (uint16_t)(in[2] | in[3] << 8);
+        elapsedMs = (uint32_t)in[4] | (uint32_t)in[5] << 8 | (uint32_t)in[6] << 16 | (uint32_t)in[7] << 24;
+        return true;
+    }
+};
+
+#endif // MODEM_PACKET_HPP
@@ -0,0 +1,235 @@
+/**
+ * @file modemReceiver.hpp
+ * @brief Streaming modem receiver for live audio, fed in small chunks as the ADC delivers them.
+ *
+ * ModemCodec::decode() needs the whole recording in memory. A device that
+ * listens for a packet keeps only a short window instead:
+ * - Idle: one Goertzel block per half symbol goes through MfskBurstDetector,
+ *   a few multiplications per sample and tone
+ * - Acquiring: after an edge, the samples of the first symbols are kept
+ *   until MfskDemodulator::alignSymbols() can find the symbol grid
+ * - Receiving: every symbol is decided as soon as its samples are in and
+ *   then dropped. After each byte the packet decoder checks whether a whole
+ *   packet has arrived
+ *
+ * The caller provides the sample buffer, nothing here allocates.
+ */
+
+#ifndef MODEM_RECEIVER_HPP
+#define MODEM_RECEIVER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "modemCodec.hpp"
+
+/**
+ * @class ModemReceiver
+ * @brief Finds and decodes modem packets in a stream of samples.
+ */
+class ModemReceiver {
+public:
+    enum class State : uint8_t {
+        Idle,       ///< Waiting for a burst
+        Acquiring,  ///< Burst seen, collecting samples to find the symbol grid
+        Receiving,  ///< Deciding symbols
+    };
+
+    /**
+     * @brief Buffer size a receiver needs.
+     * @param codec Codec of the link.
+     * @return Samples: the history before an edge, the alignment window and one more symbol.
+     */
+    static size_t bufferSamples(const ModemCodec &codec) {
+        const MfskDemodulator &demodulator = codec.getDemodulator();
+        return (LATE_SYMBOLS + 2) * demodulator.getSymbolSamples() + demodulator.alignmentSamples();
+    }
+
+    /**
+     * @brief Constructs a receiver.
+     * @param codec Codec of the link, must outlive the receiver.
+     * @param buffer Sample buffer, at least bufferSamples(codec) samples.
+     * @param capacity Samples in buffer.
+     * @param payloadBytes Longest payload expected, bounds how long a burst is followed.
+     * @param minimumDb Lowest tone amplitude in dBFS that starts a burst.
+     * @param riseDb Rise over the noise floor that starts a burst.
+     */
+    ModemReceiver(const ModemCodec &codec, float *buffer, size_t capacity, size_t payloadBytes,
+                  float minimumDb = ModemCodec::DEFAULT_MINIMUM_DB, float riseDb = ModemCodec::DEFAULT_RISE_DB)
+        : demodulator(codec.getDemodulator()), detector(demodulator, minimumDb, riseDb),
+          bitsPerSymbol(codec.getTonePlan().getBitsPerSymbol()), buffer(buffer), capacity(capacity),
+          frameBytes(ModemPacket::encodedSize(payloadBytes) + 2 < sizeof(frame)
+                         ? ModemPacket::encodedSize(payloadBytes) + 2
+                         : sizeof(frame)),
+          searchBits((LATE_SYMBOLS + 1) * bitsPerSymbol + ModemPacket::PREAMBLE_BITS), fill(0), origin(0), scan(0),
+          edge(0), start(0), symbol(0), bits(0), bitCount(0), bytes(0), state(State::Idle), ready(false), failures(0) {}
+
+    /**
+     * @brief Feed samples.
+     * @param samples New samples, full scale is +-1.
+     * @param count Number of samples.
+     * @return True when a packet is ready, take it with takePacket().
+     */
+    bool push(const float *samples, size_t count) {
+        while (count > 0) {
+            if (fill == capacity) {
+                discard();
+            }
+            size_t take = capacity - fill < count ? capacity - fill : count;
+            memcpy(buffer + fill, samples, take * sizeof(float));
+            fill += take;
+            samples += take;
+            count -= take;
+            process();
+        }
+        return ready;
+    }
+
+    /**
+     * @brief Take the last packet received.
+     * @param[out] out The packet.
+     * @return False when no packet arrived since the last call.
+     */
+    bool takePacket(ModemPacket::Decoded &out) {
+        if (!ready) {
+            return false;
+        }
+        out = packet;
+        ready = false;
+        return true;
+    }
+
+    /**
+     * @brief Forget the stream, for a new one that does not continue the last samples.
+     */
+    void reset() {
+        fill = 0;
+        origin = 0;
+        scan = 0;
+        state = State::Idle;
+        ready = false;
+    }
+
+    State getState() const { return state; }
+
+    /** @brief Bursts that were followed but did not decode. */
+    uint32_t getFailures() const { return failures; }
+
+private:
+    static constexpr size_t LATE_SYMBOLS = 2; ///< Symbols demodulated before the found edge, like ModemCodec
+
+    const MfskDemodulator &demodulator;
+    MfskBurstDetector detector;
+    uint8_t bitsPerSymbol;
+    float *buffer;
+    size_t capacity;
+    uint8_t frame[ModemPacket::MAX_ENCODED_SIZE];
+    size_t frameBytes;    ///< Bytes demodulated before a burst is given up
+    size_t searchBits;    ///< Bits by which the preamble must have started
+    size_t fill;          ///< Samples in buffer
+    uint64_t origin;      ///< Stream position of buffer[0]
+    uint64_t scan;        ///< Stream position of the next detector block
+    uint64_t edge;        ///< Stream position of the burst edge
+    uint64_t start;       ///< Stream position of symbol 0
+    size_t symbol;        ///< Next symbol to decide
+    uint32_t bits;
+    uint8_t bitCount;
+    size_t bytes;
+    State state;
+    bool ready;
+    ModemPacket::Decoded packet;
+    uint32_t failures;
+
+    /** @brief Decide what the buffer holds until it runs out of samples. */
+    void process() {
+        size_t symbolSamples = demodulator.getSymbolSamples();
+        while (true) {
+            uint64_t end = origin + fill;
+            if (state == State::Idle) {
+                if (scan + detector.getBlock() > end) {
+                    return;
+                }
+                if (scan >= origin && detector.update(buffer + (scan - origin))) {
+                    edge = scan;
+                    state = State::Acquiring;
+                }
+                scan += detector.getStride();
+            } else if (state == State::Acquiring) {
+                if (edge + demodulator.alignmentSamples() > end) {
+                    return;
+                }
+                uint64_t aligned = origin + demodulator.alignSymbols(buffer, fill, (size_t)(edge - origin));
+                // A late edge would cut the preamble, the packet decoder skips the noise before it
+                uint64_t early = (aligned - origin) / symbolSamples < LATE_SYMBOLS ? (aligned - origin) / symbolSamples
+                                                                                  : LATE_SYMBOLS;
+                start = aligned - early * symbolSamples;
+                symbol = 0;
+                bits = 0;
+                bitCount = 0;
+                bytes = 0;
+                state = State::Receiving;
+            } else {
+                uint64_t begin = start + demodulator.symbolStart(symbol);
+                uint64_t next = start + demodulator.symbolStart(symbol + 1);
+                if (next > end) {
+                    return;
+                }
+                size_t guard = (size_t)(next - begin) / 8;
+                bits |= (uint32_t)demodulator.detectSymbol(buffer + (begin - origin) + guard,
+                                                           (size_t)(next - begin) - 2 * guard)
+                        << bitCount;
+                bitCount += bitsPerSymbol;
+                symbol++;
+                while (bitCount >= 8 && state == State::Receiving) {
+                    frame[bytes++] = (uint8_t)bits;
+                    bits >>= 8;
+                    bitCount -= 8;
+                    ModemPacket::Status status = ModemPacket::decode(frame, bytes * 8, packet);
+                    if (status == ModemPacket::Status::Ok) {
+                        ready = true;
+                        finish(next);
+                    } else if (bytes == frameBytes ||
+                               (status == ModemPacket::Status::NoPreamble && bytes * 8 >= searchBits)) {
+                        // A click or a hum starts a burst too, without a preamble it is dropped early
+                        failures++;
+                        finish(next);
+                    }
+                }
+            }
+        }
+    }
+
+    /** @brief Back to listening from a stream position on. */
+    void finish(uint64_t position) {
+        state = State::Idle;
+        scan = position > scan ? position : scan;
+    }
+
+    /** @brief Drop the samples that are no longer needed to make room. */
+    void discard() {
+        size_t symbolSamples = demodulator.getSymbolSamples();
+        size_t history = LATE_SYMBOLS * symbolSamples + symbolSamples / 2;
+        uint64_t keep;
+        if (state == State::Idle) {
+            keep = scan > history ? scan - history : 0;
+        } else if (state == State::Acquiring) {
+            keep = edge > history ? edge - history : 0;
+        } else {
+            keep = start + demodulator.symbolStart(symbol);
+        }
+        keep = keep < origin ? origin : keep;
+        size_t drop = (size_t)(keep - origin);
+        if (drop == 0) {
+            // The buffer is smaller than bufferSamples(), give up the burst
+            failures += state != State::Idle;
+            state = State::Idle;
+            drop = fill;
+            scan = origin + fill;
+        }
+        memmove(buffer, buffer + drop, (fill - drop) * sizeof(float));
+        fill -= drop;
+        origin += drop;
+    }
+};
+
+#endif // MODEM_RECEIVER_HPP
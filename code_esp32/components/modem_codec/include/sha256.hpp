@@ -0,0 +1,171 @@
+/**
+ * @file sha256.hpp
+ * @brief SHA-256 and HMAC-SHA256 (FIPS 180-4, RFC 2104) for authenticating modem packets.
+ *
+ * Written out here so the firmware, the host tools and the host tests sign
+ * and check configuration packets with the same code. A packet is a few
+ * dozen bytes, speed does not matter. Only the C++ standard library is
+ * needed, nothing allocates.
+ */
+
+#ifndef SHA256_HPP
+#define SHA256_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @class Sha256
+ * @brief Incremental SHA-256.
+ */
+class Sha256 {
+public:
+    static constexpr size_t DIGEST_SIZE = 32;
+    static constexpr size_t BLOCK_SIZE = 64;
+
+    Sha256() { reset(); }
+
+    /** @brief Start a new message. */
+    void reset() {
+        static constexpr uint32_t INITIAL[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                                0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+        memcpy(state, INITIAL, sizeof(state));
+        length = 0;
+        used = 0;
+    }
+
+    /**
+     * @brief Append message bytes.
+     * @param data Bytes.
+     * @param size Number of bytes.
+     */
+    void update(const uint8_t *data, size_t size) {
+        length += size;
+        while (size > 0) {
+            size_t take = BLOCK_SIZE - used < size ? BLOCK_SIZE - used : size;
+            memcpy(block + used, data, take);
+            used += take;
+            data += take;
+            size -= take;
+            if (used == BLOCK_SIZE) {
+                compress();
+                used = 0;
+            }
+        }
+    }
+
+    /**
+     * @brief Pad the message and write the digest, the object must be reset() before reuse.
+     * @param[out] digest DIGEST_SIZE bytes.
+     */
+    void finish(uint8_t *digest) {
+        uint64_t bits = length * 8;
+        uint8_t pad = 0x80;
+        update(&pad, 1);
+        pad = 0;
+        while (used != BLOCK_SIZE - 8) {
+            update(&pad, 1);
+        }
+        uint8_t size[8];
+        for (int i = 0; i < 8; i++) {
+            size[i] = (uint8_t)(bits >> (56 - 8 * i));
+        }
+        update(size, sizeof(size));
+        for (int i = 0; i < 8; i++) {
+            for (int j = 0; j < 4; j++) {
+                digest[4 * i + j] = (uint8_t)(state[i] >> (24 - 8 * j));
+            }
+        }
+    }
+
+private:
+    uint32_t state[8];
+    uint64_t length;          ///< Message bytes so far
+    uint8_t block[BLOCK_SIZE];
+    size_t used;              ///< Bytes in block
+
+    static uint32_t rotate(uint32_t value, int bits) { return value >> bits | value << (32 - bits); }
+
+    void compress() {
+        static constexpr uint32_t K[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+        };
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 | (uint32_t)block[4 * i + 2] << 8 |
+                   block[4 * i + 3];
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotate(w[i - 15], 7) ^ rotate(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotate(w[i - 2], 17) ^ rotate(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = h + (rotate(e, 6) ^ rotate(e, 11) ^ rotate(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+            uint32_t t2 = (rotate(a, 2) ^ rotate(a, 13) ^ rotate(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+};
+
+/**
+ * @brief HMAC-SHA256 of a message.
+ * @param key Key bytes, keys longer than a block are hashed first.
+ * @param keySize Key length.
+ * @param data Message.
+ * @param size Message length.
+ * @param[out] mac Sha256::DIGEST_SIZE bytes.
+ */
+inline void hmacSha256(const uint8_t *key, size_t keySize, const uint8_t *data, size_t size, uint8_t *mac) {
+    uint8_t pad[Sha256::BLOCK_SIZE] = {};
+    Sha256 hash;
+    if (keySize > Sha256::BLOCK_SIZE) {
+        hash.update(key, keySize);
+        hash.finish(pad);
+        hash.reset();
+    } else {
+        memcpy(pad, key, keySize);
+    }
+    for (uint8_t &byte : pad) {
+        byte ^= 0x36;
+    }
+    uint8_t inner[Sha256::DIGEST_SIZE];
+    hash.update(pad, sizeof(pad));
+    hash.update(data, size);
+    hash.finish(inner);
+
+    for (uint8_t &byte : pad) {
+        byte ^= 0x36 ^ 0x5c;
+    }
+    hash.reset();
+    hash.update(pad, sizeof(pad));
+    hash.update(inner, sizeof(inner));
+    hash.finish(mac);
+}
+
+#endif // SHA256_HPP
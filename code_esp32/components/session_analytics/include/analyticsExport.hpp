@@ -0,0 +1,148 @@
+/**
+ * @file analyticsExport.hpp
+ * @brief Streams a finished session as COBS framed chunks.
+ *
+ * Every frame is COBS encoded and ends with a 0x00, before encoding it is:
+ *
+ * | Field | Bytes | Content                                               |
+ * |-------|-------|-------------------------------------------------------|
+ * | type  | 1     | Start, Data or End                                    |
+ * | index | 2     | Chunk number of a Data frame, 0 otherwise             |
+ * | body  | n     | Start: total bytes (u32), chunk size (u16)            |
+ * |       |       | Data: up to CHUNK_SIZE bytes of the session           |
+ * |       |       | End: total bytes (u32), CRC-32 of the session (u32)   |
+ * | crc   | 2     | CRC-16/CCITT-FALSE of type, index and body            |
+ *
+ * The chunks are encoded straight from the segments of AnalyticsWriter, so
+ * the only buffer is one encoded frame. A receiver that lost a frame knows
+ * which chunk is missing from the indices; the session CRC-32 in the End
+ * frame checks the reassembled whole.
+ */
+
+#ifndef ANALYTICS_EXPORT_HPP
+#define ANALYTICS_EXPORT_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include "analyticsFormat.hpp"
+#include "cobs.hpp"
+#include "modemPacket.hpp"
+
+/**
+ * @class AnalyticsExport
+ * @brief Turns the segments of a session into frames for a byte sink.
+ */
+class AnalyticsExport {
+public:
+    enum class FrameType : uint8_t { Start = 1, Data = 2, End = 3 };
+
+    static constexpr size_t CHUNK_SIZE = 240;
+    static constexpr size_t FRAME_SIZE = 3 + CHUNK_SIZE + 2;   ///< Largest frame before encoding
+    static constexpr size_t ENCODED_SIZE = CobsEncoder::encodedSize(FRAME_SIZE);
+
+    /**
+     * @brief Takes one encoded frame, delimiter included.
+     * @return false to stop the export.
+     */
+    using Sink = bool (*)(const uint8_t *data, size_t length, void *context);
+
+    AnalyticsExport(Sink sink, void *context) : sink(sink), context(context), cobs(buffer) {}
+
+    /**
+     * @brief Send one session.
+     *
+     * A lone 0x00 goes first, it ends whatever the receiver saw before the
+     * Start frame.
+     * @return Frames sent, 0 when the sink stopped the export.
+     */
+    size_t send(const AnalyticsWriter::Segment *segments, size_t count) {
+        uint32_t total = 0;
+        uint32_t crc = 0;
+        for (size_t s = 0; s < count; s++) {
+            total += (uint32_t)segments[s].length;
+            crc = analyticsCrc32(segments[s].data, segments[s].length, crc);
+        }
+        const uint8_t delimiter = 0;
+        if (!sink(&delimiter, 1, context)) {
+            return 0;
+        }
+
+        size_t frames = 0;
+        uint8_t start[6];
+        put32(start, total);
+        start[4] = CHUNK_SIZE & 0xFF;
+        start[5] = CHUNK_SIZE >> 8;
+        begin(FrameType::Start, 0);
+        put(start, sizeof(start));
+        if (!end()) {
+            return 0;
+        }
+        frames++;
+
+        size_t segment = 0;
+        size_t offset = 0;
+        for (uint16_t index = 0; (uint32_t)index * CHUNK_SIZE < total; index++) {
+            begin(FrameType::Data, index);
+            size_t left = CHUNK_SIZE;
+            while (left > 0 && segment < count) {
+                size_t take = segments[segment].length - offset;
+                take = take < left ? take : left;
+                put(segments[segment].data + offset, take);
+                offset += take;
+                left -= take;
+                if (offset == segments[segment].length) {
+                    segment++;
+                    offset = 0;
+                }
+            }
+            if (!end()) {
+                return 0;
+            }
+            frames++;
+        }
+
+        uint8_t finish[8];
+        put32(finish, total);
+        put32(finish + 4, crc);
+        begin(FrameType::End, 0);
+        put(finish, sizeof(finish));
+        if (!end()) {
+            return 0;
+        }
+        return frames + 1;
+    }
+
+private:
+    Sink sink;
+    void *context;
+    uint8_t buffer[ENCODED_SIZE] = {};
+    CobsEncoder cobs;
+    uint16_t frameCrc = 0xFFFF;
+
+    static void put32(uint8_t *out, uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            out[i] = (uint8_t)(value >> (8 * i));
+        }
+    }
+
+    void begin(FrameType type, uint16_t index) {
+        cobs.begin();
+        frameCrc = 0xFFFF;
+        const uint8_t head[3] = {(uint8_t)type, (uint8_t)(index & 0xFF), (uint8_t)(index >> 8)};
+        put(head, sizeof(head));
+    }
+
+    void put(const uint8_t *data, size_t length) {
+        frameCrc = ModemPacket::crc16(data, length, frameCrc);
+        cobs.put(data, length);
+    }
+
+    bool end() {
+        const uint8_t tail[2] = {(uint8_t)(frameCrc & 0xFF), (uint8_t)(frameCrc >> 8)};
+        cobs.put(tail, sizeof(tail));
+        size_t length = cobs.end();
+        return sink(buffer, length, context);
+    }
+};
+
+#endif // ANALYTICS_EXPORT_HPP
@@ -0,0 +1,434 @@
+/**
+ * @file analyticsFormat.hpp
+ * @brief Versioned columnar binary format of one recording session, and its encoder.
+ *
+ * A session is a timeline of analysis frames (250 ms by default). Each kind
+ * of data is a column of its own, so a reader takes only what it needs and a
+ * column is coded the way that suits its data:
+ *
+ * | Column | Content per entry                     | Coding                                        |
+ * |--------|---------------------------------------|-----------------------------------------------|
+ * | Vad    | run of frames with one VadState       | state change code, run length in Elias gamma  |
+ * | Level  | peak level in dB, max over levelFrames| blocks of 32: 16 bit base, 5 bit width, zigzag deltas |
+ * | Words  | words counted in one analysis window  | gamma of frame delta + 1, gamma of words + 1  |
+ * | Events | button press or fault                 | gamma of frame delta + 1, 4 bit type, 8 bit value |
+ *
+ * The frame delta of a window or event is the number of frames since the
+ * previous one of its column; the frame of an entry is the number of frames
+ * in the timeline when it was added. The timeline only holds the frames that
+ * were recorded, a pause of the recording is not in it.
+ *
+ * The VAD state code is one 0 bit for the expected change (silence to speech,
+ * anything else to silence) and 1 plus one bit choosing among the other two
+ * states. The first run stores its state in 2 bits.
+ *
+ * Layout, little endian: AnalyticsHeader, columnCount AnalyticsColumnEntry,
+ * the column data in directory order, each padded to a whole byte, and a
+ * CRC-32 (IEEE) of everything before it. A reader skips headerSize bytes of
+ * header and columns with an unknown id or coding, so both can grow.
+ *
+ * AnalyticsWriter keeps the columns in fixed buffers and never allocates.
+ * Every append is O(1), it is called from the audio task once per frame. The
+ * finished session is handed out as a list of segments over those buffers,
+ * so an export streams it without copying it together first.
+ */
+
+#ifndef ANALYTICS_FORMAT_HPP
+#define ANALYTICS_FORMAT_HPP
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "bitStream.hpp"
+
+/**
+ * @brief What one analysis frame held.
+ */
+enum class VadState : uint8_t {
+    Silence = 0,
+    Speech = 1,
+    Modem = 2,     ///< The modem was sending, the frame is not counted
+    Skipped = 3    ///< The frame was not analysed (scheduler overrun)
+};
+
+enum class AnalyticsColumnId : uint8_t {
+    Vad = 1,
+    Level = 2,
+    Words = 3,
+    Events = 4
+};
+
+enum class AnalyticsEventType : uint8_t {
+    Button = 1,   ///< value: ObserverId
+    Fault = 2     ///< value: recorder fault code
+};
+
+/**
+ * @struct AnalyticsHeader
+ * @brief Start of a session, 32 bytes.
+ */
+struct AnalyticsHeader {
+    char magic[4];            ///< "YODA"
+    uint8_t version;
+    uint8_t flags;            ///< FLAG_TRUNCATED
+    uint16_t headerSize;      ///< Bytes of this header, the directory follows
+    uint32_t sessionId;
+    uint32_t startTime;       ///< Unix time of the session start
+    uint32_t frameCount;      ///< Frames in the Vad column
+    uint16_t framePeriodMs;
+    uint8_t levelFrames;      ///< Frames per Level entry
+    uint8_t columnCount;
+    uint32_t dataSize;        ///< Bytes of directory and columns
+    uint8_t reserved[4];
+};
+
+/**
+ * @struct AnalyticsColumnEntry
+ * @brief Directory entry of one column, 12 bytes.
+ */
+struct AnalyticsColumnEntry {
+    uint8_t id;               ///< AnalyticsColumnId
+    uint8_t coding;           ///< Version of the coding of the column
+    uint16_t reserved;
+    uint32_t count;           ///< Entries, frames for the Vad column
+    uint32_t size;            ///< Bytes of column data
+};
+
+static_assert(sizeof(AnalyticsHeader) == 32, "AnalyticsHeader layout");
+static_assert(sizeof(AnalyticsColumnEntry) == 12, "AnalyticsColumnEntry layout");
+
+/**
+ * @brief Table driven CRC-32 (IEEE 802.3, as zlib), a nibble at a time.
+ * @param crc Result of the previous part, 0 to start.
+ */
+inline uint32_t analyticsCrc32(const uint8_t *data, size_t length, uint32_t crc = 0) {
+    static const uint32_t TABLE[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ TABLE[crc & 0x0F];
+        crc = (crc >> 4) ^ TABLE[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+/**
+ * @brief Expected next VAD state, coded with a single bit.
+ */
+inline VadState analyticsExpectedState(VadState previous) {
+    return previous == VadState::Silence ? VadState::Speech : VadState::Silence;
+}
+
+/**
+ * @class AnalyticsWriter
+ * @brief Encodes one session at a time into fixed column buffers.
+ *
+ * begin() opens a session, frame(), words() and event() append, finish()
+ * writes the open run and level block and builds header, directory and CRC.
+ * The buffers hold about two and a half hours of conversation; when the Vad or Level
+ * column runs out of room the session ends there, frames after it are
+ * dropped and the header is marked truncated. A full Words or Events column
+ * only drops those entries.
+ */
+class AnalyticsWriter {
+public:
+    static constexpr char MAGIC[4] = {'Y', 'O', 'D', 'A'};
+    static constexpr uint8_t VERSION = 1;
+    static constexpr uint8_t CODING = 1;
+    static constexpr uint8_t FLAG_TRUNCATED = 0x01;
+    static constexpr size_t COLUMN_COUNT = 4;
+    static constexpr size_t LEVEL_BLOCK = 32;   ///< Level entries per block
+
+    // An hour of conversation takes about 1.6 KB of VAD, 3.2 KB of level and 0.2 KB of words
+    static constexpr size_t VAD_CAPACITY = 4096;
+    static constexpr size_t LEVEL_CAPACITY = 8192;
+    static constexpr size_t WORDS_CAPACITY = 512;
+    static constexpr size_t EVENTS_CAPACITY = 256;
+
+    /// Header, directory, the columns and the CRC
+    static constexpr size_t SEGMENT_COUNT = 2 + COLUMN_COUNT + 1;
+
+    struct Segment {
+        const uint8_t *data;
+        size_t length;
+    };
+
+    AnalyticsWriter()
+        : columns{BitWriter(vadData, VAD_CAPACITY), BitWriter(levelData, LEVEL_CAPACITY),
+                  BitWriter(wordsData, WORDS_CAPACITY), BitWriter(eventsData, EVENTS_CAPACITY)} {}
+
+    AnalyticsWriter(const AnalyticsWriter &) = delete;
+    AnalyticsWriter &operator=(const AnalyticsWriter &) = delete;
+
+    /**
+     * @brief Drop what was there and open a new session.
+     * @param levelFrames Frames per Level entry, 4 is one entry per second at 250 ms.
+     */
+    void begin(uint32_t sessionId, uint32_t startTime, uint16_t framePeriodMs = 250, uint8_t levelFrames = 4) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.headerSize = sizeof(AnalyticsHeader);
+        header.sessionId = sessionId;
+        header.startTime = startTime;
+        header.framePeriodMs = framePeriodMs;
+        header.levelFrames = levelFrames > 0 ? levelFrames : 1;
+        header.columnCount = COLUMN_COUNT;
+        for (BitWriter &column : columns) {
+            column.reset();
+        }
+        memset(counts, 0, sizeof(counts));
+        runState = VadState::Silence;
+        previousState = VadState::Silence;
+        runLength = 0;
+        runCount = 0;
+        levelPeak = INT16_MIN;
+        levelFill = 0;
+        blockFill = 0;
+        lastWindowFrame = 0;
+        lastEventFrame = 0;
+        open = true;
+        finished = false;
+    }
+
+    /**
+     * @brief Append one analysis frame.
+     * @param levelDb Peak level of the frame.
+     * @return false when the session is not open or the timeline is full.
+     */
+    bool frame(VadState state, float levelDb) {
+        if (!open) {
+            return false;
+        }
+        // Room for the open run and block plus one more of each, so finish() always fits
+        if (!hasRoom(columns[VAD], 2 * MAX_RUN_BITS) || !hasRoom(columns[LEVEL], 2 * MAX_BLOCK_BITS)) {
+            header.flags |= FLAG_TRUNCATED;
+            return false;
+        }
+        if (runLength > 0 && state != runState) {
+            writeRun();
+        }
+        runState = state;
+        runLength++;
+
+        float rounded = roundf(levelDb);
+        int16_t level = rounded >= INT16_MAX ? INT16_MAX : rounded <= INT16_MIN + 1 ? INT16_MIN + 1 : (int16_t)rounded;
+        levelPeak = level > levelPeak ? level : levelPeak;
+        if (++levelFill == header.levelFrames) {
+            addLevel();
+        }
+        header.frameCount++;
+        return true;
+    }
+
+    /**
+     * @brief Append the word count of one analysis window, closed after the frames so far.
+     */
+    bool words(uint16_t count) {
+        uint32_t delta = header.frameCount - lastWindowFrame;
+        BitWriter &column = columns[WORDS];
+        if (!open || !column.reserve(BitWriter::gammaBits(delta + 1) + BitWriter::gammaBits((uint32_t)count + 1))) {
+            header.flags |= FLAG_TRUNCATED;
+            return false;
+        }
+        column.gamma(delta + 1);
+        column.gamma((uint32_t)count + 1);
+        lastWindowFrame = header.frameCount;
+        counts[WORDS]++;
+        return true;
+    }
+
+    /**
+     * @brief Append an event at the current frame.
+     */
+    bool event(AnalyticsEventType type, uint8_t value) {
+        uint32_t delta = header.frameCount - lastEventFrame;
+        BitWriter &column = columns[EVENTS];
+        if (!open || !column.reserve(BitWriter::gammaBits(delta + 1) + 12)) {
+            header.flags |= FLAG_TRUNCATED;
+            return false;
+        }
+        column.gamma(delta + 1);
+        column.write((uint32_t)type & 0x0F, 4);
+        column.write(value, 8);
+        lastEventFrame = header.frameCount;
+        counts[EVENTS]++;
+        return true;
+    }
+
+    /**
+     * @brief Close the session, after it getSegments() describes the encoded session.
+     */
+    void finish() {
+        if (!open) {
+            return;
+        }
+        if (runLength > 0) {
+            writeRun();
+        }
+        if (levelFill > 0) {
+            addLevel();
+        }
+        if (blockFill > 0) {
+            writeBlock();
+        }
+        counts[VAD] = header.frameCount;
+        header.dataSize = 0;
+        for (size_t c = 0; c < COLUMN_COUNT; c++) {
+            directory[c].id = (uint8_t)(c + 1);
+            directory[c].coding = CODING;
+            directory[c].reserved = 0;
+            directory[c].count = counts[c];
+            directory[c].size = (uint32_t)columns[c].getBytes();
+            header.dataSize += sizeof(AnalyticsColumnEntry) + directory[c].size;
+        }
+        uint32_t value = analyticsCrc32(reinterpret_cast<const uint8_t *>(&header), sizeof(header));
+        value = analyticsCrc32(reinterpret_cast<const uint8_t *>(directory), sizeof(directory), value);
+        for (const BitWriter &column : columns) {
+            value = analyticsCrc32(column.getData(), column.getBytes(), value);
+        }
+        memcpy(crc, &value, sizeof(crc));
+        open = false;
+        finished = true;
+    }
+
+    /**
+     * @brief The finished session in SEGMENT_COUNT pieces, in file order.
+     * @return Number of segments, 0 when no session is finished.
+     */
+    size_t getSegments(Segment (&segments)[SEGMENT_COUNT]) const {
+        if (!finished) {
+            return 0;
+        }
+        size_t n = 0;
+        segments[n++] = {reinterpret_cast<const uint8_t *>(&header), sizeof(header)};
+        segments[n++] = {reinterpret_cast<const uint8_t *>(directory), sizeof(directory)};
+        for (const BitWriter &column : columns) {
+            segments[n++] = {column.getData(), column.getBytes()};
+        }
+        segments[n++] = {crc, sizeof(crc)};
+        return n;
+    }
+
+    /**
+     * @brief Bytes of the finished session, CRC included.
+     */
+    size_t getSize() const {
+        return finished ? sizeof(header) + header.dataSize + sizeof(crc) : 0;
+    }
+
+    bool isOpen() const { return open; }
+    bool isFinished() const { return finished; }
+    bool isTruncated() const { return (header.flags & FLAG_TRUNCATED) != 0; }
+    uint32_t getSessionId() const { return header.sessionId; }
+    uint32_t getFrameCount() const { return header.frameCount; }
+    uint32_t getWindowCount() const { return counts[WORDS]; }
+    uint32_t getEventCount() const { return counts[EVENTS]; }
+
+    /**
+     * @brief Bytes the columns take so far.
+     */
+    size_t getColumnBytes() const {
+        size_t bytes = 0;
+        for (const BitWriter &column : columns) {
+            bytes += column.getBytes();
+        }
+        return bytes;
+    }
+
+private:
+    enum Column { VAD, LEVEL, WORDS, EVENTS };
+
+    static constexpr size_t MAX_RUN_BITS = 2 + 2 * 31 + 1;
+    static constexpr size_t MAX_BLOCK_BITS = 16 + 5 + (LEVEL_BLOCK - 1) * 17;
+
+    uint8_t vadData[VAD_CAPACITY];
+    uint8_t levelData[LEVEL_CAPACITY];
+    uint8_t wordsData[WORDS_CAPACITY];
+    uint8_t eventsData[EVENTS_CAPACITY];
+    BitWriter columns[COLUMN_COUNT];
+    uint32_t counts[COLUMN_COUNT] = {};
+
+    AnalyticsHeader header = {};
+    AnalyticsColumnEntry directory[COLUMN_COUNT] = {};
+    uint8_t crc[4] = {};
+
+    VadState runState = VadState::Silence;
+    VadState previousState = VadState::Silence;   ///< State of the last written run
+    uint32_t runLength = 0;
+    uint32_t runCount = 0;
+    int16_t levelPeak = INT16_MIN;        ///< Peak of the open Level entry
+    uint8_t levelFill = 0;                ///< Frames in the open Level entry
+    int16_t block[LEVEL_BLOCK];
+    size_t blockFill = 0;
+    uint32_t lastWindowFrame = 0;
+    uint32_t lastEventFrame = 0;
+    bool open = false;
+    bool finished = false;
+
+    static bool hasRoom(const BitWriter &column, size_t bits) {
+        return !column.isFull() && column.getBits() + bits <= column.getCapacityBits();
+    }
+
+    // hasRoom() was checked for every frame, these writes always fit
+    void writeRun() {
+        BitWriter &column = columns[VAD];
+        if (runCount == 0) {
+            column.write((uint32_t)runState, 2);
+        } else if (runState == analyticsExpectedState(previousState)) {
+            column.write(0, 1);
+        } else {
+            // The two states left, in order, that are neither the previous one nor the expected one
+            VadState expected = analyticsExpectedState(previousState);
+            uint32_t choice = 0;
+            for (uint8_t s = 0; s < 4; s++) {
+                if ((VadState)s == previousState || (VadState)s == expected) {
+                    continue;
+                }
+                if ((VadState)s == runState) {
+                    break;
+                }
+                choice++;
+            }
+            column.write(1 | (choice << 1), 2);
+        }
+        column.gamma(runLength);
+        runCount++;
+        previousState = runState;
+        runLength = 0;
+    }
+
+    void addLevel() {
+        block[blockFill++] = levelPeak;
+        counts[LEVEL]++;
+        levelPeak = INT16_MIN;
+        levelFill = 0;
+        if (blockFill == LEVEL_BLOCK) {
+            writeBlock();
+        }
+    }
+
+    void writeBlock() {
+        uint32_t deltas[LEVEL_BLOCK];
+        uint32_t any = 0;
+        for (size_t i = 1; i < blockFill; i++) {
+            int32_t delta = (int32_t)block[i] - block[i - 1];
+            deltas[i] = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+            any |= deltas[i];
+        }
+        unsigned width = any == 0 ? 0 : 32 - __builtin_clz(any);
+        BitWriter &column = columns[LEVEL];
+        column.write((uint16_t)block[0], 16);
+        column.write(width, 5);
+        for (size_t i = 1; i < blockFill; i++) {
+            column.write(deltas[i], width);
+        }
+        blockFill = 0;
+    }
+};
+
+#endif // ANALYTICS_FORMAT_HPP
@@ -0,0 +1,178 @@
+/**
+ * @file bitStream.hpp
+ * @brief Bit packed writer and reader over a caller supplied byte buffer.
+ *
+ * Bits are stored LSB first per byte, a field of n bits keeps its own LSB
+ * first. Next to fixed width fields both sides know the Elias gamma code for
+ * positive integers: floor(log2(v)) zero bits, a one bit and the remaining
+ * floor(log2(v)) bits of v. Small values cost few bits (1 costs 1 bit, 2 and
+ * 3 cost 3 bits) and no value has a length limit below 32 bits.
+ *
+ * The writer never allocates and never writes part of a field: when a field
+ * does not fit the buffer is left as it was and the writer reports full.
+ */
+
+#ifndef BIT_STREAM_HPP
+#define BIT_STREAM_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @class BitWriter
+ * @brief Appends bit fields to a fixed buffer.
+ */
+class BitWriter {
+public:
+    BitWriter(uint8_t *buffer, size_t capacity) : buffer(buffer), capacityBits(capacity * 8) {}
+
+    /**
+     * @brief Start over, the buffer content is overwritten from the start.
+     */
+    void reset() {
+        bitCount = 0;
+        full = false;
+    }
+
+    /**
+     * @brief Bits gamma() needs for value.
+     * @param value At least 1.
+     */
+    static unsigned gammaBits(uint32_t value) {
+        return 2 * log2(value) + 1;
+    }
+
+    /**
+     * @brief Check that bits more bits fit, and report full when they do not.
+     */
+    bool reserve(size_t bits) {
+        if (full || bitCount + bits > capacityBits) {
+            full = true;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Append the low bits of value.
+     * @param bits 0 to 32.
+     * @return false when the field did not fit, nothing is written then.
+     */
+    bool write(uint32_t value, unsigned bits) {
+        if (!reserve(bits)) {
+            return false;
+        }
+        put(value, bits);
+        return true;
+    }
+
+    /**
+     * @brief Append value as an Elias gamma code.
+     * @param value At least 1.
+     * @return false when the code did not fit, nothing is written then.
+     */
+    bool gamma(uint32_t value) {
+        unsigned n = log2(value);
+        if (!reserve(2 * n + 1)) {
+            return false;
+        }
+        put(0, n);
+        put(1, 1);
+        put(value, n);
+        return true;
+    }
+
+    size_t getBits() const { return bitCount; }
+    size_t getBytes() const { return (bitCount + 7) / 8; }
+    size_t getCapacityBits() const { return capacityBits; }
+    const uint8_t *getData() const { return buffer; }
+    bool isFull() const { return full; }
+
+private:
+    uint8_t *buffer;
+    size_t capacityBits;
+    size_t bitCount = 0;
+    bool full = false;
+
+    static unsigned log2(uint32_t value) {
+        return 31 - __builtin_clz(value | 1);
+    }
+
+    // Fields go in a byte at a time; a fresh byte is cleared before its first bit
+    void put(uint32_t value, unsigned bits) {
+        while (bits > 0) {
+            size_t byte = bitCount >> 3;
+            unsigned shift = bitCount & 7;
+            unsigned take = 8 - shift < bits ? 8 - shift : bits;
+            uint8_t part = (uint8_t)((value & ((1u << take) - 1)) << shift);
+            buffer[byte] = shift == 0 ? part : (uint8_t)(buffer[byte] | part);
+            value = take < 32 ? value >> take : 0;
+            bits -= take;
+            bitCount += take;
+        }
+    }
+};
+
+/**
+ * @class BitReader
+ * @brief Reads the fields of a BitWriter back.
+ */
+class BitReader {
+public:
+    BitReader(const uint8_t *data, size_t length) : data(data), lengthBits(length * 8) {}
+
+    /**
+     * @param bits 0 to 32.
+     * @return false when the data ends before the field.
+     */
+    bool read(unsigned bits, uint32_t &value) {
+        if (position + bits > lengthBits) {
+            return false;
+        }
+        value = 0;
+        unsigned done = 0;
+        while (done < bits) {
+            unsigned shift = position & 7;
+            unsigned take = 8 - shift < bits - done ? 8 - shift : bits - done;
+            uint32_t part = (data[position >> 3] >> shift) & ((1u << take) - 1);
+            value |= part << done;
+            done += take;
+            position += take;
+        }
+        return true;
+    }
+
+    /**
+     * @return false when the data ends inside the code or the code is longer than 32 bits.
+     */
+    bool gamma(uint32_t &value) {
+        unsigned n = 0;
+        uint32_t bit = 0;
+        while (true) {
+            if (!read(1, bit)) {
+                return false;
+            }
+            if (bit != 0) {
+                break;
+            }
+            if (++n > 31) {
+                return false;
+            }
+        }
+        uint32_t rest = 0;
+        if (!read(n, rest)) {
+            return false;
+        }
+        value = (1u << n) | rest;
+        return true;
+    }
+
+    size_t getPosition() const { return position; }
+
+private:
+    const uint8_t *data;
+    size_t lengthBits;
+    size_t position = 0;
+};
+
+#endif // BIT_STREAM_HPP
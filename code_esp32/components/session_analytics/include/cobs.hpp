@@ -0,0 +1,115 @@
+/**
+ * @file cobs.hpp
+ * @brief Consistent Overhead Byte Stuffing, byte by byte encoder and a decoder.
+ *
+ * COBS replaces every zero byte of a frame, so a single 0x00 can end it on
+ * the wire. The receiver finds the next frame after any garbage or a lost
+ * byte at the next 0x00, no length field or escape state to trust. The cost
+ * is one byte per started 254 bytes of frame.
+ *
+ * The encoder takes the frame a byte at a time, so a frame can be encoded
+ * straight from the data it is made of without first copying it together.
+ */
+
+#ifndef COBS_HPP
+#define COBS_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @class CobsEncoder
+ * @brief Encodes one frame at a time into a caller supplied buffer.
+ */
+class CobsEncoder {
+public:
+    /**
+     * @brief Buffer size needed for frames of up to length bytes, delimiter included.
+     */
+    static constexpr size_t encodedSize(size_t length) {
+        return length + length / 254 + 2;
+    }
+
+    /**
+     * @param buffer Output, at least encodedSize() of the longest frame.
+     */
+    explicit CobsEncoder(uint8_t *buffer) : buffer(buffer) {}
+
+    void begin() {
+        codeIndex = 0;
+        length = 1;
+        code = 1;
+    }
+
+    void put(uint8_t byte) {
+        if (byte == 0) {
+            closeBlock();
+            return;
+        }
+        buffer[length++] = byte;
+        if (++code == 0xFF) {
+            closeBlock();
+        }
+    }
+
+    void put(const uint8_t *data, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            put(data[i]);
+        }
+    }
+
+    /**
+     * @brief Close the frame and append the 0x00 delimiter.
+     * @return Encoded length, delimiter included.
+     */
+    size_t end() {
+        buffer[codeIndex] = code;
+        buffer[length++] = 0;
+        return length;
+    }
+
+    const uint8_t *getData() const { return buffer; }
+
+private:
+    uint8_t *buffer;
+    size_t codeIndex = 0;   ///< Where the code byte of the open block goes
+    size_t length = 1;
+    uint8_t code = 1;       ///< One more than the bytes in the open block
+
+    void closeBlock() {
+        buffer[codeIndex] = code;
+        codeIndex = length++;
+        code = 1;
+    }
+};
+
+/**
+ * @brief Decode one frame, without its 0x00 delimiter.
+ * @param data Encoded frame.
+ * @param length Its length.
+ * @param output At least length bytes.
+ * @return Decoded length, or 0 when the frame is not valid COBS.
+ */
+inline size_t cobsDecode(const uint8_t *data, size_t length, uint8_t *output) {
+    size_t in = 0;
+    size_t out = 0;
+    while (in < length) {
+        uint8_t code = data[in++];
+        if (code == 0 || in + code - 1 > length) {
+            return 0;
+        }
+        for (uint8_t i = 1; i < code; i++) {
+            if (data[in] == 0) {
+                return 0;
+            }
+            output[out++] = data[in++];
+        }
+        // A block shorter than 254 bytes stood for a zero, except at the end
+        if (code != 0xFF && in < length) {
+            output[out++] = 0;
+        }
+    }
+    return out;
+}
+
+#endif // COBS_HPP
@@ -0,0 +1,155 @@
+/**
+ * @file tascamProtocol.hpp
+ * @brief Bytes on the Tascam remote UART, both directions.
+ *
+ * The ESP32 sends one byte per remote key. The recorder answers every key
+ * with one status byte, and sends one on its own when its state changes
+ * without a key, for example when the card fills up during a recording.
+ * A status byte has both top bits set, so it cannot be mistaken for a key
+ * echoed on a shared line. The low six bits carry the state or the fault.
+ *
+ * Plain C++, so the firmware, the host tests and the recorder stand-in share
+ * one definition.
+ */
+
+#ifndef TASCAM_PROTOCOL_HPP
+#define TASCAM_PROTOCOL_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @enum TascamCommands
+ * @brief Commands for controlling the Tascam device
+ */
+enum TascamCommands : uint8_t {
+    TASCAM_START_RECORDING = 107, /**< Command to start recording */
+    TASCAM_STOP_RECORDING = 104,  /**< Command to stop recording */
+    TASCAM_IDLE = 0               /**< Command for idle state */
+};
+
+/**
+ * @enum TascamState
+ * @brief State of the recorder.
+ */
+enum class TascamState : uint8_t {
+    Unknown,    ///< After power up, the recorder may be in any state
+    Stopped,    ///< Not recording
+    Standby,    ///< Record standby, input levels shown, not writing
+    Recording,  ///< Writing a file
+};
+
+/**
+ * @enum TascamFault
+ * @brief Why the recorder cannot do what was asked.
+ */
+enum class TascamFault : uint8_t {
+    None,
+    NoCard,       ///< No SD card inserted, reported by the recorder
+    CardFull,     ///< No space left, reported by the recorder
+    CardError,    ///< Card not formatted or write error, reported by the recorder
+    NoResponse,   ///< A key was not answered in time, detected by the ESP32
+    LineBreak,    ///< RX held at the break level, the cable is out, detected by the ESP32
+};
+
+/**
+ * @brief Human readable name of a fault, for the log and the display.
+ */
+inline const char *tascamFaultName(TascamFault fault) {
+    switch (fault) {
+        case TascamFault::None:
+            return "OK";
+        case TascamFault::NoCard:
+            return "No SD card";
+        case TascamFault::CardFull:
+            return "SD card full";
+        case TascamFault::CardError:
+            return "SD card error";
+        case TascamFault::NoResponse:
+            return "No response";
+        case TascamFault::LineBreak:
+            return "Cable out";
+    }
+    return "?";
+}
+
+/**
+ * @class TascamStatusParser
+ * @brief Turns the bytes received from the recorder into state and fault reports.
+ */
+class TascamStatusParser {
+public:
+    static constexpr uint8_t STATUS_MARK = 0xC0;   ///< Top bits of every status byte
+    static constexpr uint8_t FAULT_FLAG = 0x10;    ///< Set in the code of a fault
+
+    /**
+     * @brief What one byte reported.
+     */
+    struct Report {
+        enum class Kind : uint8_t {
+            None,   ///< Not a status byte, ignored
+            State,  ///< The recorder is in state
+            Fault,  ///< The recorder refused a key or stopped by itself
+        };
+        Kind kind;
+        TascamState state;
+        TascamFault fault;
+    };
+
+    /** @brief Status byte of a state, sent by the recorder. */
+    static constexpr uint8_t encode(TascamState state) {
+        return (uint8_t)(STATUS_MARK | (uint8_t)state);
+    }
+
+    /** @brief Status byte of a fault the recorder reports itself. */
+    static constexpr uint8_t encode(TascamFault fault) {
+        return (uint8_t)(STATUS_MARK | FAULT_FLAG | ((uint8_t)fault - (uint8_t)TascamFault::NoCard));
+    }
+
+    /**
+     * @brief Parse one received byte.
+     * @param byte Byte from the UART.
+     * @return The report, Kind::None for anything that is not a known status byte.
+     */
+    Report push(uint8_t byte) {
+        Report report = {Report::Kind::None, lastState, TascamFault::None};
+        if ((byte & STATUS_MARK) != STATUS_MARK) {
+            ignored++;
+            return report;
+        }
+        uint8_t code = byte & (uint8_t)~STATUS_MARK;
+        if (code & FAULT_FLAG) {
+            uint8_t index = code & (uint8_t)~FAULT_FLAG;
+            if (index > (uint8_t)TascamFault::CardError - (uint8_t)TascamFault::NoCard) {
+                ignored++;
+                return report;
+            }
+            report.kind = Report::Kind::Fault;
+            report.fault = (TascamFault)((uint8_t)TascamFault::NoCard + index);
+            // A fault leaves the recorder stopped, a full card ends the recording
+            lastState = TascamState::Stopped;
+            report.state = lastState;
+            return report;
+        }
+        if (code < (uint8_t)TascamState::Stopped || code > (uint8_t)TascamState::Recording) {
+            ignored++;
+            return report;
+        }
+        report.kind = Report::Kind::State;
+        report.state = (TascamState)code;
+        lastState = report.state;
+        return report;
+    }
+
+    /** @brief Last state reported, Unknown before the first report. */
+    TascamState getLastState() const { return lastState; }
+
+    /** @brief Bytes that were not a known status byte, noise or a key echo. */
+    size_t getIgnoredBytes() const { return ignored; }
+
+private:
+    TascamState lastState = TascamState::Unknown;
+    size_t ignored = 0;
+};
+
+#endif // TASCAM_PROTOCOL_HPP
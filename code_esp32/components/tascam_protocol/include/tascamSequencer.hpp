@@ -0,0 +1,293 @@
+/**
+ * @file tascamSequencer.hpp
+ * @brief Which remote key to send when, without the task, the UART or the clock.
+ *
+ * TascamBoundary feeds it the requests, the reports of TascamStatusParser
+ * and the time, and sends the keys it hands out. The host simulation in
+ * test_code/Unit-test-tascam-simulator drives the same class in virtual
+ * time against a DR-40X model.
+ *
+ * The keys are planned from the state the recorder is believed to be in, so
+ * a second stop is only sent while that state is unknown. Two keys are
+ * spaced by the gap of the timing table, unless the recorder confirmed the
+ * first one. A new request replaces the keys of the previous one that were
+ * not sent yet, once the answer to the key on its way is in.
+ */
+
+#ifndef TASCAM_SEQUENCER_HPP
+#define TASCAM_SEQUENCER_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include "tascamProtocol.hpp"
+
+/**
+ * @class TascamSequencer
+ * @brief Plans and times the remote keys of the requests.
+ */
+class TascamSequencer {
+public:
+    static constexpr size_t MAX_PLAN = 4;   ///< Keys of the longest plan, Unknown to Recording
+
+    /**
+     * @brief Minimum time between two remote commands.
+     *
+     * A zero command matches any command. The first matching entry applies.
+     */
+    struct CommandTiming {
+        uint8_t previous; ///< Command sent before
+        uint8_t next;     ///< Command to send
+        uint16_t gapMs;   ///< Time the recorder needs between the two
+    };
+
+    /**
+     * @brief Gaps the DR-40X needs between two remote keys, measured with the old blocking sequence.
+     */
+    static constexpr CommandTiming TIMING[] = {
+        // Record standby has to settle before the second record key starts writing
+        {TASCAM_START_RECORDING, TASCAM_START_RECORDING, 750},
+        // The file is closed before record standby is accepted
+        {TASCAM_STOP_RECORDING, TASCAM_START_RECORDING, 500},
+        {TASCAM_IDLE, TASCAM_IDLE, 500},
+    };
+
+    /**
+     * @brief One key of a plan and the state it leaves the recorder in.
+     */
+    struct Step {
+        uint8_t command;
+        TascamState after;
+    };
+
+    /**
+     * @brief What the caller has to do next.
+     */
+    struct Action {
+        enum class Kind : uint8_t {
+            Wait,   ///< Nothing until wakeUs, or until a request or a report
+            Send,   ///< Send key now
+            Done,   ///< The request has ended, in state; startLatencyUs is set for a start
+            Fault,  ///< Tell the menu about fault
+        };
+        Kind kind;
+        uint8_t key;
+        int64_t wakeUs;          ///< For Wait, negative to wait for an event only
+        TascamState state;
+        TascamFault fault;
+        int64_t startLatencyUs;  ///< Request to last record key, 0 when no key was needed
+    };
+
+    /**
+     * @brief Constructs a TascamSequencer.
+     * @param acknowledged The recorder answers every key, wait for the answer instead of the gap.
+     * @param ackTimeoutMs Time the recorder has to answer a key.
+     */
+    TascamSequencer(bool acknowledged, uint32_t ackTimeoutMs)
+        : acknowledged(acknowledged), ackTimeoutUs((int64_t)ackTimeoutMs * 1000) {}
+
+    /**
+     * @brief Keys that take the recorder from one state to another.
+     * @param from Current state.
+     * @param to State to reach.
+     * @param[out] plan Keys in order.
+     * @return Number of keys.
+     */
+    static size_t planCommands(TascamState from, TascamState to, Step (&plan)[MAX_PLAN]) {
+        size_t count = 0;
+        if (from == to) {
+            return 0;
+        }
+        // Stop first unless a record key alone gets there
+        bool recordOnly = (from == TascamState::Stopped) || (from == TascamState::Standby && to == TascamState::Recording);
+        if (!recordOnly) {
+            if (from == TascamState::Unknown) {
+                // The first stop may only end a record pause or close a menu
+                plan[count++] = {TASCAM_STOP_RECORDING, TascamState::Unknown};
+            }
+            plan[count++] = {TASCAM_STOP_RECORDING, TascamState::Stopped};
+            from = TascamState::Stopped;
+        }
+        if (to == TascamState::Stopped) {
+            return count;
+        }
+        if (from == TascamState::Stopped) {
+            plan[count++] = {TASCAM_START_RECORDING, TascamState::Standby};
+        }
+        if (to == TascamState::Recording) {
+            plan[count++] = {TASCAM_START_RECORDING, TascamState::Recording};
+        }
+        return count;
+    }
+
+    /**
+     * @brief Gap the timing table asks for between two keys.
+     */
+    static uint32_t gapMs(uint8_t previous, uint8_t next) {
+        for (const CommandTiming &timing : TIMING) {
+            if ((timing.previous == TASCAM_IDLE || timing.previous == previous) &&
+                (timing.next == TASCAM_IDLE || timing.next == next)) {
+                return timing.gapMs;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Set a new target, the keys of the previous request that were not sent are dropped.
+     * @param target State to reach.
+     * @param nowUs Current time.
+     * @return True when keys of a running request were dropped.
+     */
+    bool request(TascamState target, int64_t nowUs) {
+        bool cancelled = active && (index < count || awaitingAck);
+        // A repeated start keeps the time of the first press
+        if (!(active && target == this->target && target == TascamState::Recording)) {
+            requestedUs = nowUs;
+        }
+        // A key waiting for its answer keeps waiting, the new plan starts from the reported state
+        this->target = target;
+        active = true;
+        replan = true;
+        return cancelled;
+    }
+
+    /**
+     * @brief A status byte arrived.
+     * @param report What TascamStatusParser made of it.
+     */
+    void report(const TascamStatusParser::Report &report) {
+        if (report.kind == TascamStatusParser::Report::Kind::None) {
+            return;
+        }
+        state = report.state;
+        if (report.kind == TascamStatusParser::Report::Kind::Fault) {
+            raise(report.fault);
+            return;
+        }
+        if (awaitingAck) {
+            awaitingAck = false;
+            confirmed = true;
+            replan = replan || state != expected;
+        } else if (active) {
+            // The recorder changed by itself, the plan no longer starts from the right state
+            replan = true;
+        }
+    }
+
+    /**
+     * @brief A fault the ESP32 detected itself, the recorder state is unknown afterwards.
+     */
+    void fault(TascamFault fault) {
+        state = TascamState::Unknown;
+        raise(fault);
+    }
+
+    /**
+     * @brief Decide what to do at nowUs. Call again after every Send, Done and Fault,
+     *        and after every request, report or wake up.
+     */
+    Action next(int64_t nowUs) {
+        Action action = {Action::Kind::Wait, 0, -1, state, TascamFault::None, 0};
+        if (pendingFault != TascamFault::None) {
+            action.kind = Action::Kind::Fault;
+            action.fault = pendingFault;
+            pendingFault = TascamFault::None;
+            return action;
+        }
+        if (!active) {
+            return action;
+        }
+        if (awaitingAck) {
+            if (nowUs < ackDeadlineUs) {
+                action.wakeUs = ackDeadlineUs;
+                return action;
+            }
+            awaitingAck = false;
+            fault(TascamFault::NoResponse);
+            return next(nowUs);
+        }
+        if (replan) {
+            count = planCommands(state, target, plan);
+            index = 0;
+            replan = false;
+        }
+        if (index >= count) {
+            active = false;
+            action.kind = Action::Kind::Done;
+            // Zero when the recorder was already recording and no key was sent
+            if (target == TascamState::Recording && state == TascamState::Recording && lastCommandUs > requestedUs) {
+                action.startLatencyUs = lastCommandUs - requestedUs;
+            }
+            return action;
+        }
+
+        // A confirmed key needs no gap, otherwise wait out the one of the timing table
+        const Step &step = plan[index];
+        if (!confirmed && lastCommand != TASCAM_IDLE) {
+            int64_t readyUs = lastCommandUs + (int64_t)gapMs(lastCommand, step.command) * 1000;
+            if (nowUs < readyUs) {
+                action.wakeUs = readyUs;
+                return action;
+            }
+        }
+        index++;
+        lastCommand = step.command;
+        lastCommandUs = nowUs;
+        confirmed = false;
+        expected = step.after;
+        if (acknowledged) {
+            awaitingAck = true;
+            ackDeadlineUs = nowUs + ackTimeoutUs;
+        } else {
+            state = step.after;
+        }
+        action.kind = Action::Kind::Send;
+        action.key = step.command;
+        return action;
+    }
+
+    /** @brief State the recorder is believed to be in. */
+    TascamState getState() const { return state; }
+
+    /** @brief State the running or last request is after. */
+    TascamState getTarget() const { return target; }
+
+    /** @brief True while a request has keys left or waits for an answer. */
+    bool isBusy() const { return active; }
+
+    /** @brief Keys in the plan of the running request, and how many were sent. */
+    size_t getPlanLength() const { return count; }
+    size_t getPlanIndex() const { return index; }
+
+private:
+    bool acknowledged;
+    int64_t ackTimeoutUs;
+
+    TascamState state = TascamState::Unknown;
+    TascamState target = TascamState::Unknown;
+    TascamState expected = TascamState::Unknown;  ///< State the last key should have led to
+    TascamFault pendingFault = TascamFault::None;
+    bool active = false;
+    bool replan = false;
+    bool awaitingAck = false;
+    bool confirmed = false;    ///< The recorder answered the last key
+    int64_t requestedUs = 0;
+    int64_t ackDeadlineUs = 0;
+    uint8_t lastCommand = TASCAM_IDLE;
+    int64_t lastCommandUs = 0;
+    Step plan[MAX_PLAN] = {};
+    size_t count = 0;
+    size_t index = 0;
+
+    void raise(TascamFault fault) {
+        pendingFault = fault;
+        // A fault ends the request, Done follows the Fault action
+        awaitingAck = false;
+        if (active) {
+            index = count;
+            replan = false;
+        }
+    }
+};
+
+#endif // TASCAM_SEQUENCER_HPP
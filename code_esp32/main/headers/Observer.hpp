@@ -17,7 +17,8 @@ enum class ObserverId {
     PatientPause,
     ResearchPause,
     CodeScanner,
-    AudioDataAvailable
+    AudioDataAvailable,
+    RecorderFault
 };
 
 
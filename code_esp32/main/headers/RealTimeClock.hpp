@@ -3,9 +3,14 @@
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <atomic>
 #include <ctime>
 #include "esp_err.h"
 #include "driver/i2c_master.h"
+#include "driver/gpio.h"
+#include "clockDiscipline.hpp"
+#include "spscRingBuffer.hpp"
 
 /**
  * @file RealTimeClock.hpp
@@ -23,6 +28,14 @@
  * This class provides functionality to read and write time/date information
  * from a DS3231 RTC module, as well as read temperature data from the built-in
  * temperature sensor.
+ *
+ * The DS3231 is read once at boot to set the system time; getTime() reads
+ * the system time and never touches the I2C bus. The "RtcSync" task keeps
+ * the system time on the DS3231 with a ClockDiscipline: from the falling
+ * edges of the 1 Hz SQW output when CONFIG_YOD_RTC_SQW_GPIO is wired, and
+ * by waiting for the seconds register to tick every CONFIG_YOD_RTC_RESYNC_S
+ * otherwise (or when the edges stop). The "rtc" serial command prints the
+ * offset and drift statistics.
  * 
  * @note Requires ESP-IDF I2C master driver
  */
@@ -30,13 +43,14 @@ class RealTimeClock {
 public:
     /**
      * @brief Constructor for RealTimeClock
-     * @param bus_handle I2C master bus handle for communication
+     * @param bus_handle Reference to the I2C master bus handle, it is read in initialize()
+     *                   so the bus may be created after construction
      * @todo Move parameters from init to constructor and check device handle
      */
-    RealTimeClock(i2c_master_bus_handle_t bus_handle);
+    RealTimeClock(i2c_master_bus_handle_t &bus_handle);
     
     /**
-     * @brief Initialize the RTC device
+     * @brief Initialize the RTC device, set the system time from it and start the sync task
      * @return ESP_OK on success, error code on failure
      * @retval ESP_OK Initialization successful
      * @retval ESP_FAIL Initialization failed
@@ -52,25 +66,92 @@ public:
     bool getTemperature(float& temp);
     
     /**
-     * @brief Read current time from the RTC
+     * @brief Current time, from the system clock that follows the RTC
      * @param[out] time Reference to tm structure to store the current time
-     * @return true if time read successfully, false otherwise
-     * @note The tm structure follows standard C library format
+     * @return true if time read successfully, false when the RTC could not be read yet
+     * @note The tm structure follows standard C library format. No I2C transfer, safe from any task
      */
     bool getTime(struct tm& time);
     
     /**
-     * @brief Set the current time on the RTC
+     * @brief Set the current time on the RTC and the system clock
      * @param[in] time Reference to tm structure containing the time to set
      * @return true if time set successfully, false otherwise
-     * @note The tm structure should follow standard C library format
+     * @note The tm structure should follow standard C library format. One I2C transaction
      */
     bool setTime(const struct tm& time);
+
+    /**
+     * @brief Offset and drift of the system clock against the RTC
+     * @param[out] stats Copy of the statistics of the sync task
+     */
+    void getSyncStats(ClockDiscipline::Stats& stats);
+
+    /**
+     * @brief Print the time, the temperature and the sync statistics on the console
+     */
+    void printStats();
     
 private:
-    i2c_master_bus_handle_t m_bus_handle;  ///< I2C master bus handle
+    static constexpr uint32_t POLL_MS = 10;          ///< Seconds register poll interval while anchoring
+    static constexpr uint32_t POLL_LIMIT_MS = 1100;  ///< The seconds register ticks within this time
+    static constexpr int64_t EDGE_MAX_AGE_US = 500000; ///< An edge older than this cannot be paired with a register read
+
+    i2c_master_bus_handle_t &m_bus_handle; ///< Reference to the I2C master bus handle
     i2c_master_dev_handle_t m_dev_handle;  ///< I2C device handle for RTC
     bool m_initialized;                     ///< Initialization status flag
+    std::atomic<bool> m_timeValid;          ///< The system time was set from the RTC
+    std::atomic<bool> m_resync;             ///< setTime() changed the RTC, anchor again
+    SemaphoreHandle_t m_mutex;              ///< Guards m_discipline, m_generation and the clock corrections
+    ClockDiscipline m_discipline;           ///< Owned by the sync task
+    uint32_t m_generation;                  ///< Counts setTime() calls, a measurement across one is dropped
+    TaskHandle_t m_syncTask;
+    gpio_num_t m_sqwPin;                    ///< GPIO_NUM_NC without SQW
+    IsrSpscRingBuffer<int64_t, 8> m_edges;  ///< SQW falling edges (esp_timer us) from the ISR to the sync task
+
+    /**
+     * @brief Waits for SQW edges, anchors at boot, after setTime() and every CONFIG_YOD_RTC_RESYNC_S
+     * @param pvParameters The RealTimeClock
+     */
+    static void syncTask(void *pvParameters);
+
+    /**
+     * @brief Falling edge of SQW, the DS3231 starts a new second
+     * @param arg The RealTimeClock
+     */
+    static void sqwIsrHandler(void *arg);
+
+    /**
+     * @brief Enable the 1 Hz square wave on SQW (INTCN and RS2/RS1 cleared)
+     */
+    esp_err_t enableSquareWave();
+
+    /**
+     * @brief Wait for the seconds register to tick and anchor the discipline on it
+     */
+    void pollAnchor();
+
+    /**
+     * @brief Hand one SQW edge to the discipline, anchoring on it when needed
+     * @param edgeUs esp_timer time of the edge
+     */
+    void sqwEdge(int64_t edgeUs);
+
+    /**
+     * @brief Apply a correction unless setTime() ran since the measurement started
+     * @note Called with m_mutex taken
+     */
+    void apply(const ClockDiscipline::Correction& correction);
+
+    /**
+     * @brief Read the time registers into a tm
+     */
+    esp_err_t readTime(struct tm& time);
+
+    /**
+     * @brief System time in us
+     */
+    static int64_t systemUs();
     
     /**
      * @brief Write data to a specific register on the RTC
@@ -9,6 +9,15 @@
  */
 class AudioAnalyzer {
   public:
+    /**
+     * @brief Limits of the spectral peak that counts as a word.
+     */
+    struct WordThresholds {
+        float levelDb = -40.0f; ///< Lowest peak level
+        float lowHz = 300.0f;   ///< Lowest peak frequency
+        float highHz = 3300.0f; ///< Highest peak frequency
+    };
+
     /**
      * @brief Constructor for the AudioAnalyzer class.
      *
@@ -39,6 +48,16 @@ class AudioAnalyzer {
      */
     void computeFft();
 
+    /**
+     * @brief Cheap alternative to computeFft() for when the frame budget is exceeded.
+     *
+     * Band-passes the samples to roughly 300-3300 Hz with two one-pole filters
+     * and estimates the dominant frequency from zero crossings. The peak value
+     * is scaled to the level an FFT bin would show for a tone of the same power,
+     * so isWord() keeps working with the same thresholds.
+     */
+    void computeBandEnergy();
+
     /**
      * @brief Prints the results of the FFT analysis.
      */
@@ -51,6 +70,27 @@ class AudioAnalyzer {
      */
     bool isWord();
 
+    /**
+     * @brief Replace the limits isWord() uses, e.g. from a configuration upload.
+     *
+     * @param thresholds New limits.
+     */
+    void setWordThresholds(const WordThresholds &thresholds) { wordThresholds = thresholds; }
+
+    /**
+     * @brief Frequency of the spectral peak of the last analysed frame.
+     *
+     * @return Peak frequency in Hz.
+     */
+    float getPeakFrequency() const { return peakFreq; }
+
+    /**
+     * @brief Level of the spectral peak of the last analysed frame.
+     *
+     * @return Peak value in dB.
+     */
+    float getPeakValue() const { return peakVal; }
+
   private:
     /**
      * @brief Number of samples to analyze.
@@ -116,4 +156,9 @@ class AudioAnalyzer {
      * @brief Frequency of the peak in the FFT result.
      */
     float peakFreq;
+
+    /**
+     * @brief Limits of the spectral peak of a word.
+     */
+    WordThresholds wordThresholds;
 };
\ No newline at end of file
@@ -1,17 +1,273 @@
 #ifndef AUDIO_MODEM_HPP
 #define AUDIO_MODEM_HPP
 #include <stdint.h>
+#include <span>
+#include <atomic>
 #include "pwmChannel.hpp"
+#include "freertos/event_groups.h"
+#include "esp_err.h"
+#include "driver/gptimer.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "spscRingBuffer.hpp"
+#include "modemCodec.hpp"
+#include "dacToneGenerator.hpp"
 
+#ifndef CONFIG_YOD_MODEM_SYMBOL_US
+#define CONFIG_YOD_MODEM_SYMBOL_US ModemCodec::DEFAULT_SYMBOL_US
+#endif
+#ifndef CONFIG_YOD_MODEM_BITS_PER_SYMBOL
+#define CONFIG_YOD_MODEM_BITS_PER_SYMBOL ModemCodec::DEFAULT_BITS_PER_SYMBOL
+#endif
+#ifndef CONFIG_YOD_MODEM_OUTPUT_DAC
+#define CONFIG_YOD_MODEM_OUTPUT_DAC 0
+#endif
+#ifndef CONFIG_YOD_MODEM_BEACON_INTERVAL_S
+#define CONFIG_YOD_MODEM_BEACON_INTERVAL_S 60
+#endif
+#ifndef CONFIG_YOD_MODEM_BEACON_LEVEL
+#define CONFIG_YOD_MODEM_BEACON_LEVEL 20
+#endif
+
+/**
+ * @class AudioModem
+ * @brief Asynchronous M-ary FSK transmitter on a PWM channel.
+ *
+ * transmit() and transmitFrame() copy the bytes into a preallocated TX buffer
+ * and return immediately. A dedicated task takes the PWM channel, and a
+ * gptimer alarm ISR steps it through the symbols. Each symbol carries 1 to 4
+ * bits, LSB first, on one of 2 to 16 tones (see mfsk.hpp). The ISR writes
+ * precomputed LEDC clock dividers, so a symbol boundary costs a few register
+ * writes and does not depend on the FreeRTOS tick. With
+ * CONFIG_YOD_MODEM_ISR_IRAM_SAFE the ISR and the packer and TX buffer paths it
+ * inlines stay in IRAM, so flash writes and erases do not delay it.
+ *
+ * With Output::Dac the PWM channel is not used. The modem task streams
+ * phase-continuous sine tones through the DAC instead (see
+ * dacToneGenerator.hpp), and the DMA sample clock times the symbols.
+ *
+ * Between startBeacons() and stopBeacons() the modem task also sends a quiet
+ * Beacon packet (see modemPacket.hpp) at a fixed interval, so a recording can
+ * be aligned anywhere without scanning it from the start.
+ */
 class AudioModem : public PWMChannel {
 public:
-    AudioModem(uint32_t highFreq, uint32_t lowFreq, gpio_num_t gpioPin);  // Constructor
+    /** @brief Called from the modem task when the TX buffer has drained. */
+    using CompletionCallback = void (*)(void *context);
+
+    /**
+     * @struct JitterStatistics
+     * @brief Deviation of the symbol boundaries from their ideal time.
+     */
+    struct JitterStatistics {
+        uint32_t symbols;     ///< Symbol boundaries measured
+        uint32_t maxUs;       ///< Largest absolute deviation
+        uint64_t sumUs;       ///< Sum of absolute deviations
+    };
+
+    /** @brief Output back end. */
+    enum class Output : uint8_t {
+        Pwm,    ///< 50% square wave from LEDC, works on any pin
+        Dac,    ///< Sine wave from the DAC, GPIO25 or GPIO26 only
+    };
+
+    static constexpr size_t TX_BUFFER_SIZE = 256;   ///< Slots in the TX buffer, one byte each
+
+    /**
+     * @brief Constructs an AudioModem.
+     * @param highFreq Tone of the highest symbol value, bit '1' in binary FSK.
+     * @param lowFreq Tone of symbol value 0.
+     * @param gpioPin PWM output pin.
+     * @param symbolUs Duration of one symbol.
+     * @param bitsPerSymbol 1 for binary FSK, 2, 3 or 4 for 4, 8 or 16 tones.
+     * @param output Output back end.
+     */
+    AudioModem(uint32_t highFreq, uint32_t lowFreq, gpio_num_t gpioPin,
+               uint32_t symbolUs = CONFIG_YOD_MODEM_SYMBOL_US,
+               uint8_t bitsPerSymbol = CONFIG_YOD_MODEM_BITS_PER_SYMBOL,
+               Output output = CONFIG_YOD_MODEM_OUTPUT_DAC ? Output::Dac : Output::Pwm);
     ~AudioModem(); // Destructor
-    void transmit(uint8_t data); // Method to transmit data
+
+    /**
+     * @brief Configure the output, precompute the tones and start the modem task.
+     * @return ESP_OK, or the error of the output, task or timer creation.
+     */
+    esp_err_t initialize();
+
+    /**
+     * @brief Queue one byte for transmission.
+     * @param data Byte to send.
+     * @return ESP_OK, or ESP_ERR_NO_MEM when the TX buffer is full.
+     */
+    esp_err_t transmit(uint8_t data);
+
+    /**
+     * @brief Queue a frame of bytes for transmission, all or nothing.
+     * @param frame Bytes to send, sent back to back without a gap.
+     * @return ESP_OK, or ESP_ERR_NO_MEM when the frame does not fit in the TX buffer.
+     */
+    esp_err_t transmitFrame(std::span<const uint8_t> frame);
+
+    /**
+     * @brief Register a function that is called every time the TX buffer has drained.
+     * @param callback Function to call, runs in the modem task so it must not block long.
+     * @param context Passed unchanged to the callback.
+     */
+    void setCompletionCallback(CompletionCallback callback, void *context = nullptr);
+
+    /**
+     * @brief True while bytes are queued or being sent.
+     */
+    bool isBusy() const;
+
+    /**
+     * @brief Block until everything queued so far has been sent.
+     * @param timeout Maximum time to wait.
+     * @return true when the modem is idle.
+     */
+    bool waitUntilIdle(TickType_t timeout);
+
+    /**
+     * @brief Duration of one symbol in microseconds.
+     */
+    uint32_t getSymbolUs() const { return symbolUs; }
+
+    /**
+     * @brief Tone plan, the receiver needs the same one.
+     */
+    const MfskTonePlan &getTonePlan() const { return tonePlan; }
+
+    /**
+     * @brief Time on air of a number of bytes in microseconds.
+     * @param bytes Number of bytes.
+     */
+    uint32_t getBurstUs(size_t bytes) const { return tonePlan.symbolCount(bytes) * symbolUs; }
+
+    /**
+     * @brief Start sending beacons, the first one after one interval.
+     * @param sessionId Session the beacons belong to.
+     * @param intervalMs Time between beacons, 0 disables them.
+     * @return ESP_OK, or the error of the timer.
+     */
+    esp_err_t startBeacons(uint16_t sessionId, uint32_t intervalMs = CONFIG_YOD_MODEM_BEACON_INTERVAL_S * 1000);
+
+    /**
+     * @brief Stop sending beacons, a beacon already on air is finished.
+     */
+    void stopBeacons();
+
+    /**
+     * @brief True while a burst is on air.
+     */
+    bool isTransmitting() const { return transmitting.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Bursts started since initialize(), a change means a burst started in between.
+     */
+    uint32_t getBurstCount() const { return burstCount.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Output back end in use.
+     */
+    Output getOutput() const { return output; }
+
+    /**
+     * @brief Symbol boundary jitter since initialize() or the last reset.
+     *
+     * Only measured with Output::Pwm, the DAC output is timed by its sample clock.
+     * @param reset Clear the statistics after reading them.
+     */
+    JitterStatistics getJitterStatistics(bool reset = false);
 
 private:
-    uint32_t highFreq; // High frequency
-    uint32_t lowFreq;  // Low frequency
+    static constexpr EventBits_t IDLE_BIT = BIT0;
+    static constexpr uint32_t NOTIFY_DATA = BIT0;       ///< New bytes in the TX buffer
+    static constexpr uint32_t NOTIFY_BURST_DONE = BIT1; ///< ISR sent the last symbol
+    static constexpr uint32_t NOTIFY_BEACON = BIT2;     ///< Beacon interval expired
+
+    MfskTonePlan tonePlan;
+    uint32_t symbolUs; // Duration of one symbol
+    Output output;
+    DacToneGenerator dac;
+    uint32_t dividers[MfskTonePlan::MAX_TONES]; ///< LEDC clock divider of every tone
+
+    SpscRingBuffer<uint8_t, TX_BUFFER_SIZE> txBuffer; ///< Filled under producerMutex, drained by the ISR
+    SemaphoreHandle_t producerMutex;  ///< Serialises callers, the ring itself has one producer
+    EventGroupHandle_t events;
+    TaskHandle_t txTask;
+    gptimer_handle_t symbolTimer;
+    CompletionCallback completionCallback;
+    void *completionContext;
+
+    // Burst state, owned by the ISR while the timer runs
+    MfskSymbolPacker packer;
+    uint32_t symbolIndex;
+    int64_t burstStartUs;
+    JitterStatistics jitter;
+    portMUX_TYPE jitterLock;
+
+    // Beacons
+    esp_timer_handle_t beaconTimer;
+    volatile bool beaconsActive;
+    uint16_t beaconSessionId;
+    uint16_t beaconSequence;
+    int64_t beaconStartUs;
+    uint32_t beaconDuty;              ///< PWM duty that gives CONFIG_YOD_MODEM_BEACON_LEVEL
+    std::atomic<bool> transmitting;
+    std::atomic<uint32_t> burstCount;
+
+    /**
+     * @brief Write the divider of one symbol value to the LEDC timer.
+     * @param symbol Symbol value to send.
+     */
+    void setSymbol(uint8_t symbol);
+
+    /**
+     * @brief Refill the packer from the TX buffer and start the next symbol.
+     * @return false when all bytes have been sent.
+     */
+    bool nextSymbol();
+
+    /**
+     * @brief Send everything in the TX buffer as one burst on the PWM output.
+     * @param quiet Send at the beacon level.
+     */
+    void sendBurst(bool quiet);
+
+    /**
+     * @brief Send everything in the TX buffer as one burst on the DAC output.
+     * @param quiet Send at the beacon level.
+     */
+    void sendBurstDac(bool quiet);
+
+    /**
+     * @brief Put the next beacon packet in the TX buffer.
+     * @return false when it does not fit.
+     */
+    bool queueBeacon();
+
+    /**
+     * @brief Configure the PWM channel, the tone dividers and the symbol timer.
+     */
+    esp_err_t initializePwm();
+
+    /**
+     * @brief Modem task, waits for data and runs bursts.
+     * @param pvParameters Pointer to the AudioModem.
+     */
+    static void txTaskFunction(void *pvParameters);
+
+    /**
+     * @brief gptimer alarm ISR, moves to the next symbol.
+     *
+     * Runs during flash operations with CONFIG_GPTIMER_ISR_IRAM_SAFE, so it may
+     * only call IRAM code: setSymbol(), nextSymbol() and forced inline helpers.
+     * @param timer Timer that fired.
+     * @param edata Alarm event data.
+     * @param userCtx Pointer to the AudioModem.
+     * @return true when a higher priority task was woken.
+     */
+    static bool onSymbolAlarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *userCtx);
 };
 
-#endif // AUDIO_MODEM_HPP
\ No newline at end of file
+#endif // AUDIO_MODEM_HPP
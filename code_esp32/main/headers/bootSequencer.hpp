@@ -0,0 +1,108 @@
+/**
+ * @file bootSequencer.hpp
+ * @brief Dependency ordered, concurrent peripheral initialisation with a boot timeline.
+ *
+ * Every job runs in its own short lived task. A job waits until all jobs it
+ * depends on have signalled their bit in a shared event group, runs its init
+ * function and then signals its own bit, so independent peripherals (I2C
+ * devices, UART, LEDC, GPIO) initialise in parallel without fixed delays.
+ */
+
+#ifndef BOOT_SEQUENCER_HPP
+#define BOOT_SEQUENCER_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <initializer_list>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "esp_err.h"
+
+/**
+ * @class BootSequencer
+ * @brief Runs init jobs concurrently in dependency order and records their timing.
+ */
+class BootSequencer {
+public:
+    /** @brief Init function of a job, runs in the job's own task. */
+    using JobFunction = esp_err_t (*)(void *context);
+
+    /** @brief Identifier returned by addJob(), used to express dependencies. */
+    using JobId = uint8_t;
+
+    static constexpr size_t MAX_JOBS = 16;  ///< Jobs per sequence, each uses one event group bit
+    static constexpr size_t MAX_MARKS = 8;  ///< Inline stages that can be timestamped with mark()
+
+    BootSequencer();
+
+    /**
+     * @brief Destructor, frees the event group once all jobs have finished.
+     */
+    ~BootSequencer();
+
+    /**
+     * @brief Add a job to the sequence.
+     * @param name Short name shown in the timeline.
+     * @param function Init function.
+     * @param context Passed unchanged to the init function.
+     * @param dependencies Jobs that must have finished successfully before this one starts.
+     * @param stackSize Stack of the job task in bytes.
+     * @return Identifier of the job.
+     */
+    JobId addJob(const char *name, JobFunction function, void *context = nullptr,
+                 std::initializer_list<JobId> dependencies = {}, uint32_t stackSize = 3072);
+
+    /**
+     * @brief Start all jobs and wait until they have finished.
+     * @param timeout Maximum time to wait for the whole sequence.
+     * @return ESP_OK when all jobs succeeded, ESP_ERR_TIMEOUT, or the error of the first failing job.
+     */
+    esp_err_t run(TickType_t timeout = portMAX_DELAY);
+
+    /**
+     * @brief Timestamp an inline boot stage.
+     * @param name Name shown in the timeline.
+     */
+    void mark(const char *name);
+
+    /**
+     * @brief Log every job and mark with its start and end time since boot,
+     * followed by the stack high-water mark of the calling task.
+     */
+    void printTimeline() const;
+
+private:
+    struct Job {
+        const char *name;
+        JobFunction function;
+        void *context;
+        EventBits_t dependencies; ///< Bits of the jobs this one waits for
+        uint32_t stackSize;
+        int64_t startUs;
+        int64_t endUs;
+        esp_err_t result;
+        int8_t core;
+        BootSequencer *sequencer;
+    };
+
+    struct Mark {
+        const char *name;
+        int64_t timeUs;
+    };
+
+    Job jobs[MAX_JOBS];
+    size_t jobCount;
+    Mark marks[MAX_MARKS];
+    size_t markCount;
+    EventGroupHandle_t doneBits;
+    volatile EventBits_t failedBits; ///< Jobs that failed or were skipped
+    bool finished;
+
+    /**
+     * @brief Task body of one job.
+     * @param pvParameters Pointer to the Job.
+     */
+    static void jobTask(void *pvParameters);
+};
+
+#endif // BOOT_SEQUENCER_HPP
@@ -7,6 +7,10 @@
 #include "observer.hpp"
 #include "esp_timer.h"
 #include "esp_sleep.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <atomic>
+#include "spscRingBuffer.hpp"
 /**
  * @class ButtonBoundary
  * @brief A class to handle button input with debounce functionality.
@@ -20,7 +24,11 @@ private:
     int debounceDelay;    ///< Debounce delay in milliseconds
     int64_t lastPressTime; ///< Last press timestamp
     Listener* listener; ///< Pointer to button listener
-    volatile bool buttonPressed; ///< Flag set by ISR when button is pressed
+    IsrSpscRingBuffer<int64_t, 8> presses; ///< Press timestamps (us) from the ISR to update()
+    bool activeLevel; ///< Pin level while the button is pressed
+    volatile bool waitingForPress; ///< Level interrupt is armed for the pressed level (power management only)
+    static TaskHandle_t wakeTask; ///< Task notified on every press
+    static std::atomic<uint32_t> pressCount; ///< Debounced presses of all buttons
 
 public:
 
@@ -50,7 +58,9 @@ public:
 
     /**
      * @brief Check for button press events and call listener if needed.
-     * Should be called periodically from main task.
+     *
+     * Presses closer than debounceDelay to the previous accepted press are
+     * dropped. Should be called periodically from main task.
      */
     void update();
 
@@ -60,6 +70,22 @@ public:
      * @return The ButtonId associated with this button.
      */
     ObserverId getId() const override;
+
+    /**
+     * @brief Set the task that is notified from the ISR when any button is pressed.
+     *
+     * Lets the observer task block instead of polling the buttons.
+     * @param task Task handle, or nullptr to disable notifications.
+     */
+    static void setWakeTask(TaskHandle_t task);
+
+    /**
+     * @brief Debounced presses of all buttons since boot.
+     *
+     * Lets another task notice user activity without being a listener.
+     * @return Press count, wraps around.
+     */
+    static uint32_t getPressCount() { return pressCount.load(std::memory_order_relaxed); }
     
     /**
      * @brief Interrupt Service Routine (ISR) handler for GPIO events.
@@ -71,6 +97,10 @@ public:
      * @param arg A pointer to user-defined data passed to the ISR. This can be used
      *            to pass context or additional information to the handler.
      * 
+     * With CONFIG_YOD_POWER_MANAGEMENT the pin uses level interrupts, because
+     * edge interrupts cannot wake the chip from light sleep. The ISR then flips
+     * the level on every call so one press gives one event.
+     * 
      * @note ISRs should be kept as short as possible to avoid blocking other
      *       interrupts. Avoid using functions that are not safe to call from
      *       an ISR context, such as those that allocate memory or use the heap.
@@ -0,0 +1,189 @@
+/**
+ * @file clockDiscipline.hpp
+ * @brief Keeps the system clock on the RTC, from the second boundaries of the RTC.
+ *
+ * Every measurement pairs a second boundary of the RTC with the system time
+ * at that moment. An anchor is a boundary whose RTC second was read from the
+ * registers; an SQW edge is a boundary whose second follows from the last
+ * accepted one. The offset (system minus RTC) is stepped away when it is
+ * large or the clock is not locked yet, otherwise the mean offset of
+ * AVERAGE_EDGES edges (or a single anchor), carried forward to the last
+ * one with the measured drift, is slewed away.
+ *
+ * An edge that is not a whole number of seconds after the previous one, give
+ * or take EDGE_TOLERANCE_US, came late (interrupt latency, a wake up) and is
+ * ignored; after RELOCK_REJECTS of them in a row a new anchor is needed. The
+ * drift of the system clock against the RTC is the slope of the offset with
+ * the corrections taken out.
+ *
+ * Plain C++, the caller reads the clocks and applies the corrections, so the
+ * host tests run it against a simulated clock.
+ */
+
+#ifndef CLOCK_DISCIPLINE_HPP
+#define CLOCK_DISCIPLINE_HPP
+
+#include <stdint.h>
+
+/**
+ * @class ClockDiscipline
+ * @brief Offset and drift tracking of the system clock against the RTC.
+ */
+class ClockDiscipline {
+public:
+    static constexpr int64_t STEP_US = 100000;            ///< Larger offsets are stepped, smaller ones slewed
+    static constexpr int64_t EDGE_TOLERANCE_US = 20000;   ///< Allowed distance of an edge from a whole second
+    static constexpr uint32_t AVERAGE_EDGES = 16;         ///< Edges averaged per slew
+    static constexpr uint32_t RELOCK_REJECTS = 3;         ///< Rejected edges in a row before a new anchor is needed
+    static constexpr int64_t DRIFT_MIN_US = 60000000;     ///< Time over which the drift is measured before it is given
+
+    struct Correction {
+        enum class Kind : uint8_t { None, Step, Slew };
+        Kind kind;
+        int64_t deltaUs;   ///< To add to the system clock
+    };
+
+    struct Stats {
+        uint32_t anchors;
+        uint32_t edges;
+        uint32_t rejected;       ///< Edges off a whole second
+        uint32_t steps;
+        uint32_t slews;
+        int32_t lastOffsetUs;    ///< System minus RTC at the last measurement
+        int32_t maxOffsetUs;     ///< Largest offset seen since the last step, either sign
+        float driftPpm;          ///< Positive when the system clock runs fast, 0 until DRIFT_MIN_US measured
+        int64_t lastSyncUs;      ///< System time of the last measurement
+    };
+
+    /**
+     * @brief Forget everything, for a new RTC time. The next measurement needs an anchor and steps.
+     */
+    void reset() {
+        stats = {};
+        anchored = false;
+        locked = false;
+        rejectsInRow = 0;
+        count = 0;
+        applied = 0;
+        hasReference = false;
+    }
+
+    bool needsAnchor() const { return !anchored; }
+    const Stats &getStats() const { return stats; }
+
+    /**
+     * @brief A boundary whose RTC second is known.
+     * @param rtcUs RTC time of the boundary, a whole second in us.
+     * @param systemUs System time at the boundary.
+     */
+    Correction anchor(int64_t rtcUs, int64_t systemUs) {
+        stats.anchors++;
+        anchored = true;
+        rejectsInRow = 0;
+        lastRtcUs = rtcUs;
+        lastSystemUs = systemUs;
+        return measure(rtcUs, systemUs, true);
+    }
+
+    /**
+     * @brief An SQW edge, a second boundary of the RTC.
+     * @param systemUs System time at the edge.
+     */
+    Correction edge(int64_t systemUs) {
+        stats.edges++;
+        if (!anchored) {
+            return {Correction::Kind::None, 0};
+        }
+        int64_t elapsed = systemUs - lastSystemUs;
+        int64_t seconds = (elapsed + 500000) / 1000000;
+        int64_t residual = elapsed - seconds * 1000000;
+        if (seconds < 1 || residual > EDGE_TOLERANCE_US || residual < -EDGE_TOLERANCE_US) {
+            stats.rejected++;
+            if (++rejectsInRow >= RELOCK_REJECTS) {
+                anchored = false;
+            }
+            return {Correction::Kind::None, 0};
+        }
+        rejectsInRow = 0;
+        lastRtcUs += seconds * 1000000;
+        lastSystemUs = systemUs;
+        return measure(lastRtcUs, systemUs, false);
+    }
+
+    /**
+     * @brief Part of the last slew that was not applied, because a new one replaced it.
+     */
+    void cancelled(int64_t deltaUs) {
+        applied -= deltaUs;
+    }
+
+private:
+    Stats stats = {};
+    bool anchored = false;
+    bool locked = false;
+    uint32_t rejectsInRow = 0;
+    int64_t lastRtcUs = 0;         ///< Last accepted boundary
+    int64_t lastSystemUs = 0;
+    int64_t sum = 0;               ///< Offsets waiting to be slewed
+    int64_t sumTimeUs = 0;         ///< Their system times, relative to the first one
+    int64_t firstUs = 0;
+    uint32_t count = 0;
+    int64_t applied = 0;           ///< Corrections handed out since the reference
+    bool hasReference = false;
+    int64_t referenceRaw = 0;      ///< Offset without corrections at the reference
+    int64_t referenceSystemUs = 0;
+
+    static int32_t clamp32(int64_t value) {
+        return value > INT32_MAX ? INT32_MAX : value < INT32_MIN ? INT32_MIN : (int32_t)value;
+    }
+
+    Correction measure(int64_t rtcUs, int64_t systemUs, bool immediate) {
+        int64_t offset = systemUs - rtcUs;
+        stats.lastOffsetUs = clamp32(offset);
+        stats.lastSyncUs = systemUs;
+
+        // What the offset would be without any correction grows with the drift
+        int64_t raw = offset - applied;
+        if (!hasReference) {
+            hasReference = true;
+            referenceRaw = raw;
+            referenceSystemUs = systemUs;
+        } else if (systemUs - referenceSystemUs >= DRIFT_MIN_US) {
+            stats.driftPpm = (float)(raw - referenceRaw) * 1e6f / (float)(systemUs - referenceSystemUs);
+        }
+
+        if (!locked || offset > STEP_US || offset < -STEP_US) {
+            locked = true;
+            stats.steps++;
+            stats.maxOffsetUs = 0;
+            count = 0;
+            applied -= offset;
+            // The step moves the system clock, and with it the last boundary
+            lastSystemUs -= offset;
+            return {Correction::Kind::Step, -offset};
+        }
+        if ((offset < 0 ? -offset : offset) > (stats.maxOffsetUs < 0 ? -stats.maxOffsetUs : stats.maxOffsetUs)) {
+            stats.maxOffsetUs = clamp32(offset);
+        }
+        if (count == 0) {
+            sum = 0;
+            sumTimeUs = 0;
+            firstUs = systemUs;
+        }
+        sum += offset;
+        sumTimeUs += systemUs - firstUs;
+        count++;
+        if (!immediate && count < AVERAGE_EDGES) {
+            return {Correction::Kind::None, 0};
+        }
+        // The mean holds for the middle of the edges, the drift moved the clock on since
+        int64_t sinceMeanUs = systemUs - firstUs - sumTimeUs / (int64_t)count;
+        int64_t delta = -sum / (int64_t)count - (int64_t)(stats.driftPpm * 1e-6f * (float)sinceMeanUs);
+        count = 0;
+        applied += delta;
+        stats.slews++;
+        return {Correction::Kind::Slew, delta};
+    }
+};
+
+#endif // CLOCK_DISCIPLINE_HPP
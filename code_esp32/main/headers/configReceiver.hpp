@@ -0,0 +1,119 @@
+/**
+ * @file configReceiver.hpp
+ * @brief Listens on the microphone for configuration packets played from a laptop speaker.
+ *
+ * While the device is not recording, the ADC samples the microphone with DMA
+ * at ConfigLink::SAMPLE_RATE and ModemReceiver looks for a Type::Config burst.
+ * Between bursts that is one Goertzel block per half symbol, so listening
+ * costs almost no CPU. A packet is only handed out when its MAC matches
+ * CONFIG_YOD_CONFIG_KEY and its counter is newer than the last one accepted,
+ * which is kept in NVS.
+ *
+ * The DMA keeps the APB clock up, so the receiver only listens within a
+ * window of CONFIG_YOD_CONFIG_RX_WINDOW_S after boot and after a button press.
+ */
+
+#ifndef CONFIG_RECEIVER_HPP
+#define CONFIG_RECEIVER_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include "esp_adc/adc_continuous.h"
+#include "soc/soc_caps.h"
+#include "esp_err.h"
+#include "configPacket.hpp"
+#include "modemReceiver.hpp"
+#include "storage.hpp"
+
+#ifndef CONFIG_YOD_CONFIG_RX
+#define CONFIG_YOD_CONFIG_RX 0
+#endif
+#ifndef CONFIG_YOD_CONFIG_KEY
+#define CONFIG_YOD_CONFIG_KEY ""
+#endif
+#ifndef CONFIG_YOD_CONFIG_RX_WINDOW_S
+#define CONFIG_YOD_CONFIG_RX_WINDOW_S 0
+#endif
+
+/**
+ * @class ConfigReceiver
+ * @brief Receives and authenticates configuration uploads on ADC1 channel 5.
+ */
+class ConfigReceiver {
+public:
+    /**
+     * @brief Constructs a ConfigReceiver.
+     * @param storage Storage of the replay counter.
+     */
+    explicit ConfigReceiver(Storage &storage);
+    ~ConfigReceiver();
+
+    /**
+     * @brief Parse the key, allocate the sample buffers and create the ADC DMA handle.
+     *
+     * Opens the first listening window and adds the listening time to the "power" report.
+     * @return ESP_OK, ESP_ERR_NOT_SUPPORTED when receiving is disabled or no key is set, or the error of the driver.
+     */
+    esp_err_t initialize();
+
+    /**
+     * @brief Start sampling. The analyzer reads the same ADC, so not while recording.
+     */
+    esp_err_t start();
+
+    /**
+     * @brief Stop sampling and drop a burst in progress.
+     */
+    esp_err_t stop();
+
+    /**
+     * @brief Feed what the DMA has delivered to the receiver.
+     * @param timeoutMs Longest wait for samples.
+     * @param[out] config Payload of an accepted packet.
+     * @return True when a new, authentic configuration arrived. Its counter is already stored.
+     */
+    bool poll(uint32_t timeoutMs, ConfigPayload &config);
+
+    bool isListening() const { return listening; }
+
+    /**
+     * @brief Listen for CONFIG_YOD_CONFIG_RX_WINDOW_S from now, e.g. after a button press.
+     */
+    void openWindow();
+
+    /**
+     * @brief Whether the listening window is open, always with a window of 0.
+     */
+    bool isWindowOpen() const;
+
+private:
+    static constexpr size_t CHUNK_SAMPLES = 256; ///< Samples per DMA frame, 12.8 ms
+    static constexpr int DC_SHIFT = 10;          ///< DC follower time constant, 2^10 samples
+    static constexpr int64_t WINDOW_US = (int64_t)CONFIG_YOD_CONFIG_RX_WINDOW_S * 1000000;
+    static constexpr size_t RAW_BYTES = CHUNK_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES; ///< One DMA frame
+
+    Storage &storage;
+    ModemCodec codec;
+    std::unique_ptr<float[]> buffer;
+    std::unique_ptr<ModemReceiver> receiver;
+    std::unique_ptr<ConfigAuthenticator> authenticator;
+    adc_continuous_handle_t handle;
+    bool listening;
+    float dc;           ///< Microphone bias, removed before the receiver
+    bool dcValid;       ///< dc holds a measured bias
+    std::unique_ptr<uint8_t[]> raw;   ///< DMA frame, on the heap like the receiver buffer
+    std::unique_ptr<float[]> samples; ///< Debiased samples of one frame
+    int64_t windowEndUs;  ///< End of the listening window
+    int64_t listenStartUs; ///< Start of the running listening interval
+    int64_t listenedUs;    ///< Finished listening intervals, the time the DMA kept the APB clock up
+    uint32_t windows;      ///< Listening windows opened
+
+    /**
+     * @brief Report hook of PowerManager, prints the listening time.
+     * @param context The ConfigReceiver.
+     */
+    static void printPower(void *context);
+};
+
+#endif // CONFIG_RECEIVER_HPP
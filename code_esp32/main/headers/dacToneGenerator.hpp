@@ -0,0 +1,102 @@
+/**
+ * @file dacToneGenerator.hpp
+ * @brief Phase-continuous sine tones on the ESP32 DAC, streamed with DMA.
+ *
+ * A 32-bit phase accumulator (numerically controlled oscillator) indexes a
+ * 256-entry sine table. Switching tone only changes the phase increment, so
+ * the waveform has no phase jump at a symbol boundary. The DMA clock sets
+ * the sample rate, so every symbol is an exact number of samples.
+ */
+
+#ifndef DAC_TONE_GENERATOR_HPP
+#define DAC_TONE_GENERATOR_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include "driver/gpio.h"
+#include "driver/dac_continuous.h"
+#include "esp_err.h"
+#include "mfsk.hpp"
+
+/**
+ * @class DacToneGenerator
+ * @brief Streams M-ary FSK symbols as sine tones through one DAC channel.
+ */
+class DacToneGenerator {
+public:
+    static constexpr uint32_t DEFAULT_SAMPLE_RATE = 192000; ///< Samples per second, 8 per period at 24 kHz
+    static constexpr uint32_t RAMP_US = 1000;               ///< Fade in and out of a burst, avoids a click
+
+    /**
+     * @brief Constructs a DacToneGenerator.
+     * @param gpioPin GPIO25 (DAC channel 1) or GPIO26 (DAC channel 2).
+     * @param sampleRate Samples per second.
+     * @param amplitude Peak amplitude in DAC steps around mid scale, 1 to 127.
+     */
+    DacToneGenerator(gpio_num_t gpioPin, uint32_t sampleRate = DEFAULT_SAMPLE_RATE, uint8_t amplitude = 100);
+    ~DacToneGenerator();
+
+    /**
+     * @brief Create the DAC DMA channel and compute the phase increment of every tone.
+     * @param plan Tone plan of the modem.
+     * @return ESP_OK, ESP_ERR_INVALID_ARG when the pin has no DAC, or the error of the driver.
+     */
+    esp_err_t initialize(const MfskTonePlan &plan);
+
+    /**
+     * @brief Scale the tones, used for quiet bursts. Not while a burst runs.
+     * @param percent Amplitude in percent of the constructor amplitude.
+     */
+    void setLevel(uint8_t percent);
+
+    /**
+     * @brief Enable the DMA and fade in from zero output.
+     */
+    esp_err_t start();
+
+    /**
+     * @brief Send one symbol, blocks until its last sample is queued for DMA.
+     * @param symbol Symbol value.
+     * @param samples Samples in the symbol.
+     */
+    esp_err_t writeSymbol(uint8_t symbol, size_t samples);
+
+    /**
+     * @brief Fade out to zero output and disable the DMA.
+     */
+    esp_err_t stop();
+
+    /**
+     * @brief Samples per second.
+     */
+    uint32_t getSampleRate() const { return sampleRate; }
+
+private:
+    static constexpr size_t TABLE_SIZE = 256;
+    static constexpr size_t CHUNK_SAMPLES = 512;
+    static constexpr uint32_t ENVELOPE_ONE = 1 << 16;
+
+    gpio_num_t gpioPin;
+    uint32_t sampleRate;
+    uint8_t amplitude;
+    dac_continuous_handle_t handle;
+    int8_t sineTable[TABLE_SIZE];                ///< One period, already scaled to the amplitude
+    uint32_t phaseSteps[MfskTonePlan::MAX_TONES];
+    uint32_t phase;
+    uint32_t currentStep;                        ///< Phase increment of the tone being sent
+    uint32_t envelope;                           ///< 0 to ENVELOPE_ONE, ramps at the burst edges
+    uint8_t chunk[CHUNK_SAMPLES];
+
+    /**
+     * @brief Write samples of a tone while the envelope moves linearly towards a target.
+     *
+     * The envelope scales the whole sample, mid scale included, so a burst
+     * starts and ends at zero output like the idle DAC.
+     * @param phaseStep Phase increment per sample.
+     * @param samples Number of samples.
+     * @param envelopeTarget Envelope at the end, 0 or ENVELOPE_ONE.
+     */
+    esp_err_t writeSamples(uint32_t phaseStep, size_t samples, uint32_t envelopeTarget);
+};
+
+#endif // DAC_TONE_GENERATOR_HPP
@@ -21,10 +21,16 @@ class DisplayController : public Listener {
 public:
     /**
      * @brief Constructs a DisplayController object.
-     * @param device Pointer to the SSD1306 device.
+     * @param device Pointer to the SSD1306 device, it must outlive the controller.
      * @param wordCountQueue Handle to the word count queue for reading data.
      */
     DisplayController(SSD1306_t* device, QueueHandle_t wordCountQueue);
+
+    /**
+     * @brief Initializes the display, the I2C bus of the device must exist.
+     * @return ESP_OK
+     */
+    esp_err_t initialize();
     
     /**
      * @brief Destructor for DisplayController.
@@ -73,7 +79,7 @@ public:
     void setRecording(bool isRecording);
 
 private:
-    SSD1306_t display; ///< SSD1306 display object.
+    SSD1306_t &display; ///< SSD1306 display object, filled in by i2c_master_init().
     QueueHandle_t wordCountQueue; ///< Handle to the word count queue.
      bool recording;
 };
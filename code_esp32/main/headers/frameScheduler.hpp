@@ -0,0 +1,145 @@
+/**
+ * @file frameScheduler.hpp
+ * @brief Periodic job release with jitter, execution time and deadline monitoring.
+ *
+ * A periodic esp_timer releases one job per period and wakes the consumer
+ * task. Release times are derived from the timer start and the release index,
+ * so they do not drift with the time spent in a job, and a window of N
+ * releases always spans exactly N periods.
+ */
+
+#ifndef FRAME_SCHEDULER_HPP
+#define FRAME_SCHEDULER_HPP
+
+#include <stdint.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+
+/**
+ * @class FrameScheduler
+ * @brief Releases periodic jobs for one consumer task and monitors their timing.
+ */
+class FrameScheduler {
+public:
+    /**
+     * @struct Release
+     * @brief One released job.
+     */
+    struct Release {
+        uint32_t index;        ///< Release number since start(), skipped releases included
+        int64_t releaseTimeUs; ///< Ideal release time
+        int64_t startTimeUs;   ///< Time the job actually started
+        uint32_t skipped;      ///< Releases dropped since the previous job because it overran
+    };
+
+    /**
+     * @struct Statistics
+     * @brief Timing statistics since start().
+     */
+    struct Statistics {
+        uint32_t jobs;            ///< Jobs executed
+        uint32_t skipped;         ///< Releases dropped because a job overran
+        uint32_t deadlineMisses;  ///< Jobs that finished after the next release
+        uint32_t overBudget;      ///< Jobs that ran longer than the budget
+        uint32_t degradedJobs;    ///< Jobs executed in degraded mode
+        int64_t jitterSumUs;
+        int64_t jitterMaxUs;
+        int64_t executionSumUs;
+        int64_t executionMaxUs;
+    };
+
+    /**
+     * @brief Constructs a FrameScheduler.
+     * @param periodUs Release period in microseconds.
+     * @param budgetUs Execution time budget of one job in microseconds.
+     * @param degradeEnabled Switch to degraded mode when a job exceeds the budget.
+     */
+    FrameScheduler(uint32_t periodUs, uint32_t budgetUs, bool degradeEnabled);
+
+    /**
+     * @brief Stops the timer and frees it.
+     */
+    ~FrameScheduler();
+
+    /**
+     * @brief Create the timer and register the "sched" serial command.
+     * @return ESP_OK, or the error of esp_timer_create.
+     */
+    esp_err_t initialize();
+
+    /**
+     * @brief Start releasing jobs to the calling task and reset the statistics.
+     *
+     * The first job is released immediately.
+     * @return ESP_OK, or the error of esp_timer_start_periodic.
+     */
+    esp_err_t start();
+
+    /**
+     * @brief Stop releasing jobs.
+     */
+    void stop();
+
+    /**
+     * @brief True between start() and stop().
+     */
+    bool isRunning() const { return running; }
+
+    /**
+     * @brief Block until the next job is released and mark it as started.
+     * @param[out] release Filled in with the release that was taken.
+     * @param timeout Maximum time to wait.
+     * @return false on timeout or when the scheduler is not running.
+     */
+    bool waitForRelease(Release &release, TickType_t timeout);
+
+    /**
+     * @brief Mark the job of a release as finished and update the statistics.
+     * @param release Release returned by waitForRelease().
+     */
+    void finishJob(const Release &release);
+
+    /**
+     * @brief True when the next job should use the cheaper degraded path.
+     */
+    bool isDegraded() const { return degraded; }
+
+    /**
+     * @brief Copy of the statistics since start().
+     */
+    Statistics getStatistics() const;
+
+    /**
+     * @brief Print the statistics to the console.
+     */
+    void printReport() const;
+
+private:
+    /** @brief Degraded jobs before the full path is tried again. */
+    static constexpr uint32_t RECOVERY_JOBS = 40;
+
+    uint32_t periodUs;
+    uint32_t budgetUs;
+    bool degradeEnabled;
+    esp_timer_handle_t timer;
+    TaskHandle_t consumer;
+    volatile bool running;
+    int64_t startTimeUs;              ///< Time of release 0
+    std::atomic<uint32_t> releaseCount; ///< Releases issued by the timer
+    uint32_t nextIndex;               ///< First release not yet taken by the consumer
+    bool degraded;
+    uint32_t degradedRemaining;
+    Statistics statistics;
+    mutable portMUX_TYPE statisticsLock;
+
+    /**
+     * @brief Timer callback, counts the release and notifies the consumer.
+     * @param arg Pointer to the FrameScheduler.
+     */
+    static void onTimer(void *arg);
+};
+
+#endif // FRAME_SCHEDULER_HPP
@@ -0,0 +1,147 @@
+/**
+ * @file i2cBusManager.hpp
+ * @brief One task that owns the shared I2C bus of the display, the RTC and the scanner.
+ *
+ * Clients do not call the i2c_master driver themselves; they hand a transfer
+ * (or, for the SSD1306 library, a job that makes its own driver calls) to
+ * the bus task and wait for the result. Every client has its own queue and
+ * the task always serves the highest priority queue first: RTC transfers,
+ * then display updates, then the scanner polls. A display update is cut
+ * into one job per page, so an RTC read waits for at most one page of
+ * display data instead of a full screen. Requests that arrive together are
+ * served in one pass of the task.
+ *
+ * Per client the task counts transfers, bytes, errors and timeouts and
+ * keeps the total and worst wait in the queue and time on the bus. The
+ * "i2c" serial command prints them.
+ *
+ * Before start() (and from inside a job) a request runs directly on the
+ * calling task, so boot code does not depend on the order of the jobs.
+ */
+
+#ifndef I2C_BUS_MANAGER_HPP
+#define I2C_BUS_MANAGER_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "driver/i2c_master.h"
+
+/**
+ * @enum I2cClient
+ * @brief Users of the bus, in order of priority.
+ */
+enum class I2cClient : uint8_t {
+    Rtc,       ///< Time and temperature reads, the clock sync
+    Display,   ///< SSD1306 pages
+    Scanner,   ///< QR scanner polls
+    Count
+};
+
+/**
+ * @class I2cBusManager
+ * @brief Process wide owner of the I2C bus, requests may come from any task.
+ */
+class I2cBusManager {
+public:
+    static constexpr size_t CLIENT_COUNT = (size_t)I2cClient::Count;
+    static constexpr size_t QUEUE_LENGTH = 4;        ///< Waiting requests per client
+    static constexpr uint32_t TRANSFER_TIMEOUT_MS = 50; ///< Driver timeout of one transfer
+    static constexpr uint32_t QUEUE_TIMEOUT_MS = 1000;  ///< Longest wait for room in a queue
+
+    /**
+     * @brief A job that makes its own driver calls on the bus task.
+     * @param context Passed through from run().
+     */
+    using Job = esp_err_t (*)(void *context);
+
+    struct ClientStats {
+        uint32_t transfers;
+        uint32_t bytes;          ///< Written and read
+        uint32_t errors;         ///< Failed transfers, timeouts included
+        uint32_t timeouts;
+        uint32_t maxWaitUs;      ///< Longest time in the queue
+        uint32_t maxBusUs;       ///< Longest time on the bus
+        uint64_t totalWaitUs;
+        uint64_t totalBusUs;
+    };
+
+    /**
+     * @brief Create the queues, start the bus task and register the "i2c" serial command.
+     * @return ESP_ERR_NO_MEM when a queue or the task could not be created.
+     */
+    static esp_err_t start();
+
+    /**
+     * @brief Write, then optionally read with a repeated start, and wait for the result.
+     * @param client Queue the transfer goes to.
+     * @param device Device handle from i2c_master_bus_add_device().
+     * @param write Bytes to write.
+     * @param writeLength Number of bytes to write.
+     * @param read Buffer for the read, nullptr for a write only.
+     * @param readLength Number of bytes to read.
+     * @return Result of the driver, or ESP_ERR_TIMEOUT when the queue stayed full.
+     */
+    static esp_err_t transfer(I2cClient client, i2c_master_dev_handle_t device, const uint8_t *write,
+                              size_t writeLength, uint8_t *read = nullptr, size_t readLength = 0);
+
+    /**
+     * @brief Run a job on the bus task and wait for it.
+     * @param client Queue the job goes to.
+     * @param job Function that makes the driver calls, it should keep to one short burst.
+     * @param context Passed to the job.
+     * @return What the job returned, or ESP_ERR_TIMEOUT when the queue stayed full.
+     */
+    static esp_err_t run(I2cClient client, Job job, void *context);
+
+    /**
+     * @brief Copy of the statistics of one client.
+     */
+    static void getStats(I2cClient client, ClientStats &stats);
+
+    /**
+     * @brief Print the statistics of every client.
+     */
+    static void printStats();
+
+private:
+    struct Request {
+        i2c_master_dev_handle_t device;
+        const uint8_t *write;
+        size_t writeLength;
+        uint8_t *read;
+        size_t readLength;
+        Job job;                   ///< Instead of the transfer when set
+        void *context;
+        int64_t queuedUs;
+        esp_err_t result;
+        SemaphoreHandle_t done;    ///< Given by the bus task, lives on the stack of the caller
+    };
+
+    static QueueHandle_t queues[CLIENT_COUNT];
+    static TaskHandle_t task;
+    static ClientStats stats[CLIENT_COUNT];
+
+    /**
+     * @brief Queue a request and wait for it, or run it here before start() and on the bus task.
+     */
+    static esp_err_t submit(I2cClient client, Request &request);
+
+    /**
+     * @brief Make the driver calls of a request and count them.
+     * @param waitUs Time the request spent in the queue.
+     */
+    static esp_err_t execute(I2cClient client, const Request &request, int64_t waitUs);
+
+    /**
+     * @brief Serves the queues, highest priority first.
+     * @param pvParameters Unused.
+     */
+    static void busTask(void *pvParameters);
+};
+
+#endif // I2C_BUS_MANAGER_HPP
@@ -0,0 +1,222 @@
+/**
+ * @file instrumentation.hpp
+ * @brief Runtime instrumentation for the YOD Recorder tasks and DSP pipeline.
+ *
+ * Samples FreeRTOS run-time statistics, stack high-water marks, queue depths
+ * and per-stage DSP cycle histograms. The statistics are available as a text
+ * report through the "stats" serial command and as a compact binary frame that
+ * is written to the console after every sample.
+ *
+ * Measurements from the audio task are handed to the instrumentation task
+ * through lock-free ring buffers, so the hot path never takes a lock. All
+ * memory is statically allocated and the cost of one sample is bounded by
+ * MAX_TASKS, MAX_QUEUES and the ring buffer sizes. With CONFIG_YOD_INSTRUMENTATION disabled the whole
+ * interface collapses to empty inline functions.
+ */
+
+#ifndef INSTRUMENTATION_HPP
+#define INSTRUMENTATION_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_cpu.h"
+#include "spscRingBuffer.hpp"
+
+/**
+ * @enum DspStage
+ * @brief Stages of the audio analysis pipeline that are timed in CPU cycles.
+ */
+enum class DspStage : uint8_t {
+    Sample,   ///< ADC capture of one frame
+    Window,   ///< Hann window and complex packing
+    Fft,      ///< Radix-2 FFT
+    Spectrum, ///< Bit reversal, split and power spectrum in dB
+    Detect,   ///< Peak search and word decision
+    Count
+};
+
+#if CONFIG_YOD_INSTRUMENTATION
+
+/**
+ * @class Instrumentation
+ * @brief Process wide collector for runtime statistics.
+ *
+ * recordCycles() and recordFrame() may be called from a single producer task
+ * (the audio analyser); they only push into a ring buffer. Sampling and
+ * reporting happen in the instrumentation task.
+ */
+class Instrumentation {
+public:
+    static constexpr size_t MAX_TASKS = 24;          ///< Tasks tracked per sample, with headroom for new tasks
+    static constexpr size_t MAX_QUEUES = 4;          ///< Queues that can be registered
+    static constexpr size_t HISTOGRAM_BUCKETS = 16;  ///< log2 buckets per DSP stage
+    static constexpr uint8_t HISTOGRAM_MIN_BITS = 10; ///< Bucket 0 holds everything below 2^10 cycles
+    static constexpr size_t CYCLE_RING_SIZE = 256;   ///< Stage measurements buffered between samples
+    static constexpr size_t FRAME_RING_SIZE = 64;    ///< Frame summaries buffered between samples
+
+    /**
+     * @brief Register the serial commands and start the sampling task.
+     */
+    static void start();
+
+    /**
+     * @brief Track the depth of a queue.
+     * @param name Short name, at most 8 characters are reported.
+     * @param queue Queue handle to sample.
+     */
+    static void registerQueue(const char *name, QueueHandle_t queue);
+
+    /**
+     * @brief Add one cycle measurement to the histogram of a DSP stage.
+     * @param stage Pipeline stage that was measured.
+     * @param cycles Elapsed CPU cycles.
+     */
+    static void recordCycles(DspStage stage, uint32_t cycles);
+
+    /**
+     * @brief Hand over the summary of one analysed audio frame.
+     * @param peakFrequency Frequency of the spectral peak in Hz.
+     * @param peakValue Level of the spectral peak in dB.
+     * @param word True when the frame was classified as speech.
+     */
+    static void recordFrame(float peakFrequency, float peakValue, bool word);
+
+    /**
+     * @brief Print the last sample as a human readable report.
+     */
+    static void printReport();
+
+    /**
+     * @brief Write the last sample as a binary frame to the console.
+     *
+     * Frame layout (little endian): 0xA5 0x5A, version, type, payload length (u16),
+     * payload, CRC-16 of the payload (u16).
+     */
+    static void dumpBinary();
+
+private:
+    struct TaskSample {
+        char name[configMAX_TASK_NAME_LEN];
+        UBaseType_t taskNumber;
+        uint32_t lastRunTime;
+        uint16_t cpuPermille;   ///< Share of one core during the last window
+        uint16_t stackHwmBytes; ///< Minimum free stack ever seen
+        uint8_t core;
+    };
+
+    struct StageHistogram {
+        uint32_t count;
+        uint32_t maxCycles;
+        uint32_t buckets[HISTOGRAM_BUCKETS];
+    };
+
+    struct CycleRecord {
+        DspStage stage;
+        uint32_t cycles;
+    };
+
+    struct FrameRecord {
+        uint32_t timeMs;
+        float peakFrequency;
+        float peakValue;
+        bool word;
+    };
+
+    struct FrameStatistics {
+        uint32_t frames;
+        uint32_t words;
+        uint32_t dropped;   ///< Records lost because a ring buffer was full
+        FrameRecord last;
+    };
+
+    struct QueueSample {
+        const char *name;
+        QueueHandle_t queue;
+        uint8_t depth;
+        uint8_t maxDepth;
+        uint8_t capacity;
+    };
+
+    static TaskSample tasks[MAX_TASKS];
+    static size_t taskCount;
+    static UBaseType_t taskOverflow; ///< Tasks running while the table was too small, 0 when they fit
+    static uint32_t lastTotalRunTime;
+    static StageHistogram stages[(size_t)DspStage::Count];
+    static SpscRingBuffer<CycleRecord, CYCLE_RING_SIZE> cycleRing;
+    static SpscRingBuffer<FrameRecord, FRAME_RING_SIZE> frameRing;
+    static std::atomic<uint32_t> droppedRecords;
+    static FrameStatistics frameStatistics;
+    static QueueSample queues[MAX_QUEUES];
+    static size_t queueCount;
+    static SemaphoreHandle_t sampleMutex; ///< Guards the sample against concurrent reports
+
+    /**
+     * @brief Take one sample of the task list and registered queues.
+     */
+    static void sample();
+
+    /**
+     * @brief Update the task table from a system state snapshot, with sampleMutex held.
+     * @param status Snapshot from uxTaskGetSystemState().
+     * @param n Tasks in the snapshot.
+     * @param totalRunTime Run time counter of the snapshot.
+     */
+    static void sampleTasks(const TaskStatus_t *status, UBaseType_t n, uint32_t totalRunTime);
+
+    /**
+     * @brief Move the buffered cycle and frame records into the statistics.
+     */
+    static void drainRings();
+
+    /**
+     * @brief Add one cycle measurement to the histogram of its stage.
+     * @param record Measurement popped from the ring buffer.
+     */
+    static void addToHistogram(const CycleRecord &record);
+
+    /**
+     * @brief Periodic sampling task.
+     * @param pvParameters Unused.
+     */
+    static void instrumentationTask(void *pvParameters);
+};
+
+/**
+ * @class StageTimer
+ * @brief Scope guard that records the cycles spent in a DSP stage.
+ */
+class StageTimer {
+public:
+    explicit StageTimer(DspStage stage) : stage(stage), start(esp_cpu_get_cycle_count()) {}
+    ~StageTimer() { Instrumentation::recordCycles(stage, esp_cpu_get_cycle_count() - start); }
+
+private:
+    DspStage stage;
+    uint32_t start;
+};
+
+#else // CONFIG_YOD_INSTRUMENTATION
+
+class Instrumentation {
+public:
+    static void start() {}
+    static void registerQueue(const char *, QueueHandle_t) {}
+    static void recordCycles(DspStage, uint32_t) {}
+    static void recordFrame(float, float, bool) {}
+    static void printReport() {}
+    static void dumpBinary() {}
+};
+
+class StageTimer {
+public:
+    explicit StageTimer(DspStage) {}
+};
+
+#endif // CONFIG_YOD_INSTRUMENTATION
+
+#endif // INSTRUMENTATION_HPP
@@ -0,0 +1,51 @@
+/**
+ * @file journalFlashAbstract.hpp
+ * @brief Raw flash area the session journal is written to.
+ *
+ * Plain C++, so JournalLog runs on the host against a simulated flash. The
+ * calls follow esp_partition_read(), esp_partition_write() and
+ * esp_partition_erase_range(): a write can only clear bits, an erase sets a
+ * whole sector back to 0xFF.
+ */
+
+#ifndef JOURNAL_FLASH_ABSTRACT_HPP
+#define JOURNAL_FLASH_ABSTRACT_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @class JournalFlashAbstract
+ * @brief Abstract base class for the flash under the journal.
+ */
+class JournalFlashAbstract {
+public:
+    static constexpr size_t SECTOR_SIZE = 4096;   ///< Erase unit, SPI_FLASH_SEC_SIZE
+    static constexpr size_t PAGE_SIZE = 256;      ///< Program unit, one write never crosses it
+
+    virtual ~JournalFlashAbstract() = default;
+
+    /**
+     * @brief Size of the area in bytes, a multiple of SECTOR_SIZE.
+     */
+    virtual size_t getSize() const = 0;
+
+    /**
+     * @return False when the flash reported an error.
+     */
+    virtual bool read(size_t offset, void *buffer, size_t length) = 0;
+
+    /**
+     * @brief Program bytes that were erased before.
+     * @return False when the flash reported an error, the bytes may be partly programmed.
+     */
+    virtual bool write(size_t offset, const void *data, size_t length) = 0;
+
+    /**
+     * @brief Erase the sector that starts at offset.
+     * @return False when the flash reported an error.
+     */
+    virtual bool eraseSector(size_t offset) = 0;
+};
+
+#endif // JOURNAL_FLASH_ABSTRACT_HPP
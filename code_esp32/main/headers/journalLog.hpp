@@ -0,0 +1,574 @@
+/**
+ * @file journalLog.hpp
+ * @brief Append-only log of fixed-size records in a ring of flash sectors.
+ *
+ * Layout: every sector starts with a JournalSectorHeader in slot 0, followed
+ * by RECORDS_PER_SECTOR slots of one JournalRecord. A sector is only written
+ * from front to back and is erased as a whole when the ring comes round to
+ * it again, dropping the oldest records. Every sector is erased once per
+ * lap, which is the whole wear levelling.
+ *
+ * Records are collected in RAM and written when they fill the rest of the
+ * current flash page, or on flush(). A write never crosses a page. The
+ * sequence number of a record is its slot: the first record of a sector
+ * plus the slot index, so a slot that was lost to a power cut or a failed
+ * write shows up as a gap in the sequence.
+ *
+ * Erasing a sector takes tens of milliseconds in which the flash cache is
+ * off. eraseAhead() does it for the next sector at a quiet moment, opening
+ * that sector later is then a header write only.
+ *
+ * Recovery after a reset reads the sector headers only, takes the one with
+ * the highest sequence as the head and finds the first erased slot in it
+ * with a binary search. A page that a power cut left half written is
+ * skipped, its good records are read and the torn ones fail their CRC.
+ *
+ * Plain C++, so the format and the recovery are tested on the host against
+ * a simulated flash. SessionJournal owns one in the firmware and calls it
+ * from a single task.
+ */
+
+#ifndef JOURNAL_LOG_HPP
+#define JOURNAL_LOG_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include "journalFlashAbstract.hpp"
+#include "modemPacket.hpp"
+
+/**
+ * @enum JournalType
+ * @brief What a JournalRecord holds, and the layout of its payload (little endian).
+ */
+enum class JournalType : uint8_t {
+    Boot = 1,          ///< Reset: reset reason (u8)
+    SessionStart = 2,  ///< Session id (u32), clock time of the start (u32, time_t)
+    SessionStop = 3,   ///< Session id (u32)
+    Patient = 4,       ///< Session id (u32), patient code (16 characters, zero padded)
+    Speech = 5,        ///< Words (u16), frames analysed (u16), modem frames (u16), window length in ms (u32)
+    Button = 6,        ///< ObserverId (u8)
+    Fault = 7,         ///< JournalFaultSource (u8), code (i32)
+};
+
+/**
+ * @enum JournalFaultSource
+ * @brief Module a Fault record comes from, it tells how to read the code.
+ */
+enum class JournalFaultSource : uint8_t {
+    Recorder = 1,  ///< TascamFault
+    Storage = 2,   ///< esp_err_t of a failed NVS flush
+};
+
+/**
+ * @struct JournalRecord
+ * @brief One entry of the journal, 32 bytes on flash.
+ */
+struct JournalRecord {
+    static constexpr size_t PAYLOAD_SIZE = 20;
+    static constexpr size_t PATIENT_LENGTH = 16;
+
+    uint32_t sequence;              ///< Set when it is written
+    uint32_t uptimeMs;              ///< Since the reset, Boot and SessionStart records anchor it
+    JournalType type;
+    uint8_t length;                 ///< Payload bytes used
+    uint8_t payload[PAYLOAD_SIZE];
+    uint16_t crc;                   ///< CRC-16/CCITT-FALSE of the bytes before it
+
+    static JournalRecord boot(uint32_t uptimeMs, uint8_t resetReason) {
+        JournalRecord record = make(JournalType::Boot, uptimeMs);
+        record.put8(resetReason);
+        return record;
+    }
+
+    static JournalRecord sessionStart(uint32_t uptimeMs, uint32_t sessionId, uint32_t startTime) {
+        JournalRecord record = make(JournalType::SessionStart, uptimeMs);
+        record.put32(sessionId);
+        record.put32(startTime);
+        return record;
+    }
+
+    static JournalRecord sessionStop(uint32_t uptimeMs, uint32_t sessionId) {
+        JournalRecord record = make(JournalType::SessionStop, uptimeMs);
+        record.put32(sessionId);
+        return record;
+    }
+
+    /**
+     * @param patient Scanned code, cut off after PATIENT_LENGTH characters.
+     */
+    static JournalRecord patient(uint32_t uptimeMs, uint32_t sessionId, const char *patient) {
+        JournalRecord record = make(JournalType::Patient, uptimeMs);
+        record.put32(sessionId);
+        memcpy(&record.payload[record.length], patient, strnlen(patient, PATIENT_LENGTH));
+        record.length += PATIENT_LENGTH;
+        return record;
+    }
+
+    static JournalRecord speech(uint32_t uptimeMs, uint16_t words, uint16_t frames, uint16_t modemFrames,
+                                uint32_t windowMs) {
+        JournalRecord record = make(JournalType::Speech, uptimeMs);
+        record.put16(words);
+        record.put16(frames);
+        record.put16(modemFrames);
+        record.put32(windowMs);
+        return record;
+    }
+
+    static JournalRecord button(uint32_t uptimeMs, uint8_t observerId) {
+        JournalRecord record = make(JournalType::Button, uptimeMs);
+        record.put8(observerId);
+        return record;
+    }
+
+    static JournalRecord fault(uint32_t uptimeMs, JournalFaultSource source, int32_t code) {
+        JournalRecord record = make(JournalType::Fault, uptimeMs);
+        record.put8((uint8_t)source);
+        record.put32((uint32_t)code);
+        return record;
+    }
+
+    uint16_t get16(size_t offset) const {
+        return (uint16_t)(payload[offset] | payload[offset + 1] << 8);
+    }
+
+    uint32_t get32(size_t offset) const {
+        return (uint32_t)get16(offset) | (uint32_t)get16(offset + 2) << 16;
+    }
+
+    uint16_t computeCrc() const {
+        return ModemPacket::crc16((const uint8_t *)this, offsetof(JournalRecord, crc));
+    }
+
+    bool isValid() const {
+        return crc == computeCrc() && length <= PAYLOAD_SIZE;
+    }
+
+private:
+    static JournalRecord make(JournalType type, uint32_t uptimeMs) {
+        JournalRecord record;
+        memset(&record, 0, sizeof(record));
+        record.uptimeMs = uptimeMs;
+        record.type = type;
+        return record;
+    }
+
+    void put8(uint8_t value) {
+        payload[length++] = value;
+    }
+
+    void put16(uint16_t value) {
+        put8(value & 0xFF);
+        put8(value >> 8);
+    }
+
+    void put32(uint32_t value) {
+        put16(value & 0xFFFF);
+        put16(value >> 16);
+    }
+};
+
+static_assert(sizeof(JournalRecord) == 32, "a JournalRecord is one 32 byte slot");
+
+/**
+ * @struct JournalSectorHeader
+ * @brief Slot 0 of every sector in use.
+ */
+struct JournalSectorHeader {
+    static constexpr uint32_t MAGIC = 0x4A444F59;   ///< "YODJ"
+    static constexpr uint16_t VERSION = 1;
+
+    uint32_t magic;
+    uint32_t sequence;      ///< One more than the sector opened before it
+    uint32_t firstRecord;   ///< Sequence of the record in slot 1
+    uint16_t version;
+    uint16_t recordSize;
+    uint8_t reserved[14];
+    uint16_t crc;           ///< CRC-16/CCITT-FALSE of the bytes before it
+
+    static JournalSectorHeader make(uint32_t sequence, uint32_t firstRecord) {
+        JournalSectorHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = MAGIC;
+        header.sequence = sequence;
+        header.firstRecord = firstRecord;
+        header.version = VERSION;
+        header.recordSize = sizeof(JournalRecord);
+        header.crc = ModemPacket::crc16((const uint8_t *)&header, offsetof(JournalSectorHeader, crc));
+        return header;
+    }
+
+    bool isValid() const {
+        return magic == MAGIC && version == VERSION && recordSize == sizeof(JournalRecord) &&
+               crc == ModemPacket::crc16((const uint8_t *)this, offsetof(JournalSectorHeader, crc));
+    }
+};
+
+static_assert(sizeof(JournalSectorHeader) == sizeof(JournalRecord), "the header fills slot 0");
+
+/**
+ * @class JournalLog
+ * @brief The journal on a JournalFlashAbstract. Not thread safe, one owner calls it.
+ */
+class JournalLog {
+public:
+    static constexpr size_t SECTOR_SIZE = JournalFlashAbstract::SECTOR_SIZE;
+    static constexpr size_t SLOT_SIZE = sizeof(JournalRecord);
+    static constexpr size_t SLOTS_PER_SECTOR = SECTOR_SIZE / SLOT_SIZE;
+    static constexpr size_t RECORDS_PER_SECTOR = SLOTS_PER_SECTOR - 1;
+    static constexpr size_t SLOTS_PER_PAGE = JournalFlashAbstract::PAGE_SIZE / SLOT_SIZE;
+    static constexpr size_t BATCH_SIZE = SLOTS_PER_PAGE;    ///< Records held in RAM at most
+
+    /**
+     * @brief Counters for the serial command and the tests.
+     */
+    struct Stats {
+        size_t appended;      ///< Records accepted by append()
+        size_t dropped;       ///< Records refused because the batch could not be written
+        size_t written;       ///< Records on flash
+        size_t writes;        ///< Flash writes of records, each within one page
+        size_t erases;        ///< Sectors erased
+        size_t failures;      ///< Erases and writes the flash reported as failed
+        size_t corrupt;       ///< Written slots skipped by read() for a bad CRC
+    };
+
+    /**
+     * @brief What mount() found and what it cost.
+     */
+    struct MountInfo {
+        size_t sectors;       ///< Sectors with a valid header
+        size_t reads;         ///< Flash reads
+        size_t bytesRead;
+        bool tornPage;        ///< A power cut left the last page half written
+    };
+
+    explicit JournalLog(JournalFlashAbstract &flash) : flash(flash) {}
+
+    JournalLog(const JournalLog &) = delete;
+    JournalLog &operator=(const JournalLog &) = delete;
+
+    /**
+     * @brief Find the end of the journal, after a reset or on an empty flash.
+     * @return False when the area is too small or a header could not be read.
+     */
+    bool mount() {
+        mountInfo = {};
+        batchCount = 0;
+        head = NONE;
+        headSlot = SLOTS_PER_SECTOR;
+        erasedAhead = NONE;
+        sectorSequence = 0;
+        nextSequence = 1;
+        sectors.assign(flash.getSize() / SECTOR_SIZE, SectorInfo{false, 0, 0});
+        if (sectors.size() < 2) {
+            return false;
+        }
+
+        for (size_t index = 0; index < sectors.size(); index++) {
+            JournalSectorHeader header;
+            if (!readCounted(index * SECTOR_SIZE, &header, sizeof(header))) {
+                return false;
+            }
+            if (!header.isValid()) {
+                continue;
+            }
+            sectors[index] = {true, header.sequence, header.firstRecord};
+            mountInfo.sectors++;
+            if (head == NONE || header.sequence > sectorSequence) {
+                head = index;
+                sectorSequence = header.sequence;
+            }
+        }
+        if (head == NONE) {
+            mounted = true;
+            return true;
+        }
+
+        // Slots are written in order, so the written ones are a prefix of the sector
+        size_t low = 1;
+        size_t high = SLOTS_PER_SECTOR;
+        while (low < high) {
+            size_t middle = (low + high) / 2;
+            uint8_t slot[SLOT_SIZE];
+            if (!readCounted(slotOffset(head, middle), slot, sizeof(slot))) {
+                return false;
+            }
+            if (isErased(slot, sizeof(slot))) {
+                high = middle;
+            } else {
+                low = middle + 1;
+            }
+        }
+        // A page cut off while it was programmed may have erased slots before programmed ones
+        size_t pageEnd = std::min(SLOTS_PER_SECTOR, (low / SLOTS_PER_PAGE + 1) * SLOTS_PER_PAGE);
+        for (size_t slot = low + 1; slot < pageEnd; slot++) {
+            uint8_t bytes[SLOT_SIZE];
+            if (!readCounted(slotOffset(head, slot), bytes, sizeof(bytes))) {
+                return false;
+            }
+            if (!isErased(bytes, sizeof(bytes))) {
+                mountInfo.tornPage = true;
+                low = pageEnd;
+                break;
+            }
+        }
+        headSlot = low;
+        nextSequence = sectors[head].firstRecord + (uint32_t)(headSlot - 1);
+        mounted = true;
+        return true;
+    }
+
+    /**
+     * @brief Add a record to the RAM batch; the batch is written once it fills the current page.
+     * @return False when the batch was full and could not be written, the record is dropped.
+     */
+    bool append(const JournalRecord &record) {
+        if (batchCount == BATCH_SIZE && !flush()) {
+            stats.dropped++;
+            return false;
+        }
+        batch[batchCount++] = record;
+        stats.appended++;
+        if (batchCount >= slotsLeftInPage()) {
+            flush();
+        }
+        return true;
+    }
+
+    /**
+     * @brief Write the batch to flash.
+     * @return False when a write failed, the unwritten records stay in the batch.
+     */
+    bool flush() {
+        if (!mounted) {
+            return batchCount == 0;
+        }
+        size_t done = 0;
+        while (done < batchCount) {
+            if (headSlot >= SLOTS_PER_SECTOR && !openSector()) {
+                break;
+            }
+            size_t count = std::min(batchCount - done, slotsLeftInPage());
+            for (size_t i = 0; i < count; i++) {
+                JournalRecord &record = batch[done + i];
+                record.sequence = nextSequence + (uint32_t)i;
+                record.crc = record.computeCrc();
+            }
+            bool ok = flash.write(slotOffset(head, headSlot), &batch[done], count * SLOT_SIZE);
+            // The slots are used either way, a failed write may have programmed part of them
+            headSlot += count;
+            nextSequence += (uint32_t)count;
+            if (!ok) {
+                stats.failures++;
+                break;
+            }
+            done += count;
+            stats.written += count;
+            stats.writes++;
+        }
+        std::copy(batch + done, batch + batchCount, batch);
+        batchCount -= done;
+        return batchCount == 0;
+    }
+
+    /**
+     * @brief Erase the sector the journal continues in now, dropping its records a little early.
+     * @return False when the erase failed.
+     */
+    bool eraseAhead() {
+        if (!mounted) {
+            return false;
+        }
+        size_t index = nextSector();
+        if (index == erasedAhead) {
+            return true;
+        }
+        sectors[index].valid = false;
+        stats.erases++;
+        if (!flash.eraseSector(index * SECTOR_SIZE)) {
+            stats.failures++;
+            return false;
+        }
+        erasedAhead = index;
+        return true;
+    }
+
+    /**
+     * @brief Copy the records on flash from sequence on, oldest first. The batch is not included.
+     *
+     * Records that were overwritten are skipped, so sequence jumps forward to
+     * the oldest one still there.
+     * @param[in,out] sequence First record wanted, advanced past the slots that were read.
+     * @param records Destination.
+     * @param maxRecords Size of records.
+     * @return Records copied, 0 when there are none from sequence on.
+     */
+    size_t read(uint32_t &sequence, JournalRecord *records, size_t maxRecords) {
+        size_t count = 0;
+        while (count < maxRecords && mounted) {
+            size_t index = findSector(sequence);
+            if (index == NONE) {
+                break;
+            }
+            const SectorInfo &info = sectors[index];
+            sequence = std::max(sequence, info.firstRecord);
+            size_t slot = 1 + (sequence - info.firstRecord);
+            size_t end = index == head ? headSlot : SLOTS_PER_SECTOR;
+            if (slot >= end) {
+                if (index == head) {
+                    break;
+                }
+                sequence = info.firstRecord + (uint32_t)RECORDS_PER_SECTOR;
+                continue;
+            }
+            size_t length = std::min(end - slot, maxRecords - count);
+            if (!flash.read(slotOffset(index, slot), &records[count], length * SLOT_SIZE)) {
+                break;
+            }
+            // The valid ones move down over the skipped ones
+            size_t kept = 0;
+            for (size_t i = 0; i < length; i++) {
+                JournalRecord record = records[count + i];
+                if (isErased(&record, SLOT_SIZE)) {
+                    continue;
+                }
+                if (!record.isValid() || record.sequence != sequence + i) {
+                    stats.corrupt++;
+                    continue;
+                }
+                records[count + kept++] = record;
+            }
+            count += kept;
+            sequence += (uint32_t)length;
+        }
+        return count;
+    }
+
+    /** @brief Sequence of the oldest record on flash, getNextSequence() when there is none. */
+    uint32_t getOldestSequence() const {
+        uint32_t oldest = nextSequence;
+        for (const SectorInfo &info : sectors) {
+            if (info.valid && info.firstRecord < oldest) {
+                oldest = info.firstRecord;
+            }
+        }
+        return oldest;
+    }
+
+    /** @brief Sequence the next record written gets. */
+    uint32_t getNextSequence() const { return nextSequence; }
+    size_t getPending() const { return batchCount; }
+    size_t getSectorCount() const { return sectors.size(); }
+    size_t getCapacity() const { return sectors.size() * RECORDS_PER_SECTOR; }
+    bool isMounted() const { return mounted; }
+    const MountInfo &getMountInfo() const { return mountInfo; }
+    const Stats &getStats() const { return stats; }
+
+private:
+    static constexpr size_t NONE = SIZE_MAX;
+
+    struct SectorInfo {
+        bool valid;             ///< Holds a valid header
+        uint32_t sequence;
+        uint32_t firstRecord;
+    };
+
+    JournalFlashAbstract &flash;
+    std::vector<SectorInfo> sectors;
+    bool mounted = false;
+    size_t head = NONE;                     ///< Sector written to
+    size_t headSlot = SLOTS_PER_SECTOR;     ///< Next slot in it, SLOTS_PER_SECTOR when full
+    size_t erasedAhead = NONE;              ///< Sector erased by eraseAhead() and not opened yet
+    uint32_t sectorSequence = 0;            ///< Sequence of the last sector opened
+    uint32_t nextSequence = 1;
+    JournalRecord batch[BATCH_SIZE];
+    size_t batchCount = 0;
+    MountInfo mountInfo = {};
+    Stats stats = {};
+
+    static size_t slotOffset(size_t sector, size_t slot) {
+        return sector * SECTOR_SIZE + slot * SLOT_SIZE;
+    }
+
+    static bool isErased(const void *data, size_t length) {
+        const uint8_t *bytes = static_cast<const uint8_t *>(data);
+        for (size_t i = 0; i < length; i++) {
+            if (bytes[i] != 0xFF) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool readCounted(size_t offset, void *buffer, size_t length) {
+        mountInfo.reads++;
+        mountInfo.bytesRead += length;
+        return flash.read(offset, buffer, length);
+    }
+
+    size_t nextSector() const {
+        return head == NONE ? 0 : (head + 1) % sectors.size();
+    }
+
+    /**
+     * @brief Slots the next write may fill before the page ends, counted from a new sector when the head is full.
+     */
+    size_t slotsLeftInPage() const {
+        size_t slot = headSlot >= SLOTS_PER_SECTOR ? 1 : headSlot;
+        return SLOTS_PER_PAGE - slot % SLOTS_PER_PAGE;
+    }
+
+    /**
+     * @brief Erase the sector after the head and make it the head.
+     * @return False when the flash failed, the next call tries the sector after it.
+     */
+    bool openSector() {
+        size_t index = nextSector();
+        head = index;
+        headSlot = SLOTS_PER_SECTOR;
+        sectors[index].valid = false;
+        sectorSequence++;
+        if (index == erasedAhead) {
+            erasedAhead = NONE;
+        } else {
+            stats.erases++;
+            if (!flash.eraseSector(index * SECTOR_SIZE)) {
+                stats.failures++;
+                return false;
+            }
+        }
+        JournalSectorHeader header = JournalSectorHeader::make(sectorSequence, nextSequence);
+        if (!flash.write(index * SECTOR_SIZE, &header, sizeof(header))) {
+            stats.failures++;
+            return false;
+        }
+        sectors[index] = {true, sectorSequence, nextSequence};
+        headSlot = 1;
+        return true;
+    }
+
+    /**
+     * @brief The sector holding sequence, or else the oldest one after it.
+     * @return NONE when no record from sequence on was written.
+     */
+    size_t findSector(uint32_t sequence) const {
+        size_t after = NONE;
+        for (size_t index = 0; index < sectors.size(); index++) {
+            const SectorInfo &info = sectors[index];
+            if (!info.valid) {
+                continue;
+            }
+            if (sequence >= info.firstRecord && sequence - info.firstRecord < RECORDS_PER_SECTOR) {
+                return index;
+            }
+            if (info.firstRecord > sequence && (after == NONE || info.firstRecord < sectors[after].firstRecord)) {
+                after = index;
+            }
+        }
+        return after;
+    }
+};
+
+#endif // JOURNAL_LOG_HPP
@@ -0,0 +1,57 @@
+/**
+ * @file ledcAllocator.hpp
+ * @brief Hands out LEDC timers and channels to PWM outputs.
+ *
+ * Every PWMChannel takes its own timer and channel when it is constructed,
+ * so outputs on different pins never change each other's frequency or duty.
+ * Only the low-speed group is used: the modem ISR writes its timer with the
+ * low-speed LL calls. On the ESP32 that is 4 timers and 8 channels.
+ */
+
+#ifndef LEDC_ALLOCATOR_HPP
+#define LEDC_ALLOCATOR_HPP
+
+#include <stdint.h>
+#include "driver/ledc.h"
+#include "esp_err.h"
+
+/**
+ * @class LedcAllocator
+ * @brief Process-wide bookkeeping of the free LEDC timers and channels.
+ */
+class LedcAllocator {
+public:
+    static constexpr ledc_mode_t MODE = LEDC_LOW_SPEED_MODE;
+
+    /**
+     * @brief A timer and a channel on it, owned by one output.
+     */
+    struct Resource {
+        ledc_timer_t timer = LEDC_TIMER_MAX;
+        ledc_channel_t channel = LEDC_CHANNEL_MAX;
+
+        bool isValid() const { return timer != LEDC_TIMER_MAX && channel != LEDC_CHANNEL_MAX; }
+    };
+
+    /**
+     * @brief Take the lowest free timer and channel.
+     * @param owner GPIO of the output, only for the log.
+     * @param[out] resource The resource, invalid on failure.
+     * @return ESP_OK, or ESP_ERR_NOT_FOUND when all timers or all channels are taken.
+     */
+    static esp_err_t allocate(int owner, Resource &resource);
+
+    /**
+     * @brief Give a resource back, it may be taken again at once.
+     * @param resource Resource from allocate(), invalidated.
+     */
+    static void release(Resource &resource);
+
+    /** @brief Timers in use. */
+    static uint32_t getTimersInUse();
+
+    /** @brief Channels in use. */
+    static uint32_t getChannelsInUse();
+};
+
+#endif // LEDC_ALLOCATOR_HPP
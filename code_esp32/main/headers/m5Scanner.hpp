@@ -79,9 +79,10 @@ public:
     uint8_t getQrCodeLengthLastScanned() const;
     
     /**
-     * @brief Initialize the QR code scanner
+     * @brief Add the scanner to the I2C bus and clear a stale ready flag
+     * @return esp_err_t Error status
      */
-    void initialize();
+    esp_err_t initialize();
     
     /**
      * @brief Set the trigger mode for the QR code scanner
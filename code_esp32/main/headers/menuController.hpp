@@ -14,6 +14,8 @@
 #include "RealTimeClock.hpp"
 #include "speaker.hpp"
 #include "gpioController.hpp"
+#include "audioAnalyzer.hpp"
+#include "configPacket.hpp"
 
 constexpr struct StatusStrings {
     const char *LOGING = "Loging";
@@ -40,13 +42,13 @@ class MenuController : public Listener
          * @param stopButton Reference to the stop ButtonBoundary.
          * @param tascamBoundary Reference to the TascamBoundary object.
          * @param audioModem Reference to the AudioModem object.
-         * @param nvs Reference to the NvsBoundary object.
+         * @param nvs Reference to the NVS store.
          * @param countQueue Queue handle for audio count.
          * @param rtc Reference to the RealTimeClock object.
          * @param speaker Reference to the Speaker object.
          * @param gpioController Reference to the GpioController object.
          */
-        MenuController(DisplayController *displayController, Storage *storage, M5Scanner &scanner, ButtonBoundary &selectButton, ButtonBoundary &startButton, ButtonBoundary &stopButton, TascamBoundary &tascamBoundary, AudioModem &audioModem ,NvsBoundary & nvs, QueueHandle_t countQueue, RealTimeClock &rtc, Speaker &speaker, GpioController &gpioController);
+        MenuController(DisplayController *displayController, Storage *storage, M5Scanner &scanner, ButtonBoundary &selectButton, ButtonBoundary &startButton, ButtonBoundary &stopButton, TascamBoundary &tascamBoundary, AudioModem &audioModem ,NvsBoundaryAbstract & nvs, QueueHandle_t countQueue, RealTimeClock &rtc, Speaker &speaker, GpioController &gpioController);
 
         /**
          * @brief Destructor for MenuController.
@@ -66,6 +68,22 @@ class MenuController : public Listener
          */
         State getCurrentState() const;
 
+        /**
+         * @brief Apply and store an authenticated configuration upload.
+         *
+         * Sets the clock, the session counter and the beacon interval, and
+         * stores the word thresholds. Only the field groups whose flag is set.
+         * @param config Payload accepted by ConfigReceiver.
+         */
+        void applyConfig(const ConfigPayload &config);
+
+        /**
+         * @brief Word thresholds of the last configuration upload.
+         * @param[out] thresholds Filled in when stored.
+         * @return False when none were uploaded.
+         */
+        bool getWordThresholds(AudioAnalyzer::WordThresholds &thresholds);
+
     private:
        
 
@@ -80,16 +98,45 @@ class MenuController : public Listener
         ButtonBoundary &stopButton;      ///< Reference to the stop button.
         TascamBoundary & tascamBoundary; ///< Reference to the Tascam boundary.
         AudioModem &audioModem;          ///< Reference to the AudioModem object.
-        NvsBoundary nvs;                 ///< NVS boundary object.
+        NvsBoundaryAbstract &nvs;        ///< NVS store, the write cache in front of the flash.
         QueueHandle_t audioCountQueue;  ///< Queue handle for audio count.
         RealTimeClock &rtc;             ///< Reference to the RealTimeClock object.
         Speaker &speaker;               ///< Reference to the Speaker object.
         GpioController &gpioController; ///< Reference to the GpioController object.
 
         void startRecording();
+
+        /**
+         * @brief Change the state and account the time to the matching power profile.
+         * @param state New state.
+         */
+        void setState(State state);
+
+        /**
+         * @brief Modem completion callback, gives the start beep after the metadata burst.
+         * @param context Pointer to the MenuController.
+         */
+        static void onModemIdle(void *context);
+
+        /**
+         * @brief Show a recorder fault and leave RECORDING, the recorder is not writing.
+         * @param fault Fault taken from the TascamBoundary.
+         */
+        void recorderFault(TascamFault fault);
+
+        /**
+         * @brief Tascam completion callback, logs how long the recorder took to start.
+         * @param state State the recorder reached.
+         * @param startLatencyUs Time from startRecording() to the last record key.
+         * @param context Pointer to the MenuController.
+         */
+        static void onTascamDone(TascamBoundary::RecorderState state, int64_t startLatencyUs, void *context);
+
         bool inSession = false;
         uint8_t *patientNumber = nullptr;
         bool numberScanned = false; ///< Flag to indicate if a number has been scanned
+        volatile bool beepAfterTransmit = false; ///< Beep once the modem burst has been sent
+        volatile uint64_t recordingSessionId = 0; ///< Session of the last start, for the latency log
 };
 
 #endif // MENU_CONTROLLER_HPP
\ No newline at end of file
@@ -0,0 +1,82 @@
+/**
+ * @file nvsBoundaryAbstract.hpp
+ * @brief Typed key-value interface of the non-volatile storage.
+ *
+ * Plain C++, so Storage and NvsWriteCache also run on the host against a
+ * mock. The read calls follow nvs_get_str() and nvs_get_blob(): the length
+ * goes in as the size of the buffer and comes back as the stored length.
+ */
+
+#ifndef NVS_BOUNDARY_ABSTRACT_HPP
+#define NVS_BOUNDARY_ABSTRACT_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @class NvsBoundaryAbstract
+ * @brief Abstract base class for NVS operations.
+ *
+ * Writes may be held back until flush(), which returns once everything
+ * written before it is on flash.
+ */
+class NvsBoundaryAbstract {
+public:
+    static constexpr size_t MAX_KEY_LENGTH = 15;   ///< NVS_KEY_NAME_MAX_SIZE without the terminator
+
+    virtual ~NvsBoundaryAbstract() = default;
+
+    virtual void writeUint64(const char* key, uint64_t value) = 0;
+
+    /**
+     * @brief Read a uint64_t.
+     * @return False when key holds no uint64_t, value is left alone.
+     */
+    virtual bool findUint64(const char* key, uint64_t &value) = 0;
+
+    /**
+     * @brief Write a string, terminator included.
+     */
+    virtual void writeString(const char* key, const char* value) = 0;
+
+    /**
+     * @brief Read a string.
+     * @param buffer Destination, nullptr to only ask the length.
+     * @param[in,out] length Size of buffer in, length with the terminator out, 0 when there is none.
+     * @return False when key holds no string, or when it does not fit in buffer.
+     */
+    virtual bool readString(const char* key, char* buffer, size_t &length) = 0;
+
+    /**
+     * @brief Write a blob, a record that is stored or lost as a whole.
+     */
+    virtual void writeBlob(const char* key, const void* data, size_t length) = 0;
+
+    /**
+     * @brief Read a blob.
+     * @param buffer Destination, nullptr to only ask the length.
+     * @param[in,out] length Size of buffer in, length of the blob out, 0 when there is none.
+     * @return False when key holds no blob, or when it does not fit in buffer.
+     */
+    virtual bool readBlob(const char* key, void* buffer, size_t &length) = 0;
+
+    virtual void eraseData(const char* key) = 0;
+
+    /**
+     * @brief Put every write made so far on flash.
+     * @return False when a write or the commit failed.
+     */
+    virtual bool flush() = 0;
+
+    /**
+     * @brief Read a uint64_t.
+     * @return The value, defaultValue when key holds none.
+     */
+    uint64_t readUint64(const char* key, uint64_t defaultValue = 0) {
+        uint64_t value = defaultValue;
+        findUint64(key, value);
+        return value;
+    }
+};
+
+#endif // NVS_BOUNDARY_ABSTRACT_HPP
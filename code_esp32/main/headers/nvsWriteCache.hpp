@@ -0,0 +1,332 @@
+/**
+ * @file nvsWriteCache.hpp
+ * @brief Write-back cache in front of the NVS store.
+ *
+ * Reads are served from RAM after the first one of a key. Writes only change
+ * the RAM copy and mark it dirty; flush() hands the dirty values to the store
+ * in the order they were written and commits them together. A key written
+ * twice before a flush costs one flash write.
+ *
+ * What survives a reset: every key holds either its value of the last
+ * completed flush or a newer one, never a mix, because NVS replaces an item
+ * as a whole. A record that must stay consistent therefore goes in one blob.
+ * A flush that fails leaves its values dirty for the next one, and a value
+ * written while a flush runs stays dirty until the following flush.
+ *
+ * Plain C++ with std::mutex, so the flush policy is tested on the host.
+ * NvsFlushTask flushes it from a task in the firmware.
+ */
+
+#ifndef NVS_WRITE_CACHE_HPP
+#define NVS_WRITE_CACHE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#include "nvsBoundaryAbstract.hpp"
+
+/**
+ * @class NvsWriteCache
+ * @brief NvsBoundaryAbstract that holds the values in RAM and writes them back on flush().
+ */
+class NvsWriteCache : public NvsBoundaryAbstract {
+public:
+    /**
+     * @brief Called after every accepted write, outside the cache lock.
+     */
+    using WriteHook = void (*)(void *context);
+
+    /**
+     * @brief Counters for benchmarks and tests.
+     */
+    struct Stats {
+        size_t hits;          ///< Reads served from RAM
+        size_t misses;        ///< Reads that went to the store
+        size_t writes;        ///< Writes and erases accepted
+        size_t coalesced;     ///< Writes to a key that was still dirty
+        size_t rejected;      ///< Writes with a key longer than MAX_KEY_LENGTH
+        size_t flushes;       ///< Flushes that had something to write
+        size_t failedFlushes; ///< Of which the store reported a failure
+        size_t storeWrites;   ///< Writes and erases handed to the store
+    };
+
+    /**
+     * @brief Constructs an NvsWriteCache.
+     * @param store Store the values are read from and written back to.
+     */
+    explicit NvsWriteCache(NvsBoundaryAbstract &store) : store(store) {}
+
+    NvsWriteCache(const NvsWriteCache &) = delete;
+    NvsWriteCache &operator=(const NvsWriteCache &) = delete;
+
+    /**
+     * @brief Set the function that schedules a flush, before the cache is shared between tasks.
+     */
+    void setWriteHook(WriteHook writeHook, void *context) {
+        hookContext = context;
+        hook = writeHook;
+    }
+
+    void writeUint64(const char* key, uint64_t value) override {
+        put(key, Type::Uint64, &value, sizeof(value));
+    }
+
+    bool findUint64(const char* key, uint64_t &value) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        const Entry *entry = load(key, Type::Uint64);
+        if (entry == nullptr) {
+            return false;
+        }
+        memcpy(&value, entry->value.data(), sizeof(value));
+        return true;
+    }
+
+    void writeString(const char* key, const char* value) override {
+        put(key, Type::String, value, strlen(value) + 1);
+    }
+
+    bool readString(const char* key, char* buffer, size_t &length) override {
+        return read(key, Type::String, buffer, length);
+    }
+
+    void writeBlob(const char* key, const void* data, size_t length) override {
+        put(key, Type::Blob, data, length);
+    }
+
+    bool readBlob(const char* key, void* buffer, size_t &length) override {
+        return read(key, Type::Blob, buffer, length);
+    }
+
+    void eraseData(const char* key) override {
+        put(key, Type::None, nullptr, 0);
+    }
+
+    /**
+     * @brief Write the dirty values to the store in write order and commit them.
+     * @return False when the store reported a failure, the values stay dirty.
+     */
+    bool flush() override {
+        std::lock_guard<std::mutex> flushing(flushMutex);
+        std::vector<Entry> batch;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const Entry &entry : entries) {
+                if (entry.dirty) {
+                    batch.push_back(entry);
+                }
+            }
+        }
+        if (batch.empty()) {
+            return true;
+        }
+        // Write order, so a later key never reaches flash before an earlier one of the same batch
+        std::sort(batch.begin(), batch.end(), [](const Entry &a, const Entry &b) { return a.order < b.order; });
+
+        // The store is written without the cache lock, reads and writes go on meanwhile
+        for (const Entry &entry : batch) {
+            switch (entry.type) {
+                case Type::Uint64: {
+                    uint64_t value;
+                    memcpy(&value, entry.value.data(), sizeof(value));
+                    store.writeUint64(entry.key, value);
+                    break;
+                }
+                case Type::String:
+                    store.writeString(entry.key, (const char *)entry.value.data());
+                    break;
+                case Type::Blob:
+                    store.writeBlob(entry.key, entry.value.data(), entry.value.size());
+                    break;
+                case Type::None:
+                    store.eraseData(entry.key);
+                    break;
+            }
+        }
+        bool ok = store.flush();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.flushes++;
+        stats.storeWrites += batch.size();
+        if (!ok) {
+            stats.failedFlushes++;
+            return false;
+        }
+        for (const Entry &flushed : batch) {
+            Entry *entry = find(flushed.key);
+            // Written again during the flush, the newer value goes with the next one
+            if (entry != nullptr && entry->version == flushed.version) {
+                entry->dirty = false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief True when a value has not been flushed yet.
+     */
+    bool isDirty() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const Entry &entry : entries) {
+            if (entry.dirty) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    Stats getStats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+private:
+    /**
+     * @brief What a key holds, None after an erase.
+     */
+    enum class Type : uint8_t {
+        None,
+        Uint64,
+        String,
+        Blob,
+    };
+
+    struct Entry {
+        char key[MAX_KEY_LENGTH + 1];
+        Type type;            ///< Type of the value, or the type that was looked up and not found
+        bool present;
+        bool dirty;
+        uint32_t version;     ///< Bumped by every write
+        uint32_t order;       ///< Write order of the dirty value
+        std::vector<uint8_t> value;
+    };
+
+    NvsBoundaryAbstract &store;
+    mutable std::mutex mutex;   ///< Guards entries, stats and the counters
+    std::mutex flushMutex;      ///< One flush at a time
+    std::vector<Entry> entries;
+    uint32_t writeCount = 0;
+    WriteHook hook = nullptr;
+    void *hookContext = nullptr;
+    Stats stats = {};
+
+    Entry *find(const char *key) {
+        for (Entry &entry : entries) {
+            if (strcmp(entry.key, key) == 0) {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief The entry of key when it holds a value of type, read from the store on a miss.
+     * @return nullptr when it holds none. Called with the lock held.
+     */
+    const Entry *load(const char *key, Type type) {
+        if (strlen(key) > MAX_KEY_LENGTH) {
+            return nullptr;
+        }
+        Entry *entry = find(key);
+        // A value of another type, an erase, or a type already looked up answer from RAM
+        if (entry != nullptr && (entry->present || entry->type == Type::None || entry->type == type)) {
+            stats.hits++;
+            return (entry->present && entry->type == type) ? entry : nullptr;
+        }
+        stats.misses++;
+        if (entry == nullptr) {
+            entries.emplace_back();
+            entry = &entries.back();
+            strcpy(entry->key, key);
+            entry->dirty = false;
+            entry->version = 0;
+            entry->order = 0;
+        }
+        entry->type = type;
+        entry->present = false;
+        entry->value.clear();
+        switch (type) {
+            case Type::Uint64: {
+                uint64_t value;
+                if (store.findUint64(key, value)) {
+                    entry->value.resize(sizeof(value));
+                    memcpy(entry->value.data(), &value, sizeof(value));
+                    entry->present = true;
+                }
+                break;
+            }
+            case Type::String:
+            case Type::Blob: {
+                size_t length = 0;
+                bool found = type == Type::String ? store.readString(key, nullptr, length)
+                                                  : store.readBlob(key, nullptr, length);
+                if (!found) {
+                    break;
+                }
+                entry->value.resize(length);
+                found = type == Type::String ? store.readString(key, (char *)entry->value.data(), length)
+                                             : store.readBlob(key, entry->value.data(), length);
+                entry->present = found;
+                if (!found) {
+                    entry->value.clear();
+                }
+                break;
+            }
+            case Type::None:
+                break;
+        }
+        return entry->present ? entry : nullptr;
+    }
+
+    bool read(const char *key, Type type, void *buffer, size_t &length) {
+        std::lock_guard<std::mutex> lock(mutex);
+        const Entry *entry = load(key, type);
+        if (entry == nullptr) {
+            length = 0;
+            return false;
+        }
+        size_t size = length;
+        length = entry->value.size();
+        if (buffer == nullptr) {
+            return true;
+        }
+        if (size < length) {
+            return false;
+        }
+        memcpy(buffer, entry->value.data(), length);
+        return true;
+    }
+
+    void put(const char *key, Type type, const void *data, size_t length) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (strlen(key) > MAX_KEY_LENGTH) {
+                stats.rejected++;
+                return;
+            }
+            Entry *entry = find(key);
+            if (entry == nullptr) {
+                entries.emplace_back();
+                entry = &entries.back();
+                strcpy(entry->key, key);
+                entry->version = 0;
+            } else if (entry->dirty) {
+                stats.coalesced++;
+            }
+            entry->type = type;
+            entry->present = type != Type::None;
+            entry->dirty = true;
+            entry->version++;
+            entry->order = writeCount++;
+            entry->value.assign((const uint8_t *)data, (const uint8_t *)data + length);
+            stats.writes++;
+        }
+        if (hook != nullptr) {
+            hook(hookContext);
+        }
+    }
+};
+
+#endif // NVS_WRITE_CACHE_HPP
@@ -0,0 +1,160 @@
+/**
+ * @file powerManager.hpp
+ * @brief Dynamic frequency scaling, automatic light sleep and awake-time accounting.
+ *
+ * The CPU runs at CONFIG_YOD_PM_MIN_FREQ_MHZ and enters light sleep whenever
+ * no power management lock is held. Drivers that need a stable clock (ADC
+ * sampling, the Tascam UART, LEDC tone output) hold a PowerManager::Lock only
+ * for the duration of that work.
+ *
+ * For every recorder state the time spent and the time slept are accumulated,
+ * which the "power" serial command turns into an awake percentage and an
+ * estimated average current.
+ */
+
+#ifndef POWER_MANAGER_HPP
+#define POWER_MANAGER_HPP
+
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+#if CONFIG_YOD_POWER_MANAGEMENT
+#include "esp_pm.h"
+#endif
+
+/**
+ * @enum PowerProfile
+ * @brief Recorder states that are accounted separately.
+ */
+enum class PowerProfile : uint8_t {
+    Loging,
+    Idle,
+    Recording,
+    Count
+};
+
+#if CONFIG_YOD_POWER_MANAGEMENT
+
+/**
+ * @class PowerManager
+ * @brief Process wide power management configuration and statistics.
+ */
+class PowerManager {
+public:
+    /**
+     * @enum LockType
+     * @brief What a lock keeps from being scaled down.
+     */
+    enum class LockType : uint8_t {
+        CpuMax,  ///< CPU at maximum frequency, no light sleep (timing critical DSP work)
+        ApbMax,  ///< APB at 80 MHz, no light sleep (UART baud rate, LEDC output frequency)
+        Count
+    };
+
+    /**
+     * @brief Configure DFS and light sleep, create the locks and register the serial command.
+     * @return ESP_OK on success, or the error of esp_pm_configure.
+     */
+    static esp_err_t initialize();
+
+    /**
+     * @brief Switch the profile that time is accounted to.
+     * @param profile New recorder state.
+     */
+    static void setProfile(PowerProfile profile);
+
+    /**
+     * @brief Print the awake percentage and estimated current per profile.
+     */
+    static void printReport();
+
+    /**
+     * @brief Reset all accumulated statistics.
+     */
+    static void resetStatistics();
+
+    /** @brief Adds lines to the report, for a driver that keeps the chip awake on its own. */
+    using ReportHook = void (*)(void *context);
+
+    /**
+     * @brief Set the function printReport() calls after its table.
+     * @param hook Function to call, or nullptr to remove it.
+     * @param context Passed unchanged to the hook.
+     */
+    static void setReportHook(ReportHook hook, void *context);
+
+    /**
+     * @brief Take a lock that is released from another scope than it was taken in.
+     * @param type Lock to take.
+     */
+    static void acquire(LockType type);
+
+    /**
+     * @brief Release a lock taken with acquire().
+     * @param type Lock to release.
+     */
+    static void release(LockType type);
+
+    /**
+     * @class Lock
+     * @brief Scope guard holding a power management lock.
+     */
+    class Lock {
+    public:
+        explicit Lock(LockType type);
+        ~Lock();
+        Lock(const Lock &) = delete;
+        Lock &operator=(const Lock &) = delete;
+
+    private:
+        LockType type;
+    };
+
+private:
+    struct ProfileStatistics {
+        int64_t totalUs; ///< Time spent in the profile, excluding the running interval
+        int64_t sleptUs; ///< Time spent in light sleep while in the profile
+        uint32_t wakeups; ///< Number of light sleep exits
+    };
+
+    static esp_pm_lock_handle_t locks[(size_t)LockType::Count];
+    static ProfileStatistics statistics[(size_t)PowerProfile::Count];
+    static volatile PowerProfile currentProfile;
+    static int64_t profileStartUs;
+    static ReportHook reportHook;
+    static void *reportContext;
+
+    /**
+     * @brief Light sleep exit callback, adds the slept time to the current profile.
+     * @param sleepTimeUs Time actually spent in light sleep.
+     * @param arg Unused.
+     * @return ESP_OK
+     */
+    static esp_err_t onLightSleepExit(int64_t sleepTimeUs, void *arg);
+};
+
+#else // CONFIG_YOD_POWER_MANAGEMENT
+
+class PowerManager {
+public:
+    enum class LockType : uint8_t { CpuMax, ApbMax, Count };
+
+    static esp_err_t initialize() { return ESP_OK; }
+    static void setProfile(PowerProfile) {}
+    static void printReport() {}
+    static void resetStatistics() {}
+    using ReportHook = void (*)(void *context);
+    static void setReportHook(ReportHook, void *) {}
+    static void acquire(LockType) {}
+    static void release(LockType) {}
+
+    class Lock {
+    public:
+        explicit Lock(LockType) {}
+    };
+};
+
+#endif // CONFIG_YOD_POWER_MANAGEMENT
+
+#endif // POWER_MANAGER_HPP
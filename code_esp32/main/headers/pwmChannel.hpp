@@ -12,18 +12,17 @@
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "driver/ledc.h"
+#include "esp_err.h"
+#include "ledcAllocator.hpp"
 #include <stdio.h>
 
-/**
- * @brief Configuration structure for PWM channel parameters
- */
 /**
  * @brief Configuration structure for PWM channel parameters
  */
 struct PWMConfig {
-    ledc_timer_t timer = LEDC_TIMER_0;          ///< LEDC timer selection
-    ledc_mode_t mode = LEDC_LOW_SPEED_MODE;     ///< LEDC speed mode
-    ledc_channel_t channel = LEDC_CHANNEL_0;    ///< LEDC channel selection
+    ledc_timer_t timer = LEDC_TIMER_0;          ///< LEDC timer selection, set by LedcAllocator
+    ledc_mode_t mode = LedcAllocator::MODE;     ///< LEDC speed mode
+    ledc_channel_t channel = LEDC_CHANNEL_0;    ///< LEDC channel selection, set by LedcAllocator
     uint32_t frequency = 10000;                 ///< Frequency in Hz (10kHz)
     uint32_t duty = 16;                         ///< Duty cycle value
     ledc_timer_bit_t resolution = LEDC_TIMER_5_BIT; ///< Timer resolution in bits
@@ -33,44 +32,48 @@ struct PWMConfig {
  * @brief PWM Channel class for controlling ESP32 LEDC peripheral
  * 
  * This class provides a thread-safe interface for configuring and controlling
- * PWM channels using the ESP32's LEDC (LED Control) peripheral. It supports
- * mutex-protected operations for safe multi-threaded usage.
+ * PWM channels using the ESP32's LEDC (LED Control) peripheral. Every instance
+ * gets its own LEDC timer and channel from LedcAllocator and its own mutex, so
+ * outputs on different pins run in parallel.
  */
 class PWMChannel {
 public:
     /**
      * @brief Constructor for PWM Channel
      * @param gpioPin GPIO pin number to be used for PWM output
+     * @details Takes a free LEDC timer and channel, initialize() reports when none was left.
      */
     PWMChannel(gpio_num_t gpioPin);
     
     /**
-     * @brief Virtual destructor
+     * @brief Virtual destructor, gives the LEDC timer and channel back
      */
     virtual ~PWMChannel();
+
+    PWMChannel(const PWMChannel &) = delete;
+    PWMChannel &operator=(const PWMChannel &) = delete;
     
     /**
      * @brief Initialize the PWM channel with configured parameters
      * @details Configures the LEDC timer and channel, then pauses the timer.
      *          This method is thread-safe and uses mutex protection.
+     * @return ESP_OK, ESP_ERR_NOT_FOUND when no LEDC timer or channel was free,
+     *         ESP_ERR_NO_MEM without a mutex, or the error of the LEDC driver.
      */
-    void initialize();
+    esp_err_t initialize();
 
 protected:
     gpio_num_t gpioPin;    ///< GPIO pin number for PWM output
     PWMConfig config;      ///< PWM configuration parameters
     
-    /**
-     * @brief Shared mutex for thread-safe PWM operations
-     * @details Static mutex shared across all PWM channel instances
-     */
-    static SemaphoreHandle_t pwmMutex;
+    LedcAllocator::Resource resource; ///< LEDC timer and channel of this output
+    bool configured;                  ///< The timer and channel were configured by initialize()
     
     /**
-     * @brief Create mutex if it doesn't exist
-     * @details Thread-safe mutex creation with null check
+     * @brief Mutex for thread-safe PWM operations
+     * @details One per instance, it only guards this output's timer and channel
      */
-    static void createMutex();
+    SemaphoreHandle_t pwmMutex;
 };
 
 #endif // PWM_CHANNEL_HPP
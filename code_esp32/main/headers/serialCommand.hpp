@@ -0,0 +1,95 @@
+/**
+ * @file serialCommand.hpp
+ * @brief Line based command interface on the console UART.
+ *
+ * Modules register a named command with a handler. A low priority task reads
+ * lines from the console UART and dispatches the first word of every line to
+ * the matching handler, passing the rest of the line as arguments.
+ */
+
+#ifndef SERIAL_COMMAND_HPP
+#define SERIAL_COMMAND_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "esp_err.h"
+
+/**
+ * @class SerialCommand
+ * @brief Registry and reader task for console commands.
+ *
+ * The registry is a fixed size table so registering a command never allocates.
+ * Commands may be registered from any task at any time, also while the
+ * reader task dispatches. Handlers run in the context of the reader task and may block; they should not
+ * be called from time-critical code.
+ */
+class SerialCommand {
+public:
+    /**
+     * @brief Signature of a command handler.
+     * @param args Remaining text on the command line (never null, may be empty).
+     * @param context User pointer given at registration.
+     */
+    using Handler = void (*)(const char *args, void *context);
+
+    /** @brief Maximum number of commands that can be registered. */
+    static constexpr size_t MAX_COMMANDS = 12;
+
+    /** @brief Maximum length of one command line including terminator. */
+    static constexpr size_t MAX_LINE_LENGTH = 96;
+
+    /**
+     * @brief Register a command.
+     * @param name Command word, must stay valid for the lifetime of the program.
+     * @param help One line description shown by the built-in "help" command.
+     * @param handler Function called when the command is entered.
+     * @param context User pointer forwarded to the handler.
+     * @return ESP_OK on success, ESP_ERR_NO_MEM when the table is full.
+     */
+    static esp_err_t registerCommand(const char *name, const char *help, Handler handler, void *context = nullptr);
+
+    /**
+     * @brief Install the console UART driver and start the reader task.
+     * @return ESP_OK on success, or the error of the UART driver install.
+     */
+    static esp_err_t start();
+
+    /**
+     * @brief Write bytes to the console UART as they are, past stdout and its buffer.
+     * @return false when the driver did not take all of them.
+     */
+    static bool writeRaw(const void *data, size_t length);
+
+    /**
+     * @brief Change the console baud rate once everything written so far has left.
+     * @param baud New rate, 0 for CONFIG_ESP_CONSOLE_UART_BAUDRATE.
+     * @return ESP_OK, or the error of the UART driver.
+     */
+    static esp_err_t setBaudRate(uint32_t baud);
+
+private:
+    struct Entry {
+        const char *name;
+        const char *help;
+        Handler handler;
+        void *context;
+    };
+
+    static Entry commands[MAX_COMMANDS];
+    static std::atomic<size_t> commandCount;   ///< Published after the entry is written
+
+    /**
+     * @brief Look up and run the command on one line.
+     * @param line Null terminated line without line ending.
+     */
+    static void dispatch(char *line);
+
+    /**
+     * @brief Reader task, collects characters into lines and dispatches them.
+     * @param pvParameters Unused.
+     */
+    static void serialCommandTask(void *pvParameters);
+};
+
+#endif // SERIAL_COMMAND_HPP
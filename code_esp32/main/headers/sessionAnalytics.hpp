@@ -0,0 +1,124 @@
+/**
+ * @file sessionAnalytics.hpp
+ * @brief Timeline of the current and the last session in the analytics format.
+ *
+ * The audio task adds every analysis frame (VAD state and peak level) and
+ * every window word count to an AnalyticsWriter (analyticsFormat.hpp); a
+ * frame costs a few bit writes. Session start, stop and events come from the
+ * menu on the observer task through a lock-free queue that the audio task
+ * drains in poll(), so only the audio task ever writes a timeline.
+ *
+ * Two writers take turns: the open session goes into one while the other
+ * keeps the last finished session for "analytics export [baud]". The export
+ * switches the console to CONFIG_YOD_ANALYTICS_EXPORT_BAUD, streams the
+ * finished session as COBS frames (analyticsExport.hpp) straight from the
+ * writer buffers to the UART, and switches back. Log lines are dropped
+ * meanwhile so they cannot end up between the frames.
+ *
+ * With CONFIG_YOD_ANALYTICS disabled the whole interface collapses to empty
+ * inline functions.
+ */
+
+#ifndef SESSION_ANALYTICS_HPP
+#define SESSION_ANALYTICS_HPP
+
+#include <stdint.h>
+#include <time.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "Observer.hpp"
+#include "analyticsFormat.hpp"
+
+#if CONFIG_YOD_ANALYTICS
+
+#include <atomic>
+#include "spscRingBuffer.hpp"
+
+/**
+ * @class SessionAnalytics
+ * @brief Process wide session timeline.
+ */
+class SessionAnalytics {
+public:
+    /**
+     * @brief Register the "analytics" serial command.
+     */
+    static void start();
+
+    /// @name Observer task, the one producer of the command queue
+    /// @{
+    static void sessionStart(uint32_t sessionId, time_t startTime);
+    static void sessionStop();
+    static void button(ObserverId id);
+    static void fault(uint8_t code);
+    /// @}
+
+    /// @name Audio task
+    /// @{
+    /**
+     * @brief Apply the queued starts, stops and events, call before frame().
+     * @param framePeriodMs Frame period of the audio task, stored with a session this call opens.
+     */
+    static void poll(uint16_t framePeriodMs);
+
+    /**
+     * @brief One analysis frame of the open session.
+     * @param skipped Frames the scheduler dropped before this one, added as VadState::Skipped.
+     */
+    static void frame(VadState state, float levelDb, uint32_t skipped);
+
+    /**
+     * @brief Word count of an analysis window that closed after the last frame.
+     */
+    static void window(uint16_t words);
+    /// @}
+
+    static void printSummary();
+
+    /**
+     * @brief Stream the last finished session to the console.
+     * @param baud Rate of the export, 0 for CONFIG_YOD_ANALYTICS_EXPORT_BAUD.
+     */
+    static void exportBinary(uint32_t baud);
+
+private:
+    struct Command {
+        enum class Kind : uint8_t { Start, Stop, Event };
+        Kind kind;
+        AnalyticsEventType type;
+        uint8_t value;
+        uint32_t sessionId;
+        uint32_t startTime;
+    };
+
+    static AnalyticsWriter writers[2];
+    static SpscRingBuffer<Command, 16> commands;
+    static std::atomic<int> active;         ///< Writer of the open session, -1 for none; set by the audio task
+    static std::atomic<int> finished;       ///< Writer holding the last finished session, -1 for none
+    static std::atomic<int> exporting;      ///< Writer the export reads, -1 for none
+    static std::atomic<uint32_t> dropped;   ///< Commands the queue had no room for, sessions lost to an export
+
+    static void post(const Command &command);
+    static void apply(const Command &command, uint16_t framePeriodMs);
+    static void finish();
+};
+
+#else // CONFIG_YOD_ANALYTICS
+
+class SessionAnalytics {
+public:
+    static void start() {}
+    static void sessionStart(uint32_t, time_t) {}
+    static void sessionStop() {}
+    static void button(ObserverId) {}
+    static void fault(uint8_t) {}
+    static void poll(uint16_t) {}
+    static void frame(VadState, float, uint32_t) {}
+    static void window(uint16_t) {}
+    static void printSummary() {}
+    static void exportBinary(uint32_t) {}
+};
+
+#endif // CONFIG_YOD_ANALYTICS
+
+#endif // SESSION_ANALYTICS_HPP
@@ -0,0 +1,151 @@
+/**
+ * @file sessionJournal.hpp
+ * @brief Session journal in the "journal" flash partition.
+ *
+ * Sessions, patient codes, the speech statistics of every analysis window,
+ * button presses and faults are kept as JournalLog records, so they survive
+ * a reset. The record functions stamp the uptime and hand the record to the
+ * journal task through a queue without waiting: a full queue drops the
+ * record and counts it, the audio task is never held up by the flash. The
+ * task batches the records in RAM and writes them a flash page at a time,
+ * at the latest CONFIG_YOD_JOURNAL_FLUSH_MS after the first one. A session
+ * stop or a fault is written at once.
+ *
+ * The "journal" serial command prints a summary; "journal export [from]"
+ * writes the records as binary frames for code_clientSide/journal_export.py.
+ * With CONFIG_YOD_JOURNAL disabled the whole interface collapses to empty
+ * inline functions.
+ */
+
+#ifndef SESSION_JOURNAL_HPP
+#define SESSION_JOURNAL_HPP
+
+#include <stdint.h>
+#include <time.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "Observer.hpp"
+#include "journalLog.hpp"
+
+#if CONFIG_YOD_JOURNAL
+
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_partition.h"
+
+/**
+ * @class JournalPartition
+ * @brief JournalFlashAbstract on a data partition.
+ */
+class JournalPartition : public JournalFlashAbstract {
+public:
+    static constexpr const char *LABEL = "journal";
+    static constexpr esp_partition_subtype_t SUBTYPE = (esp_partition_subtype_t)0x40;   ///< See partitions.csv
+
+    /**
+     * @brief Find the partition.
+     * @return ESP_ERR_NOT_FOUND when the partition table has none.
+     */
+    esp_err_t initialize();
+
+    size_t getSize() const override;
+    bool read(size_t offset, void *buffer, size_t length) override;
+    bool write(size_t offset, const void *data, size_t length) override;
+    bool eraseSector(size_t offset) override;
+
+private:
+    const esp_partition_t *partition = nullptr;
+};
+
+/**
+ * @class SessionJournal
+ * @brief Process wide journal, the record functions may be called from any task.
+ */
+class SessionJournal {
+public:
+    /**
+     * @brief Mount the journal, write a Boot record and start the journal task.
+     *
+     * Registers the "journal" serial command. Records made before it are dropped.
+     * @return ESP_ERR_NOT_FOUND without a journal partition, ESP_ERR_NO_MEM when the task or queue failed.
+     */
+    static esp_err_t start();
+
+    static void sessionStart(uint32_t sessionId, time_t startTime);
+    static void sessionStop(uint32_t sessionId);
+
+    /**
+     * @param code Scanned patient code, the first JournalRecord::PATIENT_LENGTH characters are kept.
+     */
+    static void patient(uint32_t sessionId, const char *code);
+
+    /**
+     * @brief Result of one analysis window.
+     * @param words Words counted.
+     * @param frames Frames analysed, modem frames not included.
+     * @param modemFrames Frames left out because the modem was sending.
+     * @param windowMs Length of the window.
+     */
+    static void speech(uint16_t words, uint16_t frames, uint16_t modemFrames, uint32_t windowMs);
+
+    static void button(ObserverId id);
+    static void fault(JournalFaultSource source, int32_t code);
+
+    /**
+     * @brief Print the size, the sequence range and the counters of the journal.
+     */
+    static void printSummary();
+
+    /**
+     * @brief Write the batch to flash, then the records from sequence on as binary frames to the console.
+     *
+     * Frame layout as the instrumentation frames: 0xA5 0x5A, version, type,
+     * payload length (u16), payload, CRC-16 of the payload (u16). Type 0x02
+     * carries up to EXPORT_CHUNK records of 32 bytes as they are on flash;
+     * type 0x03 ends the export with the oldest and next sequence and the
+     * dropped count (3 x u32).
+     * @param sequence First record wanted, 0 for all of them.
+     */
+    static void exportBinary(uint32_t sequence);
+
+private:
+    static constexpr size_t EXPORT_CHUNK = 32;   ///< Records per frame
+
+    static JournalPartition partition;
+    static JournalLog journal;
+    static QueueHandle_t queue;
+    static SemaphoreHandle_t mutex;             ///< Guards journal between the task and the serial command
+    static std::atomic<uint32_t> dropped;       ///< Records the queue had no room for
+
+    /**
+     * @brief Stamp the uptime and queue a record without waiting.
+     */
+    static void post(JournalRecord record);
+
+    /**
+     * @brief Takes the records off the queue and writes them.
+     * @param pvParameters Unused.
+     */
+    static void journalTask(void *pvParameters);
+};
+
+#else // CONFIG_YOD_JOURNAL
+
+class SessionJournal {
+public:
+    static esp_err_t start() { return ESP_OK; }
+    static void sessionStart(uint32_t, time_t) {}
+    static void sessionStop(uint32_t) {}
+    static void patient(uint32_t, const char *) {}
+    static void speech(uint16_t, uint16_t, uint16_t, uint32_t) {}
+    static void button(ObserverId) {}
+    static void fault(JournalFaultSource, int32_t) {}
+    static void printSummary() {}
+    static void exportBinary(uint32_t) {}
+};
+
+#endif // CONFIG_YOD_JOURNAL
+
+#endif // SESSION_JOURNAL_HPP
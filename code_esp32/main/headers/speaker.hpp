@@ -3,12 +3,20 @@
  * @brief Header file for the Speaker class.
  *
  * This class is responsible for controlling a speaker using PWM signals.
- * It provides functionality to generate beep sounds at specified frequencies.
+ * It plays beeps and tone patterns in the background: a pattern is queued
+ * and an esp_timer callback switches the tones, so the caller never waits
+ * for the sound to finish.
  */
 
 #ifndef SPEAKER_HPP
 #define SPEAKER_HPP
 #include <stdint.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+#include "esp_timer.h"
 #include "pwmChannel.hpp"
 
 /**
@@ -16,14 +24,86 @@
  * @brief A class to manage speaker operations.
  *
  * The Speaker class inherits from the PWMChannel class and is designed to control
- * a speaker connected to a specific GPIO pin. It allows generating beep sounds
- * at desired frequencies.
+ * a speaker connected to a specific GPIO pin. Its LEDC timer and channel come
+ * from LedcAllocator, so it sounds at the same time as the PWM output of the AudioModem.
  */
 class Speaker : public PWMChannel {
 public:
+    /**
+     * @brief One step of a pattern.
+     */
+    struct Tone {
+        uint16_t frequencyHz; ///< Tone frequency, 0 for a rest
+        uint16_t durationMs;  ///< Length of the tone
+        uint16_t gapMs;       ///< Silence after the tone
+    };
+
+    static constexpr uint16_t BEEP_MS = 1500;   ///< Length of beep()
+    static constexpr size_t QUEUE_TONES = 16;   ///< Tones that can wait to be played
+
     Speaker(gpio_num_t gpioPin);  // Constructor
     ~Speaker(); // Destructor
-    void beep(uint32_t freq); // Method to make a beep sound
+
+    /**
+     * @brief Configure the LEDC timer and channel and create the step timer.
+     * @return ESP_OK, or the error of esp_timer or PWMChannel::initialize().
+     */
+    esp_err_t initialize();
+
+    /**
+     * @brief Queue a beep of BEEP_MS, returns at once.
+     * @param freq Frequency in Hz.
+     */
+    void beep(uint32_t freq);
+
+    /**
+     * @brief Queue a pattern behind the tones that are still playing, returns at once.
+     * @param tones Steps of the pattern, copied.
+     * @param count Number of steps.
+     * @return ESP_OK, ESP_ERR_NO_MEM when the queue has no room for the whole pattern.
+     */
+    esp_err_t play(const Tone *tones, size_t count);
+
+    /**
+     * @brief Silence the speaker and drop the queued tones.
+     */
+    void stop();
+
+    /**
+     * @brief True while a tone, a gap or a queued tone is left.
+     */
+    bool isPlaying() const;
+
+    /**
+     * @brief Block until the queue has played out.
+     * @param timeout Maximum time to wait.
+     * @return True when the speaker is idle.
+     */
+    bool waitUntilIdle(TickType_t timeout);
+
+private:
+    static constexpr EventBits_t IDLE_BIT = BIT0;
+
+    enum class Phase : uint8_t {
+        Tone,  ///< The timer ends the current tone
+        Gap,   ///< The timer ends the gap after it
+    };
+
+    esp_timer_handle_t stepTimer;
+    SemaphoreHandle_t stateMutex;  ///< Guards the queue against the timer callback
+    EventGroupHandle_t events;
+    Tone queue[QUEUE_TONES];
+    size_t head;                   ///< Next free slot
+    size_t tail;                   ///< Next tone to play
+    bool active;                   ///< A tone or gap is timed
+    Phase phase;
+    uint16_t gapMs;                ///< Gap after the current tone
+
+    /** @brief esp_timer callback, ends the current step. */
+    static void onStep(void *arg);
+
+    /** @brief Start the next queued tone, or go idle. Called with stateMutex held. */
+    void startNext();
 };
 
 #endif // SPEAKER_HPP
@@ -0,0 +1,211 @@
+/**
+ * @file spscRingBuffer.hpp
+ * @brief Lock-free single-producer/single-consumer ring buffer.
+ *
+ * One context (a task or an ISR) pushes, one other context pops. The head
+ * and tail indices live on separate cache lines and each side keeps a cached
+ * copy of the other side's index, so in the common case a push or pop only
+ * touches its own line. Nothing blocks and nothing allocates, which makes
+ * the producer side usable from an interrupt handler.
+ *
+ * The file only depends on the C++ standard library so the same code runs in
+ * the host tests. IsrSpscRingBuffer adds a FreeRTOS task notification for
+ * consumers that want to block until data arrives.
+ */
+
+#ifndef SPSC_RING_BUFFER_HPP
+#define SPSC_RING_BUFFER_HPP
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#endif
+
+#ifndef SPSC_CACHE_LINE_SIZE
+#define SPSC_CACHE_LINE_SIZE 64
+#endif
+
+// Forced inlining keeps push() inside IRAM when it is called from an IRAM ISR
+#define SPSC_ALWAYS_INLINE inline __attribute__((always_inline))
+
+/**
+ * @class SpscRingBuffer
+ * @brief Fixed size lock-free queue for exactly one producer and one consumer.
+ * @tparam T Element type, must be trivially copyable.
+ * @tparam N Number of slots, a power of two. N - 1 elements fit at once.
+ */
+template <typename T, size_t N>
+class SpscRingBuffer {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of two");
+    static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+
+public:
+    SpscRingBuffer() : head(0), cachedTail(0), tail(0), cachedHead(0) {}
+
+    SpscRingBuffer(const SpscRingBuffer &) = delete;
+    SpscRingBuffer &operator=(const SpscRingBuffer &) = delete;
+
+    /**
+     * @brief Append one element. Producer side only.
+     * @param value Element to copy in.
+     * @return false when the buffer is full.
+     */
+    SPSC_ALWAYS_INLINE bool push(const T &value) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - cachedTail >= N - 1) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (h - cachedTail >= N - 1) {
+                return false;
+            }
+        }
+        slots[h & MASK] = value;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Append up to count elements with one index update. Producer side only.
+     * @param values Elements to copy in.
+     * @param count Number of elements available.
+     * @return Number of elements actually pushed.
+     */
+    size_t pushBatch(const T *values, size_t count) {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t space = (N - 1) - (h - cachedTail);
+        if (space < count) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            space = (N - 1) - (h - cachedTail);
+        }
+        if (count > space) {
+            count = space;
+        }
+        for (size_t i = 0; i < count; i++) {
+            slots[(h + i) & MASK] = values[i];
+        }
+        head.store(h + count, std::memory_order_release);
+        return count;
+    }
+
+    /**
+     * @brief Remove the oldest element. Consumer side only.
+     * @param[out] value Receives the element.
+     * @return false when the buffer is empty.
+     */
+    SPSC_ALWAYS_INLINE bool pop(T &value) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == cachedHead) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (t == cachedHead) {
+                return false;
+            }
+        }
+        value = slots[t & MASK];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Remove up to count elements with one index update. Consumer side only.
+     * @param[out] values Receives the elements, oldest first.
+     * @param count Room in values.
+     * @return Number of elements actually popped.
+     */
+    size_t popBatch(T *values, size_t count) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t available = cachedHead - t;
+        if (available < count) {
+            cachedHead = head.load(std::memory_order_acquire);
+            available = cachedHead - t;
+        }
+        if (count > available) {
+            count = available;
+        }
+        for (size_t i = 0; i < count; i++) {
+            values[i] = slots[(t + i) & MASK];
+        }
+        tail.store(t + count, std::memory_order_release);
+        return count;
+    }
+
+    /**
+     * @brief Number of elements waiting. Exact only when called from one of the two sides.
+     */
+    size_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief True when no element is waiting.
+     */
+    bool empty() const { return size() == 0; }
+
+    /**
+     * @brief Maximum number of elements that fit at once.
+     */
+    static constexpr size_t capacity() { return N - 1; }
+
+private:
+    static constexpr size_t MASK = N - 1;
+
+    // Producer line: written by the producer, read by the consumer
+    alignas(SPSC_CACHE_LINE_SIZE) std::atomic<size_t> head;
+    size_t cachedTail; ///< Producer's last seen tail
+
+    // Consumer line: written by the consumer, read by the producer
+    alignas(SPSC_CACHE_LINE_SIZE) std::atomic<size_t> tail;
+    size_t cachedHead; ///< Consumer's last seen head
+
+    alignas(SPSC_CACHE_LINE_SIZE) T slots[N];
+};
+
+#ifdef ESP_PLATFORM
+
+/**
+ * @class IsrSpscRingBuffer
+ * @brief SpscRingBuffer whose producer is an ISR and whose consumer is a task.
+ *
+ * pushFromIsr() notifies the consumer task, which can block in waitForData()
+ * instead of polling. Several buffers may notify the same task.
+ * @tparam T Element type, must be trivially copyable.
+ * @tparam N Number of slots, a power of two.
+ */
+template <typename T, size_t N>
+class IsrSpscRingBuffer : public SpscRingBuffer<T, N> {
+public:
+    /**
+     * @brief Push from an ISR and notify the consumer task.
+     * @param value Element to copy in.
+     * @param consumer Task to notify, or nullptr to only queue the data.
+     * @param[in,out] higherPriorityTaskWoken Set when a context switch should be requested.
+     * @return false when the buffer is full.
+     */
+    SPSC_ALWAYS_INLINE bool pushFromIsr(const T &value, TaskHandle_t consumer, BaseType_t *higherPriorityTaskWoken) {
+        bool pushed = this->push(value);
+        if (consumer != nullptr) {
+            vTaskNotifyGiveFromISR(consumer, higherPriorityTaskWoken);
+        }
+        return pushed;
+    }
+
+    /**
+     * @brief Block the calling consumer task until the producer pushed something.
+     * @param timeout Maximum time to wait.
+     * @return true when data is waiting.
+     */
+    bool waitForData(TickType_t timeout) {
+        if (!this->empty()) {
+            return true;
+        }
+        ulTaskNotifyTake(pdTRUE, timeout);
+        return !this->empty();
+    }
+};
+
+#endif // ESP_PLATFORM
+
+#endif // SPSC_RING_BUFFER_HPP
@@ -7,18 +7,19 @@
  */
 
 /**
- * @class NvsBoundaryAbstract
- * @brief Abstract base class for NVS operations.
+ * @class NvsBoundary
+ * @brief Concrete implementation of NvsBoundaryAbstract.
  *
- * This class defines the interface for reading, writing, and erasing data in non-volatile storage.
+ * This class provides the functionality to interact with the NVS, including writing,
+ * reading, and erasing data using the ESP-IDF NVS API. The handle is opened
+ * once in initialize() and kept; writes are committed together by flush().
  */
 
 /**
- * @class NvsBoundary
- * @brief Concrete implementation of NvsBoundaryAbstract.
+ * @class NvsFlushTask
+ * @brief Flushes an NvsWriteCache from a task, a short while after a write.
  *
- * This class provides the functionality to interact with the NVS, including writing,
- * reading, and erasing data using the ESP-IDF NVS API.
+ * Writes that follow each other within the delay share one commit.
  */
 
 /**
@@ -26,7 +27,8 @@
  * @brief A class for managing session data in non-volatile storage.
  *
  * The Storage class uses an NvsBoundaryAbstract instance to manage session IDs
- * and provides methods to set, get, and clear the session ID.
+ * and provides methods to set, get, and clear the session ID. It also keeps the
+ * settings of a configuration upload and the record of the last session over a reset.
  */
 
 #ifndef STORAGE_HPP
@@ -34,35 +36,132 @@
 
 #include <cstdint>
 #include <nvs.h>
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "sdkconfig.h"
+#include "nvsBoundaryAbstract.hpp"
+#include "nvsWriteCache.hpp"
 
-class NvsBoundaryAbstract {
-public:
-    virtual ~NvsBoundaryAbstract() = default;
-    virtual void writeUint64(const char* key, uint64_t value) = 0;
-    virtual uint64_t readUint64(const char* key, uint64_t defaultValue = 0) = 0;
-    virtual void eraseData(const char* key) = 0;
-};
+#ifndef CONFIG_YOD_NVS_FLUSH_DELAY_MS
+#define CONFIG_YOD_NVS_FLUSH_DELAY_MS 500
+#endif
 
 class NvsBoundary : public NvsBoundaryAbstract
 {
 public:
     NvsBoundary();
     ~NvsBoundary() override;
+
+    NvsBoundary(const NvsBoundary &) = delete;
+    NvsBoundary &operator=(const NvsBoundary &) = delete;
+
+    /**
+     * @brief Initialise the NVS partition and open the storage namespace.
+     *
+     * A partition without free pages or of a newer format is erased first.
+     * @return ESP_OK, or the error of nvs_flash_init() or nvs_open().
+     */
+    esp_err_t initialize();
+
     void writeUint64(const char* key, uint64_t value) override;
-    uint64_t readUint64(const char* key, uint64_t defaultValue = 0) override;
+    bool findUint64(const char* key, uint64_t &value) override;
+    void writeString(const char* key, const char* value) override;
+    bool readString(const char* key, char* buffer, size_t &length) override;
+    void writeBlob(const char* key, const void* data, size_t length) override;
+    bool readBlob(const char* key, void* buffer, size_t &length) override;
     void eraseData(const char* key) override;
 
+    /**
+     * @brief Commit the writes since the previous flush.
+     * @return False when one of them or the commit failed.
+     */
+    bool flush() override;
+
 private:
     nvs_handle_t nvsHandle;
+    bool open;
+    bool writeFailed;   /**< A write since the last flush() failed */
+
+    void check(esp_err_t err, const char *operation, const char *key);
+};
+
+class NvsFlushTask {
+public:
+    /**
+     * @brief Constructs an NvsFlushTask.
+     * @param cache Cache to flush.
+     * @param delayMs Time between the first write of a batch and its flush.
+     */
+    NvsFlushTask(NvsWriteCache &cache, uint32_t delayMs = CONFIG_YOD_NVS_FLUSH_DELAY_MS);
+    ~NvsFlushTask();
+
+    /**
+     * @brief Start the task and hook it to the writes of the cache.
+     * @return ESP_OK, or ESP_ERR_NO_MEM when the task could not be created.
+     */
+    esp_err_t initialize();
+
+private:
+    static constexpr uint32_t RETRY_MAX_MS = 60000; ///< Longest delay between retries of a failing flush
+
+    static void onWrite(void *context);
+    static void flushTaskFunction(void *pvParameters);
+
+    NvsWriteCache &cache;
+    uint32_t delayMs;
+    TaskHandle_t flushTask;
 };
 
 class Storage {
 public:
+    /**
+     * @brief What is kept of the last session, stored as one blob so it is written as a whole.
+     */
+    struct SessionRecord {
+        static constexpr size_t PATIENT_LENGTH = 24;
+
+        uint64_t sessionId;
+        int64_t startTime;               ///< Seconds since the epoch from the RTC
+        char patient[PATIENT_LENGTH];    ///< Scanned patient number, empty without one
+    };
+
     explicit Storage(NvsBoundaryAbstract& nvsBoundary);
     void setSessionId(uint64_t sessionId);
     uint64_t getSessionId();
     void clearSessionId();
 
+    /**
+     * @brief Counter of the last accepted configuration upload, replay protection of ConfigReceiver.
+     *
+     * Flushed through to flash before it returns, unlike the other settings:
+     * a counter lost in a reset would let a recorded upload be replayed.
+     * @return False when the commit failed.
+     */
+    bool commitConfigCounter(uint32_t counter);
+    uint32_t getConfigCounter();
+
+    /**
+     * @brief Word detection thresholds from a configuration upload.
+     * @return False when none were uploaded, the analyzer keeps its defaults.
+     */
+    void setWordThresholds(int8_t levelDb, uint16_t lowHz, uint16_t highHz);
+    bool getWordThresholds(int8_t &levelDb, uint16_t &lowHz, uint16_t &highHz);
+
+    /**
+     * @brief Timestamp beacon interval from a configuration upload, 0 disables the beacons.
+     * @param defaultValue Interval when none was uploaded.
+     */
+    void setBeaconIntervalS(uint32_t seconds);
+    uint32_t getBeaconIntervalS(uint32_t defaultValue);
+
+    /**
+     * @brief Record of the session that was started last.
+     * @return False when none was stored.
+     */
+    void setLastSession(const SessionRecord &record);
+    bool getLastSession(SessionRecord &record);
+
 private:
     NvsBoundaryAbstract& nvsService;
 };
@@ -1,75 +1,247 @@
 #ifndef TASCAM_BOUNDARY_HPP
 #define TASCAM_BOUNDARY_HPP
 
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
 #include <driver/uart.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/event_groups.h>
+#include <freertos/semphr.h>
 #include <esp_err.h>
+#include "sdkconfig.h"
 #include "recoderAbstract.hpp"
+#include "tascamProtocol.hpp"
+#include "tascamSequencer.hpp"
+#include "Observer.hpp"
+#include "listener.hpp"
 
-/**
- * @enum TascamCommands
- * @brief Commands for controlling the Tascam device
- */
-enum TascamCommands : uint8_t {
-    TASCAM_START_RECORDING = 107, /**< Command to start recording */
-    TASCAM_STOP_RECORDING = 104,  /**< Command to stop recording */
-    TASCAM_IDLE = 0               /**< Command for idle state */
-};
+#ifndef CONFIG_YOD_TASCAM_STATUS
+#define CONFIG_YOD_TASCAM_STATUS 0
+#endif
+#ifndef CONFIG_YOD_TASCAM_ACK_TIMEOUT_MS
+#define CONFIG_YOD_TASCAM_ACK_TIMEOUT_MS 1000
+#endif
 
 /**
  * @class TascamBoundary
  * @brief Implements the RecoderAbstract interface for Tascam devices
- * 
+ *
  * This class provides the implementation for controlling Tascam recording devices
  * through UART communication.
+ *
+ * startRecording(), stopRecording() and idle() only post the state the
+ * recorder should reach and return at once. A command task hands the
+ * requests, the status reports and the time to a TascamSequencer, which
+ * plans the remote key presses from the state the recorder is believed to be
+ * in and spaces them by the gaps of the DR-40X timing table, and sends the
+ * keys it hands out. A new request cancels the commands of the previous one
+ * that were not sent yet.
+ *
+ * The same task parses the status bytes on the RX line (see tascamProtocol.hpp).
+ * A reported state always replaces the believed one. With
+ * CONFIG_YOD_TASCAM_STATUS the next key follows as soon as the previous one
+ * is confirmed, and a refused or unanswered key ends the request. Faults are
+ * handed to the listener as ObserverId::RecorderFault from update(), in the
+ * observer task like a button press.
  */
-class TascamBoundary : public RecoderAbstract {
+class TascamBoundary : public RecoderAbstract, public Observer {
 public:
+    /** @brief State of the recorder as far as the remote knows. */
+    using RecorderState = TascamState;
+
+    /**
+     * @brief Called from the command task once a request has been carried out.
+     * @param state State the recorder reached.
+     * @param startLatencyUs Time from startRecording() to the last record key, 0 for other requests.
+     * @param context Passed unchanged to the callback.
+     */
+    using CompletionCallback = void (*)(RecorderState state, int64_t startLatencyUs, void *context);
+
     /**
      * @brief Constructor for TascamBoundary
      * @param uartNum The UART port number to use
      * @param uartQueue Pointer to the UART queue handle
      */
     TascamBoundary(uart_port_t uartNum, QueueHandle_t *uartQueue);
-    
+
     /**
      * @brief Destructor for TascamBoundary
      */
     ~TascamBoundary();
-    
+
     /**
-     * @brief Initialize the Tascam device communication
+     * @brief Initialize the Tascam device communication and start the command task
+     * @return ESP_OK, or the error of the UART driver or the task creation.
      */
-    void initialize();
-    
+    esp_err_t initialize();
+
     /**
-     * @brief Start the recording process
+     * @brief Start the recording process, returns at once
      * @see RecoderAbstract::startRecording
      */
     void startRecording() override;
-    
+
     /**
-     * @brief Stop the recording process
+     * @brief Stop the recording process, returns at once
+     *
+     * Commands of a start that were not sent yet are dropped.
      * @see RecoderAbstract::stopRecording
      */
     void stopRecording() override;
-    
+
     /**
-     * @brief Set the device to idle state
+     * @brief Set the device to record standby, returns at once
      * @see RecoderAbstract::idle
      */
     void idle() override;
 
+    /**
+     * @brief Register a function that is called every time a request has been carried out.
+     * @param callback Function to call, runs in the command task so it must not block long.
+     * @param context Passed unchanged to the callback.
+     */
+    void setCompletionCallback(CompletionCallback callback, void *context = nullptr);
+
+    /**
+     * @brief True while commands are planned or being sent.
+     */
+    bool isBusy() const;
+
+    /**
+     * @brief Block until the last request has been carried out.
+     * @param timeout Maximum time to wait.
+     * @return true when the command task is idle.
+     */
+    bool waitUntilIdle(TickType_t timeout);
+
+    /**
+     * @brief State the recorder is believed to be in.
+     */
+    RecorderState getState() const { return state; }
+
+    /**
+     * @brief Time from the last startRecording() to its last record key, 0 before the first one.
+     */
+    int64_t getLastStartLatencyUs() const { return lastStartLatencyUs; }
+
+    /**
+     * @brief Set the listener that is told about recorder faults.
+     * @param faultListener Notified with ObserverId::RecorderFault.
+     */
+    void setListener(Listener &faultListener);
+
+    /**
+     * @brief Set the task that update() runs in, it is woken when a fault arrives.
+     * @param task Observer task, or nullptr to rely on its poll interval.
+     */
+    void setWakeTask(TaskHandle_t task);
+
+    /**
+     * @brief Notify the listener when a fault is pending.
+     */
+    void update() override;
+
+    /**
+     * @brief Get the observer identifier.
+     * @return ObserverId::RecorderFault.
+     */
+    ObserverId getId() const override;
+
+    /**
+     * @brief Take the pending fault.
+     * @return The last fault since the previous call, TascamFault::None without one.
+     */
+    TascamFault takeFault();
+
 private:
+    static constexpr EventBits_t IDLE_BIT = BIT0;
+    static constexpr size_t UART_EVENT_QUEUE_SIZE = 16;
+
+    /**
+     * @brief Why waitEvent() returned.
+     */
+    enum class Wake : uint8_t {
+        Timeout,  ///< The deadline passed
+        Request,  ///< A new request was posted
+        Status,   ///< The recorder reported, or the line broke
+    };
+
+    /**
+     * @brief A state to reach, posted by the public calls.
+     */
+    struct Request {
+        RecorderState target;
+        int64_t requestedUs;
+    };
+
     /**
      * @brief Send a command to the Tascam device
      * @param command The command code to send
      */
     void sendCommand(uint8_t command);
-    
+
+    /**
+     * @brief Post a request, replacing one that is still waiting.
+     * @param target State to reach.
+     */
+    void post(RecorderState target);
+
+    /**
+     * @brief Wait for a request or a report from the recorder.
+     * @param untilUs Deadline in esp_timer time, negative to wait forever.
+     * @param[out] request The new request, for Wake::Request.
+     */
+    Wake waitEvent(int64_t untilUs, Request &request);
+
+    /**
+     * @brief Read and parse what one UART event announced, and hand it to the sequencer.
+     * @return Wake::Status when the event carried a report or a break, Wake::Timeout otherwise.
+     */
+    Wake handleUartEvent(const uart_event_t &event);
+
+    /**
+     * @brief Hand a new request to the sequencer.
+     */
+    void accept(const Request &request);
+
+    /**
+     * @brief Report a finished request and go idle unless another one is waiting.
+     */
+    void finish(const TascamSequencer::Action &action);
+
+    /**
+     * @brief Record a fault and wake the observer task.
+     */
+    void raiseFault(TascamFault fault);
+
+    /**
+     * @brief Command task, carries out the requests.
+     * @param pvParameters Pointer to the TascamBoundary.
+     */
+    static void commandTaskFunction(void *pvParameters);
+
     uart_port_t uartNum;      /**< The UART port number used for communication */
     QueueHandle_t *uartQueue; /**< Pointer to the UART queue handle */
+
+    QueueHandle_t requests;   /**< Mailbox of one Request, a new one overwrites a waiting one */
+    SemaphoreHandle_t requestMutex; /**< Keeps the mailbox and IDLE_BIT consistent */
+    QueueSetHandle_t queueSet;      /**< The mailbox and the UART events, the command task waits on both */
+    EventGroupHandle_t events;
+    TaskHandle_t commandTask;
+    CompletionCallback completionCallback;
+    void *completionContext;
+    Listener *listener;
+    TaskHandle_t wakeTask;
+    std::atomic<TascamFault> pendingFault;
+
+    // Owned by the command task
+    TascamStatusParser parser;
+    TascamSequencer sequencer;
+    volatile RecorderState state;   /**< Copy of the sequencer's, for getState() */
+    volatile int64_t lastStartLatencyUs;
 };
 
-#endif // TASCAM_BOUNDARY_HPP
\ No newline at end of file
+#endif // TASCAM_BOUNDARY_HPP
@@ -20,6 +20,8 @@
 
 // Forward declaration
 class MenuController;
+class AudioModem;
+class ConfigReceiver;
 
 /**
  * @class TaskHandler
@@ -51,11 +53,13 @@ public:
      * @param observers Reference to vector of Observer pointers for task communication
      * @param countQueue Reference to FreeRTOS queue handle for inter-task messaging
      * @param menuController Reference to the menu controller for UI operations
+     * @param audioModem Reference to the modem, frames during its bursts are not analyzed
+     * @param configReceiver Reference to the configuration receiver, listens while not recording
      * 
      * @note All parameters are stored as references, so the caller must ensure
      *       that the referenced objects remain valid for the lifetime of this TaskHandler.
      */
-    TaskHandler(std::vector<Observer*>& observers, QueueHandle_t& countQueue, MenuController& menuController);
+    TaskHandler(std::vector<Observer*>& observers, QueueHandle_t& countQueue, MenuController& menuController, AudioModem& audioModem, ConfigReceiver& configReceiver);
 
     /**
      * @brief Starts all managed FreeRTOS tasks
@@ -72,6 +76,14 @@ public:
      */
     void startTasks();
 
+    /**
+     * @brief Handle of the observer update task, nullptr before startTasks()
+     * 
+     * Observers outside an ISR notify it to have update() run at once
+     * instead of after the poll interval.
+     */
+    TaskHandle_t getObserverTask() const { return observerTask; }
+
 private:
     /**
      * @brief Reference to the vector of observers for inter-task communication
@@ -97,6 +109,27 @@ private:
      */
     MenuController& menuController;
 
+    /**
+     * @brief Reference to the audio modem
+     * 
+     * Its tones are picked up by the microphone, frames that overlap a burst
+     * are left out of the speech statistics.
+     */
+    AudioModem& audioModem;
+
+    /**
+     * @brief Reference to the configuration receiver
+     * 
+     * Shares the microphone ADC with the analyzer, so it only listens while
+     * the device is not recording.
+     */
+    ConfigReceiver& configReceiver;
+
+    /**
+     * @brief Handle of the observer update task
+     */
+    TaskHandle_t observerTask = nullptr;
+
     /**
      * @brief Static task function for handling observer updates
      * 
@@ -17,55 +17,116 @@
 #include "headers/WordCountQueueObserver.hpp"
 #include "gpioController.hpp"
 #include "headers/hardware_config.hpp"
+#include "instrumentation.hpp"
+#include "serialCommand.hpp"
+#include "powerManager.hpp"
+#include "bootSequencer.hpp"
+#include "configReceiver.hpp"
+#include "storage.hpp"
+#include "sessionJournal.hpp"
+#include "sessionAnalytics.hpp"
+#include "i2cBusManager.hpp"
 
 extern "C" void app_main(void) {
     ESP_LOGI("YOD_RECORDER", "Starting initialization...");
+    // The job table is about 0.9 KB, kept off the main task stack
+    auto boot = std::make_unique<BootSequencer>();
+
+    // Power management first, so every driver below sees the final clock setup
+    PowerManager::initialize();
 
     // GPIO Service and Controller
     gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
     GpioController gpioController;
-    gpioController.initialize();
-    gpioController.setGpio2Level(0);
 
     // Buttons
     ButtonBoundary buttonResearch(BUTTON_RESEARCH_PIN, ObserverId::ResearchPause, GPIO_INTR_POSEDGE);
     ButtonBoundary buttonSelect(BUTTON_SELECT_PIN, ObserverId::Start, GPIO_INTR_POSEDGE);
     ButtonBoundary buttonStop(BUTTON_STOP_PIN, ObserverId::Stop, GPIO_INTR_POSEDGE);
     ButtonBoundary buttonPatient(BUTTON_PATIENT_PIN, ObserverId::PatientPause, GPIO_INTR_NEGEDGE);
-    buttonResearch.initialize();
-    buttonSelect.initialize();
-    buttonStop.initialize();
-    buttonPatient.initialize();
+    ButtonBoundary *buttons[] = {&buttonResearch, &buttonSelect, &buttonStop, &buttonPatient};
 
     // Queue
     QueueHandle_t countQueue = xQueueCreate(5, sizeof(uint8_t));
+    Instrumentation::registerQueue("count", countQueue);
 
-    // Display and RTC
-    SSD1306_t display_dev;
-    i2c_master_init(&display_dev, CONFIG_SDA_GPIO, CONFIG_SCL_GPIO, CONFIG_RESET_GPIO);
+    // Display, RTC and scanner share the I2C bus that i2c_master_init() creates, I2cBusManager serves it
+    SSD1306_t display_dev = {};
     auto display = std::make_unique<DisplayController>(&display_dev, countQueue);
     RealTimeClock rtcClock(display_dev._i2c_bus_handle);
-    rtcClock.initialize();
+    M5Scanner scanner(display_dev._i2c_bus_handle);
 
     // Peripherals
-    M5Scanner scanner(display_dev._i2c_bus_handle);
-    scanner.initialize();
-    AudioModem modem(23000, 21000, AUDIO_MODEM_PIN);
-    modem.initialize();
+    AudioModem modem(ModemCodec::HIGH_FREQ, ModemCodec::LOW_FREQ, AUDIO_MODEM_PIN);
     TascamBoundary tascamBoundary(TASCAM_UART_NUM, new QueueHandle_t);
-    tascamBoundary.initialize();
-
-    // Observer and Speaker
     WordCountQueueObserver wordCountQueueObserver(countQueue);
     Speaker speaker(SPEAKER_PIN);
-    speaker.initialize();
+    // Session ids and settings are read and written in RAM, the flush task commits them
+    NvsBoundary nvsBoundaryInstance;
+    NvsWriteCache nvsCache(nvsBoundaryInstance);
+    NvsFlushTask nvsFlushTask(nvsCache);
+    boot->mark("constructed");
+
+    // Independent peripherals initialise concurrently, the I2C devices wait for the bus
+    BootSequencer::JobId i2cBus = boot->addJob("i2c_bus", [](void *device) {
+        i2c_master_init(static_cast<SSD1306_t *>(device), CONFIG_SDA_GPIO, CONFIG_SCL_GPIO, CONFIG_RESET_GPIO);
+        if (I2cBusManager::start() != ESP_OK) {
+            ESP_LOGE("YOD_RECORDER", "I2C bus task not started, transfers run on the calling tasks");
+        }
+        return ESP_OK;
+    }, &display_dev);
+    boot->addJob("display", [](void *controller) {
+        return static_cast<DisplayController *>(controller)->initialize();
+    }, display.get(), {i2cBus});
+    boot->addJob("rtc", [](void *rtc) {
+        return static_cast<RealTimeClock *>(rtc)->initialize();
+    }, &rtcClock, {i2cBus});
+    boot->addJob("scanner", [](void *scanner) {
+        return static_cast<M5Scanner *>(scanner)->initialize();
+    }, &scanner, {i2cBus});
+    boot->addJob("buttons", [](void *list) {
+        for (ButtonBoundary *button : *static_cast<ButtonBoundary *(*)[4]>(list)) {
+            button->initialize();
+        }
+        return ESP_OK;
+    }, &buttons);
+    boot->addJob("gpio", [](void *controller) {
+        GpioController *gpio = static_cast<GpioController *>(controller);
+        esp_err_t ret = gpio->initialize();
+        if (ret == ESP_OK) {
+            gpio->setGpio2Level(0);
+        }
+        return ret;
+    }, &gpioController);
+    boot->addJob("tascam", [](void *tascam) {
+        return static_cast<TascamBoundary *>(tascam)->initialize();
+    }, &tascamBoundary);
+    boot->addJob("modem", [](void *modem) {
+        return static_cast<AudioModem *>(modem)->initialize();
+    }, &modem);
+    boot->addJob("speaker", [](void *speaker) {
+        return static_cast<Speaker *>(speaker)->initialize();
+    }, &speaker);
+    boot->addJob("nvs", [](void *nvs) {
+        return static_cast<NvsBoundary *>(nvs)->initialize();
+    }, &nvsBoundaryInstance);
+    boot->addJob("journal", [](void *) {
+        return SessionJournal::start();
+    }, nullptr);
+
+    esp_err_t bootResult = boot->run(pdMS_TO_TICKS(5000));
+    if (bootResult != ESP_OK) {
+        ESP_LOGE("YOD_RECORDER", "Peripheral initialization incomplete: %s", esp_err_to_name(bootResult));
+    }
 
     // Menu Controller
-    NvsBoundary nvsBoundaryInstance;
-    auto storage = std::make_unique<Storage>(nvsBoundaryInstance);
+    if (nvsFlushTask.initialize() != ESP_OK) {
+        ESP_LOGE("YOD_RECORDER", "NVS flush task not started, settings stay in RAM");
+    }
+    auto storage = std::make_unique<Storage>(nvsCache);
     auto menu = std::make_unique<MenuController>(
         display.get(), storage.get(), scanner, buttonSelect, buttonPatient, buttonStop,
-        tascamBoundary, modem, nvsBoundaryInstance , countQueue, rtcClock, speaker, gpioController
+        tascamBoundary, modem, nvsCache, countQueue, rtcClock, speaker, gpioController
     );
 
     // Set Listeners
@@ -74,12 +135,20 @@ extern "C" void app_main(void) {
     buttonPatient.setListener(*menu);
     buttonResearch.setListener(*menu);
     wordCountQueueObserver.setListener(*display);
+    tascamBoundary.setListener(*menu);
 
     // Start Tasks
     //TODO nog naar array veranderen
-    std::vector<Observer*> observers = {&buttonPatient, &buttonSelect, &buttonStop, &buttonResearch, &wordCountQueueObserver}; 
-    TaskHandler taskHandler(observers, countQueue, *menu);
+    std::vector<Observer*> observers = {&buttonPatient, &buttonSelect, &buttonStop, &buttonResearch, &wordCountQueueObserver, &tascamBoundary};
+    ConfigReceiver configReceiver(*storage);
+    TaskHandler taskHandler(observers, countQueue, *menu, modem, configReceiver);
     taskHandler.startTasks();
+    tascamBoundary.setWakeTask(taskHandler.getObserverTask());
+    boot->mark("LOGING");
+    Instrumentation::start();
+    SessionAnalytics::start();
+    SerialCommand::start();
+    boot->printTimeline();
 
     ESP_LOGI("YOD_RECORDER", "Initialization complete. Starting main loop...");
     while (true) {
@@ -3,16 +3,28 @@
 #include <string.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <sys/time.h>
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "driver/i2c_master.h"
+#include "sdkconfig.h"
+#include "serialCommand.hpp"
+#include "i2cBusManager.hpp"
 
 static const char* TAG = "RealTimeClock";
 
 #define DS3231_ADDR 0x68
 #define DS3231_TIME_REG 0x00
+#define DS3231_CONTROL_REG 0x0E
 #define DS3231_TEMP_REG 0x11
 
-RealTimeClock::RealTimeClock(i2c_master_bus_handle_t bus_handle) : m_bus_handle(bus_handle), m_dev_handle(nullptr), m_initialized(false) {
+#define DS3231_CONTROL_INTCN 0x04   // Alarm interrupt instead of the square wave
+#define DS3231_CONTROL_RS 0x18      // Square wave rate, 00 is 1 Hz
+
+RealTimeClock::RealTimeClock(i2c_master_bus_handle_t &bus_handle)
+    : m_bus_handle(bus_handle), m_dev_handle(nullptr), m_initialized(false), m_timeValid(false), m_resync(false),
+      m_mutex(nullptr), m_generation(0), m_syncTask(nullptr),
+      m_sqwPin(CONFIG_YOD_RTC_SQW_GPIO >= 0 ? (gpio_num_t)CONFIG_YOD_RTC_SQW_GPIO : GPIO_NUM_NC) {
     // Device will be initialized in initialize() method
 }
 
@@ -36,8 +48,54 @@ esp_err_t RealTimeClock::initialize() {
         return ret;
     }
     
+    m_mutex = xSemaphoreCreateMutex();
+    if (m_mutex == nullptr) {
+        return ESP_ERR_NO_MEM;
+    }
     m_initialized = true;
-    ESP_LOGI(TAG, "DS3231 RTC initialized with I2C bus handle");
+
+    // Whole seconds for now, the sync task aligns the second boundary
+    struct tm time;
+    ret = readTime(time);
+    if (ret == ESP_OK) {
+        struct timeval tv = {mktime(&time), 0};
+        settimeofday(&tv, nullptr);
+        m_timeValid = true;
+    } else {
+        ESP_LOGE(TAG, "Failed to read the time, the system time is not set: %s", esp_err_to_name(ret));
+    }
+
+    if (m_sqwPin != GPIO_NUM_NC) {
+        ret = enableSquareWave();
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to enable the square wave, polling instead: %s", esp_err_to_name(ret));
+            m_sqwPin = GPIO_NUM_NC;
+        }
+    }
+
+    // Lowest priority, the anchor polls the bus for up to a second
+    if (xTaskCreatePinnedToCore(syncTask, "RtcSync", 3072, this, 1, &m_syncTask, 0) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (m_sqwPin != GPIO_NUM_NC) {
+        // SQW is open drain; GPIO 34-39 have no pull-up and need an external one
+        gpio_config_t io_conf = {};
+        io_conf.intr_type = GPIO_INTR_NEGEDGE;
+        io_conf.pin_bit_mask = (1ULL << m_sqwPin);
+        io_conf.mode = GPIO_MODE_INPUT;
+        io_conf.pull_up_en = GPIO_PULLUP_ENABLE;
+        io_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
+        ESP_ERROR_CHECK(gpio_config(&io_conf));
+        ESP_ERROR_CHECK(gpio_isr_handler_add(m_sqwPin, sqwIsrHandler, this));
+    }
+
+    SerialCommand::registerCommand("rtc", "RTC time, temperature, clock offset and drift",
+        [](const char *, void *rtc) {
+            static_cast<RealTimeClock *>(rtc)->printStats();
+        }, this);
+
+    ESP_LOGI(TAG, "DS3231 RTC initialized, system time %s, synced %s", m_timeValid ? "set" : "not set",
+             m_sqwPin != GPIO_NUM_NC ? "by SQW" : "by polling");
     return ESP_OK;
 }
 
@@ -61,18 +119,235 @@ bool RealTimeClock::getTemperature(float& temp) {
 }
 
 bool RealTimeClock::getTime(struct tm& time) {
+    if (!m_timeValid) {
+        ESP_LOGE(TAG, "System time not set from the DS3231");
+        return false;
+    }
+
+    time_t now = ::time(nullptr);
+    localtime_r(&now, &time);
+    return true;
+}
+
+bool RealTimeClock::setTime(const struct tm& time) {
     if (!m_initialized) {
         ESP_LOGE(TAG, "DS3231 not initialized");
         return false;
     }
     
-    uint8_t data[7];
-    if (readRegisters(DS3231_TIME_REG, data, 7) != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to read time registers");
+    uint8_t data[8];
+    
+    // Register address, then the time registers in one transaction
+    data[0] = DS3231_TIME_REG;
+    data[1] = decToBcd(time.tm_sec);              // Seconds
+    data[2] = decToBcd(time.tm_min);              // Minutes
+    data[3] = decToBcd(time.tm_hour);             // Hours (24-hour format)
+    data[4] = decToBcd(time.tm_wday + 1);         // Day of week (1-7)
+    data[5] = decToBcd(time.tm_mday);             // Day of month
+    data[6] = decToBcd(time.tm_mon + 1);          // Month (1-12)
+    data[7] = decToBcd(time.tm_year % 100);       // Year (last 2 digits)
+    
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    esp_err_t ret = I2cBusManager::transfer(I2cClient::Rtc, m_dev_handle, data, sizeof(data));
+    if (ret == ESP_OK) {
+        // Writing the seconds restarts the second of the DS3231, the system clock starts it along
+        struct tm copy = time;
+        struct timeval tv = {mktime(&copy), 0};
+        settimeofday(&tv, nullptr);
+        m_timeValid = true;
+        m_discipline.reset();
+        m_generation++;
+    }
+    xSemaphoreGive(m_mutex);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write the time registers: %s", esp_err_to_name(ret));
         return false;
     }
     
+    m_resync = true;
+    if (m_syncTask != nullptr) {
+        xTaskNotifyGive(m_syncTask);
+    }
+    return true;
+}
+
+void RealTimeClock::getSyncStats(ClockDiscipline::Stats& stats) {
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    stats = m_discipline.getStats();
+    xSemaphoreGive(m_mutex);
+}
+
+void RealTimeClock::printStats() {
+    struct tm now;
+    char text[32] = "not set";
+    if (m_timeValid && getTime(now)) {
+        strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &now);
+    }
+    float temperature = 0;
+    bool hasTemperature = getTemperature(temperature);
+    ClockDiscipline::Stats stats;
+    getSyncStats(stats);
+
+    printf("rtc %s, %.2f C, synced %s", text, hasTemperature ? temperature : 0.0f,
+           m_sqwPin != GPIO_NUM_NC ? "by SQW on GPIO " : "by polling every ");
+    printf("%d%s\n", m_sqwPin != GPIO_NUM_NC ? (int)m_sqwPin : CONFIG_YOD_RTC_RESYNC_S,
+           m_sqwPin != GPIO_NUM_NC ? "" : " s");
+    printf("anchors %u edges %u rejected %u steps %u slews %u\n", (unsigned)stats.anchors, (unsigned)stats.edges,
+           (unsigned)stats.rejected, (unsigned)stats.steps, (unsigned)stats.slews);
+    printf("offset %ld us, max %ld us since the last step, drift %.2f ppm, last sync %lld s ago\n",
+           (long)stats.lastOffsetUs, (long)stats.maxOffsetUs, stats.driftPpm,
+           stats.lastSyncUs != 0 ? (long long)((systemUs() - stats.lastSyncUs) / 1000000) : -1LL);
+}
+
+void RealTimeClock::syncTask(void *pvParameters) {
+    RealTimeClock *rtc = static_cast<RealTimeClock *>(pvParameters);
+    TickType_t nextPoll = xTaskGetTickCount();
+
+    while (true) {
+        if (rtc->m_resync.exchange(false)) {
+            // Edges from before the new time belong to the old second
+            int64_t edgeUs;
+            while (rtc->m_edges.pop(edgeUs)) {
+            }
+            nextPoll = xTaskGetTickCount();
+        }
+
+        int32_t left = (int32_t)(nextPoll - xTaskGetTickCount());
+        if (left > 0) {
+            if (rtc->m_edges.waitForData((TickType_t)left)) {
+                int64_t edgeUs;
+                while (rtc->m_edges.pop(edgeUs)) {
+                    rtc->sqwEdge(edgeUs);
+                }
+            }
+            continue;
+        }
+
+        // Once anchored the edges keep the clock, the register is only polled when they stop
+        if (rtc->m_sqwPin == GPIO_NUM_NC || rtc->m_discipline.needsAnchor()) {
+            rtc->pollAnchor();
+        }
+        nextPoll = xTaskGetTickCount() + pdMS_TO_TICKS(CONFIG_YOD_RTC_RESYNC_S * 1000);
+    }
+}
+
+void IRAM_ATTR RealTimeClock::sqwIsrHandler(void *arg) {
+    RealTimeClock *rtc = static_cast<RealTimeClock *>(arg);
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    rtc->m_edges.pushFromIsr(esp_timer_get_time(), rtc->m_syncTask, &higherPriorityTaskWoken);
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+esp_err_t RealTimeClock::enableSquareWave() {
+    uint8_t control;
+    esp_err_t ret = readRegister(DS3231_CONTROL_REG, &control);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return writeRegister(DS3231_CONTROL_REG, control & ~(DS3231_CONTROL_INTCN | DS3231_CONTROL_RS));
+}
+
+void RealTimeClock::pollAnchor() {
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    uint32_t generation = m_generation;
+    xSemaphoreGive(m_mutex);
+
+    uint8_t first;
+    if (readRegister(DS3231_TIME_REG, &first) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to read the seconds, sync skipped");
+        return;
+    }
+    int64_t previousUs = systemUs();
+    int64_t deadlineUs = esp_timer_get_time() + POLL_LIMIT_MS * 1000;
+    while (esp_timer_get_time() < deadlineUs) {
+        vTaskDelay(pdMS_TO_TICKS(POLL_MS));
+        int64_t readUs = systemUs();
+        struct tm time;
+        uint8_t seconds;
+        if (readRegister(DS3231_TIME_REG, &seconds) != ESP_OK) {
+            break;
+        }
+        if (seconds == first) {
+            previousUs = readUs;
+            continue;
+        }
+        // The second started between the two reads, the rest of the time is read after it
+        if (readTime(time) != ESP_OK) {
+            break;
+        }
+        int64_t rtcUs = (int64_t)mktime(&time) * 1000000;
+        xSemaphoreTake(m_mutex, portMAX_DELAY);
+        if (generation == m_generation) {
+            apply(m_discipline.anchor(rtcUs, previousUs + (readUs - previousUs) / 2));
+        }
+        xSemaphoreGive(m_mutex);
+        return;
+    }
+    ESP_LOGW(TAG, "The seconds register did not tick, sync skipped");
+}
+
+void RealTimeClock::sqwEdge(int64_t edgeUs) {
+    // Where the edge fell on the system clock
+    int64_t ageUs = esp_timer_get_time() - edgeUs;
+    int64_t edgeSystemUs = systemUs() - ageUs;
+
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    uint32_t generation = m_generation;
+    bool anchor = m_discipline.needsAnchor();
+    if (!anchor) {
+        apply(m_discipline.edge(edgeSystemUs));
+    }
+    xSemaphoreGive(m_mutex);
+    if (!anchor || ageUs > EDGE_MAX_AGE_US) {
+        return;
+    }
+
+    // The registers still show the second the edge started
+    struct tm time;
+    if (readTime(time) != ESP_OK) {
+        return;
+    }
+    int64_t rtcUs = (int64_t)mktime(&time) * 1000000;
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    if (generation == m_generation) {
+        apply(m_discipline.anchor(rtcUs, edgeSystemUs));
+    }
+    xSemaphoreGive(m_mutex);
+}
+
+void RealTimeClock::apply(const ClockDiscipline::Correction& correction) {
+    switch (correction.kind) {
+        case ClockDiscipline::Correction::Kind::Step: {
+            int64_t us = systemUs() + correction.deltaUs;
+            struct timeval tv = {(time_t)(us / 1000000), (suseconds_t)(us % 1000000)};
+            settimeofday(&tv, nullptr);
+            m_timeValid = true;
+            ESP_LOGI(TAG, "System time stepped by %lld us", (long long)correction.deltaUs);
+            break;
+        }
+        case ClockDiscipline::Correction::Kind::Slew: {
+            struct timeval delta = {(time_t)(correction.deltaUs / 1000000),
+                                    (suseconds_t)(correction.deltaUs % 1000000)};
+            struct timeval remaining = {};
+            if (adjtime(&delta, &remaining) == 0) {
+                m_discipline.cancelled((int64_t)remaining.tv_sec * 1000000 + remaining.tv_usec);
+            }
+            break;
+        }
+        case ClockDiscipline::Correction::Kind::None:
+            break;
+    }
+}
+
+esp_err_t RealTimeClock::readTime(struct tm& time) {
+    uint8_t data[7];
+    esp_err_t ret = readRegisters(DS3231_TIME_REG, data, 7);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
     // Convert BCD to decimal and populate tm structure
+    time = {};
     time.tm_sec = bcdToDec(data[0] & 0x7F);        // Seconds
     time.tm_min = bcdToDec(data[1] & 0x7F);        // Minutes
     time.tm_hour = bcdToDec(data[2] & 0x3F);       // Hours (24-hour format)
@@ -80,38 +355,13 @@ bool RealTimeClock::getTime(struct tm& time) {
     time.tm_mday = bcdToDec(data[4] & 0x3F);       // Day of month
     time.tm_mon = bcdToDec(data[5] & 0x1F) - 1;    // Month (0-11)
     time.tm_year = bcdToDec(data[6]) + 100;        // Year since 1900 (assuming 21st century)
-    
-    return true;
+    return ESP_OK;
 }
 
-bool RealTimeClock::setTime(const struct tm& time) {
-    if (!m_initialized) {
-        ESP_LOGE(TAG, "DS3231 not initialized");
-        return false;
-    }
-    
-    uint8_t data[7];
-    
-    // Convert decimal to BCD and prepare data
-    data[0] = decToBcd(time.tm_sec);              // Seconds
-    data[1] = decToBcd(time.tm_min);              // Minutes
-    data[2] = decToBcd(time.tm_hour);             // Hours (24-hour format)
-    data[3] = decToBcd(time.tm_wday + 1);         // Day of week (1-7)
-    data[4] = decToBcd(time.tm_mday);             // Day of month
-    data[5] = decToBcd(time.tm_mon + 1);          // Month (1-12)
-    data[6] = decToBcd(time.tm_year % 100);       // Year (last 2 digits)
-    
-    // Write all time registers at once
-    esp_err_t ret = ESP_OK;
-    for (int i = 0; i < 7; i++) {
-        ret = writeRegister(DS3231_TIME_REG + i, data[i]);
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to write time register %d", i);
-            return false;
-        }
-    }
-    
-    return true;
+int64_t RealTimeClock::systemUs() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
 }
 
 esp_err_t RealTimeClock::writeRegister(uint8_t reg, uint8_t data) {
@@ -120,7 +370,7 @@ esp_err_t RealTimeClock::writeRegister(uint8_t reg, uint8_t data) {
     }
     
     uint8_t write_data[2] = {reg, data};
-    esp_err_t ret = i2c_master_transmit(m_dev_handle, write_data, 2, 1000 / portTICK_PERIOD_MS);
+    esp_err_t ret = I2cBusManager::transfer(I2cClient::Rtc, m_dev_handle, write_data, 2);
     
     return ret;
 }
@@ -134,7 +384,7 @@ esp_err_t RealTimeClock::readRegisters(uint8_t reg, uint8_t* data, size_t len) {
         return ESP_ERR_INVALID_ARG;
     }
     
-    esp_err_t ret = i2c_master_transmit_receive(m_dev_handle, &reg, 1, data, len, 1000 / portTICK_PERIOD_MS);
+    esp_err_t ret = I2cBusManager::transfer(I2cClient::Rtc, m_dev_handle, &reg, 1, data, len);
     
     return ret;
 }
@@ -11,6 +11,7 @@
 #include "esp_dsp.h"
 #include "esp_rom_sys.h"
 #include "esp_heap_caps.h"
+#include "instrumentation.hpp"
 
 static const char *TAG = "AudioAnalyzer";
 
@@ -48,6 +49,7 @@ esp_err_t AudioAnalyzer::init() {
 }
 
 void AudioAnalyzer::sampleInput() {
+    StageTimer timer(DspStage::Sample);
     // Derive delay from desired sample rate (in microseconds) and measure effective rate
     const float targetPeriodUs = 1e6f / sampleRate;
     const int delayUs = (int)lrintf(fmaxf(targetPeriodUs, 0.0f));
@@ -73,27 +75,37 @@ void AudioAnalyzer::sampleInput() {
 }
 
 void AudioAnalyzer::computeFft() {
-    dsps_wind_hann_f32(wind, N);
-    for (int i = 0 ; i < N ; i++) {
-        yCf[i * 2 + 0] = x1[i] * wind[i];
-        yCf[i * 2 + 1] = x2[i] * wind[i];
+    {
+        StageTimer timer(DspStage::Window);
+        dsps_wind_hann_f32(wind, N);
+        for (int i = 0 ; i < N ; i++) {
+            yCf[i * 2 + 0] = x1[i] * wind[i];
+            yCf[i * 2 + 1] = x2[i] * wind[i];
+        }
+    }
+    {
+        StageTimer timer(DspStage::Fft);
+        dsps_fft2r_fc32(yCf, N);
     }
-    unsigned int start_b = dsp_get_cpu_cycle_count();
-    dsps_fft2r_fc32(yCf, N);
-    unsigned int end_b = dsp_get_cpu_cycle_count();
-    dsps_bit_rev_fc32(yCf, N);
-    dsps_cplx2reC_fc32(yCf, N);
 
     // Calculate frequency resolution
     float freqResolution = (measuredSampleRate > 0.0f ? measuredSampleRate : sampleRate) / N;
 
-    // Process all bins
-      for (int i = 0 ; i < N / 2 ; i++) {
-        y1Cf[i] = 10 * log10f((y1Cf[i * 2 + 0] * y1Cf[i * 2 + 0] + y1Cf[i * 2 + 1] * y1Cf[i * 2 + 1]) / N);
-        y2Cf[i] = 10 * log10f((y2Cf[i * 2 + 0] * y2Cf[i * 2 + 0] + y2Cf[i * 2 + 1] * y2Cf[i * 2 + 1]) / N);
-        // Simple way to show two power spectrums as one plot
-        sumY[i] = fmax(y1Cf[i], y2Cf[i]);
+    {
+        StageTimer timer(DspStage::Spectrum);
+        dsps_bit_rev_fc32(yCf, N);
+        dsps_cplx2reC_fc32(yCf, N);
+
+        // Process all bins
+        for (int i = 0 ; i < N / 2 ; i++) {
+            y1Cf[i] = 10 * log10f((y1Cf[i * 2 + 0] * y1Cf[i * 2 + 0] + y1Cf[i * 2 + 1] * y1Cf[i * 2 + 1]) / N);
+            y2Cf[i] = 10 * log10f((y2Cf[i * 2 + 0] * y2Cf[i * 2 + 0] + y2Cf[i * 2 + 1] * y2Cf[i * 2 + 1]) / N);
+            // Simple way to show two power spectrums as one plot
+            sumY[i] = fmax(y1Cf[i], y2Cf[i]);
+        }
     }
+
+    StageTimer timer(DspStage::Detect);
     peakBin = 0; // Start peak detection from the first bin
     peakVal = sumY[5];
     for (int i = 5; i < N / 2; i++) { // Iterate through all N/2 bins
@@ -103,8 +115,37 @@ void AudioAnalyzer::computeFft() {
         }
     }
     peakFreq = peakBin * freqResolution;
+}
+
+void AudioAnalyzer::computeBandEnergy() {
+    StageTimer timer(DspStage::Detect);
+    const float rate = measuredSampleRate > 0.0f ? measuredSampleRate : sampleRate;
+    const float dt = 1.0f / rate;
+    const float highPassRc = 1.0f / (2.0f * (float)M_PI * 300.0f);
+    const float lowPassRc = 1.0f / (2.0f * (float)M_PI * 3300.0f);
+    const float a = highPassRc / (highPassRc + dt);
+    const float b = dt / (lowPassRc + dt);
+
+    float highPass = 0.0f;
+    float band = 0.0f;
+    float power = 0.0f;
+    int zeroCrossings = 0;
+    bool positive = false;
+    for (int i = 1; i < N; i++) {
+        highPass = a * (highPass + x1[i] - x1[i - 1]);
+        band += b * (highPass - band);
+        power += band * band;
+        if ((band > 0.0f) != positive) {
+            positive = !positive;
+            zeroCrossings++;
+        }
+    }
+    power /= (N - 1);
 
-    //ESP_LOGI(TAG, "FFT for %i complex points take %i cycles", N, end_b - start_b);
+    // A tone of power P shows up in a Hann windowed FFT bin at about P * N / 8
+    peakVal = 10 * log10f(power * N / 8 + 1e-12f);
+    peakFreq = zeroCrossings * rate / (2.0f * N);
+    peakBin = (int)(peakFreq * N / rate);
 }
 
 void AudioAnalyzer::printResults() {
@@ -116,7 +157,7 @@ void AudioAnalyzer::printResults() {
 
 bool AudioAnalyzer::isWord() {
     // ESP_LOGI(TAG, "Peak value: %.2f dB", peakVal);
-    if (peakVal > -40 && peakFreq >= 300 && peakFreq <= 3300){
+    if (peakVal > wordThresholds.levelDb && peakFreq >= wordThresholds.lowHz && peakFreq <= wordThresholds.highHz){
         return true; // Word detected if peak value is above threshold
     }else {
         return false; // No word detected
@@ -1,48 +1,353 @@
 #include "audioModem.hpp"
-#include <iostream> // For demonstration purposes (e.g., logging)
+#include <math.h>
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "hal/ledc_ll.h"
+#include "powerManager.hpp"
+#include "modemCodec.hpp"
+
+static const char *TAG = "AudioModem";
 
 // Constructor
-AudioModem::AudioModem(uint32_t highFreq, uint32_t lowFreq, gpio_num_t gpioPin) 
-    : PWMChannel(gpioPin), highFreq(highFreq), lowFreq(lowFreq) {
+AudioModem::AudioModem(uint32_t highFreq, uint32_t lowFreq, gpio_num_t gpioPin, uint32_t symbolUs, uint8_t bitsPerSymbol,
+                       Output output)
+    : PWMChannel(gpioPin), tonePlan(lowFreq, highFreq, bitsPerSymbol), symbolUs(symbolUs), output(output),
+      dac(gpioPin), dividers{},
+      producerMutex(nullptr), events(nullptr), txTask(nullptr), symbolTimer(nullptr), completionCallback(nullptr),
+      completionContext(nullptr), packer(tonePlan.getBitsPerSymbol()), symbolIndex(0), burstStartUs(0), jitter{},
+      jitterLock(portMUX_INITIALIZER_UNLOCKED), beaconTimer(nullptr), beaconsActive(false), beaconSessionId(0),
+      beaconSequence(0), beaconStartUs(0), beaconDuty(0), transmitting(false), burstCount(0) {
 }
 
 // Destructor
 AudioModem::~AudioModem() {
+    if (txTask != nullptr) {
+        vTaskDelete(txTask);
+    }
+    if (symbolTimer != nullptr) {
+        gptimer_del_timer(symbolTimer);
+    }
+    if (beaconTimer != nullptr) {
+        esp_timer_stop(beaconTimer);
+        esp_timer_delete(beaconTimer);
+    }
+    if (events != nullptr) {
+        vEventGroupDelete(events);
+    }
+    if (producerMutex != nullptr) {
+        vSemaphoreDelete(producerMutex);
+    }
+}
+
+esp_err_t AudioModem::initialize() {
+    producerMutex = xSemaphoreCreateMutex();
+    events = xEventGroupCreate();
+    if (producerMutex == nullptr || events == nullptr) {
+        return ESP_ERR_NO_MEM;
+    }
+    xEventGroupSetBits(events, IDLE_BIT);
+
+    esp_err_t ret = (output == Output::Dac) ? dac.initialize(tonePlan) : initializePwm();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    esp_timer_create_args_t args = {};
+    args.callback = [](void *arg) {
+        AudioModem *modem = static_cast<AudioModem *>(arg);
+        xTaskNotify(modem->txTask, NOTIFY_BEACON, eSetBits);
+    };
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "modem_beacon";
+    ret = esp_timer_create(&args, &beaconTimer);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create beacon timer: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    // Above the observer task, so a burst is not delayed by menu handling
+    if (xTaskCreatePinnedToCore(txTaskFunction, "ModemTx", 3072, this, 6, &txTask, 0) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t AudioModem::initializePwm() {
+    esp_err_t ret = PWMChannel::initialize();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize PWM output: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    // The fundamental of a square wave with duty D scales with sin(pi * D)
+    float level = CONFIG_YOD_MODEM_BEACON_LEVEL / 100.0f;
+    beaconDuty = (uint32_t)lroundf(asinf(level) / (float)M_PI * (1 << config.resolution));
+    beaconDuty = beaconDuty < 1 ? 1 : beaconDuty;
+
+    // Let the driver pick clock source and divider once per tone, the ISR only writes the result
+    xSemaphoreTake(pwmMutex, portMAX_DELAY);
+    for (size_t k = 0; k < tonePlan.getToneCount(); k++) {
+        ledc_set_freq(config.mode, config.timer, (uint32_t)lroundf(tonePlan.toneFrequency((uint8_t)k)));
+        ledc_ll_get_clock_divider(LEDC_LL_GET_HW(), config.mode, config.timer, &dividers[k]);
+    }
+    xSemaphoreGive(pwmMutex);
+
+    gptimer_config_t timerConfig = {};
+    timerConfig.clk_src = GPTIMER_CLK_SRC_DEFAULT;
+    timerConfig.direction = GPTIMER_COUNT_UP;
+    timerConfig.resolution_hz = 1000000; // 1 us per tick
+    ret = gptimer_new_timer(&timerConfig, &symbolTimer);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create symbol timer: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    gptimer_event_callbacks_t callbacks = {};
+    callbacks.on_alarm = onSymbolAlarm;
+    ESP_ERROR_CHECK(gptimer_register_event_callbacks(symbolTimer, &callbacks, this));
+    gptimer_alarm_config_t alarm = {};
+    alarm.alarm_count = symbolUs;
+    alarm.reload_count = 0;
+    alarm.flags.auto_reload_on_alarm = true;
+    ESP_ERROR_CHECK(gptimer_set_alarm_action(symbolTimer, &alarm));
+    return ESP_OK;
 }
 
 // Method to transmit data
-void AudioModem::transmit(uint8_t data) {
-    // Take mutex before PWM operations
-    if (xSemaphoreTake(pwmMutex, portMAX_DELAY) == pdTRUE) {
-
-        // vTaskDelay(pdMS_TO_TICKS(200)); 
-        // Code to transmit data using the audio modem
-        // std::cout << "Transmitting data: " << static_cast<int>(data) << std::endl;
-        uint8_t mask = 1; // Start with the least significant bit
-        //printf("Processing data...\n");
-        // ledc_set_freq(config.mode, config.timer, highFreq);
-        // vTaskDelay(pdMS_TO_TICKS(100));
-        ledc_timer_resume(config.mode, config.timer); // Resume PWM signal
-
-        for (uint8_t i = 0; i < 8; i++)
-        {
-            //printf("Bit %d: %d\n", i, (data & mask) ? 1 : 0);
-            if (data & mask)
-            {
-                ledc_set_freq(config.mode, config.timer, highFreq);
+esp_err_t AudioModem::transmit(uint8_t data) {
+    return transmitFrame(std::span<const uint8_t>(&data, 1));
+}
+
+esp_err_t AudioModem::transmitFrame(std::span<const uint8_t> frame) {
+    if (txTask == nullptr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(producerMutex, portMAX_DELAY);
+    // Only the producer side adds, so the free space can only grow while we hold the mutex
+    if (frame.size() > txBuffer.capacity() - txBuffer.size()) {
+        xSemaphoreGive(producerMutex);
+        ESP_LOGW(TAG, "TX buffer full, frame of %u bytes dropped", (unsigned)frame.size());
+        return ESP_ERR_NO_MEM;
+    }
+    xEventGroupClearBits(events, IDLE_BIT);
+    txBuffer.pushBatch(frame.data(), frame.size());
+    xSemaphoreGive(producerMutex);
+
+    xTaskNotify(txTask, NOTIFY_DATA, eSetBits);
+    return ESP_OK;
+}
+
+void AudioModem::setCompletionCallback(CompletionCallback callback, void *context) {
+    completionContext = context;
+    completionCallback = callback;
+}
+
+bool AudioModem::isBusy() const {
+    return events != nullptr && (xEventGroupGetBits(events) & IDLE_BIT) == 0;
+}
+
+bool AudioModem::waitUntilIdle(TickType_t timeout) {
+    if (events == nullptr) {
+        return true;
+    }
+    return (xEventGroupWaitBits(events, IDLE_BIT, pdFALSE, pdTRUE, timeout) & IDLE_BIT) != 0;
+}
+
+esp_err_t AudioModem::startBeacons(uint16_t sessionId, uint32_t intervalMs) {
+    stopBeacons();
+    if (intervalMs == 0 || beaconTimer == nullptr) {
+        return ESP_OK;
+    }
+    beaconSessionId = sessionId;
+    beaconSequence = 0;
+    beaconStartUs = esp_timer_get_time();
+    beaconsActive = true;
+    return esp_timer_start_periodic(beaconTimer, (uint64_t)intervalMs * 1000);
+}
+
+void AudioModem::stopBeacons() {
+    if (beaconsActive) {
+        beaconsActive = false;
+        esp_timer_stop(beaconTimer);
+    }
+}
+
+bool AudioModem::queueBeacon() {
+    BeaconPayload beacon = {};
+    beacon.sessionId = beaconSessionId;
+    beacon.sequence = beaconSequence;
+    beacon.elapsedMs = (uint32_t)((esp_timer_get_time() - beaconStartUs) / 1000);
+    uint8_t packet[ModemPacket::encodedSize(BeaconPayload::SIZE)];
+    size_t length = ModemCodec::encodeBeacon(beacon, packet, sizeof(packet));
+
+    xSemaphoreTake(producerMutex, portMAX_DELAY);
+    bool fits = length <= txBuffer.capacity() - txBuffer.size();
+    if (fits) {
+        xEventGroupClearBits(events, IDLE_BIT);
+        txBuffer.pushBatch(packet, length);
+        beaconSequence++;
+    }
+    xSemaphoreGive(producerMutex);
+    return fits;
+}
+
+AudioModem::JitterStatistics AudioModem::getJitterStatistics(bool reset) {
+    portENTER_CRITICAL(&jitterLock);
+    JitterStatistics copy = jitter;
+    if (reset) {
+        jitter = {};
+    }
+    portEXIT_CRITICAL(&jitterLock);
+    return copy;
+}
+
+IRAM_ATTR void AudioModem::setSymbol(uint8_t symbol) {
+    ledc_ll_set_clock_divider(LEDC_LL_GET_HW(), config.mode, config.timer, dividers[symbol]);
+    ledc_ll_ls_timer_update(LEDC_LL_GET_HW(), config.mode, config.timer);
+}
+
+IRAM_ATTR bool AudioModem::nextSymbol() {
+    uint8_t byte;
+    while (packer.needsByte() && txBuffer.pop(byte)) {
+        packer.push(byte);
+    }
+    if (packer.empty()) {
+        return false;
+    }
+    setSymbol(packer.pop());
+    return true;
+}
+
+void AudioModem::sendBurst(bool quiet) {
+    // Keeps the divider table of this instance's timer stable while a burst plays it
+    xSemaphoreTake(pwmMutex, portMAX_DELAY);
+    ledc_set_duty(config.mode, config.channel, quiet ? beaconDuty : config.duty);
+    ledc_update_duty(config.mode, config.channel);
+    // LEDC runs from APB, a frequency change would shift the tones
+    PowerManager::acquire(PowerManager::LockType::ApbMax);
+
+    // The ISR is not running yet, so the task may act as the consumer for the first symbol
+    packer.clear();
+    symbolIndex = 0;
+    nextSymbol();
+    ulTaskNotifyValueClear(NULL, NOTIFY_BURST_DONE);
+
+    // The timer only runs during a burst, so it holds no power management lock in between
+    gptimer_enable(symbolTimer);
+    gptimer_set_raw_count(symbolTimer, 0);
+    ledc_timer_resume(config.mode, config.timer); // Resume PWM signal
+    burstStartUs = esp_timer_get_time();
+    gptimer_start(symbolTimer);
+
+    uint32_t notified = 0;
+    while ((notified & NOTIFY_BURST_DONE) == 0) {
+        xTaskNotifyWait(0, NOTIFY_BURST_DONE, &notified, portMAX_DELAY);
+    }
+
+    gptimer_stop(symbolTimer);
+    gptimer_disable(symbolTimer);
+    ledc_timer_pause(config.mode, config.timer); // Pause PWM signal
+
+    PowerManager::release(PowerManager::LockType::ApbMax);
+    xSemaphoreGive(pwmMutex);
+}
+
+void AudioModem::sendBurstDac(bool quiet) {
+    // The DAC DMA is clocked from the PLL, APB must not drop while it streams
+    PowerManager::acquire(PowerManager::LockType::ApbMax);
+    dac.setLevel(quiet ? CONFIG_YOD_MODEM_BEACON_LEVEL : 100);
+    dac.start();
+
+    // The task is the consumer here, symbols are timed by whole samples
+    uint64_t sampleRate = dac.getSampleRate();
+    packer.clear();
+    uint8_t byte;
+    for (uint64_t symbol = 0;; symbol++) {
+        while (packer.needsByte() && txBuffer.pop(byte)) {
+            packer.push(byte);
+        }
+        if (packer.empty()) {
+            break;
+        }
+        size_t samples = (size_t)(((symbol + 1) * symbolUs * sampleRate) / 1000000 - (symbol * symbolUs * sampleRate) / 1000000);
+        dac.writeSymbol(packer.pop(), samples);
+    }
+
+    dac.stop();
+    PowerManager::release(PowerManager::LockType::ApbMax);
+}
+
+void AudioModem::txTaskFunction(void *pvParameters) {
+    AudioModem *modem = static_cast<AudioModem *>(pvParameters);
+    bool beaconPending = false;
+    while (true) {
+        uint32_t notified = 0;
+        xTaskNotifyWait(0, NOTIFY_DATA | NOTIFY_BEACON, &notified, portMAX_DELAY);
+        if (notified & NOTIFY_BEACON) {
+            beaconPending = modem->beaconsActive;
+        }
+        bool quiet = false;
+        if (modem->txBuffer.empty()) {
+            // A beacon waits for queued frames, so it never splits one and goes out at its own level
+            if (!beaconPending || !modem->queueBeacon()) {
+                continue;
+            }
+            beaconPending = false;
+            quiet = true;
+        }
+
+        modem->burstCount.fetch_add(1, std::memory_order_release);
+        modem->transmitting.store(true, std::memory_order_release);
+        if (modem->output == Output::Dac) {
+            modem->sendBurstDac(quiet);
+        } else {
+            modem->sendBurst(quiet);
+        }
+        modem->transmitting.store(false, std::memory_order_release);
+
+        // A producer may have queued more after the last pop, the next loop picks it up
+        xSemaphoreTake(modem->producerMutex, portMAX_DELAY);
+        bool drained = modem->txBuffer.empty();
+        if (drained) {
+            xEventGroupSetBits(modem->events, IDLE_BIT);
+        }
+        xSemaphoreGive(modem->producerMutex);
+
+        if (!drained) {
+            xTaskNotify(modem->txTask, NOTIFY_DATA, eSetBits);
+        } else {
+            if (beaconPending) {
+                xTaskNotify(modem->txTask, NOTIFY_BEACON, eSetBits);
             }
-            else
-            {
-                ledc_set_freq(config.mode, config.timer, lowFreq);
+            if (modem->completionCallback != nullptr) {
+                modem->completionCallback(modem->completionContext);
             }
-            mask = mask << 1; // Shift the mask to the next bit
-            vTaskDelay(pdMS_TO_TICKS(20)); // Delay for 100 ms
         }
-        ledc_timer_pause(config.mode, config.timer); // Pause PWM signal
-        
-        // Release mutex
-        xSemaphoreGive(pwmMutex);
-    } else {
-        printf("Failed to acquire PWM mutex for transmission!\n");
-    }
-}
\ No newline at end of file
+    }
+}
+
+IRAM_ATTR bool AudioModem::onSymbolAlarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *userCtx) {
+    AudioModem *modem = static_cast<AudioModem *>(userCtx);
+
+    // Deviation of this boundary from its ideal time, ISR latency included
+    modem->symbolIndex++;
+    int64_t deviation = esp_timer_get_time() - (modem->burstStartUs + (int64_t)modem->symbolIndex * modem->symbolUs);
+    uint32_t absoluteUs = (uint32_t)(deviation < 0 ? -deviation : deviation);
+    portENTER_CRITICAL_ISR(&modem->jitterLock);
+    modem->jitter.symbols++;
+    modem->jitter.sumUs += absoluteUs;
+    if (absoluteUs > modem->jitter.maxUs) {
+        modem->jitter.maxUs = absoluteUs;
+    }
+    portEXIT_CRITICAL_ISR(&modem->jitterLock);
+
+    if (!modem->nextSymbol()) {
+        // Last symbol is complete, the task pauses the output
+        BaseType_t higherPriorityTaskWoken = pdFALSE;
+        xTaskNotifyFromISR(modem->txTask, NOTIFY_BURST_DONE, eSetBits, &higherPriorityTaskWoken);
+        return higherPriorityTaskWoken == pdTRUE;
+    }
+    return false;
+}
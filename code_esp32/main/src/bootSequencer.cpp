@@ -0,0 +1,121 @@
+#include "bootSequencer.hpp"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "BootSequencer";
+
+static constexpr UBaseType_t JOB_PRIORITY = 10;
+
+static portMUX_TYPE failedBitsLock = portMUX_INITIALIZER_UNLOCKED;
+
+BootSequencer::BootSequencer()
+    : jobs{}, jobCount(0), marks{}, markCount(0), doneBits(xEventGroupCreate()), failedBits(0), finished(false) {
+}
+
+BootSequencer::~BootSequencer() {
+    if (finished) {
+        vEventGroupDelete(doneBits);
+    } else {
+        // A job may still be running and signal the group, leak it rather than crash
+        ESP_LOGW(TAG, "Sequence did not finish, event group kept alive");
+    }
+}
+
+BootSequencer::JobId BootSequencer::addJob(const char *name, JobFunction function, void *context,
+                                           std::initializer_list<JobId> dependencies, uint32_t stackSize) {
+    configASSERT(jobCount < MAX_JOBS);
+
+    Job &job = jobs[jobCount];
+    job = {name, function, context, 0, stackSize, 0, 0, ESP_OK, -1, this};
+    for (JobId dependency : dependencies) {
+        configASSERT(dependency < jobCount);
+        job.dependencies |= (EventBits_t)1 << dependency;
+    }
+    return (JobId)jobCount++;
+}
+
+esp_err_t BootSequencer::run(TickType_t timeout) {
+    if (doneBits == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    EventBits_t allBits = 0;
+    for (size_t i = 0; i < jobCount; i++) {
+        allBits |= (EventBits_t)1 << i;
+        // No affinity, so independent jobs spread over both cores
+        if (xTaskCreate(jobTask, jobs[i].name, jobs[i].stackSize, &jobs[i], JOB_PRIORITY, NULL) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create job '%s'", jobs[i].name);
+            jobs[i].result = ESP_ERR_NO_MEM;
+            portENTER_CRITICAL(&failedBitsLock);
+            failedBits |= (EventBits_t)1 << i;
+            portEXIT_CRITICAL(&failedBitsLock);
+            xEventGroupSetBits(doneBits, (EventBits_t)1 << i);
+        }
+    }
+
+    EventBits_t done = xEventGroupWaitBits(doneBits, allBits, pdFALSE, pdTRUE, timeout);
+    if ((done & allBits) != allBits) {
+        ESP_LOGE(TAG, "Boot sequence timed out");
+        return ESP_ERR_TIMEOUT;
+    }
+    finished = true;
+
+    for (size_t i = 0; i < jobCount; i++) {
+        if (jobs[i].result != ESP_OK) {
+            return jobs[i].result;
+        }
+    }
+    return ESP_OK;
+}
+
+void BootSequencer::mark(const char *name) {
+    if (markCount < MAX_MARKS) {
+        marks[markCount++] = {name, esp_timer_get_time()};
+    }
+}
+
+void BootSequencer::printTimeline() const {
+    ESP_LOGI(TAG, "Boot timeline (ms since boot):");
+    for (size_t i = 0; i < jobCount; i++) {
+        const Job &job = jobs[i];
+        ESP_LOGI(TAG, "  %-12s %6lld -> %6lld (%4lld ms) core %d %s", job.name, job.startUs / 1000, job.endUs / 1000,
+                 (job.endUs - job.startUs) / 1000, job.core, esp_err_to_name(job.result));
+    }
+    for (size_t i = 0; i < markCount; i++) {
+        ESP_LOGI(TAG, "  %-12s %6lld", marks[i].name, marks[i].timeUs / 1000);
+    }
+    // The caller is the task that constructed everything, so this shows how close its stack came to the canary
+    ESP_LOGI(TAG, "Stack high-water mark of %s: %u bytes free", pcTaskGetName(NULL),
+             (unsigned)uxTaskGetStackHighWaterMark(NULL));
+}
+
+void BootSequencer::jobTask(void *pvParameters) {
+    Job &job = *static_cast<Job *>(pvParameters);
+    BootSequencer &sequencer = *job.sequencer;
+    EventBits_t ownBit = (EventBits_t)1 << (&job - sequencer.jobs);
+
+    if (job.dependencies != 0) {
+        xEventGroupWaitBits(sequencer.doneBits, job.dependencies, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+
+    job.startUs = esp_timer_get_time();
+    job.core = (int8_t)xPortGetCoreID();
+    if (sequencer.failedBits & job.dependencies) {
+        ESP_LOGW(TAG, "Skipping '%s', a dependency failed", job.name);
+        job.result = ESP_ERR_INVALID_STATE;
+    } else {
+        job.result = job.function(job.context);
+    }
+    job.endUs = esp_timer_get_time();
+
+    if (job.result != ESP_OK) {
+        ESP_LOGE(TAG, "Job '%s' failed: %s", job.name, esp_err_to_name(job.result));
+        portENTER_CRITICAL(&failedBitsLock);
+        sequencer.failedBits |= ownBit;
+        portEXIT_CRITICAL(&failedBitsLock);
+    }
+
+    xEventGroupSetBits(sequencer.doneBits, ownBit);
+    vTaskDelete(NULL);
+}
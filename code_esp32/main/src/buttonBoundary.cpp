@@ -2,10 +2,15 @@
 #include "esp_sleep.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "sdkconfig.h"
+#include "hal/gpio_ll.h"
 
+TaskHandle_t ButtonBoundary::wakeTask = nullptr;
+std::atomic<uint32_t> ButtonBoundary::pressCount{0};
 
 ButtonBoundary::ButtonBoundary(gpio_num_t pin, ObserverId buttonId, gpio_int_type_t interruptType)
-    : buttonPin(pin), interruptType(interruptType), id(buttonId), listener(nullptr), buttonPressed(false)
+    : buttonPin(pin), interruptType(interruptType), id(buttonId), lastState(false), debounceDelay(50), lastPressTime(INT64_MIN / 2), listener(nullptr),
+      activeLevel(interruptType != GPIO_INTR_NEGEDGE && interruptType != GPIO_INTR_LOW_LEVEL), waitingForPress(true)
 {
 }
 
@@ -28,31 +33,27 @@ void ButtonBoundary::initialize()
     io_conf.mode = GPIO_MODE_INPUT;
     io_conf.pull_up_en = GPIO_PULLUP_ENABLE;
     io_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
-    gpio_config(&io_conf);
-    
-    // Short delay to ensure GPIO configuration is complete
-   // Add the ISR handler for this button
-    gpio_isr_handler_add(buttonPin, gpioIsrHandler, this);
-    vTaskDelay(pdMS_TO_TICKS(200));
-
-    // Add the ISR handler for this specific button pin
-    // esp_err_t ret = gpio_isr_handler_add(buttonPin, gpioIsrHandler, this);
-    // if (ret != ESP_OK) {
-    //     printf("Failed to add ISR handler for GPIO %d: %s\n", buttonPin, esp_err_to_name(ret));
-    //     return;
-    // }
-    
-    // printf("Button initialized on GPIO %d with interrupt type %d\n", buttonPin, interruptType);
-    
-    // Small delay to ensure ISR handler is properly registered
-    vTaskDelay(pdMS_TO_TICKS(50));
+    ESP_ERROR_CHECK(gpio_config(&io_conf));
 
+#if CONFIG_YOD_POWER_MANAGEMENT
+    // Edge interrupts are not seen in light sleep, wait for the pressed level instead
+    gpio_wakeup_enable(buttonPin, activeLevel ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
+#endif
+
+    // gpio_config() and gpio_isr_handler_add() are synchronous, no settling delay is needed
+    ESP_ERROR_CHECK(gpio_isr_handler_add(buttonPin, gpioIsrHandler, this));
 }
 
 
 void ButtonBoundary::update() {
-    if (buttonPressed) {
-        buttonPressed = false; // Clear the flag
+    int64_t pressTime;
+    while (presses.pop(pressTime)) {
+        // Contact bounce shows up as a burst of presses, only the first one counts
+        if (pressTime - lastPressTime < (int64_t)debounceDelay * 1000) {
+            continue;
+        }
+        lastPressTime = pressTime;
+        pressCount.fetch_add(1, std::memory_order_relaxed);
         if (listener != nullptr) {
             listener->notify(id); // Pass the button ID to the listener
         }
@@ -65,8 +66,27 @@ ObserverId ButtonBoundary::getId() const {
     return id;
 }
 
+void ButtonBoundary::setWakeTask(TaskHandle_t task) {
+    wakeTask = task;
+}
+
 void IRAM_ATTR ButtonBoundary::gpioIsrHandler(void *arg) {
     // ISR should be kept minimal - just set a flag
     ButtonBoundary *button = static_cast<ButtonBoundary *>(arg);
-    button->buttonPressed = true; 
+
+#if CONFIG_YOD_POWER_MANAGEMENT
+    // Re-arm on the opposite level, otherwise the interrupt keeps firing while held
+    bool pressed = button->waitingForPress;
+    button->waitingForPress = !pressed;
+    bool nextLevel = pressed ? !button->activeLevel : button->activeLevel;
+    gpio_ll_set_intr_type(GPIO_LL_GET_HW(GPIO_PORT_0), button->buttonPin,
+                          nextLevel ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
+    if (!pressed) {
+        return;
+    }
+#endif
+
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    button->presses.pushFromIsr(esp_timer_get_time(), wakeTask, &higherPriorityTaskWoken);
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
 }
\ No newline at end of file
@@ -0,0 +1,195 @@
+#include "configReceiver.hpp"
+#include <stdio.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "powerManager.hpp"
+
+static const char *TAG = "ConfigReceiver";
+
+// The analyzer task listens, the console task reads the times for the "power" report
+static portMUX_TYPE listenLock = portMUX_INITIALIZER_UNLOCKED;
+
+ConfigReceiver::ConfigReceiver(Storage &storage)
+    : storage(storage),
+      codec(ConfigLink::SAMPLE_RATE, ConfigLink::SYMBOL_US, ConfigLink::BITS_PER_SYMBOL, ConfigLink::LOW_FREQ,
+            ConfigLink::HIGH_FREQ),
+      handle(nullptr), listening(false), dc(0.0f), dcValid(false), windowEndUs(0), listenStartUs(0),
+      listenedUs(0), windows(0) {
+}
+
+ConfigReceiver::~ConfigReceiver() {
+    if (handle != nullptr) {
+        PowerManager::setReportHook(nullptr, nullptr);
+        stop();
+        adc_continuous_deinit(handle);
+    }
+}
+
+esp_err_t ConfigReceiver::initialize() {
+    if (!CONFIG_YOD_CONFIG_RX) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    uint8_t key[ConfigLink::KEY_SIZE];
+    if (!parseConfigKey(CONFIG_YOD_CONFIG_KEY, key)) {
+        ESP_LOGW(TAG, "CONFIG_YOD_CONFIG_KEY is not %u hex digits, configuration upload disabled",
+                 (unsigned)(2 * ConfigLink::KEY_SIZE));
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    authenticator = std::make_unique<ConfigAuthenticator>(key, storage.getConfigCounter());
+
+    size_t capacity = ModemReceiver::bufferSamples(codec);
+    buffer = std::make_unique<float[]>(capacity);
+    receiver = std::make_unique<ModemReceiver>(codec, buffer.get(), capacity, ConfigPayload::SIZE);
+    raw = std::make_unique<uint8_t[]>(RAW_BYTES);
+    samples = std::make_unique<float[]>(CHUNK_SAMPLES);
+
+    adc_continuous_handle_cfg_t handleConfig = {};
+    handleConfig.max_store_buf_size = 4 * RAW_BYTES;
+    handleConfig.conv_frame_size = RAW_BYTES;
+    esp_err_t ret = adc_continuous_new_handle(&handleConfig, &handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create ADC DMA handle: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    adc_digi_pattern_config_t pattern = {};
+    pattern.atten = ADC_ATTEN_DB_12;
+    pattern.channel = ADC_CHANNEL_5;
+    pattern.unit = ADC_UNIT_1;
+    pattern.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+    adc_continuous_config_t config = {};
+    config.pattern_num = 1;
+    config.adc_pattern = &pattern;
+    config.sample_freq_hz = ConfigLink::SAMPLE_RATE;
+    config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+    ret = adc_continuous_config(handle, &config);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure ADC DMA: %s", esp_err_to_name(ret));
+        adc_continuous_deinit(handle);
+        handle = nullptr;
+        return ret;
+    }
+    PowerManager::setReportHook(printPower, this);
+    openWindow();
+    ESP_LOGI(TAG, "Listening for configuration uploads, last counter %lu",
+             (unsigned long)authenticator->getLastCounter());
+    return ESP_OK;
+}
+
+void ConfigReceiver::openWindow() {
+    portENTER_CRITICAL(&listenLock);
+    windowEndUs = esp_timer_get_time() + WINDOW_US;
+    windows++;
+    portEXIT_CRITICAL(&listenLock);
+}
+
+bool ConfigReceiver::isWindowOpen() const {
+    return WINDOW_US == 0 || esp_timer_get_time() < windowEndUs;
+}
+
+esp_err_t ConfigReceiver::start() {
+    if (handle == nullptr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (listening) {
+        return ESP_OK;
+    }
+    receiver->reset();
+    dcValid = false;
+    esp_err_t ret = adc_continuous_start(handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start ADC DMA: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    portENTER_CRITICAL(&listenLock);
+    listenStartUs = esp_timer_get_time();
+    listening = true;
+    portEXIT_CRITICAL(&listenLock);
+    return ESP_OK;
+}
+
+esp_err_t ConfigReceiver::stop() {
+    if (!listening) {
+        return ESP_OK;
+    }
+    portENTER_CRITICAL(&listenLock);
+    listenedUs += esp_timer_get_time() - listenStartUs;
+    listening = false;
+    portEXIT_CRITICAL(&listenLock);
+    return adc_continuous_stop(handle);
+}
+
+void ConfigReceiver::printPower(void *context) {
+    ConfigReceiver *receiver = static_cast<ConfigReceiver *>(context);
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&listenLock);
+    bool listening = receiver->listening;
+    int64_t listenedUs = receiver->listenedUs + (listening ? now - receiver->listenStartUs : 0);
+    int64_t leftUs = receiver->windowEndUs - now;
+    uint32_t windows = receiver->windows;
+    portEXIT_CRITICAL(&listenLock);
+
+    // The ADC DMA holds its own APB lock, so this time is awake time in the table above
+    printf("config rx: %s, listened %.1f s in %lu windows (ADC DMA, no light sleep)", listening ? "listening" : "off",
+           listenedUs / 1e6, (unsigned long)windows);
+    if (WINDOW_US == 0) {
+        printf(", always on when not recording\n");
+    } else {
+        printf(", window %lld s left\n", (long long)(leftUs > 0 ? leftUs / 1000000 : 0));
+    }
+}
+
+bool ConfigReceiver::poll(uint32_t timeoutMs, ConfigPayload &config) {
+    if (!listening) {
+        return false;
+    }
+    uint32_t length = 0;
+    if (adc_continuous_read(handle, raw.get(), RAW_BYTES, &length, timeoutMs) != ESP_OK) {
+        return false;
+    }
+
+    size_t count = 0;
+    for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= length; i += SOC_ADC_DIGI_RESULT_BYTES) {
+        const adc_digi_output_data_t *result = reinterpret_cast<const adc_digi_output_data_t *>(&raw[i]);
+        if (result->type1.channel != ADC_CHANNEL_5) {
+            continue;
+        }
+        float x = (float)result->type1.data / 2048.0f - 1.0f;
+        // Seeded with the first sample, so the bias does not decay through the tone band as a burst
+        if (!dcValid) {
+            dc = x;
+            dcValid = true;
+        }
+        dc += (x - dc) * (1.0f / (1 << DC_SHIFT));
+        samples[count++] = x - dc;
+    }
+    if (!receiver->push(samples.get(), count)) {
+        return false;
+    }
+
+    ModemPacket::Decoded packet;
+    if (!receiver->takePacket(packet)) {
+        return false;
+    }
+    switch (authenticator->check(packet, config)) {
+        case ConfigAuthenticator::Result::Accepted:
+            // Committed before anything is applied, a reset halfway cannot reopen the counter
+            if (!storage.commitConfigCounter(authenticator->getLastCounter())) {
+                ESP_LOGE(TAG, "Configuration %lu not applied, its counter could not be stored",
+                         (unsigned long)config.counter);
+                return false;
+            }
+            ESP_LOGI(TAG, "Configuration %lu accepted, flags 0x%02x", (unsigned long)config.counter, config.flags);
+            return true;
+        case ConfigAuthenticator::Result::Replayed:
+            ESP_LOGI(TAG, "Configuration %lu already applied", (unsigned long)config.counter);
+            return false;
+        case ConfigAuthenticator::Result::BadMac:
+            ESP_LOGW(TAG, "Configuration packet with a wrong MAC refused");
+            return false;
+        case ConfigAuthenticator::Result::NotConfig:
+            break;
+    }
+    return false;
+}
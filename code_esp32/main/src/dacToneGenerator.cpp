@@ -0,0 +1,108 @@
+#include "dacToneGenerator.hpp"
+#include <math.h>
+#include "esp_log.h"
+
+static const char *TAG = "DacToneGenerator";
+
+DacToneGenerator::DacToneGenerator(gpio_num_t gpioPin, uint32_t sampleRate, uint8_t amplitude)
+    : gpioPin(gpioPin), sampleRate(sampleRate), amplitude(amplitude > 127 ? 127 : amplitude), handle(nullptr),
+      sineTable{}, phaseSteps{}, phase(0), currentStep(0), envelope(0), chunk{} {
+}
+
+DacToneGenerator::~DacToneGenerator() {
+    if (handle != nullptr) {
+        dac_continuous_del_channels(handle);
+    }
+}
+
+esp_err_t DacToneGenerator::initialize(const MfskTonePlan &plan) {
+    dac_channel_mask_t mask;
+    if (gpioPin == GPIO_NUM_25) {
+        mask = DAC_CHANNEL_MASK_CH0;
+    } else if (gpioPin == GPIO_NUM_26) {
+        mask = DAC_CHANNEL_MASK_CH1;
+    } else {
+        ESP_LOGE(TAG, "GPIO%d has no DAC", gpioPin);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    setLevel(100);
+    for (size_t k = 0; k < plan.getToneCount(); k++) {
+        phaseSteps[k] = (uint32_t)llround((double)plan.toneFrequency((uint8_t)k) * 4294967296.0 / sampleRate);
+    }
+
+    dac_continuous_config_t config = {};
+    config.chan_mask = mask;
+    config.desc_num = 4;
+    config.buf_size = 2048;
+    config.freq_hz = sampleRate;
+    config.offset = 0;
+    config.clk_src = DAC_DIGI_CLK_SRC_DEFAULT;
+    config.chan_mode = DAC_CHANNEL_MODE_SIMUL;
+    esp_err_t ret = dac_continuous_new_channels(&config, &handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create DAC channel: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+void DacToneGenerator::setLevel(uint8_t percent) {
+    float peak = amplitude * (percent > 100 ? 100 : percent) / 100.0f;
+    for (size_t i = 0; i < TABLE_SIZE; i++) {
+        sineTable[i] = (int8_t)lroundf(peak * sinf(2.0f * (float)M_PI * i / TABLE_SIZE));
+    }
+}
+
+esp_err_t DacToneGenerator::start() {
+    esp_err_t ret = dac_continuous_enable(handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    phase = 0;
+    envelope = 0;
+    return ESP_OK;
+}
+
+esp_err_t DacToneGenerator::writeSymbol(uint8_t symbol, size_t samples) {
+    // The first symbol carries the fade in
+    size_t ramp = (size_t)((uint64_t)RAMP_US * sampleRate / 1000000);
+    if (envelope < ENVELOPE_ONE) {
+        ramp = ramp < samples ? ramp : samples;
+        esp_err_t ret = writeSamples(phaseSteps[symbol], ramp, ENVELOPE_ONE);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        samples -= ramp;
+    }
+    return writeSamples(phaseSteps[symbol], samples, ENVELOPE_ONE);
+}
+
+esp_err_t DacToneGenerator::stop() {
+    // Fade out on the last tone, so the burst ends without a step
+    size_t ramp = (size_t)((uint64_t)RAMP_US * sampleRate / 1000000);
+    writeSamples(currentStep, ramp, 0);
+    // Flush the zeros through the DMA descriptors before the output stops
+    writeSamples(0, CHUNK_SAMPLES, 0);
+    return dac_continuous_disable(handle);
+}
+
+esp_err_t DacToneGenerator::writeSamples(uint32_t phaseStep, size_t samples, uint32_t envelopeTarget) {
+    currentStep = phaseStep;
+    int32_t envelopeStep = samples > 0 ? ((int32_t)envelopeTarget - (int32_t)envelope) / (int32_t)samples : 0;
+    while (samples > 0) {
+        size_t count = samples < CHUNK_SAMPLES ? samples : CHUNK_SAMPLES;
+        for (size_t i = 0; i < count; i++) {
+            int32_t value = ((128 + sineTable[phase >> 24]) * (int32_t)envelope) >> 16;
+            chunk[i] = (uint8_t)(value > 255 ? 255 : value);
+            phase += phaseStep;
+            envelope = (uint32_t)((int32_t)envelope + envelopeStep);
+        }
+        esp_err_t ret = dac_continuous_write(handle, chunk, count, nullptr, -1);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        samples -= count;
+    }
+    envelope = envelopeTarget;
+    return ESP_OK;
+}
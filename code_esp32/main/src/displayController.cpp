@@ -1,16 +1,36 @@
 #include "displayController.hpp"
 #include "esp_log.h"
+#include "i2cBusManager.hpp"
 #include <cstring>
 
 static const char *DISPLAY_TAG = "DisplayController";
 
+static constexpr int DISPLAY_PAGES = 8; ///< 64 rows of 8 pixels
+
+/**
+ * @brief Arguments of a text job, on the stack of the caller while it waits.
+ */
+struct TextJob {
+    SSD1306_t *display;
+    int page;
+    const char *text;
+    int length;
+    bool invert;
+};
+
 DisplayController::DisplayController(SSD1306_t* device, QueueHandle_t wordCountQueue) 
     : display(*device), wordCountQueue(wordCountQueue) {
-    ESP_LOGI(DISPLAY_TAG, "DisplayController constructed with pre-initialized device");
+    recording = false;
+}
+
+esp_err_t DisplayController::initialize() {
     // Initialize the display with proper dimensions
-    ssd1306_init(&display, 128, 64);
+    I2cBusManager::run(I2cClient::Display, [](void *device) {
+        ssd1306_init(static_cast<SSD1306_t *>(device), 128, 64);
+        return ESP_OK;
+    }, &display);
     ESP_LOGI(DISPLAY_TAG, "Display initialized successfully");
-    recording = false;
+    return ESP_OK;
 }
 
 DisplayController::~DisplayController() {
@@ -22,13 +42,25 @@ i2c_master_bus_handle_t DisplayController::getI2cBusHandle() {
 }
 
 void DisplayController::clear() {
-    ssd1306_clear_screen(&display, false);
+    // One page per job, an RTC transfer never waits for a whole screen
+    for (int page = 0; page < DISPLAY_PAGES; page++) {
+        TextJob job = {&display, page, nullptr, 0, false};
+        I2cBusManager::run(I2cClient::Display, [](void *context) {
+            TextJob *job = static_cast<TextJob *>(context);
+            ssd1306_clear_line(job->display, job->page, job->invert);
+            return ESP_OK;
+        }, &job);
+    }
     ESP_LOGD(DISPLAY_TAG, "Display cleared");
 }
 
 void DisplayController::displayText(uint8_t line, const char* text) {
-    size_t len = strlen(text);
-    ssd1306_display_text(&display, line, (char*)text, len, false);
+    TextJob job = {&display, line, text, (int)strlen(text), false};
+    I2cBusManager::run(I2cClient::Display, [](void *context) {
+        TextJob *job = static_cast<TextJob *>(context);
+        ssd1306_display_text(job->display, job->page, (char *)job->text, job->length, job->invert);
+        return ESP_OK;
+    }, &job);
     ESP_LOGD(DISPLAY_TAG, "Displayed text on line %d: %s", line, text);
 }
 
@@ -38,8 +70,12 @@ void DisplayController::displayTextX3(uint8_t line, const char *text, bool inver
         return;
     }
     
-    size_t len = strlen(text);
-    ssd1306_display_text_x3(&display, line, (char*)text, len, invert);
+    TextJob job = {&display, line, text, (int)strlen(text), invert};
+    I2cBusManager::run(I2cClient::Display, [](void *context) {
+        TextJob *job = static_cast<TextJob *>(context);
+        ssd1306_display_text_x3(job->display, job->page, (char *)job->text, job->length, job->invert);
+        return ESP_OK;
+    }, &job);
     ESP_LOGD(DISPLAY_TAG, "Displayed text x3 on line %d: %s", line, text);
 }
 
@@ -0,0 +1,172 @@
+#include "frameScheduler.hpp"
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "serialCommand.hpp"
+
+static const char *TAG = "FrameScheduler";
+
+FrameScheduler::FrameScheduler(uint32_t periodUs, uint32_t budgetUs, bool degradeEnabled)
+    : periodUs(periodUs), budgetUs(budgetUs), degradeEnabled(degradeEnabled), timer(nullptr), consumer(nullptr),
+      running(false), startTimeUs(0), releaseCount(0), nextIndex(0), degraded(false), degradedRemaining(0),
+      statistics{}, statisticsLock(portMUX_INITIALIZER_UNLOCKED) {
+}
+
+FrameScheduler::~FrameScheduler() {
+    if (timer != nullptr) {
+        stop();
+        esp_timer_delete(timer);
+    }
+}
+
+esp_err_t FrameScheduler::initialize() {
+    esp_timer_create_args_t args = {};
+    args.callback = onTimer;
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "frame_release";
+    esp_err_t ret = esp_timer_create(&args, &timer);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create release timer: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    SerialCommand::registerCommand("sched", "frame jitter, execution time and deadline misses",
+        [](const char *, void *context) { static_cast<FrameScheduler *>(context)->printReport(); }, this);
+    return ESP_OK;
+}
+
+esp_err_t FrameScheduler::start() {
+    if (timer == nullptr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    consumer = xTaskGetCurrentTaskHandle();
+    ulTaskNotifyTake(pdTRUE, 0); // Drop releases of a previous run
+
+    portENTER_CRITICAL(&statisticsLock);
+    memset(&statistics, 0, sizeof(statistics));
+    portEXIT_CRITICAL(&statisticsLock);
+    nextIndex = 0;
+    degraded = false;
+    degradedRemaining = 0;
+
+    // Release 0 is issued here, the timer issues release 1 after one period
+    startTimeUs = esp_timer_get_time();
+    releaseCount.store(1, std::memory_order_release);
+    running = true;
+    esp_err_t ret = esp_timer_start_periodic(timer, periodUs);
+    if (ret != ESP_OK) {
+        running = false;
+        ESP_LOGE(TAG, "Failed to start release timer: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    xTaskNotifyGive(consumer);
+    return ESP_OK;
+}
+
+void FrameScheduler::stop() {
+    if (running) {
+        running = false;
+        esp_timer_stop(timer);
+    }
+}
+
+bool FrameScheduler::waitForRelease(Release &release, TickType_t timeout) {
+    if (!running) {
+        return false;
+    }
+    if (releaseCount.load(std::memory_order_acquire) <= nextIndex) {
+        ulTaskNotifyTake(pdTRUE, timeout);
+    }
+    uint32_t issued = releaseCount.load(std::memory_order_acquire);
+    if (issued <= nextIndex) {
+        return false;
+    }
+
+    // Only the newest release is run, older ones missed their slot
+    release.index = issued - 1;
+    release.skipped = release.index - nextIndex;
+    release.releaseTimeUs = startTimeUs + (int64_t)release.index * periodUs;
+    release.startTimeUs = esp_timer_get_time();
+    nextIndex = issued;
+    return true;
+}
+
+void FrameScheduler::finishJob(const Release &release) {
+    int64_t endUs = esp_timer_get_time();
+    int64_t jitterUs = release.startTimeUs - release.releaseTimeUs;
+    int64_t executionUs = endUs - release.startTimeUs;
+    bool missed = endUs > release.releaseTimeUs + periodUs;
+    bool overBudget = executionUs > (int64_t)budgetUs;
+
+    portENTER_CRITICAL(&statisticsLock);
+    statistics.jobs++;
+    statistics.skipped += release.skipped;
+    statistics.jitterSumUs += jitterUs;
+    statistics.executionSumUs += executionUs;
+    if (jitterUs > statistics.jitterMaxUs) {
+        statistics.jitterMaxUs = jitterUs;
+    }
+    if (executionUs > statistics.executionMaxUs) {
+        statistics.executionMaxUs = executionUs;
+    }
+    if (missed) {
+        statistics.deadlineMisses++;
+    }
+    if (overBudget) {
+        statistics.overBudget++;
+    }
+    if (degraded) {
+        statistics.degradedJobs++;
+    }
+    portEXIT_CRITICAL(&statisticsLock);
+
+    if (missed) {
+        ESP_LOGW(TAG, "Frame %lu missed its deadline by %lld us", (unsigned long)release.index,
+                 endUs - (release.releaseTimeUs + periodUs));
+    }
+
+    if (!degradeEnabled) {
+        return;
+    }
+    if (degraded) {
+        if (--degradedRemaining == 0) {
+            degraded = false;
+            ESP_LOGI(TAG, "Trying the full analysis again");
+        }
+    } else if (overBudget) {
+        degraded = true;
+        degradedRemaining = RECOVERY_JOBS;
+        ESP_LOGW(TAG, "Frame took %lld us, budget %lu us, degrading for %lu frames", executionUs,
+                 (unsigned long)budgetUs, (unsigned long)RECOVERY_JOBS);
+    }
+}
+
+FrameScheduler::Statistics FrameScheduler::getStatistics() const {
+    portENTER_CRITICAL(&statisticsLock);
+    Statistics copy = statistics;
+    portEXIT_CRITICAL(&statisticsLock);
+    return copy;
+}
+
+void FrameScheduler::printReport() const {
+    Statistics s = getStatistics();
+    printf("period %lu us, budget %lu us, %s\n", (unsigned long)periodUs, (unsigned long)budgetUs,
+           running ? (degraded ? "running degraded" : "running") : "stopped");
+    printf("jobs %lu skipped %lu deadline misses %lu over budget %lu degraded %lu\n", (unsigned long)s.jobs,
+           (unsigned long)s.skipped, (unsigned long)s.deadlineMisses, (unsigned long)s.overBudget,
+           (unsigned long)s.degradedJobs);
+    if (s.jobs > 0) {
+        printf("jitter avg %lld us max %lld us, execution avg %lld us max %lld us\n", s.jitterSumUs / s.jobs,
+               s.jitterMaxUs, s.executionSumUs / s.jobs, s.executionMaxUs);
+    }
+}
+
+void FrameScheduler::onTimer(void *arg) {
+    FrameScheduler *scheduler = static_cast<FrameScheduler *>(arg);
+    if (!scheduler->running) {
+        return;
+    }
+    scheduler->releaseCount.fetch_add(1, std::memory_order_release);
+    xTaskNotifyGive(scheduler->consumer);
+}
@@ -0,0 +1,148 @@
+#include "i2cBusManager.hpp"
+#include <stdio.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "serialCommand.hpp"
+
+static const char *TAG = "I2cBusManager";
+
+static const char *const CLIENT_NAMES[I2cBusManager::CLIENT_COUNT] = {"rtc", "display", "scanner"};
+
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+QueueHandle_t I2cBusManager::queues[I2cBusManager::CLIENT_COUNT] = {};
+TaskHandle_t I2cBusManager::task = NULL;
+I2cBusManager::ClientStats I2cBusManager::stats[I2cBusManager::CLIENT_COUNT] = {};
+
+esp_err_t I2cBusManager::start() {
+    for (size_t i = 0; i < CLIENT_COUNT; i++) {
+        queues[i] = xQueueCreate(QUEUE_LENGTH, sizeof(Request *));
+        if (queues[i] == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    // Below the observer task, above the Tascam task; the callers block until their request is done
+    if (xTaskCreatePinnedToCore(busTask, "I2cBus", 3072, NULL, 4, &task, 0) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    SerialCommand::registerCommand("i2c", "I2C transfers, errors, queue wait and bus time per device",
+        [](const char *, void *) {
+            printStats();
+        });
+    return ESP_OK;
+}
+
+esp_err_t I2cBusManager::transfer(I2cClient client, i2c_master_dev_handle_t device, const uint8_t *write,
+                                  size_t writeLength, uint8_t *read, size_t readLength) {
+    Request request = {};
+    request.device = device;
+    request.write = write;
+    request.writeLength = writeLength;
+    request.read = read;
+    request.readLength = readLength;
+    return submit(client, request);
+}
+
+esp_err_t I2cBusManager::run(I2cClient client, Job job, void *context) {
+    Request request = {};
+    request.job = job;
+    request.context = context;
+    return submit(client, request);
+}
+
+esp_err_t I2cBusManager::submit(I2cClient client, Request &request) {
+    if (task == NULL || xTaskGetCurrentTaskHandle() == task) {
+        return execute(client, request, 0);
+    }
+
+    StaticSemaphore_t doneBuffer;
+    request.done = xSemaphoreCreateBinaryStatic(&doneBuffer);
+    request.queuedUs = esp_timer_get_time();
+    Request *pointer = &request;
+    if (xQueueSend(queues[(size_t)client], &pointer, pdMS_TO_TICKS(QUEUE_TIMEOUT_MS)) != pdTRUE) {
+        vSemaphoreDelete(request.done);
+        ESP_LOGW(TAG, "Queue of the %s full", CLIENT_NAMES[(size_t)client]);
+        return ESP_ERR_TIMEOUT;
+    }
+    xTaskNotifyGive(task);
+    // The bus task always finishes a request, a transfer is bounded by TRANSFER_TIMEOUT_MS
+    xSemaphoreTake(request.done, portMAX_DELAY);
+    vSemaphoreDelete(request.done);
+    return request.result;
+}
+
+esp_err_t I2cBusManager::execute(I2cClient client, const Request &request, int64_t waitUs) {
+    int64_t startUs = esp_timer_get_time();
+    esp_err_t result;
+    if (request.job != nullptr) {
+        result = request.job(request.context);
+    } else if (request.read != nullptr) {
+        result = i2c_master_transmit_receive(request.device, request.write, request.writeLength, request.read,
+                                             request.readLength, TRANSFER_TIMEOUT_MS);
+    } else {
+        result = i2c_master_transmit(request.device, request.write, request.writeLength, TRANSFER_TIMEOUT_MS);
+    }
+    uint32_t busUs = (uint32_t)(esp_timer_get_time() - startUs);
+
+    ClientStats &s = stats[(size_t)client];
+    portENTER_CRITICAL(&statsLock);
+    s.transfers++;
+    s.bytes += request.writeLength + request.readLength;
+    if (result != ESP_OK) {
+        s.errors++;
+        if (result == ESP_ERR_TIMEOUT) {
+            s.timeouts++;
+        }
+    }
+    s.totalWaitUs += (uint64_t)waitUs;
+    s.totalBusUs += busUs;
+    if ((uint32_t)waitUs > s.maxWaitUs) {
+        s.maxWaitUs = (uint32_t)waitUs;
+    }
+    if (busUs > s.maxBusUs) {
+        s.maxBusUs = busUs;
+    }
+    portEXIT_CRITICAL(&statsLock);
+    return result;
+}
+
+void I2cBusManager::busTask(void *pvParameters) {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // Every pass starts again at the top, a display page never goes before a waiting RTC read
+        bool served = true;
+        while (served) {
+            served = false;
+            for (size_t i = 0; i < CLIENT_COUNT; i++) {
+                Request *request;
+                if (xQueueReceive(queues[i], &request, 0) == pdTRUE) {
+                    request->result = execute((I2cClient)i, *request, esp_timer_get_time() - request->queuedUs);
+                    xSemaphoreGive(request->done);
+                    served = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void I2cBusManager::getStats(I2cClient client, ClientStats &copy) {
+    portENTER_CRITICAL(&statsLock);
+    copy = stats[(size_t)client];
+    portEXIT_CRITICAL(&statsLock);
+}
+
+void I2cBusManager::printStats() {
+    printf("%-8s %9s %9s %6s %8s %9s %9s %9s %9s\n", "device", "transfers", "bytes", "errors", "timeouts",
+           "wait avg", "wait max", "bus avg", "bus max");
+    for (size_t i = 0; i < CLIENT_COUNT; i++) {
+        ClientStats s;
+        getStats((I2cClient)i, s);
+        uint32_t count = s.transfers > 0 ? s.transfers : 1;
+        printf("%-8s %9lu %9lu %6lu %8lu %6lu us %6lu us %6lu us %6lu us\n", CLIENT_NAMES[i],
+               (unsigned long)s.transfers, (unsigned long)s.bytes, (unsigned long)s.errors,
+               (unsigned long)s.timeouts, (unsigned long)(s.totalWaitUs / count), (unsigned long)s.maxWaitUs,
+               (unsigned long)(s.totalBusUs / count), (unsigned long)s.maxBusUs);
+    }
+}
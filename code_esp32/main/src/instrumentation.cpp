@@ -0,0 +1,274 @@
+#include "instrumentation.hpp"
+
+#if CONFIG_YOD_INSTRUMENTATION
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
+#include "serialCommand.hpp"
+
+static const char *TAG = "Instrumentation";
+
+static constexpr uint8_t FRAME_SYNC_0 = 0xA5;
+static constexpr uint8_t FRAME_SYNC_1 = 0x5A;
+static constexpr uint8_t FRAME_VERSION = 1;
+static constexpr uint8_t FRAME_TYPE_STATS = 0x01;
+static constexpr size_t NAME_BYTES = 8;
+
+static const char *const STAGE_NAMES[(size_t)DspStage::Count] = {
+    "sample", "window", "fft", "spectrum", "detect"
+};
+
+Instrumentation::TaskSample Instrumentation::tasks[Instrumentation::MAX_TASKS] = {};
+size_t Instrumentation::taskCount = 0;
+UBaseType_t Instrumentation::taskOverflow = 0;
+uint32_t Instrumentation::lastTotalRunTime = 0;
+Instrumentation::StageHistogram Instrumentation::stages[(size_t)DspStage::Count] = {};
+SpscRingBuffer<Instrumentation::CycleRecord, Instrumentation::CYCLE_RING_SIZE> Instrumentation::cycleRing;
+SpscRingBuffer<Instrumentation::FrameRecord, Instrumentation::FRAME_RING_SIZE> Instrumentation::frameRing;
+std::atomic<uint32_t> Instrumentation::droppedRecords{0};
+Instrumentation::FrameStatistics Instrumentation::frameStatistics = {};
+Instrumentation::QueueSample Instrumentation::queues[Instrumentation::MAX_QUEUES] = {};
+size_t Instrumentation::queueCount = 0;
+SemaphoreHandle_t Instrumentation::sampleMutex = NULL;
+
+void Instrumentation::start() {
+    sampleMutex = xSemaphoreCreateMutex();
+    SerialCommand::registerCommand("stats", "print task, stack, DSP and queue statistics",
+        [](const char *, void *) { printReport(); });
+    SerialCommand::registerCommand("statsbin", "write the statistics as a binary frame",
+        [](const char *, void *) { dumpBinary(); });
+
+    xTaskCreatePinnedToCore(instrumentationTask, "Instrumentation", 3072, NULL, 1, NULL, 0);
+}
+
+void Instrumentation::registerQueue(const char *name, QueueHandle_t queue) {
+    if (queue == NULL || queueCount >= MAX_QUEUES) {
+        ESP_LOGW(TAG, "Cannot track queue '%s'", name);
+        return;
+    }
+    queues[queueCount++] = {name, queue, 0, 0, 0};
+}
+
+void Instrumentation::recordCycles(DspStage stage, uint32_t cycles) {
+    if (!cycleRing.push({stage, cycles})) {
+        droppedRecords.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Instrumentation::recordFrame(float peakFrequency, float peakValue, bool word) {
+    FrameRecord record = {(uint32_t)(esp_timer_get_time() / 1000), peakFrequency, peakValue, word};
+    if (!frameRing.push(record)) {
+        droppedRecords.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Instrumentation::drainRings() {
+    CycleRecord cycles[32];
+    size_t n;
+    while ((n = cycleRing.popBatch(cycles, 32)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            addToHistogram(cycles[i]);
+        }
+    }
+
+    FrameRecord frame;
+    while (frameRing.pop(frame)) {
+        frameStatistics.frames++;
+        if (frame.word) {
+            frameStatistics.words++;
+        }
+        frameStatistics.last = frame;
+    }
+    frameStatistics.dropped = droppedRecords.load(std::memory_order_relaxed);
+}
+
+void Instrumentation::addToHistogram(const CycleRecord &record) {
+    StageHistogram &histogram = stages[(size_t)record.stage];
+    uint32_t cycles = record.cycles;
+
+    // Bucket by bit length so a measurement costs a count-leading-zeros
+    int bits = (cycles == 0) ? 0 : 32 - __builtin_clz(cycles);
+    int bucket = bits - HISTOGRAM_MIN_BITS;
+    if (bucket < 0) {
+        bucket = 0;
+    } else if (bucket >= (int)HISTOGRAM_BUCKETS) {
+        bucket = HISTOGRAM_BUCKETS - 1;
+    }
+
+    histogram.buckets[bucket]++;
+    histogram.count++;
+    if (cycles > histogram.maxCycles) {
+        histogram.maxCycles = cycles;
+    }
+}
+
+void Instrumentation::sample() {
+    static TaskStatus_t status[MAX_TASKS];
+    uint32_t totalRunTime = 0;
+    UBaseType_t n = uxTaskGetSystemState(status, MAX_TASKS, &totalRunTime);
+    // With more tasks than MAX_TASKS nothing is filled in, the DSP and queue statistics are still sampled
+    UBaseType_t overflow = (n == 0) ? uxTaskGetNumberOfTasks() : 0;
+    if (overflow > 0 && taskOverflow == 0) {
+        ESP_LOGW(TAG, "Task table full, %u tasks running and MAX_TASKS is %u, task statistics paused",
+                 (unsigned)overflow, (unsigned)MAX_TASKS);
+    }
+
+    xSemaphoreTake(sampleMutex, portMAX_DELAY);
+    drainRings();
+    taskOverflow = overflow;
+    if (n == 0) {
+        taskCount = 0;
+    } else {
+        sampleTasks(status, n, totalRunTime);
+    }
+
+    for (size_t i = 0; i < queueCount; i++) {
+        QueueSample &q = queues[i];
+        UBaseType_t waiting = uxQueueMessagesWaiting(q.queue);
+        q.depth = (uint8_t)waiting;
+        q.capacity = (uint8_t)(waiting + uxQueueSpacesAvailable(q.queue));
+        if (q.depth > q.maxDepth) {
+            q.maxDepth = q.depth;
+        }
+    }
+    xSemaphoreGive(sampleMutex);
+}
+
+void Instrumentation::sampleTasks(const TaskStatus_t *status, UBaseType_t n, uint32_t totalRunTime) {
+    uint32_t window = totalRunTime - lastTotalRunTime;
+    lastTotalRunTime = totalRunTime;
+
+    TaskSample previous[MAX_TASKS];
+    size_t previousCount = taskCount;
+    memcpy(previous, tasks, sizeof(TaskSample) * previousCount);
+
+    taskCount = n;
+    for (UBaseType_t i = 0; i < n; i++) {
+        TaskSample &task = tasks[i];
+        strlcpy(task.name, status[i].pcTaskName, sizeof(task.name));
+        task.taskNumber = status[i].xTaskNumber;
+        task.lastRunTime = status[i].ulRunTimeCounter;
+        task.stackHwmBytes = (uint16_t)status[i].usStackHighWaterMark;
+        BaseType_t core = xTaskGetCoreID(status[i].xHandle);
+        task.core = (core == tskNO_AFFINITY) ? 0xFF : (uint8_t)core;
+
+        uint32_t delta = status[i].ulRunTimeCounter;
+        for (size_t j = 0; j < previousCount; j++) {
+            if (previous[j].taskNumber == task.taskNumber) {
+                delta = status[i].ulRunTimeCounter - previous[j].lastRunTime;
+                break;
+            }
+        }
+        task.cpuPermille = (window > 0) ? (uint16_t)(((uint64_t)delta * 1000) / window) : 0;
+    }
+}
+
+void Instrumentation::printReport() {
+    xSemaphoreTake(sampleMutex, portMAX_DELAY);
+    if (taskOverflow > 0) {
+        printf("task table full, %u tasks running, MAX_TASKS %u\n", (unsigned)taskOverflow, (unsigned)MAX_TASKS);
+    }
+    printf("%-16s %4s %7s %6s\n", "task", "core", "cpu%", "stack");
+    for (size_t i = 0; i < taskCount; i++) {
+        const TaskSample &task = tasks[i];
+        printf("%-16s %4d %3u.%u %6u\n", task.name, task.core == 0xFF ? -1 : task.core,
+               task.cpuPermille / 10, task.cpuPermille % 10, task.stackHwmBytes);
+    }
+
+    printf("%-9s %8s %10s  log2 buckets from 2^%u cycles\n", "stage", "count", "max", HISTOGRAM_MIN_BITS);
+    for (size_t s = 0; s < (size_t)DspStage::Count; s++) {
+        const StageHistogram &h = stages[s];
+        printf("%-9s %8lu %10lu ", STAGE_NAMES[s], (unsigned long)h.count, (unsigned long)h.maxCycles);
+        for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+            printf(" %lu", (unsigned long)h.buckets[b]);
+        }
+        printf("\n");
+    }
+
+    for (size_t i = 0; i < queueCount; i++) {
+        const QueueSample &q = queues[i];
+        printf("queue %-8s depth %u/%u max %u\n", q.name, q.depth, q.capacity, q.maxDepth);
+    }
+
+    const FrameStatistics &f = frameStatistics;
+    printf("frames %lu words %lu dropped %lu last %.0f Hz %.1f dB at %lu ms\n", (unsigned long)f.frames,
+           (unsigned long)f.words, (unsigned long)f.dropped, f.last.peakFrequency, f.last.peakValue,
+           (unsigned long)f.last.timeMs);
+    xSemaphoreGive(sampleMutex);
+}
+
+void Instrumentation::dumpBinary() {
+    static uint8_t frame[6 + 4 + 1 + MAX_TASKS * 13 + 1 + (size_t)DspStage::Count * (8 + HISTOGRAM_BUCKETS * 2)
+                         + 1 + MAX_QUEUES * 11 + 2];
+    size_t pos = 6;
+    xSemaphoreTake(sampleMutex, portMAX_DELAY);
+
+    auto put8 = [&](uint8_t v) { frame[pos++] = v; };
+    auto put16 = [&](uint16_t v) { put8(v & 0xFF); put8(v >> 8); };
+    auto put32 = [&](uint32_t v) { put16(v & 0xFFFF); put16(v >> 16); };
+    auto putName = [&](const char *name) {
+        size_t len = strnlen(name, NAME_BYTES);
+        memcpy(&frame[pos], name, len);
+        memset(&frame[pos + len], 0, NAME_BYTES - len);
+        pos += NAME_BYTES;
+    };
+
+    put32((uint32_t)(esp_timer_get_time() / 1000));
+
+    put8((uint8_t)taskCount);
+    for (size_t i = 0; i < taskCount; i++) {
+        putName(tasks[i].name);
+        put8(tasks[i].core);
+        put16(tasks[i].cpuPermille);
+        put16(tasks[i].stackHwmBytes);
+    }
+
+    put8((uint8_t)DspStage::Count);
+    for (size_t s = 0; s < (size_t)DspStage::Count; s++) {
+        put32(stages[s].count);
+        put32(stages[s].maxCycles);
+        for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+            uint32_t v = stages[s].buckets[b];
+            put16(v > 0xFFFF ? 0xFFFF : (uint16_t)v);
+        }
+    }
+
+    put8((uint8_t)queueCount);
+    for (size_t i = 0; i < queueCount; i++) {
+        putName(queues[i].name);
+        put8(queues[i].depth);
+        put8(queues[i].maxDepth);
+        put8(queues[i].capacity);
+    }
+
+    uint16_t payloadLength = (uint16_t)(pos - 6);
+    frame[0] = FRAME_SYNC_0;
+    frame[1] = FRAME_SYNC_1;
+    frame[2] = FRAME_VERSION;
+    frame[3] = FRAME_TYPE_STATS;
+    frame[4] = payloadLength & 0xFF;
+    frame[5] = payloadLength >> 8;
+    put16(esp_rom_crc16_le(0, &frame[6], payloadLength));
+
+    // Past stdout, which would put a CR before every 0x0A byte of the frame; one driver write keeps it whole
+    fflush(stdout);
+    SerialCommand::writeRaw(frame, pos);
+    xSemaphoreGive(sampleMutex);
+}
+
+void Instrumentation::instrumentationTask(void *pvParameters) {
+    TickType_t lastWake = xTaskGetTickCount();
+    while (true) {
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(CONFIG_YOD_INSTRUMENTATION_PERIOD_MS));
+        sample();
+#if CONFIG_YOD_INSTRUMENTATION_BINARY_DUMP
+        dumpBinary();
+#endif
+    }
+}
+
+#endif // CONFIG_YOD_INSTRUMENTATION
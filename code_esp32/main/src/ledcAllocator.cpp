@@ -0,0 +1,59 @@
+#include "ledcAllocator.hpp"
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+
+static const char *TAG = "LedcAllocator";
+
+static portMUX_TYPE allocatorLock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t usedTimers = 0;   ///< Bit n set when LEDC timer n is taken
+static uint32_t usedChannels = 0; ///< Bit n set when LEDC channel n is taken
+
+static int lowestFree(uint32_t used, int count) {
+    for (int i = 0; i < count; i++) {
+        if ((used & (1u << i)) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+esp_err_t LedcAllocator::allocate(int owner, Resource &resource) {
+    resource = Resource();
+    taskENTER_CRITICAL(&allocatorLock);
+    int timer = lowestFree(usedTimers, LEDC_TIMER_MAX);
+    int channel = lowestFree(usedChannels, LEDC_CHANNEL_MAX);
+    if (timer >= 0 && channel >= 0) {
+        usedTimers |= 1u << timer;
+        usedChannels |= 1u << channel;
+    }
+    taskEXIT_CRITICAL(&allocatorLock);
+
+    if (timer < 0 || channel < 0) {
+        ESP_LOGE(TAG, "No free LEDC %s for GPIO%d, all %d are in use", timer < 0 ? "timer" : "channel", owner,
+                 timer < 0 ? (int)LEDC_TIMER_MAX : (int)LEDC_CHANNEL_MAX);
+        return ESP_ERR_NOT_FOUND;
+    }
+    resource.timer = (ledc_timer_t)timer;
+    resource.channel = (ledc_channel_t)channel;
+    ESP_LOGI(TAG, "GPIO%d uses LEDC timer %d, channel %d", owner, timer, channel);
+    return ESP_OK;
+}
+
+void LedcAllocator::release(Resource &resource) {
+    if (!resource.isValid()) {
+        return;
+    }
+    taskENTER_CRITICAL(&allocatorLock);
+    usedTimers &= ~(1u << resource.timer);
+    usedChannels &= ~(1u << resource.channel);
+    taskEXIT_CRITICAL(&allocatorLock);
+    resource = Resource();
+}
+
+uint32_t LedcAllocator::getTimersInUse() {
+    return __builtin_popcount(usedTimers);
+}
+
+uint32_t LedcAllocator::getChannelsInUse() {
+    return __builtin_popcount(usedChannels);
+}
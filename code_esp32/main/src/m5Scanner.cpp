@@ -2,6 +2,7 @@
 #include "m5Scanner.hpp"
 #include <driver/i2c_master.h>
 #include <cstring>
+#include "i2cBusManager.hpp"
 
 // #define I2C_MASTER_SCL_IO 34               // GPIO number for I2C master clock
 // #define I2C_MASTER_SDA_IO 35               // GPIO number for I2C master data
@@ -13,22 +14,26 @@
 #define I2C_MASTER_FREQ_HZ          100000  
 #define QRCODE_SCANNER_ADDR 0x21   
 M5Scanner::M5Scanner(i2c_master_bus_handle_t & i2cBusHandle) : i2cBusHandle(i2cBusHandle), qrDevHandle(NULL) {
-      
+    // The device is added in initialize(), the bus may not exist yet
+}
+
+M5Scanner::~M5Scanner() {}
+
+esp_err_t M5Scanner::initialize() {
     // Create a device handle for the QR scanner using the global bus handle
     i2c_device_config_t dev_cfg = {
         .dev_addr_length = I2C_ADDR_BIT_LEN_7,
         .device_address = QRCODE_SCANNER_ADDR,
         .scl_speed_hz = I2C_MASTER_FREQ_HZ,
     };
-     i2c_master_bus_add_device(i2cBusHandle, &dev_cfg, &qrDevHandle);
-}
-
-M5Scanner::~M5Scanner() {}
-
-void M5Scanner::initialize() {
+    esp_err_t ret = i2c_master_bus_add_device(i2cBusHandle, &dev_cfg, &qrDevHandle);
+    if (ret != ESP_OK) {
+        ESP_LOGE("M5Scanner", "Failed to add scanner to the I2C bus: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    // First read clears a stale ready flag
     checkIfCodeIsScanned();
-    vTaskDelay(pdMS_TO_TICKS(100));
-  
+    return ESP_OK;
 }
 
 bool M5Scanner::checkIfCodeIsScanned()
@@ -80,13 +85,13 @@ uint8_t M5Scanner::getQrCodeLengthLastScanned() const
 esp_err_t M5Scanner::qrcodeRegisterWriteByte(uint16_t regAddr, uint8_t data)
 {
     uint8_t write_buf[3] = {(uint8_t)(regAddr & 0xFF), (uint8_t)(regAddr >> 8), data};
-    return i2c_master_transmit(qrDevHandle, write_buf, sizeof(write_buf), 1000 / portTICK_PERIOD_MS);
+    return I2cBusManager::transfer(I2cClient::Scanner, qrDevHandle, write_buf, sizeof(write_buf));
 } 
 
 esp_err_t M5Scanner::qrcodeRegisterRead(uint16_t regAddr, uint8_t *data, size_t len)
 {
     uint8_t addr_bytes[2] = {(uint8_t)(regAddr & 0xFF), (uint8_t)(regAddr >> 8)};
-    return i2c_master_transmit_receive(qrDevHandle, addr_bytes, 2, data, len, 1000 / portTICK_PERIOD_MS);
+    return I2cBusManager::transfer(I2cClient::Scanner, qrDevHandle, addr_bytes, 2, data, len);
 }
 
 esp_err_t M5Scanner::setTriggerMode(uint8_t mode)
@@ -1,9 +1,14 @@
 #include "menuController.hpp"
 #include "esp_log.h"
+#include "powerManager.hpp"
+#include "modemCodec.hpp"
+#include "sessionJournal.hpp"
+#include "sessionAnalytics.hpp"
 #include <string.h>
+#include <time.h>
 #include <limits>
 
-MenuController::MenuController(DisplayController *displayController, Storage *storage, M5Scanner &scanner, ButtonBoundary &selectButton, ButtonBoundary &startButton, ButtonBoundary &stopButton, TascamBoundary &tascamBoundary, AudioModem &audioModem, NvsBoundary &nvs, QueueHandle_t countQueue, RealTimeClock &rtc, Speaker &speaker, GpioController &gpioController)
+MenuController::MenuController(DisplayController *displayController, Storage *storage, M5Scanner &scanner, ButtonBoundary &selectButton, ButtonBoundary &startButton, ButtonBoundary &stopButton, TascamBoundary &tascamBoundary, AudioModem &audioModem, NvsBoundaryAbstract &nvs, QueueHandle_t countQueue, RealTimeClock &rtc, Speaker &speaker, GpioController &gpioController)
     : currentState(State::LOGING),
       display(displayController),
       storage(storage),
@@ -20,11 +25,19 @@ MenuController::MenuController(DisplayController *displayController, Storage *st
       speaker(speaker),
       gpioController(gpioController),
       inSession(false),
-      numberScanned(false) {}
+      numberScanned(false),
+      beepAfterTransmit(false) {
+    audioModem.setCompletionCallback(onModemIdle, this);
+    tascamBoundary.setCompletionCallback(onTascamDone, this);
+}
 
 MenuController::~MenuController() {}
 
 void MenuController::notify(ObserverId buttonId) {
+    if (buttonId != ObserverId::RecorderFault) {
+        SessionJournal::button(buttonId);
+        SessionAnalytics::button(buttonId);
+    }
     switch (buttonId) {
         case ObserverId::CodeScanner:
             patientNumber = scanner.getCode();
@@ -32,6 +45,10 @@ void MenuController::notify(ObserverId buttonId) {
             numberScanned = true;
             [[fallthrough]];
         default:
+            if (buttonId == ObserverId::RecorderFault) {
+                recorderFault(tascamBoundary.takeFault());
+                break;
+            }
             menuTask(buttonId);
             break;
     }
@@ -47,36 +64,44 @@ void MenuController::startRecording() {
         storage->setSessionId(sessionId);
     }
 
+    // Returns at once, the remote keys are spaced out by the Tascam command task
+    recordingSessionId = sessionId;
     tascamBoundary.startRecording();
-    // 1, 2, 3 are for syncing
-    audioModem.transmit(1);
-    audioModem.transmit(2);
-    audioModem.transmit(3);
-    //sesionId and time info sending
-    audioModem.transmit(sessionId);
-    audioModem.transmit(current_time.tm_min);
-    audioModem.transmit(current_time.tm_hour);
-    audioModem.transmit(current_time.tm_mday);
-    audioModem.transmit(current_time.tm_mon);
-    audioModem.transmit(current_time.tm_year);
-
-    if (numberScanned && !inSession) {
-        //to let the receiver know that patient number will be send
-        audioModem.transmit(1);
-        audioModem.transmit(patientNumber[0]);
-        audioModem.transmit(patientNumber[1]);
+    // Sent as a packet with preamble, CRC and FEC, see modemCodec.hpp
+    bool sendPatient = numberScanned && !inSession;
+    SessionMetadata metadata = ModemCodec::sessionMetadata(sessionId, current_time, sendPatient ? patientNumber : nullptr);
+    if (!inSession) {
+        // Goes to RAM like the session id, the flush task commits both together
+        Storage::SessionRecord record = {};
+        record.sessionId = sessionId;
+        record.startTime = mktime(&current_time);
+        if (sendPatient) {
+            strncpy(record.patient, (const char *)patientNumber, sizeof(record.patient) - 1);
+        }
+        storage->setLastSession(record);
+        SessionJournal::sessionStart((uint32_t)sessionId, record.startTime);
+        SessionAnalytics::sessionStart((uint32_t)sessionId, record.startTime);
+        if (sendPatient) {
+            SessionJournal::patient((uint32_t)sessionId, record.patient);
+        }
+    }
+    if (sendPatient) {
         patientNumber = nullptr;
         numberScanned = false;
-    } else {
-        // Indicate no patient number is being sent
-        audioModem.transmit(2);
     }
-    //to let the receiver know that patient number will be send
-    audioModem.transmit(3);
+
+    uint8_t packet[ModemPacket::encodedSize(SessionMetadata::SIZE)];
+    size_t length = ModemCodec::encodeSessionMetadata(metadata, packet, sizeof(packet));
+
+    // The burst runs in the modem task, the beep follows once it has finished
+    beepAfterTransmit = true;
+    if (audioModem.transmitFrame(std::span<const uint8_t>(packet, length)) != ESP_OK) {
+        beepAfterTransmit = false;
+        speaker.beep(500);
+    }
+    audioModem.startBeacons(metadata.sessionId, storage->getBeaconIntervalS(CONFIG_YOD_MODEM_BEACON_INTERVAL_S) * 1000);
     inSession = true;
-    speaker.beep(500);
     display->displayTextX3(2, "Rec...", false);
-    vTaskDelay(pdMS_TO_TICKS(200));
 }
 
 void MenuController::menuTask(ObserverId buttonId) {
@@ -88,26 +113,34 @@ void MenuController::menuTask(ObserverId buttonId) {
                 display->clear();
                 display->displayText(2, "Patient number scanned");
                 ESP_LOGI("SCANNER", "Patient number: %s", (char *)patientNumber);
-                currentState = State::IDLE;
+                setState(State::IDLE);
             }
             break;
         case State::IDLE:
             if (buttonId == ObserverId::Start) {
                 startRecording();
-                currentState = State::RECORDING;
+                setState(State::RECORDING);
             } else if (buttonId == ObserverId::Stop) {
+                audioModem.stopBeacons();
+                if (inSession) {
+                    SessionJournal::sessionStop((uint32_t)recordingSessionId);
+                    SessionAnalytics::sessionStop();
+                }
                 inSession = false;
                 display->clear();
                 display->displayText(2, "Log in patient");
-                currentState = State::LOGING;
+                setState(State::LOGING);
             }
             break;
         case State::RECORDING:
             if (buttonId == ObserverId::Stop) {
                 tascamBoundary.stopRecording();
+                audioModem.stopBeacons();
+                SessionJournal::sessionStop((uint32_t)recordingSessionId);
+                SessionAnalytics::sessionStop();
                 display->clear();
                 display->displayText(2, "Log in patient");
-                currentState = State::LOGING;
+                setState(State::LOGING);
                 inSession = false;
                 numberScanned = false;
                 patientNumber = nullptr;
@@ -120,6 +153,87 @@ void MenuController::menuTask(ObserverId buttonId) {
     }
 }
 
+void MenuController::onModemIdle(void *context) {
+    MenuController *menu = static_cast<MenuController *>(context);
+    if (menu->beepAfterTransmit) {
+        menu->beepAfterTransmit = false;
+        menu->speaker.beep(500);
+    }
+}
+
+void MenuController::recorderFault(TascamFault fault) {
+    if (fault == TascamFault::None) {
+        return;
+    }
+    ESP_LOGE("TASCAM", "Recorder fault: %s", tascamFaultName(fault));
+    SessionJournal::fault(JournalFaultSource::Recorder, (int32_t)fault);
+    SessionAnalytics::fault((uint8_t)fault);
+    static const Speaker::Tone ERROR_PATTERN[] = {{300, 200, 100}, {300, 200, 0}};
+    speaker.play(ERROR_PATTERN, sizeof(ERROR_PATTERN) / sizeof(ERROR_PATTERN[0]));
+    display->clear();
+    display->displayText(1, "Recorder:");
+    display->displayText(2, tascamFaultName(fault));
+    if (currentState == State::RECORDING) {
+        // Nothing is being recorded, the session stays open so start tries again
+        audioModem.stopBeacons();
+        display->displayText(3, "Start: retry");
+        setState(State::IDLE);
+    }
+}
+
+void MenuController::onTascamDone(TascamBoundary::RecorderState state, int64_t startLatencyUs, void *context) {
+    MenuController *menu = static_cast<MenuController *>(context);
+    if (state == TascamBoundary::RecorderState::Recording && startLatencyUs > 0) {
+        ESP_LOGI("TASCAM", "Session %llu: recorder started %lld ms after start was pressed",
+                 (unsigned long long)menu->recordingSessionId, startLatencyUs / 1000);
+    }
+}
+
+void MenuController::setState(State state) {
+    currentState = state;
+    switch (state) {
+        case State::LOGING:
+            PowerManager::setProfile(PowerProfile::Loging);
+            break;
+        case State::IDLE:
+            PowerManager::setProfile(PowerProfile::Idle);
+            break;
+        case State::RECORDING:
+            PowerManager::setProfile(PowerProfile::Recording);
+            break;
+    }
+}
+
 MenuController::State MenuController::getCurrentState() const {
     return currentState;
 }
+
+void MenuController::applyConfig(const ConfigPayload &config) {
+    if (config.flags & ConfigPayload::FLAG_CLOCK) {
+        struct tm time = config.clockTime();
+        if (!rtc.setTime(time)) {
+            ESP_LOGE("CONFIG", "Failed to set the clock");
+        }
+    }
+    if (config.flags & ConfigPayload::FLAG_THRESHOLDS) {
+        storage->setWordThresholds(config.wordLevelDb, config.wordLowHz, config.wordHighHz);
+    }
+    if (config.flags & ConfigPayload::FLAG_SESSION) {
+        storage->setSessionId(config.sessionId);
+        storage->setBeaconIntervalS(config.beaconIntervalS);
+    }
+    ESP_LOGI("CONFIG", "Applied configuration %lu", (unsigned long)config.counter);
+    speaker.beep(1000);
+}
+
+bool MenuController::getWordThresholds(AudioAnalyzer::WordThresholds &thresholds) {
+    int8_t levelDb;
+    uint16_t lowHz, highHz;
+    if (!storage->getWordThresholds(levelDb, lowHz, highHz)) {
+        return false;
+    }
+    thresholds.levelDb = levelDb;
+    thresholds.lowHz = lowHz;
+    thresholds.highHz = highHz;
+    return true;
+}
@@ -0,0 +1,157 @@
+#include "powerManager.hpp"
+
+#if CONFIG_YOD_POWER_MANAGEMENT
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_sleep.h"
+#include "esp_private/esp_clk.h"
+#include "driver/uart.h"
+#include "serialCommand.hpp"
+
+static const char *TAG = "PowerManager";
+
+static const char *const PROFILE_NAMES[(size_t)PowerProfile::Count] = {"Loging", "Idle", "Recording"};
+
+static portMUX_TYPE statisticsLock = portMUX_INITIALIZER_UNLOCKED;
+
+esp_pm_lock_handle_t PowerManager::locks[(size_t)PowerManager::LockType::Count] = {};
+PowerManager::ProfileStatistics PowerManager::statistics[(size_t)PowerProfile::Count] = {};
+volatile PowerProfile PowerManager::currentProfile = PowerProfile::Loging;
+int64_t PowerManager::profileStartUs = 0;
+PowerManager::ReportHook PowerManager::reportHook = nullptr;
+void *PowerManager::reportContext = nullptr;
+
+esp_err_t PowerManager::initialize() {
+    esp_pm_config_t config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_YOD_PM_MIN_FREQ_MHZ,
+        .light_sleep_enable = true,
+    };
+    esp_err_t ret = esp_pm_configure(&config);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure power management: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "yod_cpu", &locks[(size_t)LockType::CpuMax]));
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "yod_apb", &locks[(size_t)LockType::ApbMax]));
+
+    // Buttons register themselves as GPIO wake-up pins, the console wakes on RX activity
+    esp_sleep_enable_gpio_wakeup();
+    uart_set_wakeup_threshold((uart_port_t)CONFIG_ESP_CONSOLE_UART_NUM, 3);
+    esp_sleep_enable_uart_wakeup(CONFIG_ESP_CONSOLE_UART_NUM);
+
+    esp_pm_sleep_cbs_register_config_t callbacks = {};
+    callbacks.exit_cb = onLightSleepExit;
+    callbacks.exit_cb_user_arg = nullptr;
+    esp_pm_light_sleep_register_cbs(&callbacks);
+
+    profileStartUs = esp_timer_get_time();
+
+    SerialCommand::registerCommand("power", "awake time and estimated current per state ('power reset' clears)",
+        [](const char *args, void *) {
+            if (strcmp(args, "reset") == 0) {
+                resetStatistics();
+            } else {
+                printReport();
+            }
+        });
+
+    ESP_LOGI(TAG, "DFS %d-%d MHz with automatic light sleep", CONFIG_YOD_PM_MIN_FREQ_MHZ, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+    return ESP_OK;
+}
+
+void PowerManager::setProfile(PowerProfile profile) {
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&statisticsLock);
+    statistics[(size_t)currentProfile].totalUs += now - profileStartUs;
+    profileStartUs = now;
+    currentProfile = profile;
+    portEXIT_CRITICAL(&statisticsLock);
+}
+
+void PowerManager::resetStatistics() {
+    portENTER_CRITICAL(&statisticsLock);
+    memset(statistics, 0, sizeof(statistics));
+    profileStartUs = esp_timer_get_time();
+    portEXIT_CRITICAL(&statisticsLock);
+}
+
+void PowerManager::setReportHook(ReportHook hook, void *context) {
+    reportContext = context;
+    reportHook = hook;
+}
+
+void PowerManager::printReport() {
+    ProfileStatistics snapshot[(size_t)PowerProfile::Count];
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&statisticsLock);
+    memcpy(snapshot, statistics, sizeof(snapshot));
+    snapshot[(size_t)currentProfile].totalUs += now - profileStartUs;
+    portEXIT_CRITICAL(&statisticsLock);
+
+    int64_t allTotalUs = 0;
+    int64_t allSleptUs = 0;
+    printf("%-10s %9s %7s %8s %8s\n", "state", "time_s", "awake%", "wakeups", "est_mA");
+    for (size_t i = 0; i < (size_t)PowerProfile::Count; i++) {
+        const ProfileStatistics &p = snapshot[i];
+        allTotalUs += p.totalUs;
+        allSleptUs += p.sleptUs;
+        if (p.totalUs <= 0) {
+            printf("%-10s %9s\n", PROFILE_NAMES[i], "-");
+            continue;
+        }
+        float awake = 1.0f - (float)p.sleptUs / (float)p.totalUs;
+        float currentMa = awake * CONFIG_YOD_PM_ACTIVE_CURRENT_MA + (1.0f - awake) * CONFIG_YOD_PM_SLEEP_CURRENT_UA / 1000.0f;
+        printf("%-10s %9.1f %7.1f %8lu %8.2f\n", PROFILE_NAMES[i], p.totalUs / 1e6, awake * 100.0f,
+               (unsigned long)p.wakeups, currentMa);
+    }
+    if (allTotalUs > 0) {
+        float awake = 1.0f - (float)allSleptUs / (float)allTotalUs;
+        float currentMa = awake * CONFIG_YOD_PM_ACTIVE_CURRENT_MA + (1.0f - awake) * CONFIG_YOD_PM_SLEEP_CURRENT_UA / 1000.0f;
+        printf("%-10s %9.1f %7.1f %8s %8.2f\n", "total", allTotalUs / 1e6, awake * 100.0f, "", currentMa);
+    }
+    printf("CPU now at %d MHz (SoC current only, peripherals not included)\n", esp_clk_cpu_freq() / 1000000);
+    if (reportHook != nullptr) {
+        reportHook(reportContext);
+    }
+}
+
+IRAM_ATTR esp_err_t PowerManager::onLightSleepExit(int64_t sleepTimeUs, void *arg) {
+    portENTER_CRITICAL_ISR(&statisticsLock);
+    ProfileStatistics &p = statistics[(size_t)currentProfile];
+    p.sleptUs += sleepTimeUs;
+    p.wakeups++;
+    portEXIT_CRITICAL_ISR(&statisticsLock);
+    return ESP_OK;
+}
+
+void PowerManager::acquire(LockType type) {
+    esp_pm_lock_handle_t handle = locks[(size_t)type];
+    if (handle != nullptr) {
+        esp_pm_lock_acquire(handle);
+    }
+}
+
+void PowerManager::release(LockType type) {
+    esp_pm_lock_handle_t handle = locks[(size_t)type];
+    if (handle != nullptr) {
+        esp_pm_lock_release(handle);
+    }
+}
+
+PowerManager::Lock::Lock(LockType type) : type(type) {
+    acquire(type);
+}
+
+PowerManager::Lock::~Lock() {
+    release(type);
+}
+
+#endif // CONFIG_YOD_POWER_MANAGEMENT
@@ -8,44 +8,37 @@
 #include "pwmChannel.hpp"
 #include <iostream> // For demonstration purposes (e.g., logging)
 
-// Static mutex initialization
-SemaphoreHandle_t PWMChannel::pwmMutex = NULL;
-
 /**
  * @brief Constructor for PWM Channel
  * @param gpioPin GPIO pin number to be used for PWM output
  * 
- * Initializes the PWM channel with the specified GPIO pin and creates
- * the shared mutex if it doesn't exist.
+ * Initializes the PWM channel with the specified GPIO pin, takes a free LEDC
+ * timer and channel and creates the mutex of this output.
  */
 PWMChannel::PWMChannel(gpio_num_t gpioPin) 
-    : gpioPin(gpioPin) {
-    createMutex();
+    : gpioPin(gpioPin), configured(false), pwmMutex(xSemaphoreCreateMutex()) {
+    if (LedcAllocator::allocate(gpioPin, resource) == ESP_OK) {
+        config.timer = resource.timer;
+        config.channel = resource.channel;
+    }
+    if (pwmMutex == NULL) {
+        std::cout << "Failed to create PWM mutex!" << std::endl;
+    }
 }
 
 /**
  * @brief Destructor for PWM Channel
  * 
- * Virtual destructor for proper cleanup in inheritance scenarios.
- * Currently performs no specific cleanup operations.
+ * Stops the output and gives the LEDC timer and channel back to the allocator.
  */
 PWMChannel::~PWMChannel() {
-}
-
-/**
- * @brief Create shared mutex for PWM operations
- * 
- * Creates a FreeRTOS mutex if it doesn't already exist. This mutex is shared
- * across all PWM channel instances to ensure thread-safe operations.
- * 
- * @note This method is thread-safe and can be called multiple times safely.
- */
-void PWMChannel::createMutex() {
-    if (pwmMutex == NULL) {
-        pwmMutex = xSemaphoreCreateMutex();
-        if (pwmMutex == NULL) {
-            std::cout << "Failed to create PWM mutex!" << std::endl;
-        }
+    if (configured) {
+        ledc_stop(config.mode, config.channel, 0);
+        ledc_timer_pause(config.mode, config.timer);
+    }
+    LedcAllocator::release(resource);
+    if (pwmMutex != NULL) {
+        vSemaphoreDelete(pwmMutex);
     }
 }
 
@@ -58,16 +51,23 @@ void PWMChannel::createMutex() {
  * - Channel configuration (GPIO pin, duty cycle, interrupt settings)
  * - Timer pause for controlled start
  * 
- * The operation is protected by a mutex to ensure thread safety in
- * multi-threaded environments.
+ * The operation is protected by the mutex of this output, other outputs
+ * have their own timer and channel and are not blocked.
  * 
  * @note The timer is initially paused after configuration. Call appropriate
  *       LEDC functions to resume operation when needed.
  * 
- * @warning If mutex acquisition fails, the initialization will be skipped
- *          and an error message will be logged.
+ * @warning Without an LEDC timer and channel, or without a mutex, the
+ *          initialization is skipped and an error is returned.
  */
-void PWMChannel::initialize() {
+esp_err_t PWMChannel::initialize() {
+    if (!resource.isValid()) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (pwmMutex == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t ret = ESP_OK;
     // Take mutex before configuring PWM
     if (xSemaphoreTake(pwmMutex, portMAX_DELAY) == pdTRUE) {
         ledc_timer_config_t ledc_timer = {
@@ -77,7 +77,7 @@ void PWMChannel::initialize() {
             .freq_hz          = config.frequency,
             .clk_cfg          = LEDC_AUTO_CLK
         };
-        ledc_timer_config(&ledc_timer);
+        ret = ledc_timer_config(&ledc_timer);
 
         // LEDC Channel Configuration
         ledc_channel_config_t ledc_channel = {
@@ -89,7 +89,10 @@ void PWMChannel::initialize() {
             .duty           = config.duty,  // Set duty cycle
             .hpoint         = 0
         };
-        ledc_channel_config(&ledc_channel);
+        if (ret == ESP_OK) {
+            ret = ledc_channel_config(&ledc_channel);
+        }
+        configured = ret == ESP_OK;
         
         // Initially pause the timer
         ledc_timer_pause(config.mode, config.timer); 
@@ -99,5 +102,7 @@ void PWMChannel::initialize() {
         xSemaphoreGive(pwmMutex);
     } else {
         std::cout << "Failed to acquire PWM mutex for initialization!" << std::endl;
+        ret = ESP_ERR_TIMEOUT;
     }
+    return ret;
 }
@@ -0,0 +1,113 @@
+#include "serialCommand.hpp"
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/uart.h"
+#include "driver/uart_vfs.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "SerialCommand";
+
+static constexpr uart_port_t CONSOLE_UART_NUM = (uart_port_t)CONFIG_ESP_CONSOLE_UART_NUM;
+
+SerialCommand::Entry SerialCommand::commands[SerialCommand::MAX_COMMANDS] = {};
+std::atomic<size_t> SerialCommand::commandCount{0};
+static portMUX_TYPE registerLock = portMUX_INITIALIZER_UNLOCKED;
+
+esp_err_t SerialCommand::registerCommand(const char *name, const char *help, Handler handler, void *context) {
+    if (name == nullptr || handler == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // Boot jobs and tasks register concurrently; the reader only sees an entry once it is complete
+    portENTER_CRITICAL(&registerLock);
+    size_t count = commandCount.load(std::memory_order_relaxed);
+    if (count < MAX_COMMANDS) {
+        commands[count] = {name, help, handler, context};
+        commandCount.store(count + 1, std::memory_order_release);
+    }
+    portEXIT_CRITICAL(&registerLock);
+    if (count >= MAX_COMMANDS) {
+        ESP_LOGE(TAG, "Command table full, cannot register '%s'", name);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t SerialCommand::start() {
+    // Route stdin/stdout through the driver so log output and command
+    // replies share one path with the reader.
+    esp_err_t ret = uart_driver_install(CONSOLE_UART_NUM, 256, 0, 0, NULL, 0);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to install console UART driver: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    uart_vfs_dev_use_driver(CONSOLE_UART_NUM);
+
+    xTaskCreatePinnedToCore(serialCommandTask, "SerialCommand", 3072, NULL, 2, NULL, 0);
+    return ESP_OK;
+}
+
+bool SerialCommand::writeRaw(const void *data, size_t length) {
+    // No TX ring buffer is installed, the driver copies straight into the FIFO
+    return uart_write_bytes(CONSOLE_UART_NUM, data, length) == (int)length;
+}
+
+esp_err_t SerialCommand::setBaudRate(uint32_t baud) {
+    fflush(stdout);
+    esp_err_t ret = uart_wait_tx_done(CONSOLE_UART_NUM, pdMS_TO_TICKS(1000));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return uart_set_baudrate(CONSOLE_UART_NUM, baud != 0 ? baud : CONFIG_ESP_CONSOLE_UART_BAUDRATE);
+}
+
+void SerialCommand::dispatch(char *line) {
+    // Split the command word from its arguments
+    char *args = line;
+    while (*args != '\0' && *args != ' ') {
+        args++;
+    }
+    if (*args == ' ') {
+        *args++ = '\0';
+    }
+    if (line[0] == '\0') {
+        return;
+    }
+
+    size_t count = commandCount.load(std::memory_order_acquire);
+    if (strcmp(line, "help") == 0) {
+        for (size_t i = 0; i < count; i++) {
+            printf("%-10s %s\n", commands[i].name, commands[i].help ? commands[i].help : "");
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(line, commands[i].name) == 0) {
+            commands[i].handler(args, commands[i].context);
+            return;
+        }
+    }
+    printf("Unknown command '%s', type 'help'\n", line);
+}
+
+void SerialCommand::serialCommandTask(void *pvParameters) {
+    char line[MAX_LINE_LENGTH];
+    size_t length = 0;
+
+    while (true) {
+        uint8_t c;
+        if (uart_read_bytes(CONSOLE_UART_NUM, &c, 1, portMAX_DELAY) != 1) {
+            continue;
+        }
+        if (c == '\r' || c == '\n') {
+            line[length] = '\0';
+            dispatch(line);
+            length = 0;
+        } else if (length < MAX_LINE_LENGTH - 1) {
+            line[length++] = (char)c;
+        }
+    }
+}
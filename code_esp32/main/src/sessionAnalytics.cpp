@@ -0,0 +1,201 @@
+#include "sessionAnalytics.hpp"
+
+#if CONFIG_YOD_ANALYTICS
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "analyticsExport.hpp"
+#include "powerManager.hpp"
+#include "serialCommand.hpp"
+
+static const char *TAG = "SessionAnalytics";
+
+static constexpr uint8_t LEVEL_FRAMES = 4;          ///< Frames per level entry, one second at 250 ms
+static constexpr uint32_t BAUD_SWITCH_MS = 100;     ///< Time the host gets to follow a baud rate change
+
+AnalyticsWriter SessionAnalytics::writers[2];
+SpscRingBuffer<SessionAnalytics::Command, 16> SessionAnalytics::commands;
+std::atomic<int> SessionAnalytics::active{-1};
+std::atomic<int> SessionAnalytics::finished{-1};
+std::atomic<int> SessionAnalytics::exporting{-1};
+std::atomic<uint32_t> SessionAnalytics::dropped{0};
+static std::atomic<uint32_t> droppedLogLines{0};
+
+// Takes the log output during an export, a log line between the frames would break one
+static int dropLog(const char *, va_list) {
+    droppedLogLines.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
+
+static bool writeFrame(const uint8_t *data, size_t length, void *) {
+    return SerialCommand::writeRaw(data, length);
+}
+
+void SessionAnalytics::start() {
+    SerialCommand::registerCommand("analytics", "last session timeline ('analytics export [baud]' streams it)",
+        [](const char *args, void *) {
+            if (strncmp(args, "export", 6) == 0) {
+                exportBinary((uint32_t)strtoul(args + 6, nullptr, 10));
+            } else {
+                printSummary();
+            }
+        });
+}
+
+void SessionAnalytics::sessionStart(uint32_t sessionId, time_t startTime) {
+    post({Command::Kind::Start, AnalyticsEventType::Button, 0, sessionId, (uint32_t)startTime});
+}
+
+void SessionAnalytics::sessionStop() {
+    post({Command::Kind::Stop, AnalyticsEventType::Button, 0, 0, 0});
+}
+
+void SessionAnalytics::button(ObserverId id) {
+    post({Command::Kind::Event, AnalyticsEventType::Button, (uint8_t)id, 0, 0});
+}
+
+void SessionAnalytics::fault(uint8_t code) {
+    post({Command::Kind::Event, AnalyticsEventType::Fault, code, 0, 0});
+}
+
+void SessionAnalytics::post(const Command &command) {
+    if (!commands.push(command)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void SessionAnalytics::poll(uint16_t framePeriodMs) {
+    Command command;
+    while (commands.pop(command)) {
+        apply(command, framePeriodMs);
+    }
+}
+
+void SessionAnalytics::apply(const Command &command, uint16_t framePeriodMs) {
+    int index = active.load();
+    switch (command.kind) {
+        case Command::Kind::Start: {
+            if (index >= 0) {
+                finish();
+            }
+            // The writer that does not hold the last session; an export only reads that one,
+            // unless a session finished while it was starting
+            int next = finished.load() == 0 ? 1 : 0;
+            if (exporting.load() == next) {
+                ESP_LOGW(TAG, "Session %lu not kept, its buffer is being exported", (unsigned long)command.sessionId);
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            writers[next].begin(command.sessionId, command.startTime, framePeriodMs, LEVEL_FRAMES);
+            active.store(next);
+            break;
+        }
+        case Command::Kind::Stop:
+            if (index >= 0) {
+                finish();
+            }
+            break;
+        case Command::Kind::Event:
+            if (index >= 0) {
+                writers[index].event(command.type, command.value);
+            }
+            break;
+    }
+}
+
+void SessionAnalytics::finish() {
+    int index = active.load();
+    AnalyticsWriter &writer = writers[index];
+    writer.finish();
+    active.store(-1);
+    finished.store(index);
+    ESP_LOGI(TAG, "Session %lu: %lu frames in %u bytes%s", (unsigned long)writer.getSessionId(),
+             (unsigned long)writer.getFrameCount(), (unsigned)writer.getSize(),
+             writer.isTruncated() ? ", truncated" : "");
+}
+
+void SessionAnalytics::frame(VadState state, float levelDb, uint32_t skipped) {
+    int index = active.load(std::memory_order_relaxed);
+    if (index < 0) {
+        return;
+    }
+    AnalyticsWriter &writer = writers[index];
+    // A skipped frame has no level of its own, the next one stands in
+    for (uint32_t i = 0; i < skipped; i++) {
+        writer.frame(VadState::Skipped, levelDb);
+    }
+    writer.frame(state, levelDb);
+}
+
+void SessionAnalytics::window(uint16_t words) {
+    int index = active.load(std::memory_order_relaxed);
+    if (index >= 0) {
+        writers[index].words(words);
+    }
+}
+
+void SessionAnalytics::printSummary() {
+    int open = active.load();
+    int last = finished.load();
+    printf("analytics session %s, %lu dropped\n", open >= 0 ? "open" : "closed",
+           (unsigned long)dropped.load(std::memory_order_relaxed));
+    if (last < 0) {
+        printf("no finished session\n");
+        return;
+    }
+    const AnalyticsWriter &writer = writers[last];
+    printf("last session %lu: %lu frames, %lu windows, %lu events, %u bytes%s\n",
+           (unsigned long)writer.getSessionId(), (unsigned long)writer.getFrameCount(),
+           (unsigned long)writer.getWindowCount(), (unsigned long)writer.getEventCount(), (unsigned)writer.getSize(),
+           writer.isTruncated() ? ", truncated" : "");
+}
+
+void SessionAnalytics::exportBinary(uint32_t baud) {
+    baud = baud != 0 ? baud : CONFIG_YOD_ANALYTICS_EXPORT_BAUD;
+    // Claim the finished writer; the audio task checks the claim before it opens a session
+    int index;
+    do {
+        index = finished.load();
+        exporting.store(index);
+    } while (index != finished.load());
+    if (index < 0) {
+        printf("analytics export failed: no finished session\n");
+        return;
+    }
+    const AnalyticsWriter &writer = writers[index];
+    AnalyticsWriter::Segment segments[AnalyticsWriter::SEGMENT_COUNT];
+    size_t count = writer.getSegments(segments);
+    printf("analytics export %u bytes at %lu baud\n", (unsigned)writer.getSize(), (unsigned long)baud);
+
+    size_t frames = 0;
+    esp_err_t ret;
+    {
+        // The UART clock must not drop with the APB during the transfer
+        PowerManager::Lock lock(PowerManager::LockType::ApbMax);
+        vprintf_like_t log = esp_log_set_vprintf(dropLog);
+        ret = SerialCommand::setBaudRate(baud);
+        if (ret == ESP_OK) {
+            vTaskDelay(pdMS_TO_TICKS(BAUD_SWITCH_MS));
+            AnalyticsExport exporter(writeFrame, nullptr);
+            frames = exporter.send(segments, count);
+        }
+        SerialCommand::setBaudRate(0);
+        esp_log_set_vprintf(log);
+    }
+    exporting.store(-1);
+
+    vTaskDelay(pdMS_TO_TICKS(BAUD_SWITCH_MS));
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Cannot switch to %lu baud: %s", (unsigned long)baud, esp_err_to_name(ret));
+    }
+    ESP_LOGI(TAG, "Export of session %lu done, %u frames, %lu log lines dropped during it",
+             (unsigned long)writer.getSessionId(), (unsigned)frames,
+             (unsigned long)droppedLogLines.exchange(0, std::memory_order_relaxed));
+}
+
+#endif // CONFIG_YOD_ANALYTICS
@@ -0,0 +1,243 @@
+#include "sessionJournal.hpp"
+
+#if CONFIG_YOD_JOURNAL
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_rom_crc.h"
+#include "serialCommand.hpp"
+
+static const char *TAG = "SessionJournal";
+
+static constexpr uint8_t FRAME_SYNC_0 = 0xA5;
+static constexpr uint8_t FRAME_SYNC_1 = 0x5A;
+static constexpr uint8_t FRAME_VERSION = 1;
+static constexpr uint8_t FRAME_TYPE_JOURNAL = 0x02;
+static constexpr uint8_t FRAME_TYPE_JOURNAL_END = 0x03;
+
+static std::atomic<uint32_t> droppedLogLines{0};
+
+// Takes the log output during an export, a log line between the frames would break one
+static int dropLog(const char *, va_list) {
+    droppedLogLines.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
+
+static const char *const TYPE_NAMES[] = {
+    "?", "boot", "start", "stop", "patient", "speech", "button", "fault"
+};
+
+JournalPartition SessionJournal::partition;
+JournalLog SessionJournal::journal(SessionJournal::partition);
+QueueHandle_t SessionJournal::queue = NULL;
+SemaphoreHandle_t SessionJournal::mutex = NULL;
+std::atomic<uint32_t> SessionJournal::dropped{0};
+
+esp_err_t JournalPartition::initialize() {
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, SUBTYPE, LABEL);
+    return partition != nullptr ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+size_t JournalPartition::getSize() const {
+    return partition != nullptr ? partition->size : 0;
+}
+
+bool JournalPartition::read(size_t offset, void *buffer, size_t length) {
+    return esp_partition_read(partition, offset, buffer, length) == ESP_OK;
+}
+
+bool JournalPartition::write(size_t offset, const void *data, size_t length) {
+    return esp_partition_write(partition, offset, data, length) == ESP_OK;
+}
+
+bool JournalPartition::eraseSector(size_t offset) {
+    return esp_partition_erase_range(partition, offset, SECTOR_SIZE) == ESP_OK;
+}
+
+esp_err_t SessionJournal::start() {
+    esp_err_t ret = partition.initialize();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "No '%s' partition, the journal is off", JournalPartition::LABEL);
+        return ret;
+    }
+    int64_t startUs = esp_timer_get_time();
+    if (!journal.mount()) {
+        ESP_LOGE(TAG, "Failed to read the journal partition");
+        return ESP_FAIL;
+    }
+    const JournalLog::MountInfo &info = journal.getMountInfo();
+    ESP_LOGI(TAG, "Mounted in %lld us: %u of %u sectors in use, records %lu to %lu%s",
+             (long long)(esp_timer_get_time() - startUs), (unsigned)info.sectors, (unsigned)journal.getSectorCount(),
+             (unsigned long)journal.getOldestSequence(), (unsigned long)journal.getNextSequence() - 1,
+             info.tornPage ? ", skipped a torn page" : "");
+    // Nothing is recorded yet, the first sector of this run is opened without an erase
+    journal.eraseAhead();
+
+    mutex = xSemaphoreCreateMutex();
+    queue = xQueueCreate(CONFIG_YOD_JOURNAL_QUEUE_LENGTH, sizeof(JournalRecord));
+    if (mutex == NULL || queue == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    // Lowest priority, the flash writes wait for everything else
+    if (xTaskCreatePinnedToCore(journalTask, "Journal", 3072, NULL, 1, NULL, 0) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    SerialCommand::registerCommand("journal", "journal summary ('journal export [from]' writes binary frames)",
+        [](const char *args, void *) {
+            if (strncmp(args, "export", 6) == 0) {
+                exportBinary((uint32_t)strtoul(args + 6, nullptr, 10));
+            } else {
+                printSummary();
+            }
+        });
+
+    post(JournalRecord::boot(0, (uint8_t)esp_reset_reason()));
+    return ESP_OK;
+}
+
+void SessionJournal::sessionStart(uint32_t sessionId, time_t startTime) {
+    post(JournalRecord::sessionStart(0, sessionId, (uint32_t)startTime));
+}
+
+void SessionJournal::sessionStop(uint32_t sessionId) {
+    post(JournalRecord::sessionStop(0, sessionId));
+}
+
+void SessionJournal::patient(uint32_t sessionId, const char *code) {
+    post(JournalRecord::patient(0, sessionId, code));
+}
+
+void SessionJournal::speech(uint16_t words, uint16_t frames, uint16_t modemFrames, uint32_t windowMs) {
+    post(JournalRecord::speech(0, words, frames, modemFrames, windowMs));
+}
+
+void SessionJournal::button(ObserverId id) {
+    post(JournalRecord::button(0, (uint8_t)id));
+}
+
+void SessionJournal::fault(JournalFaultSource source, int32_t code) {
+    post(JournalRecord::fault(0, source, code));
+}
+
+void SessionJournal::post(JournalRecord record) {
+    record.uptimeMs = (uint32_t)(esp_timer_get_time() / 1000);
+    if (queue == NULL || xQueueSend(queue, &record, 0) != pdPASS) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void SessionJournal::journalTask(void *pvParameters) {
+    TickType_t deadline = 0;   // When the batch is written at the latest
+
+    while (true) {
+        TickType_t wait = portMAX_DELAY;
+        if (journal.getPending() > 0) {
+            int32_t left = (int32_t)(deadline - xTaskGetTickCount());
+            wait = left > 0 ? (TickType_t)left : 0;
+        }
+        JournalRecord record;
+        bool received = xQueueReceive(queue, &record, wait) == pdTRUE;
+
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        bool pending = journal.getPending() > 0;
+        if (!received) {
+            if (!journal.flush()) {
+                ESP_LOGW(TAG, "Write failed, retrying");
+            }
+        } else if (!journal.append(record)) {
+            ESP_LOGW(TAG, "Record %u dropped, the journal cannot be written", (unsigned)record.type);
+        } else if (record.type == JournalType::SessionStop || record.type == JournalType::Fault) {
+            journal.flush();
+            // Between sessions, so the erase does not fall in the next recording
+            if (record.type == JournalType::SessionStop) {
+                journal.eraseAhead();
+            }
+        }
+        if (journal.getPending() > 0 && (!pending || !received)) {
+            deadline = xTaskGetTickCount() + pdMS_TO_TICKS(CONFIG_YOD_JOURNAL_FLUSH_MS);
+        }
+        xSemaphoreGive(mutex);
+    }
+}
+
+void SessionJournal::printSummary() {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    const JournalLog::Stats &stats = journal.getStats();
+    const JournalLog::MountInfo &info = journal.getMountInfo();
+    printf("journal %u sectors, %u records, records %lu to %lu, %u in RAM\n", (unsigned)journal.getSectorCount(),
+           (unsigned)journal.getCapacity(), (unsigned long)journal.getOldestSequence(),
+           (unsigned long)journal.getNextSequence() - 1, (unsigned)journal.getPending());
+    printf("mount %u reads %u bytes%s\n", (unsigned)info.reads, (unsigned)info.bytesRead,
+           info.tornPage ? " torn page" : "");
+    printf("appended %u written %u in %u writes, %u erases, %u failures, %u corrupt, %lu dropped\n",
+           (unsigned)stats.appended, (unsigned)stats.written, (unsigned)stats.writes, (unsigned)stats.erases,
+           (unsigned)stats.failures, (unsigned)stats.corrupt,
+           (unsigned long)(stats.dropped + dropped.load(std::memory_order_relaxed)));
+
+    // The newest records, as far as they fit in one read
+    JournalRecord records[8];
+    uint32_t sequence = journal.getNextSequence() > 8 ? journal.getNextSequence() - 8 : 0;
+    size_t count = journal.read(sequence, records, 8);
+    xSemaphoreGive(mutex);
+    for (size_t i = 0; i < count; i++) {
+        const JournalRecord &r = records[i];
+        size_t type = (size_t)r.type < sizeof(TYPE_NAMES) / sizeof(TYPE_NAMES[0]) ? (size_t)r.type : 0;
+        printf("%8lu %10lu ms %-7s", (unsigned long)r.sequence, (unsigned long)r.uptimeMs, TYPE_NAMES[type]);
+        for (size_t b = 0; b < r.length; b++) {
+            printf(" %02x", r.payload[b]);
+        }
+        printf("\n");
+    }
+}
+
+void SessionJournal::exportBinary(uint32_t sequence) {
+    static uint8_t frame[6 + EXPORT_CHUNK * sizeof(JournalRecord) + 2];
+
+    auto send = [](uint8_t type, size_t payloadLength) {
+        frame[0] = FRAME_SYNC_0;
+        frame[1] = FRAME_SYNC_1;
+        frame[2] = FRAME_VERSION;
+        frame[3] = type;
+        frame[4] = payloadLength & 0xFF;
+        frame[5] = payloadLength >> 8;
+        uint16_t crc = esp_rom_crc16_le(0, &frame[6], payloadLength);
+        frame[6 + payloadLength] = crc & 0xFF;
+        frame[7 + payloadLength] = crc >> 8;
+        // Past stdout, which would put a CR before every 0x0A byte of the frame
+        SerialCommand::writeRaw(frame, payloadLength + 8);
+    };
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    journal.flush();
+    xSemaphoreGive(mutex);
+    fflush(stdout);
+    vprintf_like_t log = esp_log_set_vprintf(dropLog);
+    while (true) {
+        // One chunk per lock, the journal task writes on in between
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        size_t count = journal.read(sequence, reinterpret_cast<JournalRecord *>(&frame[6]), EXPORT_CHUNK);
+        xSemaphoreGive(mutex);
+        if (count == 0) {
+            break;
+        }
+        send(FRAME_TYPE_JOURNAL, count * sizeof(JournalRecord));
+    }
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    uint32_t end[3] = {journal.getOldestSequence(), journal.getNextSequence(),
+                       (uint32_t)journal.getStats().dropped + dropped.load(std::memory_order_relaxed)};
+    xSemaphoreGive(mutex);
+    memcpy(&frame[6], end, sizeof(end));
+    send(FRAME_TYPE_JOURNAL_END, sizeof(end));
+    esp_log_set_vprintf(log);
+    ESP_LOGI(TAG, "Export done, %lu log lines dropped during it",
+             (unsigned long)droppedLogLines.exchange(0, std::memory_order_relaxed));
+}
+
+#endif // CONFIG_YOD_JOURNAL
@@ -1,27 +1,146 @@
 #include "speaker.hpp"
-#include <iostream> // For demonstration purposes (e.g., logging)
+#include "powerManager.hpp"
+#include "esp_log.h"
+
+static const char *TAG = "Speaker";
 
 // Constructor
-Speaker::Speaker(gpio_num_t gpioPin) 
-    : PWMChannel(gpioPin) {
+Speaker::Speaker(gpio_num_t gpioPin)
+    : PWMChannel(gpioPin), stepTimer(nullptr), stateMutex(nullptr), events(nullptr), queue{}, head(0), tail(0),
+      active(false), phase(Phase::Tone), gapMs(0) {
 }
 
 // Destructor
 Speaker::~Speaker() {
+    if (stepTimer != nullptr) {
+        esp_timer_stop(stepTimer);
+        esp_timer_delete(stepTimer);
+    }
+    if (active) {
+        PowerManager::release(PowerManager::LockType::ApbMax);
+    }
+    if (events != nullptr) {
+        vEventGroupDelete(events);
+    }
+    if (stateMutex != nullptr) {
+        vSemaphoreDelete(stateMutex);
+    }
+}
+
+esp_err_t Speaker::initialize() {
+    stateMutex = xSemaphoreCreateMutex();
+    events = xEventGroupCreate();
+    if (stateMutex == nullptr || events == nullptr) {
+        return ESP_ERR_NO_MEM;
+    }
+    xEventGroupSetBits(events, IDLE_BIT);
+
+    esp_timer_create_args_t args = {};
+    args.callback = onStep;
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "speaker_step";
+    esp_err_t ret = esp_timer_create(&args, &stepTimer);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create step timer: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    return PWMChannel::initialize();
 }
 
 // Method to make a beep sound
 void Speaker::beep(uint32_t freq) {
-    // Take mutex before PWM operations
-    if (xSemaphoreTake(pwmMutex, portMAX_DELAY) == pdTRUE) {
+    Tone tone = {(uint16_t)freq, BEEP_MS, 0};
+    if (play(&tone, 1) != ESP_OK) {
+        ESP_LOGW(TAG, "Beep dropped, tone queue full");
+    }
+}
+
+esp_err_t Speaker::play(const Tone *tones, size_t count) {
+    if (stepTimer == nullptr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(stateMutex, portMAX_DELAY);
+    size_t used = (head + QUEUE_TONES - tail) % QUEUE_TONES;
+    if (count > QUEUE_TONES - 1 - used) {
+        xSemaphoreGive(stateMutex);
+        return ESP_ERR_NO_MEM;
+    }
+    for (size_t i = 0; i < count; i++) {
+        queue[head] = tones[i];
+        head = (head + 1) % QUEUE_TONES;
+    }
+    if (!active && count > 0) {
+        // Released in startNext() once the queue has played out
+        PowerManager::acquire(PowerManager::LockType::ApbMax);
+        xEventGroupClearBits(events, IDLE_BIT);
+        active = true;
+        startNext();
+    }
+    xSemaphoreGive(stateMutex);
+    return ESP_OK;
+}
+
+void Speaker::stop() {
+    if (stepTimer == nullptr) {
+        return;
+    }
+    xSemaphoreTake(stateMutex, portMAX_DELAY);
+    esp_timer_stop(stepTimer);
+    ledc_timer_pause(config.mode, config.timer);
+    tail = head;
+    if (active) {
+        active = false;
+        PowerManager::release(PowerManager::LockType::ApbMax);
+        xEventGroupSetBits(events, IDLE_BIT);
+    }
+    xSemaphoreGive(stateMutex);
+}
+
+bool Speaker::isPlaying() const {
+    return events != nullptr && (xEventGroupGetBits(events) & IDLE_BIT) == 0;
+}
+
+bool Speaker::waitUntilIdle(TickType_t timeout) {
+    if (events == nullptr) {
+        return true;
+    }
+    return (xEventGroupWaitBits(events, IDLE_BIT, pdFALSE, pdTRUE, timeout) & IDLE_BIT) != 0;
+}
+
+void Speaker::onStep(void *arg) {
+    Speaker *speaker = static_cast<Speaker *>(arg);
+    xSemaphoreTake(speaker->stateMutex, portMAX_DELAY);
+    // stop() may have run while this callback waited for the mutex
+    if (speaker->active) {
+        if (speaker->phase == Phase::Tone) {
+            ledc_timer_pause(speaker->config.mode, speaker->config.timer);
+        }
+        if (speaker->phase == Phase::Tone && speaker->gapMs > 0) {
+            speaker->phase = Phase::Gap;
+            esp_timer_start_once(speaker->stepTimer, (uint64_t)speaker->gapMs * 1000);
+        } else {
+            speaker->startNext();
+        }
+    }
+    xSemaphoreGive(speaker->stateMutex);
+}
+
+void Speaker::startNext() {
+    if (tail == head) {
+        active = false;
+        PowerManager::release(PowerManager::LockType::ApbMax);
+        xEventGroupSetBits(events, IDLE_BIT);
+        return;
+    }
+    Tone tone = queue[tail];
+    tail = (tail + 1) % QUEUE_TONES;
+    if (tone.frequencyHz > 0) {
+        ledc_set_freq(config.mode, config.timer, tone.frequencyHz);
         ledc_timer_resume(config.mode, config.timer);
-        ledc_set_freq(config.mode, config.timer, freq);
-        vTaskDelay(1500 / portTICK_PERIOD_MS); // Beep duration
-        ledc_timer_pause(config.mode, config.timer);
-        
-        // Release mutex
-        xSemaphoreGive(pwmMutex);
-    } else {
-        std::cout << "Failed to acquire PWM mutex for beep!" << std::endl;
     }
+    phase = Phase::Tone;
+    gapMs = tone.gapMs;
+    // A zero length step still goes through the timer, so a pattern never recurses here
+    esp_timer_start_once(stepTimer, tone.durationMs > 0 ? (uint64_t)tone.durationMs * 1000 : 1);
 }
@@ -1,77 +1,184 @@
 #include "storage.hpp"
-#include <iostream>
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <nvs_flash.h>
+#include "esp_log.h"
+#include "sessionJournal.hpp"
 
 #define STORAGE_NAMESPACE "storage"
 #define SESSION_ID_KEY "session_id"
+#define CONFIG_COUNTER_KEY "cfg_counter"
+#define WORD_THRESHOLDS_KEY "word_thresh"
+#define BEACON_INTERVAL_KEY "beacon_int"
+#define LAST_SESSION_KEY "last_session"
+
+static const char *TAG = "NvsBoundary";
 
 // Constructor for NvsBoundary
-NvsBoundary::NvsBoundary() { 
-    nvs_flash_init();
+NvsBoundary::NvsBoundary() : nvsHandle(0), open(false), writeFailed(false) {
 }
 
 // Destructor for NvsBoundary
 NvsBoundary::~NvsBoundary() {
-    // Cleanup code for NvsBoundary
+    if (open) {
+        nvs_close(nvsHandle);
+    }
 }
 
-// Write uint64_t to NVS
-void NvsBoundary::writeUint64(const char* key, uint64_t value) {
-    esp_err_t err = nvs_open(STORAGE_NAMESPACE, NVS_READWRITE, &nvsHandle);
+// Initialise the partition and keep the handle open
+esp_err_t NvsBoundary::initialize() {
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_LOGW(TAG, "NVS partition erased: %s", esp_err_to_name(err));
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        err = nvs_flash_init();
+    }
     if (err != ESP_OK) {
-        std::cerr << "Failed to open NVS: " << esp_err_to_name(err) << std::endl;
-        return;
+        ESP_LOGE(TAG, "Failed to initialise NVS: %s", esp_err_to_name(err));
+        return err;
     }
+    err = nvs_open(STORAGE_NAMESPACE, NVS_READWRITE, &nvsHandle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+        return err;
+    }
+    open = true;
+    return ESP_OK;
+}
 
-    err = nvs_set_u64(nvsHandle, key, value);
+void NvsBoundary::check(esp_err_t err, const char *operation, const char *key) {
     if (err != ESP_OK) {
-        std::cerr << "Failed to write data: " << esp_err_to_name(err) << std::endl;
-    } else {
-        nvs_commit(nvsHandle);
+        ESP_LOGE(TAG, "Failed to %s %s: %s", operation, key, esp_err_to_name(err));
+        writeFailed = true;
     }
+}
 
-    nvs_close(nvsHandle);
+// Write uint64_t to NVS, committed by flush()
+void NvsBoundary::writeUint64(const char* key, uint64_t value) {
+    check(open ? nvs_set_u64(nvsHandle, key, value) : ESP_ERR_NVS_INVALID_HANDLE, "write", key);
 }
 
 // Read uint64_t from NVS
-uint64_t NvsBoundary::readUint64(const char* key, uint64_t defaultValue) {
-    esp_err_t err = nvs_open(STORAGE_NAMESPACE, NVS_READONLY, &nvsHandle);
-    if (err != ESP_OK) {
-        std::cerr << "Failed to open NVS: " << esp_err_to_name(err) << std::endl;
-        return defaultValue;
+bool NvsBoundary::findUint64(const char* key, uint64_t &value) {
+    if (!open) {
+        return false;
+    }
+    esp_err_t err = nvs_get_u64(nvsHandle, key, &value);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGE(TAG, "Failed to read %s: %s", key, esp_err_to_name(err));
     }
+    return err == ESP_OK;
+}
+
+void NvsBoundary::writeString(const char* key, const char* value) {
+    check(open ? nvs_set_str(nvsHandle, key, value) : ESP_ERR_NVS_INVALID_HANDLE, "write", key);
+}
 
-    uint64_t value = defaultValue;
-    err = nvs_get_u64(nvsHandle, key, &value);
-    if (err == ESP_ERR_NVS_NOT_FOUND) {
-        std::cerr << "Key not found in NVS: " << key << std::endl;
-        value = defaultValue;
-    } else if (err != ESP_OK) {
-        std::cerr << "Failed to read data: " << esp_err_to_name(err) << std::endl;
-        value = defaultValue;
+bool NvsBoundary::readString(const char* key, char* buffer, size_t &length) {
+    size_t size = length;
+    length = 0;
+    if (!open || nvs_get_str(nvsHandle, key, nullptr, &length) != ESP_OK) {
+        length = 0;
+        return false;
     }
+    if (buffer == nullptr) {
+        return true;
+    }
+    return length <= size && nvs_get_str(nvsHandle, key, buffer, &length) == ESP_OK;
+}
 
-    nvs_close(nvsHandle);
-    return value;
+void NvsBoundary::writeBlob(const char* key, const void* data, size_t length) {
+    check(open ? nvs_set_blob(nvsHandle, key, data, length) : ESP_ERR_NVS_INVALID_HANDLE, "write", key);
 }
 
-// Erase data from NVS
+bool NvsBoundary::readBlob(const char* key, void* buffer, size_t &length) {
+    size_t size = length;
+    length = 0;
+    if (!open || nvs_get_blob(nvsHandle, key, nullptr, &length) != ESP_OK) {
+        length = 0;
+        return false;
+    }
+    if (buffer == nullptr) {
+        return true;
+    }
+    return length <= size && nvs_get_blob(nvsHandle, key, buffer, &length) == ESP_OK;
+}
+
+// Erase data from NVS, committed by flush()
 void NvsBoundary::eraseData(const char* key) {
-    esp_err_t err = nvs_open(STORAGE_NAMESPACE, NVS_READWRITE, &nvsHandle);
-    if (err != ESP_OK) {
-        std::cerr << "Failed to open NVS: " << esp_err_to_name(err) << std::endl;
-        return;
+    esp_err_t err = open ? nvs_erase_key(nvsHandle, key) : ESP_ERR_NVS_INVALID_HANDLE;
+    // Erasing what is not there leaves the store as asked
+    if (err != ESP_ERR_NVS_NOT_FOUND) {
+        check(err, "erase", key);
     }
+}
 
-    err = nvs_erase_key(nvsHandle, key);
+bool NvsBoundary::flush() {
+    bool ok = !writeFailed;
+    writeFailed = false;
+    esp_err_t err = open ? nvs_commit(nvsHandle) : ESP_ERR_NVS_INVALID_HANDLE;
     if (err != ESP_OK) {
-        std::cerr << "Failed to erase data: " << esp_err_to_name(err) << std::endl;
-    } else {
-        nvs_commit(nvsHandle);
+        ESP_LOGE(TAG, "Failed to commit: %s", esp_err_to_name(err));
+        ok = false;
     }
+    return ok;
+}
+
+NvsFlushTask::NvsFlushTask(NvsWriteCache &cache, uint32_t delayMs)
+    : cache(cache), delayMs(delayMs), flushTask(nullptr) {
+}
 
-    nvs_close(nvsHandle);
+NvsFlushTask::~NvsFlushTask() {
+    if (flushTask != nullptr) {
+        cache.setWriteHook(nullptr, nullptr);
+        vTaskDelete(flushTask);
+    }
+}
+
+esp_err_t NvsFlushTask::initialize() {
+    // Lowest priority, a flush may wait for the flash but nothing waits for it
+    if (xTaskCreatePinnedToCore(flushTaskFunction, "NvsFlush", 3072, this, 1, &flushTask, 0) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    cache.setWriteHook(onWrite, this);
+    // Writes made before the task existed
+    xTaskNotifyGive(flushTask);
+    return ESP_OK;
+}
+
+void NvsFlushTask::onWrite(void *context) {
+    xTaskNotifyGive(static_cast<NvsFlushTask *>(context)->flushTask);
+}
+
+void NvsFlushTask::flushTaskFunction(void *pvParameters) {
+    NvsFlushTask *flusher = static_cast<NvsFlushTask *>(pvParameters);
+
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        // Writes within the delay join the batch. A failed flush is tried again after
+        // a delay doubling up to RETRY_MAX_MS, only the first failure of a run is
+        // journaled since every fault record forces a flush of the journal itself.
+        uint32_t retryMs = flusher->delayMs;
+        uint32_t failures = 0;
+        do {
+            vTaskDelay(pdMS_TO_TICKS(retryMs));
+            ulTaskNotifyTake(pdTRUE, 0);
+            if (flusher->cache.flush()) {
+                if (failures > 0) {
+                    ESP_LOGI(TAG, "Flush recovered after %lu failures", (unsigned long)failures);
+                }
+                failures = 0;
+                retryMs = flusher->delayMs;
+            } else {
+                if (failures++ == 0) {
+                    SessionJournal::fault(JournalFaultSource::Storage, ESP_FAIL);
+                }
+                retryMs = std::min(retryMs * 2, std::max(RETRY_MAX_MS, flusher->delayMs));
+                ESP_LOGW(TAG, "Flush failed, retrying in %lu ms", (unsigned long)retryMs);
+            }
+        } while (flusher->cache.isDirty());
+    }
 }
 
 // Constructor for Storage, injecting NVS_boundary_abstract
@@ -96,3 +203,58 @@ uint64_t Storage::getSessionId() {
 void Storage::clearSessionId() {
     nvsService.eraseData(SESSION_ID_KEY);
 }
+
+// Set the counter of the last accepted configuration upload and commit it at once
+bool Storage::commitConfigCounter(uint32_t counter) {
+    nvsService.writeUint64(CONFIG_COUNTER_KEY, counter);
+    return nvsService.flush();
+}
+
+// Get the counter of the last accepted configuration upload
+uint32_t Storage::getConfigCounter() {
+    return (uint32_t)nvsService.readUint64(CONFIG_COUNTER_KEY, 0);
+}
+
+// Set the word thresholds, packed in one key with bit 48 marking a stored value
+void Storage::setWordThresholds(int8_t levelDb, uint16_t lowHz, uint16_t highHz) {
+    uint64_t packed = 1ULL << 48 | (uint64_t)(uint8_t)levelDb << 32 | (uint64_t)lowHz << 16 | highHz;
+    nvsService.writeUint64(WORD_THRESHOLDS_KEY, packed);
+}
+
+// Get the word thresholds
+bool Storage::getWordThresholds(int8_t &levelDb, uint16_t &lowHz, uint16_t &highHz) {
+    uint64_t packed = nvsService.readUint64(WORD_THRESHOLDS_KEY, 0);
+    if ((packed >> 48) == 0) {
+        return false;
+    }
+    levelDb = (int8_t)(uint8_t)(packed >> 32);
+    lowHz = (uint16_t)(packed >> 16);
+    highHz = (uint16_t)packed;
+    return true;
+}
+
+// Set the beacon interval
+void Storage::setBeaconIntervalS(uint32_t seconds) {
+    nvsService.writeUint64(BEACON_INTERVAL_KEY, seconds);
+}
+
+// Get the beacon interval
+uint32_t Storage::getBeaconIntervalS(uint32_t defaultValue) {
+    return (uint32_t)nvsService.readUint64(BEACON_INTERVAL_KEY, defaultValue);
+}
+
+// Set the record of the last session, one blob so it is never half written
+void Storage::setLastSession(const SessionRecord &record) {
+    nvsService.writeBlob(LAST_SESSION_KEY, &record, sizeof(record));
+}
+
+// Get the record of the last session
+bool Storage::getLastSession(SessionRecord &record) {
+    size_t length = sizeof(record);
+    // A blob of another size was written by other firmware
+    if (!nvsService.readBlob(LAST_SESSION_KEY, &record, length) || length != sizeof(record)) {
+        return false;
+    }
+    record.patient[SessionRecord::PATIENT_LENGTH - 1] = '\0';
+    return true;
+}
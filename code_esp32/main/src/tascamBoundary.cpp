@@ -1,18 +1,56 @@
 #include "tascamBoundary.hpp"
+#include "powerManager.hpp"
+#include "esp_log.h"
+#include "esp_timer.h"
 
+static const char *TAG = "TascamBoundary";
+
+static const char *stateName(TascamBoundary::RecorderState state) {
+    switch (state) {
+        case TascamBoundary::RecorderState::Stopped:
+            return "stopped";
+        case TascamBoundary::RecorderState::Standby:
+            return "in standby";
+        case TascamBoundary::RecorderState::Recording:
+            return "recording";
+        default:
+            return "unknown";
+    }
+}
 
 TascamBoundary::TascamBoundary(uart_port_t uartNum, QueueHandle_t *uartQueue)
-    : uartNum(UART_NUM_2), uartQueue(uartQueue)
+    : uartNum(uartNum), uartQueue(uartQueue), requests(nullptr), requestMutex(nullptr), queueSet(nullptr),
+      events(nullptr), commandTask(nullptr), completionCallback(nullptr), completionContext(nullptr),
+      listener(nullptr), wakeTask(nullptr), pendingFault(TascamFault::None),
+      sequencer(CONFIG_YOD_TASCAM_STATUS, CONFIG_YOD_TASCAM_ACK_TIMEOUT_MS), state(RecorderState::Unknown),
+      lastStartLatencyUs(0)
 {
-  
+
 }
 
 TascamBoundary::~TascamBoundary()
 {
+    if (commandTask != nullptr) {
+        vTaskDelete(commandTask);
+    }
+    if (queueSet != nullptr) {
+        xQueueRemoveFromSet(*uartQueue, queueSet);
+        xQueueRemoveFromSet(requests, queueSet);
+        vQueueDelete(queueSet);
+    }
     uart_driver_delete(uartNum);
+    if (events != nullptr) {
+        vEventGroupDelete(events);
+    }
+    if (requestMutex != nullptr) {
+        vSemaphoreDelete(requestMutex);
+    }
+    if (requests != nullptr) {
+        vQueueDelete(requests);
+    }
 }
 
-void TascamBoundary::initialize()
+esp_err_t TascamBoundary::initialize()
 {
     uart_config_t uart_config = {
         .baud_rate = 9600,
@@ -28,36 +66,249 @@ void TascamBoundary::initialize()
     ESP_ERROR_CHECK(uart_param_config(uartNum, &uart_config));
     ESP_ERROR_CHECK(uart_set_pin(uartNum, 17, 16, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
     ESP_ERROR_CHECK(uart_set_line_inverse(uartNum, UART_SIGNAL_RXD_INV | UART_SIGNAL_TXD_INV));
-    ESP_ERROR_CHECK(uart_driver_install(uartNum, 256, 256, 256, uartQueue, 0));
-    vTaskDelay(pdMS_TO_TICKS(100));
-}
+    esp_err_t ret = uart_driver_install(uartNum, 256, 256, UART_EVENT_QUEUE_SIZE, uartQueue, 0);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to install UART driver: %s", esp_err_to_name(ret));
+        return ret;
+    }
 
+    requests = xQueueCreate(1, sizeof(Request));
+    requestMutex = xSemaphoreCreateMutex();
+    queueSet = xQueueCreateSet(1 + UART_EVENT_QUEUE_SIZE);
+    events = xEventGroupCreate();
+    if (requests == nullptr || requestMutex == nullptr || queueSet == nullptr || events == nullptr) {
+        return ESP_ERR_NO_MEM;
+    }
+    // Both are still empty, as a queue set requires
+    xQueueAddToSet(requests, queueSet);
+    xQueueAddToSet(*uartQueue, queueSet);
+    xEventGroupSetBits(events, IDLE_BIT);
 
+    // Below the modem and the observer task, the remote keys only need to be on time to about a tick
+    if (xTaskCreatePinnedToCore(commandTaskFunction, "Tascam", 3072, this, 3, &commandTask, 0) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
 
 void TascamBoundary::startRecording()
 {
-    idle();
-    vTaskDelay(pdMS_TO_TICKS(250));
-    sendCommand(TascamCommands::TASCAM_START_RECORDING); // Replace with the actual command to start recording
-    //sendCommand(139);
+    post(RecorderState::Recording);
+}
+
+void TascamBoundary::stopRecording()
+{
+    post(RecorderState::Stopped);
+}
+
+void TascamBoundary::idle()
+{
+    post(RecorderState::Standby);
+}
+
+void TascamBoundary::setCompletionCallback(CompletionCallback callback, void *context)
+{
+    completionContext = context;
+    completionCallback = callback;
+}
+
+void TascamBoundary::setListener(Listener &faultListener)
+{
+    listener = &faultListener;
+}
+
+void TascamBoundary::setWakeTask(TaskHandle_t task)
+{
+    wakeTask = task;
+}
+
+void TascamBoundary::update()
+{
+    if (pendingFault != TascamFault::None && listener != nullptr) {
+        listener->notify(ObserverId::RecorderFault);
+    }
+}
+
+ObserverId TascamBoundary::getId() const
+{
+    return ObserverId::RecorderFault;
+}
+
+TascamFault TascamBoundary::takeFault()
+{
+    return pendingFault.exchange(TascamFault::None);
+}
+
+bool TascamBoundary::isBusy() const
+{
+    return events != nullptr && (xEventGroupGetBits(events) & IDLE_BIT) == 0;
+}
+
+bool TascamBoundary::waitUntilIdle(TickType_t timeout)
+{
+    if (events == nullptr) {
+        return true;
+    }
+    return (xEventGroupWaitBits(events, IDLE_BIT, pdFALSE, pdTRUE, timeout) & IDLE_BIT) != 0;
+}
+
+void TascamBoundary::post(RecorderState target)
+{
+    if (commandTask == nullptr) {
+        ESP_LOGW(TAG, "Not initialized, request dropped");
+        return;
+    }
+    Request request = {target, esp_timer_get_time()};
+    xSemaphoreTake(requestMutex, portMAX_DELAY);
+    xEventGroupClearBits(events, IDLE_BIT);
+    xQueueOverwrite(requests, &request);
+    xSemaphoreGive(requestMutex);
 }
 
 void TascamBoundary::sendCommand(uint8_t command)
 {
-    //idle(); // Ensure the device is in idle state before sending a command
+    // The baud rate is derived from APB, keep it fixed until the byte is out
+    PowerManager::Lock lock(PowerManager::LockType::ApbMax);
     uart_write_bytes(uartNum, (const char*)&command, 1);
-    vTaskDelay(pdMS_TO_TICKS(500)); // Adjust delay as needed
-    
+    uart_wait_tx_done(uartNum, pdMS_TO_TICKS(50));
 }
 
-void TascamBoundary::idle()
+TascamBoundary::Wake TascamBoundary::waitEvent(int64_t untilUs, Request &request)
 {
-    stopRecording();
-    stopRecording();
-    sendCommand(TascamCommands::TASCAM_START_RECORDING);
+    while (true) {
+        TickType_t ticks = portMAX_DELAY;
+        if (untilUs >= 0) {
+            int64_t waitUs = untilUs - esp_timer_get_time();
+            if (waitUs <= 0) {
+                return Wake::Timeout;
+            }
+            ticks = pdMS_TO_TICKS((waitUs + 999) / 1000) + 1;
+        }
+        QueueSetMemberHandle_t member = xQueueSelectFromSet(queueSet, ticks);
+        if (member == nullptr) {
+            continue;
+        }
+        if (member == requests) {
+            xQueueReceive(requests, &request, 0);
+            return Wake::Request;
+        }
+        uart_event_t event;
+        if (xQueueReceive(*uartQueue, &event, 0) == pdTRUE) {
+            Wake wake = handleUartEvent(event);
+            if (wake != Wake::Timeout) {
+                return wake;
+            }
+        }
+    }
 }
 
-void TascamBoundary::stopRecording()
+TascamBoundary::Wake TascamBoundary::handleUartEvent(const uart_event_t &event)
 {
-    sendCommand(TascamCommands::TASCAM_STOP_RECORDING); // Use the defined command to stop recording
+    Wake wake = Wake::Timeout;
+    switch (event.type) {
+        case UART_DATA: {
+            uint8_t bytes[16];
+            size_t left = event.size;
+            while (left > 0) {
+                int length = uart_read_bytes(uartNum, bytes, left < sizeof(bytes) ? left : sizeof(bytes), 0);
+                if (length <= 0) {
+                    break;
+                }
+                left -= (size_t)length;
+                for (int i = 0; i < length; i++) {
+                    TascamStatusParser::Report report = parser.push(bytes[i]);
+                    if (report.kind != TascamStatusParser::Report::Kind::None) {
+                        sequencer.report(report);
+                        wake = Wake::Status;
+                    }
+                }
+            }
+            break;
+        }
+        case UART_BREAK:
+            // Without a return line the input may rest at the break level, so only trusted with status
+            if (CONFIG_YOD_TASCAM_STATUS) {
+                sequencer.fault(TascamFault::LineBreak);
+                wake = Wake::Status;
+            }
+            break;
+        case UART_FIFO_OVF:
+        case UART_BUFFER_FULL:
+            ESP_LOGW(TAG, "RX overflow, input flushed");
+            uart_flush_input(uartNum);
+            break;
+        case UART_PARITY_ERR:
+        case UART_FRAME_ERR:
+            ESP_LOGW(TAG, "RX %s error", event.type == UART_PARITY_ERR ? "parity" : "frame");
+            break;
+        default:
+            break;
+    }
+    return wake;
+}
+
+void TascamBoundary::raiseFault(TascamFault fault)
+{
+    ESP_LOGE(TAG, "Recorder fault: %s", tascamFaultName(fault));
+    pendingFault = fault;
+    if (wakeTask != nullptr) {
+        xTaskNotifyGive(wakeTask);
+    }
+}
+
+void TascamBoundary::accept(const Request &request)
+{
+    RecorderState previous = sequencer.getTarget();
+    size_t sent = sequencer.getPlanIndex();
+    size_t count = sequencer.getPlanLength();
+    if (sequencer.request(request.target, request.requestedUs)) {
+        ESP_LOGI(TAG, "Sequence to %s cancelled after %u of %u commands, now %s",
+                 stateName(previous), (unsigned)sent, (unsigned)count, stateName(request.target));
+    }
+}
+
+void TascamBoundary::finish(const TascamSequencer::Action &action)
+{
+    if (action.startLatencyUs > 0) {
+        lastStartLatencyUs = action.startLatencyUs;
+    }
+    ESP_LOGI(TAG, "Recorder %s", stateName(action.state));
+    if (completionCallback != nullptr) {
+        completionCallback(action.state, action.startLatencyUs, completionContext);
+    }
+
+    // Idle only when no request arrived in the meantime, post() clears the bit under the same mutex
+    xSemaphoreTake(requestMutex, portMAX_DELAY);
+    if (uxQueueMessagesWaiting(requests) == 0) {
+        xEventGroupSetBits(events, IDLE_BIT);
+    }
+    xSemaphoreGive(requestMutex);
+}
+
+void TascamBoundary::commandTaskFunction(void *pvParameters)
+{
+    TascamBoundary *tascam = static_cast<TascamBoundary *>(pvParameters);
+    Request request;
+
+    while (true) {
+        TascamSequencer::Action action = tascam->sequencer.next(esp_timer_get_time());
+        tascam->state = tascam->sequencer.getState();
+        switch (action.kind) {
+            case TascamSequencer::Action::Kind::Send:
+                tascam->sendCommand(action.key);
+                break;
+            case TascamSequencer::Action::Kind::Fault:
+                tascam->raiseFault(action.fault);
+                break;
+            case TascamSequencer::Action::Kind::Done:
+                tascam->finish(action);
+                break;
+            case TascamSequencer::Action::Kind::Wait:
+                // Reports only update the sequencer, a request or a deadline moves it on
+                if (tascam->waitEvent(action.wakeUs, request) == Wake::Request) {
+                    tascam->accept(request);
+                }
+                break;
+        }
+    }
 }
@@ -2,13 +2,26 @@
 #include "esp_log.h"
 #include "audioAnalyzer.hpp" // Assuming this is the correct path
 #include "menuController.hpp"
+#include "audioModem.hpp"
 #include "esp_timer.h"
+#include "buttonBoundary.hpp"
+#include "powerManager.hpp"
+#include "instrumentation.hpp"
+#include "frameScheduler.hpp"
+#include "configReceiver.hpp"
+#include "sessionJournal.hpp"
+#include "sessionAnalytics.hpp"
 
 // Define TAG for logging
 static const char *TAG = "TaskHandler";
 
-TaskHandler::TaskHandler(std::vector<Observer*>& observers, QueueHandle_t& countQueue, MenuController& menuController)
-    : observers(observers), countQueue(countQueue), menuController(menuController) {
+static constexpr uint32_t FRAME_PERIOD_MS = 250;   ///< One analysis frame per period while recording
+static constexpr uint32_t FRAMES_PER_WINDOW = 240; ///< Frames per ratio window, one minute
+static constexpr uint32_t IDLE_POLL_MS = 100;      ///< State poll interval while not recording
+static constexpr uint32_t OBSERVER_POLL_MS = 1000; ///< Queue observer poll interval without button activity
+
+TaskHandler::TaskHandler(std::vector<Observer*>& observers, QueueHandle_t& countQueue, MenuController& menuController, AudioModem& audioModem, ConfigReceiver& configReceiver)
+    : observers(observers), countQueue(countQueue), menuController(menuController), audioModem(audioModem), configReceiver(configReceiver) {
 }
 
 void TaskHandler::startTasks() {
@@ -18,14 +31,16 @@ void TaskHandler::startTasks() {
         4096,
         this,
         5,
-        NULL,
+        &observerTask,
         0
     );
+    ButtonBoundary::setWakeTask(observerTask);
 
+    // ConfigReceiver aligns the symbols of a burst on this stack
     xTaskCreatePinnedToCore(
         audioAnalyzerTask,
         "AudioAnalyzerTask",
-        4096,
+        8192,
         this,
         5,
         NULL,
@@ -38,11 +53,9 @@ void TaskHandler::observerUpdateTask(void *pvParameters) {
     while (true) {
         for (Observer* obs : taskHandler->observers) {
             obs->update();
-            // Small delay between observer updates to prevent blocking
-            vTaskDelay(pdMS_TO_TICKS(10));
         }
-        // Longer delay to ensure other tasks can run
-        vTaskDelay(pdMS_TO_TICKS(200));
+        // Buttons wake the task directly, the timeout only serves the queue observers
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(OBSERVER_POLL_MS));
     }
 }
 
@@ -51,44 +64,85 @@ void TaskHandler::audioAnalyzerTask(void *param)
     TaskHandler* taskHandler = static_cast<TaskHandler*>(param);
     QueueHandle_t queue = taskHandler->countQueue;
     MenuController& menuController = taskHandler->menuController;
+    AudioModem& audioModem = taskHandler->audioModem;
+    ConfigReceiver& configReceiver = taskHandler->configReceiver;
     
     AudioAnalyzer audioAnalyzer;
     audioAnalyzer.init();    
+    AudioAnalyzer::WordThresholds thresholds;
+    if (menuController.getWordThresholds(thresholds)) {
+        audioAnalyzer.setWordThresholds(thresholds);
+    }
+    bool configRx = configReceiver.initialize() == ESP_OK;
+
+    FrameScheduler scheduler(FRAME_PERIOD_MS * 1000, CONFIG_YOD_FRAME_BUDGET_MS * 1000, CONFIG_YOD_FRAME_DEGRADE);
+    scheduler.initialize();
 
     uint8_t count = 0;
     uint8_t i = 0;
-    TickType_t lastWakeTime = xTaskGetTickCount(); // Initialize lastWakeTime
-    int64_t startTime = 0;
+    uint32_t windowStartIndex = 0;
     uint8_t consecutiveWords = 0;
+    uint32_t modemFrames = 0;
+    uint32_t buttonPresses = ButtonBoundary::getPressCount();
     TickType_t lastLogTime = xTaskGetTickCount();
 
     ESP_LOGI(TAG, "Audio analysis loop started.");
     
     while (1)
     {
+        // Session starts and stops of the menu, before the frames that belong to them
+        SessionAnalytics::poll(FRAME_PERIOD_MS);
+
         // Only analyze audio when in RECORDING state
         if (menuController.getCurrentState() == MenuController::State::RECORDING) {
-            if (i == 0) {
-                startTime = esp_timer_get_time();
+            // The analyzer reads the microphone ADC itself
+            configReceiver.stop();
+            if (!scheduler.isRunning()) {
+                scheduler.start();
+                windowStartIndex = 0;
             }
-            
-            if ((xTaskGetTickCount() - lastWakeTime) >= pdMS_TO_TICKS(250)) {
-                lastWakeTime = xTaskGetTickCount();
+
+            // Frames are released by the scheduler timer, not by the end of the previous frame
+            FrameScheduler::Release release;
+            if (!scheduler.waitForRelease(release, pdMS_TO_TICKS(IDLE_POLL_MS))) {
+                continue;
+            }
+            // A burst that starts or runs during sampling puts modem tones in the frame
+            uint32_t burstsBefore = audioModem.getBurstCount();
+            bool modemActive = audioModem.isTransmitting();
+            {
+                PowerManager::Lock lock(PowerManager::LockType::CpuMax);
                 audioAnalyzer.sampleInput();
-                audioAnalyzer.computeFft();
-                // audioAnalyzer.printResults();
-                
-                if(audioAnalyzer.isWord()){
-                    consecutiveWords++;
+                if (scheduler.isDegraded()) {
+                    audioAnalyzer.computeBandEnergy();
                 } else {
-                    consecutiveWords = 0;
+                    audioAnalyzer.computeFft();
                 }
+            }
+            // audioAnalyzer.printResults();
 
-                if(consecutiveWords == 2){
-                    count++;
-                    consecutiveWords = 0; // Reset after counting
-                }
-                // Update lastWakeTime after processing
+            modemActive = modemActive || audioModem.isTransmitting() || audioModem.getBurstCount() != burstsBefore;
+
+            bool word = audioAnalyzer.isWord();
+            scheduler.finishJob(release);
+            Instrumentation::recordFrame(audioAnalyzer.getPeakFrequency(), audioAnalyzer.getPeakValue(), word);
+            if (modemActive) {
+                // Neither a word nor silence, the frame is left out of the ratio
+                modemFrames++;
+            } else if(word){
+                consecutiveWords++;
+            } else {
+                consecutiveWords = 0;
+            }
+
+            VadState vad = modemActive ? VadState::Modem : word ? VadState::Speech : VadState::Silence;
+            SessionAnalytics::frame(vad, audioAnalyzer.getPeakValue(), release.skipped);
+
+            if(!modemActive && consecutiveWords == 2){
+                count++;
+                consecutiveWords = 0; // Reset after counting
+            }
+            if (!modemActive) {
                 i += 1;
             }
 
@@ -99,10 +153,13 @@ void TaskHandler::audioAnalyzerTask(void *param)
                 lastLogTime = xTaskGetTickCount();
             }
 
-            if (i >= 240) {
-                int64_t endTime = esp_timer_get_time();
+            // The window closes on the release count, so it always spans FRAMES_PER_WINDOW periods
+            if (release.index + 1 - windowStartIndex >= FRAMES_PER_WINDOW) {
+                uint32_t windowTimeMs = (release.index + 1 - windowStartIndex) * FRAME_PERIOD_MS;
                 float ratio = (i > 0) ? (float)count / i * 2 : 0;
-                ESP_LOGI(TAG, "Analysis cycle complete. Count = %d, Samples = %d, Ratio = %.2f, Time = %lld ms", count, i, ratio, (endTime - startTime) / 1000);
+                ESP_LOGI(TAG, "Analysis cycle complete. Count = %d, Samples = %d, Ratio = %.2f, Time = %lld ms, Modem frames = %lu", count, i, ratio, (long long)windowTimeMs, (unsigned long)modemFrames);
+                SessionJournal::speech(count, i, (uint16_t)modemFrames, windowTimeMs);
+                SessionAnalytics::window(count);
                 
                 // Send count to queue
                 if (queue != NULL) { 
@@ -115,19 +172,42 @@ void TaskHandler::audioAnalyzerTask(void *param)
                     ESP_LOGE(TAG, "Audio_analyzer_task: count_queue handle is NULL.");
                 }
                 
+                windowStartIndex = release.index + 1;
+                modemFrames = 0;
                 i = 0;
                 count = 0;
                 consecutiveWords = 0;
             }
         } else {
             // Reset counters when not recording
+            scheduler.stop();
             i = 0;
             count = 0;
             consecutiveWords = 0;
-            lastWakeTime = xTaskGetTickCount();
+            modemFrames = 0;
             lastLogTime = xTaskGetTickCount();
+            // Listening keeps the chip out of light sleep, so only for a window after a button press
+            uint32_t presses = ButtonBoundary::getPressCount();
+            if (presses != buttonPresses) {
+                buttonPresses = presses;
+                configReceiver.openWindow();
+            }
+            bool listen = configRx && configReceiver.isWindowOpen();
+            if (!listen) {
+                configReceiver.stop();
+            }
+            if (!listen || configReceiver.start() != ESP_OK) {
+                vTaskDelay(pdMS_TO_TICKS(IDLE_POLL_MS));
+                continue;
+            }
+            // Listen for a configuration upload, the read blocks at most one poll interval
+            ConfigPayload config;
+            if (configReceiver.poll(IDLE_POLL_MS, config)) {
+                menuController.applyConfig(config);
+                if ((config.flags & ConfigPayload::FLAG_THRESHOLDS) && menuController.getWordThresholds(thresholds)) {
+                    audioAnalyzer.setWordThresholds(thresholds);
+                }
+            }
         }
-
-        vTaskDelay(pdMS_TO_TICKS(10)); // Yield to other tasks
     }
 }
@@ -4,65 +4,95 @@
 #include "freertos/queue.h"
 #include "esp_log.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "tascamBoundary.hpp"
 
 static const char *TAG = "Unit test aansturing tascam dr40x";
 
+static void onTascamDone(TascamBoundary::RecorderState state, int64_t startLatencyUs, void *) {
+    if (state == TascamBoundary::RecorderState::Recording) {
+        ESP_LOGI(TAG, "Recording started %lld ms after the request", startLatencyUs / 1000);
+    }
+}
+
+/**
+ * @brief Time a call takes to return, the recorder keys are sent by the command task.
+ */
+static int64_t timeCall(TascamBoundary &tascam, void (TascamBoundary::*call)()) {
+    int64_t start = esp_timer_get_time();
+    (tascam.*call)();
+    return esp_timer_get_time() - start;
+}
+
 extern "C" void app_main(void)
 {
     ESP_LOGI(TAG, "Hello from Unit test aansturing tascam dr40x!");
     ESP_LOGI(TAG, "ESP32 chip: %s", esp_get_idf_version());
     ESP_LOGI(TAG, "Free heap: %ld bytes", esp_get_free_heap_size());
-    
+
     // Create UART queue for Tascam communication
     QueueHandle_t uart_queue;
-    
+
     // Initialize TascamBoundary instance
     TascamBoundary tascam(UART_NUM_2, &uart_queue);
-    tascam.initialize();
+    ESP_ERROR_CHECK(tascam.initialize());
+    tascam.setCompletionCallback(onTascamDone);
     ESP_LOGI(TAG, "TascamBoundary initialized");
-    
+
     // Test sequence starts here
     ESP_LOGI(TAG, "ESP32 in start screen - Test sequence beginning");
-    
+
     // Wait 5 seconds, then send standby (idle) signal
     ESP_LOGI(TAG, "Waiting 5 seconds before sending standby signal...");
     vTaskDelay(pdMS_TO_TICKS(5000));
     ESP_LOGI(TAG, "Sending standby signal - Tascam should go to standby mode");
-    tascam.idle();
-    
+    ESP_LOGI(TAG, "idle() returned after %lld us", timeCall(tascam, &TascamBoundary::idle));
+    tascam.waitUntilIdle(portMAX_DELAY);
+
     // Wait another 5 seconds, then send record signal
     ESP_LOGI(TAG, "Waiting 5 seconds before sending record signal...");
     vTaskDelay(pdMS_TO_TICKS(5000));
     ESP_LOGI(TAG, "Sending record signal - Tascam should start recording");
-    tascam.startRecording();
-    
+    ESP_LOGI(TAG, "startRecording() returned after %lld us", timeCall(tascam, &TascamBoundary::startRecording));
+    tascam.waitUntilIdle(portMAX_DELAY);
+
     // Wait another 5 seconds, then send stop signal
     ESP_LOGI(TAG, "Waiting 5 seconds before sending stop signal...");
     vTaskDelay(pdMS_TO_TICKS(5000));
     ESP_LOGI(TAG, "Sending stop signal - Tascam should stop recording");
+    ESP_LOGI(TAG, "stopRecording() returned after %lld us", timeCall(tascam, &TascamBoundary::stopRecording));
+    tascam.waitUntilIdle(portMAX_DELAY);
+
+    // Stop pressed while the start is still in record standby, the second record key must not be sent
+    ESP_LOGI(TAG, "Start followed by a stop after 100 ms - Tascam should end stopped, not recording");
+    tascam.startRecording();
+    vTaskDelay(pdMS_TO_TICKS(100));
     tascam.stopRecording();
-    
+    tascam.waitUntilIdle(portMAX_DELAY);
+    ESP_LOGI(TAG, "Recorder believed %s",
+             tascam.getState() == TascamBoundary::RecorderState::Stopped ? "stopped (PASS)" : "not stopped (FAIL)");
+
     ESP_LOGI(TAG, "Test sequence completed!");
-    
+
     // Keep the program running and repeat the test sequence every 20 seconds
     while(1) {
         ESP_LOGI(TAG, "Waiting 10 seconds before next test cycle...");
         vTaskDelay(pdMS_TO_TICKS(10000));
-        
+
         ESP_LOGI(TAG, "Starting next test cycle");
-        
+
         // Repeat the sequence
         ESP_LOGI(TAG, "Sending standby signal...");
         tascam.idle();
         vTaskDelay(pdMS_TO_TICKS(5000));
-        
+
         ESP_LOGI(TAG, "Sending record signal...");
         tascam.startRecording();
         vTaskDelay(pdMS_TO_TICKS(5000));
-        
+
         ESP_LOGI(TAG, "Sending stop signal...");
         tascam.stopRecording();
+        tascam.waitUntilIdle(portMAX_DELAY);
         ESP_LOGI(TAG, "Test cycle completed!");
     }
 }
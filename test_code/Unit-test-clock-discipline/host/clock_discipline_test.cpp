@@ -0,0 +1,135 @@
+// Host test for ClockDiscipline: a simulated system clock that drifts against
+// an ideal RTC is kept on it from SQW edges (with interrupt jitter, missed
+// edges and late ones) and from polled anchors, and the offset, the step
+// count and the drift estimate are checked.
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <random>
+#include "clockDiscipline.hpp"
+
+/**
+ * System clock running at (1 + drift) of the RTC, corrections applied at once.
+ */
+struct SimulatedClock {
+    double driftPpm;
+    int64_t startUs;
+    int64_t correctionUs = 0;
+
+    int64_t at(int64_t rtcUs) const {
+        return startUs + rtcUs + (int64_t)((double)rtcUs * driftPpm * 1e-6) + correctionUs;
+    }
+
+    void apply(const ClockDiscipline::Correction &correction) {
+        correctionUs += correction.deltaUs;
+    }
+};
+
+static int64_t absolute(int64_t value) {
+    return value < 0 ? -value : value;
+}
+
+static bool testSqwLock() {
+    SimulatedClock clock{40.0, 700000};   // Booted on the whole second, 0.7 s off
+    ClockDiscipline discipline;
+    std::mt19937 random(1);
+    std::uniform_int_distribution<int> jitter(0, 60);
+    std::uniform_int_distribution<int> chance(0, 99);
+
+    const int64_t second = 1000000;
+    clock.apply(discipline.anchor(1 * second, clock.at(1 * second)));
+    int64_t worst = 0;
+    uint32_t late = 0;
+    for (int64_t s = 2; s <= 7200; s++) {
+        int roll = chance(random);
+        if (roll < 5) {
+            continue;   // Missed in light sleep
+        }
+        int64_t edgeUs = clock.at(s * second) + jitter(random);
+        if (roll == 5) {
+            edgeUs += 30000;   // Seen late, after a wake up
+            late++;
+        }
+        clock.apply(discipline.edge(edgeUs));
+        // Once the drift is measured the clock stays within the drift of one slew interval
+        if (s > 120) {
+            worst = std::max(worst, absolute(clock.at(s * second) - s * second));
+        }
+    }
+    const ClockDiscipline::Stats &stats = discipline.getStats();
+    bool ok = stats.steps == 1 && worst < 1000 && stats.rejected == late && !discipline.needsAnchor() &&
+              stats.driftPpm > 38.0f && stats.driftPpm < 42.0f && stats.slews > 400;
+    printf("sqw lock: worst %lld us, %u rejected of %u late, drift %.2f ppm, %u slews: %s\n", (long long)worst,
+           (unsigned)stats.rejected, (unsigned)late, stats.driftPpm, (unsigned)stats.slews, ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+static bool testPolledAnchors() {
+    SimulatedClock clock{-25.0, 300000};
+    ClockDiscipline discipline;
+    std::mt19937 random(2);
+    std::uniform_int_distribution<int> pollError(-5000, 5000);   // 10 ms between reads
+
+    const int64_t interval = 600 * 1000000LL;
+    int64_t worst = 0;
+    for (int64_t t = interval; t <= 24 * 3600 * 1000000LL; t += interval) {
+        if (t > interval) {
+            // Just before the anchor, after running free for the interval
+            worst = std::max(worst, absolute(clock.at(t) - t));
+        }
+        clock.apply(discipline.anchor(t, clock.at(t) + pollError(random)));
+    }
+    const ClockDiscipline::Stats &stats = discipline.getStats();
+    bool ok = stats.steps == 1 && worst < 25000 && stats.driftPpm > -26.0f && stats.driftPpm < -24.0f;
+    printf("polled anchors: worst %lld us, drift %.2f ppm: %s\n", (long long)worst, stats.driftPpm,
+           ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+static bool testRelock() {
+    SimulatedClock clock{10.0, 0};
+    ClockDiscipline discipline;
+    const int64_t second = 1000000;
+    clock.apply(discipline.anchor(second, clock.at(second)));
+    for (int64_t s = 2; s < 60; s++) {
+        clock.apply(discipline.edge(clock.at(s * second)));
+    }
+    bool ok = !discipline.needsAnchor();
+
+    // Something else moved the system clock, the edges no longer fall on whole seconds
+    clock.correctionUs += 300000;
+    for (int64_t s = 60; s < 63; s++) {
+        clock.apply(discipline.edge(clock.at(s * second)));
+    }
+    ok = ok && discipline.needsAnchor() && discipline.getStats().rejected == 3;
+    clock.apply(discipline.anchor(63 * second, clock.at(63 * second)));
+    ok = ok && discipline.getStats().steps == 2 && absolute(clock.at(64 * second) - 64 * second) < 100;
+
+    discipline.reset();
+    ok = ok && discipline.needsAnchor() && discipline.getStats().anchors == 0;
+    printf("relock: %s\n", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+static bool testCancelledSlew() {
+    ClockDiscipline discipline;
+    discipline.anchor(0, 50000);             // Step -50 ms
+    auto slew = discipline.anchor(1000000, 1000000 + 2000);
+    // Half of the slew was still pending when the next one replaced it
+    discipline.cancelled(slew.deltaUs / 2);
+    auto next = discipline.anchor(2000000, 2000000 + 1000);
+    bool ok = slew.kind == ClockDiscipline::Correction::Kind::Slew && slew.deltaUs == -2000 &&
+              next.kind == ClockDiscipline::Correction::Kind::Slew && next.deltaUs == -1000;
+    printf("cancelled slew: %s\n", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+int main() {
+    bool ok = testSqwLock();
+    ok = testPolledAnchors() && ok;
+    ok = testRelock() && ok;
+    ok = testCancelledSlew() && ok;
+    printf("%s\n", ok ? "ALL PASSED" : "FAILED");
+    return ok ? 0 : 1;
+}
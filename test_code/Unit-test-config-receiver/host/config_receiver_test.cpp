@@ -0,0 +1,264 @@
+// Loopback test of the configuration upload: packets signed like the host
+// encoder signs them go through a speaker-to-microphone channel into 12-bit
+// ADC samples at 20 kHz, and are fed to the streaming receiver in DMA sized
+// chunks, the way ConfigReceiver does on the device.
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "configPacket.hpp"
+#include "modemReceiver.hpp"
+
+static constexpr uint32_t RATE = ConfigLink::SAMPLE_RATE;
+static constexpr size_t CHUNK = 256;           // Samples per ADC DMA frame
+static constexpr float AMPLITUDE = 0.2f;       // Tone peak at the ADC, of full scale
+static constexpr float DRIFT_PPM = 300.0f;     // Laptop sound card against the ESP32 ADC clock
+static constexpr float DC_OFFSET = 0.1f;       // Microphone bias not at mid scale
+
+static const uint8_t KEY[ConfigLink::KEY_SIZE] = {
+    0x3a, 0x91, 0x0c, 0x5e, 0x77, 0x12, 0xf4, 0x08, 0x6d, 0xb2, 0x49, 0xe1, 0x30, 0x8f, 0x5a, 0xc6,
+    0x21, 0x7b, 0x94, 0x0e, 0xd3, 0x66, 0x18, 0xaf, 0x42, 0xc9, 0x05, 0x7e, 0xb8, 0x53, 0xea, 0x1d,
+};
+
+static bool hexEquals(const uint8_t *bytes, size_t size, const char *hex) {
+    char text[2 * Sha256::DIGEST_SIZE + 1];
+    for (size_t i = 0; i < size; i++) {
+        snprintf(text + 2 * i, 3, "%02x", bytes[i]);
+    }
+    return strcmp(text, hex) == 0;
+}
+
+/**
+ * @brief SHA-256 and HMAC-SHA256 against published test vectors.
+ */
+static bool testVectors() {
+    uint8_t digest[Sha256::DIGEST_SIZE];
+    Sha256 hash;
+    hash.update((const uint8_t *)"abc", 3);
+    hash.finish(digest);
+    bool ok = hexEquals(digest, sizeof(digest), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+    // Two blocks after padding
+    const char *twoBlocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    hash.reset();
+    hash.update((const uint8_t *)twoBlocks, strlen(twoBlocks));
+    hash.finish(digest);
+    ok = ok && hexEquals(digest, sizeof(digest), "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+
+    // RFC 4231 test case 2
+    const char *data = "what do ya want for nothing?";
+    hmacSha256((const uint8_t *)"Jefe", 4, (const uint8_t *)data, strlen(data), digest);
+    ok = ok && hexEquals(digest, sizeof(digest), "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843");
+
+    uint8_t key[ConfigLink::KEY_SIZE];
+    ok = ok && parseConfigKey("3a910c5e7712f4086db249e1308f5ac6217b940ed36618af42c9057eb853ea1d", key) &&
+         memcmp(key, KEY, sizeof(key)) == 0 && !parseConfigKey("3a91", key) && !parseConfigKey(nullptr, key);
+    printf("SHA-256, HMAC-SHA256 and key parsing: %s\n", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+static ConfigPayload makeConfig(uint32_t counter) {
+    ConfigPayload config = {};
+    config.counter = counter;
+    config.flags = ConfigPayload::FLAG_CLOCK | ConfigPayload::FLAG_THRESHOLDS | ConfigPayload::FLAG_SESSION;
+    config.year = 126;
+    config.month = 9;
+    config.day = 18;
+    config.hour = 14;
+    config.minute = 5;
+    config.second = 30;
+    config.wordLevelDb = -42;
+    config.wordLowHz = 250;
+    config.wordHighHz = 3400;
+    config.sessionId = 77;
+    config.beaconIntervalS = 30;
+    config.sign(KEY);
+    return config;
+}
+
+/**
+ * @brief Add a frame as it arrives at the microphone after a lead-in.
+ *
+ * The laptop clock runs DRIFT_PPM fast, the speaker is 3 dB louder at the
+ * highest tone than at the lowest, and the room adds an echo 3 ms later.
+ */
+static void addBurst(std::vector<float> &signal, size_t leadIn, const uint8_t *frame, size_t length) {
+    MfskTonePlan plan(ConfigLink::LOW_FREQ, ConfigLink::HIGH_FREQ, ConfigLink::BITS_PER_SYMBOL);
+    MfskSymbolPacker packer(plan.getBitsPerSymbol());
+    size_t symbols = plan.symbolCount(length);
+    double clock = 1.0 + DRIFT_PPM * 1e-6;
+    size_t burst = (size_t)(symbols * ConfigLink::SYMBOL_US * 1e-6 / clock * RATE);
+    signal.resize(std::max(signal.size(), leadIn + burst + RATE), 0.0f);
+
+    std::vector<uint8_t> values(symbols);
+    for (size_t s = 0, next = 0; s < symbols; s++) {
+        while (packer.needsByte() && next < length) {
+            packer.push(frame[next++]);
+        }
+        values[s] = packer.pop();
+    }
+
+    std::vector<float> tones(burst, 0.0f);
+    double phase = 0.0;
+    for (size_t n = 0; n < burst; n++) {
+        size_t s = (size_t)((double)n / RATE * clock * 1e6 / ConfigLink::SYMBOL_US);
+        if (s >= symbols) {
+            break;
+        }
+        float gain = AMPLITUDE * powf(10.0f, 3.0f * values[s] / (plan.getToneCount() - 1) / 20.0f);
+        tones[n] = gain * (float)sin(phase);
+        phase = fmod(phase + 2.0 * M_PI * plan.toneFrequency(values[s]) * clock / RATE, 2.0 * M_PI);
+    }
+    size_t echo = RATE * 3 / 1000;
+    for (size_t n = 0; n < burst; n++) {
+        signal[leadIn + n] += tones[n] + (n >= echo ? 0.3f * tones[n - echo] : 0.0f);
+    }
+}
+
+/**
+ * @brief Noise, 12-bit quantisation and the DC removal of ConfigReceiver, then the receiver in DMA chunks.
+ * @return Packets received, in order.
+ */
+static std::vector<ModemPacket::Decoded> receive(const std::vector<float> &signal, float noiseRms, std::mt19937 &rng,
+                                                 double *nsPerSample = nullptr) {
+    ModemCodec codec(RATE, ConfigLink::SYMBOL_US, ConfigLink::BITS_PER_SYMBOL, ConfigLink::LOW_FREQ,
+                     ConfigLink::HIGH_FREQ);
+    std::vector<float> buffer(ModemReceiver::bufferSamples(codec));
+    ModemReceiver receiver(codec, buffer.data(), buffer.size(), ConfigPayload::SIZE);
+
+    std::normal_distribution<float> noise(0.0f, noiseRms);
+    std::vector<float> raw(signal.size());
+    for (size_t n = 0; n < signal.size(); n++) {
+        float x = signal[n] + DC_OFFSET + noise(rng);
+        raw[n] = (float)std::min(4095L, std::max(0L, lrintf((x + 1.0f) * 2048.0f)));
+    }
+
+    std::vector<ModemPacket::Decoded> packets;
+    float dc = raw.empty() ? 0.0f : raw[0] / 2048.0f - 1.0f;
+    double seconds = 0.0;
+    for (size_t first = 0; first < raw.size(); first += CHUNK) {
+        float chunk[CHUNK];
+        size_t count = std::min(CHUNK, raw.size() - first);
+        for (size_t i = 0; i < count; i++) {
+            float x = raw[first + i] / 2048.0f - 1.0f;
+            dc += (x - dc) * (1.0f / 1024.0f);
+            chunk[i] = x - dc;
+        }
+        auto begin = std::chrono::steady_clock::now();
+        bool ready = receiver.push(chunk, count);
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        ModemPacket::Decoded packet;
+        if (ready && receiver.takePacket(packet)) {
+            packets.push_back(packet);
+        }
+    }
+    if (nsPerSample != nullptr) {
+        *nsPerSample = seconds * 1e9 / raw.size();
+    }
+    return packets;
+}
+
+/**
+ * @brief Two uploads in one stream are received, authenticated and applied once each.
+ */
+static bool testLoopback(float snrDb, std::mt19937 &rng) {
+    ConfigPayload first = makeConfig(1000), second = makeConfig(1001);
+    second.sessionId = 78;
+    second.sign(KEY);
+    uint8_t frames[2][ModemPacket::encodedSize(ConfigPayload::SIZE)];
+    size_t length = first.encode(frames[0], sizeof(frames[0]));
+    second.encode(frames[1], sizeof(frames[1]));
+
+    // The host tool plays every packet twice, the repeat must be refused as a replay
+    std::vector<float> signal;
+    size_t position = RATE * 13 / 10;
+    for (int i = 0; i < 4; i++) {
+        addBurst(signal, position, frames[i / 2], length);
+        position += (size_t)(length * 8 / ConfigLink::BITS_PER_SYMBOL * ConfigLink::SYMBOL_US * 1e-6 * RATE) + RATE / 2;
+    }
+    float noiseRms = AMPLITUDE / sqrtf(2.0f) * powf(10.0f, -snrDb / 20.0f);
+    std::vector<ModemPacket::Decoded> packets = receive(signal, noiseRms, rng);
+
+    ConfigAuthenticator authenticator(KEY, 999);
+    int accepted = 0, replayed = 0;
+    bool ok = packets.size() == 4;
+    for (const ModemPacket::Decoded &packet : packets) {
+        ConfigPayload config;
+        ConfigAuthenticator::Result result = authenticator.check(packet, config);
+        if (result == ConfigAuthenticator::Result::Accepted) {
+            uint8_t expected[ConfigPayload::SIZE], received[ConfigPayload::SIZE];
+            (accepted == 0 ? first : second).serialize(expected);
+            config.serialize(received);
+            ok = ok && memcmp(expected, received, sizeof(expected)) == 0;
+            accepted++;
+        } else if (result == ConfigAuthenticator::Result::Replayed) {
+            replayed++;
+        }
+    }
+    ok = ok && accepted == 2 && replayed == 2 && authenticator.getLastCounter() == 1001;
+    printf("%5.1f dB SNR: %zu packets, %d accepted, %d refused as replay: %s\n", snrDb, packets.size(), accepted,
+           replayed, ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+/**
+ * @brief Changed, foreign and old packets are refused.
+ */
+static bool testRejects() {
+    ModemPacket::Decoded packet = {};
+    ConfigPayload config = makeConfig(5);
+    uint8_t payload[ConfigPayload::SIZE];
+    config.serialize(payload);
+    packet.type = ModemPacket::Type::Config;
+    packet.length = sizeof(payload);
+    memcpy(packet.payload, payload, sizeof(payload));
+
+    ConfigPayload out;
+    ConfigAuthenticator authenticator(KEY, 4);
+    bool ok = true;
+    for (size_t i = 0; i < ConfigPayload::SIZE; i++) {
+        packet.payload[i] ^= 0x01;
+        ok = ok && authenticator.check(packet, out) == ConfigAuthenticator::Result::BadMac;
+        packet.payload[i] ^= 0x01;
+    }
+    uint8_t otherKey[ConfigLink::KEY_SIZE];
+    memcpy(otherKey, KEY, sizeof(otherKey));
+    otherKey[31] ^= 0x80;
+    ConfigAuthenticator stranger(otherKey, 0);
+    ok = ok && stranger.check(packet, out) == ConfigAuthenticator::Result::BadMac;
+
+    packet.type = ModemPacket::Type::Beacon;
+    ok = ok && authenticator.check(packet, out) == ConfigAuthenticator::Result::NotConfig;
+    packet.type = ModemPacket::Type::Config;
+    ok = ok && authenticator.check(packet, out) == ConfigAuthenticator::Result::Accepted;
+    ok = ok && authenticator.check(packet, out) == ConfigAuthenticator::Result::Replayed;
+    printf("refuses changed bytes, another key, another type and a replay: %s\n", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+/**
+ * @brief Noise alone gives no packet, and listening costs little.
+ */
+static bool testIdle(std::mt19937 &rng) {
+    std::vector<float> silence(RATE * 30, 0.0f);
+    double ns = 0.0;
+    bool ok = receive(silence, AMPLITUDE / 10, rng, &ns).empty();
+    printf("30 s of noise: no packet, %.1f ns per sample while listening: %s\n", ns, ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+int main() {
+    std::mt19937 rng(40);
+    bool ok = testVectors();
+    for (float snrDb : {30.0f, 10.0f, 3.0f}) {
+        ok = testLoopback(snrDb, rng) && ok;
+    }
+    ok = testRejects() && ok;
+    ok = testIdle(rng) && ok;
+    printf("%s\n", ok ? "ALL PASSED" : "FAILED");
+    return ok ? 0 : 1;
+}
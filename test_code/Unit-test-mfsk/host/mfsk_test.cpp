@@ -0,0 +1,403 @@
+// Host test and benchmark for the M-ary FSK modem: every mode is synthesised
+// into a 48 kHz WAV file, read back and demodulated, and the symbol error
+// rate is measured against the signal-to-noise ratio.
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <random>
+#include <vector>
+#include "modemCodec.hpp"
+
+static constexpr uint32_t SAMPLE_RATE = 48000;
+static constexpr uint32_t LOW_FREQ = ModemCodec::LOW_FREQ;
+static constexpr uint32_t HIGH_FREQ = ModemCodec::HIGH_FREQ;
+static constexpr uint32_t SYMBOL_US = ModemCodec::DEFAULT_SYMBOL_US;
+static constexpr float AMPLITUDE = 0.5f;
+
+static void writeLe(FILE *file, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        fputc((value >> (8 * i)) & 0xFF, file);
+    }
+}
+
+/**
+ * @brief Write mono 16-bit PCM, the format the Tascam files are converted to.
+ */
+static bool writeWav(const char *path, const std::vector<float> &samples) {
+    FILE *file = fopen(path, "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    uint32_t dataBytes = (uint32_t)samples.size() * 2;
+    fwrite("RIFF", 1, 4, file);
+    writeLe(file, 36 + dataBytes, 4);
+    fwrite("WAVEfmt ", 1, 8, file);
+    writeLe(file, 16, 4);
+    writeLe(file, 1, 2);                // PCM
+    writeLe(file, 1, 2);                // Mono
+    writeLe(file, SAMPLE_RATE, 4);
+    writeLe(file, SAMPLE_RATE * 2, 4);
+    writeLe(file, 2, 2);
+    writeLe(file, 16, 2);
+    fwrite("data", 1, 4, file);
+    writeLe(file, dataBytes, 4);
+    for (float sample : samples) {
+        float clipped = sample > 1.0f ? 1.0f : (sample < -1.0f ? -1.0f : sample);
+        writeLe(file, (uint16_t)(int16_t)lrintf(clipped * 32767.0f), 2);
+    }
+    return fclose(file) == 0;
+}
+
+/**
+ * @brief Read the file written by writeWav(), chunks other than fmt and data are skipped.
+ */
+static bool readWav(const char *path, std::vector<float> &samples, uint32_t &sampleRate) {
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    uint8_t header[12];
+    bool ok = fread(header, 1, 12, file) == 12 && memcmp(header, "RIFF", 4) == 0 && memcmp(header + 8, "WAVE", 4) == 0;
+    uint8_t chunk[8];
+    while (ok && fread(chunk, 1, 8, file) == 8) {
+        uint32_t size = chunk[4] | chunk[5] << 8 | chunk[6] << 16 | (uint32_t)chunk[7] << 24;
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            uint8_t format[16];
+            ok = size >= 16 && fread(format, 1, 16, file) == 16 && format[0] == 1 && format[2] == 1 && format[14] == 16;
+            sampleRate = format[4] | format[5] << 8 | format[6] << 16 | (uint32_t)format[7] << 24;
+            fseek(file, size - 16, SEEK_CUR);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            samples.resize(size / 2);
+            for (float &sample : samples) {
+                uint8_t bytes[2];
+                ok = ok && fread(bytes, 1, 2, file) == 2;
+                sample = (int16_t)(bytes[0] | bytes[1] << 8) / 32768.0f;
+            }
+            break;
+        } else {
+            fseek(file, size, SEEK_CUR);
+        }
+    }
+    fclose(file);
+    return ok && !samples.empty();
+}
+
+static void addNoise(std::vector<float> &samples, float sigma, std::mt19937 &rng) {
+    std::normal_distribution<float> noise(0.0f, sigma);
+    for (float &sample : samples) {
+        sample += noise(rng);
+    }
+}
+
+/**
+ * @brief Send a ModemPacket through a WAV file in every mode, with silence before and after.
+ */
+static bool testWavRoundTrip() {
+    bool ok = true;
+    std::mt19937 rng(1);
+    uint8_t payload[SessionMetadata::SIZE] = {0x01, 0x02, 7, 9, 3, 4, 125, 1, '4', '2'};
+    uint8_t packet[ModemPacket::encodedSize(SessionMetadata::SIZE)];
+    size_t packetSize = ModemPacket::encode(ModemPacket::Type::SessionMetadata, payload, sizeof(payload), packet,
+                                            sizeof(packet));
+
+    for (uint8_t bitsPerSymbol = 1; bitsPerSymbol <= 4; bitsPerSymbol++) {
+        MfskTonePlan plan(LOW_FREQ, HIGH_FREQ, bitsPerSymbol);
+        MfskModulator modulator(plan, SAMPLE_RATE, SYMBOL_US);
+        size_t lead = SAMPLE_RATE / 10 + rng() % 500;
+        std::vector<float> samples(lead + modulator.sampleCount(packetSize) + SAMPLE_RATE / 10, 0.0f);
+        modulator.modulate(packet, packetSize, AMPLITUDE, samples.data() + lead);
+        addNoise(samples, 0.01f, rng);
+
+        char path[64];
+        snprintf(path, sizeof(path), "mfsk_%u_tones.wav", (unsigned)plan.getToneCount());
+        std::vector<float> recording;
+        uint32_t sampleRate = 0;
+        bool fileOk = writeWav(path, samples) && readWav(path, recording, sampleRate) && sampleRate == SAMPLE_RATE;
+
+        MfskDemodulator demodulator(plan, sampleRate, SYMBOL_US);
+        size_t start = demodulator.detectStart(recording.data(), recording.size(), AMPLITUDE * AMPLITUDE / 8);
+        uint8_t received[sizeof(packet)];
+        size_t got = demodulator.demodulate(recording.data(), recording.size(), start, received, packetSize);
+        ModemPacket::Decoded decoded;
+        bool packetOk = got == packetSize &&
+                        ModemPacket::decode(received, got * 8, decoded) == ModemPacket::Status::Ok &&
+                        decoded.length == sizeof(payload) && memcmp(decoded.payload, payload, sizeof(payload)) == 0;
+
+        printf("%2u tones: WAV %s, start %zd samples off, packet %s, burst %.2f s\n", (unsigned)plan.getToneCount(),
+               fileOk ? "ok" : "FAIL", (ssize_t)start - (ssize_t)lead, packetOk ? "PASS" : "FAIL",
+               plan.symbolCount(packetSize) * SYMBOL_US / 1e6);
+        ok = ok && fileOk && packetOk;
+        remove(path);
+    }
+    return ok;
+}
+
+static bool testPacker() {
+    bool ok = true;
+    const uint8_t data[3] = {0xA5, 0x3C, 0x81};
+    for (uint8_t bitsPerSymbol = 1; bitsPerSymbol <= 4; bitsPerSymbol++) {
+        MfskTonePlan plan(LOW_FREQ, HIGH_FREQ, bitsPerSymbol);
+        MfskSymbolPacker packer(bitsPerSymbol);
+        uint32_t unpacked = 0;
+        size_t next = 0, symbols = 0, shift = 0;
+        while (true) {
+            while (packer.needsByte() && next < sizeof(data)) {
+                packer.push(data[next++]);
+            }
+            if (packer.empty()) {
+                break;
+            }
+            unpacked |= (uint32_t)packer.pop() << shift;
+            shift += bitsPerSymbol;
+            symbols++;
+        }
+        ok = ok && symbols == plan.symbolCount(sizeof(data)) && (unpacked & 0xFFFFFF) == 0x813CA5 &&
+             (unpacked >> 24) == 0;
+    }
+    MfskTonePlan binary(LOW_FREQ, HIGH_FREQ, 1);
+    ok = ok && binary.toneFrequency(0) == LOW_FREQ && binary.toneFrequency(1) == HIGH_FREQ;
+    printf("symbol packing: %s\n", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+/**
+ * @brief Symbol error rate against SNR for every mode, SNR is signal power over noise power in the full band.
+ */
+static bool benchmarkSymbolErrorRate() {
+    constexpr size_t SYMBOLS = 2000;
+    static const float SNR_DB[] = {-20, -15, -12, -9, -6, -3, 0, 5};
+    std::mt19937 rng(2);
+    bool ok = true;
+
+    printf("symbol error rate, %u us symbols at %u Hz:\n%8s", (unsigned)SYMBOL_US, (unsigned)SAMPLE_RATE, "SNR dB");
+    for (float snr : SNR_DB) {
+        printf("%9.0f", snr);
+    }
+    printf("%12s\n", "bit/s");
+
+    for (uint8_t bitsPerSymbol = 1; bitsPerSymbol <= 4; bitsPerSymbol++) {
+        MfskTonePlan plan(LOW_FREQ, HIGH_FREQ, bitsPerSymbol);
+        MfskModulator modulator(plan, SAMPLE_RATE, SYMBOL_US);
+        MfskDemodulator demodulator(plan, SAMPLE_RATE, SYMBOL_US);
+        size_t bytes = SYMBOLS * bitsPerSymbol / 8;
+        std::vector<uint8_t> data(bytes);
+        for (uint8_t &byte : data) {
+            byte = (uint8_t)rng();
+        }
+        std::vector<float> clean(modulator.sampleCount(bytes), 0.0f);
+        modulator.modulate(data.data(), bytes, AMPLITUDE, clean.data());
+
+        printf("%5u-FSK", (unsigned)plan.getToneCount());
+        for (float snr : SNR_DB) {
+            float sigma = sqrtf(AMPLITUDE * AMPLITUDE / 2 / powf(10.0f, snr / 10.0f));
+            std::vector<float> noisy = clean;
+            addNoise(noisy, sigma, rng);
+            std::vector<uint8_t> received(bytes);
+            demodulator.demodulate(noisy.data(), noisy.size(), 0, received.data(), bytes);
+
+            // Compare symbol by symbol
+            MfskSymbolPacker sent(bitsPerSymbol), got(bitsPerSymbol);
+            size_t errors = 0, symbols = plan.symbolCount(bytes);
+            for (size_t s = 0, next = 0; s < symbols; s++) {
+                while (sent.needsByte() && next < bytes) {
+                    sent.push(data[next]);
+                    got.push(received[next++]);
+                }
+                errors += sent.pop() != got.pop();
+            }
+            float ser = (float)errors / symbols;
+            printf("%9.4f", ser);
+            if (snr >= 0 && ser > 0.001f) {
+                ok = false;
+            }
+        }
+        printf("%12.0f\n", bitsPerSymbol * 1e6 / SYMBOL_US);
+    }
+    printf("symbol error rate at 0 dB and up: %s\n", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+static constexpr uint32_t ANALOG_RATE = 1536000;     // 32 times the recorder rate
+static constexpr uint32_t DAC_RATE = 192000;         // DacToneGenerator::DEFAULT_SAMPLE_RATE
+
+/**
+ * @brief Symbol values of a byte sequence.
+ */
+static std::vector<uint8_t> toSymbols(const MfskTonePlan &plan, const std::vector<uint8_t> &data) {
+    std::vector<uint8_t> symbols;
+    MfskSymbolPacker packer(plan.getBitsPerSymbol());
+    size_t next = 0;
+    while (true) {
+        while (packer.needsByte() && next < data.size()) {
+            packer.push(data[next++]);
+        }
+        if (packer.empty()) {
+            return symbols;
+        }
+        symbols.push_back(packer.pop());
+    }
+}
+
+/**
+ * @brief LEDC output: a 50% square wave whose new frequency takes effect at the next period.
+ *
+ * Every analog sample is the exact average of the square wave over its interval.
+ */
+static std::vector<float> renderPwm(const MfskTonePlan &plan, const std::vector<uint8_t> &symbols, uint32_t symbolUs) {
+    size_t perSymbol = (size_t)((uint64_t)symbolUs * ANALOG_RATE / 1000000);
+    std::vector<float> out(symbols.size() * perSymbol);
+    // Integral of the square wave over one period, from 0 to a fraction of it
+    auto integral = [](double cycles) {
+        double fraction = cycles - floor(cycles);
+        return fraction < 0.5 ? fraction : 1.0 - fraction;
+    };
+    double phase = 0.0;
+    double frequency = plan.toneFrequency(symbols[0]);
+    double pending = frequency;
+    for (size_t i = 0; i < out.size(); i++) {
+        if (i % perSymbol == 0) {
+            pending = plan.toneFrequency(symbols[i / perSymbol]);
+        }
+        double next = phase + frequency / ANALOG_RATE;
+        if (pending != frequency && floor(next) != floor(phase)) {
+            // Period boundary inside this sample, continue with the new frequency after it
+            double rest = 1.0 - (floor(next) - phase) / (next - phase);
+            frequency = pending;
+            next = floor(next) + rest * frequency / ANALOG_RATE;
+        }
+        out[i] = (float)(2.0 * (integral(next) - integral(phase)) / (next - phase + 1e-30)) * 0.5f;
+        phase = next;
+    }
+    return out;
+}
+
+/**
+ * @brief DAC output: the NCO of DacToneGenerator at 8 bits, held for one DAC sample.
+ */
+static std::vector<float> renderDac(const MfskTonePlan &plan, const std::vector<uint8_t> &symbols, uint32_t symbolUs) {
+    size_t perSymbol = (size_t)((uint64_t)symbolUs * ANALOG_RATE / 1000000);
+    std::vector<float> out(symbols.size() * perSymbol);
+    uint32_t phase = 0;
+    uint8_t value = 128;
+    for (size_t i = 0; i < out.size(); i++) {
+        if (i % (ANALOG_RATE / DAC_RATE) == 0) {
+            uint32_t step = (uint32_t)llround(plan.toneFrequency(symbols[i / perSymbol]) * 4294967296.0 / DAC_RATE);
+            value = (uint8_t)(128 + lroundf(100.0f * sinf(2.0f * (float)M_PI * (phase >> 24) / 256.0f)));
+            phase += step;
+        }
+        out[i] = (value - 128) / 256.0f;
+    }
+    return out;
+}
+
+/**
+ * @brief Recorder front end: windowed-sinc anti-alias filter, then decimation to SAMPLE_RATE.
+ * @param taps Filter length, a short filter lets harmonics alias into the audio band.
+ */
+static std::vector<float> record(const std::vector<float> &analog, size_t taps) {
+    const double cutoff = 23500.0 / ANALOG_RATE;
+    std::vector<float> h(taps);
+    double sum = 0.0;
+    for (size_t n = 0; n < taps; n++) {
+        double m = n - (taps - 1) / 2.0;
+        double sinc = m == 0 ? 2 * cutoff : sin(2 * M_PI * cutoff * m) / (M_PI * m);
+        double window = 0.42 - 0.5 * cos(2 * M_PI * n / (taps - 1)) + 0.08 * cos(4 * M_PI * n / (taps - 1));
+        h[n] = (float)(sinc * window);
+        sum += h[n];
+    }
+    // Output sample k is centred on analog sample k * factor, which removes the filter delay
+    size_t factor = ANALOG_RATE / SAMPLE_RATE;
+    size_t half = (taps - 1) / 2;
+    std::vector<float> out(analog.size() / factor);
+    for (size_t k = 0; k < out.size(); k++) {
+        float acc = 0.0f;
+        for (size_t n = 0; n < taps; n++) {
+            size_t i = k * factor + half - n;
+            if (i < analog.size()) {
+                acc += h[n] * analog[i];
+            }
+        }
+        out[k] = (float)(acc / sum);
+    }
+    return out;
+}
+
+/**
+ * @brief Average per-symbol SNR at the recorder, and the symbol error rate with noise added.
+ */
+static void measureBackend(const MfskTonePlan &plan, const std::vector<uint8_t> &symbols,
+                           const std::vector<float> &recording, uint32_t symbolUs, float noiseSigma, std::mt19937 &rng,
+                           double &snrDb, double &ser) {
+    MfskDemodulator demodulator(plan, SAMPLE_RATE, symbolUs);
+    std::vector<float> noisy = recording;
+    addNoise(noisy, noiseSigma, rng);
+    double snrSum = 0.0;
+    size_t errors = 0, measured = 0;
+    for (size_t s = 1; s + 1 < symbols.size(); s++) {
+        size_t begin = (size_t)((uint64_t)s * symbolUs * SAMPLE_RATE / 1000000);
+        size_t end = (size_t)((uint64_t)(s + 1) * symbolUs * SAMPLE_RATE / 1000000);
+        size_t guard = (end - begin) / 8;
+        if (end > recording.size()) {
+            break;
+        }
+        snrSum += 10.0 * log10(demodulator.toneSnr(recording.data() + begin + guard, end - begin - 2 * guard, symbols[s]));
+        errors += demodulator.detectSymbol(noisy.data() + begin + guard, end - begin - 2 * guard) != symbols[s];
+        measured++;
+    }
+    snrDb = snrSum / measured;
+    ser = (double)errors / measured;
+}
+
+/**
+ * @brief Compare the PWM square wave and the DAC sine behind a sharp and a weak recorder filter.
+ *
+ * The SNR column is the tone against everything else the recorder picks up
+ * in 0-24 kHz without added noise, so it shows harmonics that alias into the
+ * band and the tone switching transients. The SER column adds noise at
+ * -12 dB of the tone.
+ */
+static bool benchmarkOutputBackends() {
+    static const uint32_t SYMBOL_US_LIST[] = {20000, 5000, 2000};
+    std::mt19937 rng(5);
+    MfskTonePlan plan(LOW_FREQ, HIGH_FREQ, 2);
+    std::vector<uint8_t> data(24);
+    for (uint8_t &byte : data) {
+        byte = (uint8_t)rng();
+    }
+    std::vector<uint8_t> symbols = toSymbols(plan, data);
+    bool ok = true;
+
+    printf("4-FSK output back ends at the recorder (SNR without noise, SER with noise at -12 dB):\n");
+    printf("%9s %-6s %14s %9s %14s %9s\n", "symbol", "output", "sharp SNR dB", "SER", "weak SNR dB", "SER");
+    for (uint32_t symbolUs : SYMBOL_US_LIST) {
+        for (int backend = 0; backend < 2; backend++) {
+            std::vector<float> analog = backend == 0 ? renderPwm(plan, symbols, symbolUs) : renderDac(plan, symbols, symbolUs);
+            double snr[2], ser[2];
+            for (int filter = 0; filter < 2; filter++) {
+                std::vector<float> recording = record(analog, filter == 0 ? 1023 : 63);
+                // Noise relative to the tone power measured on this recording
+                double power = 0.0;
+                for (float sample : recording) {
+                    power += sample * sample;
+                }
+                float sigma = (float)sqrt(power / recording.size() * pow(10.0, 12.0 / 10.0));
+                std::mt19937 noiseRng(6);
+                measureBackend(plan, symbols, recording, symbolUs, sigma, noiseRng,
+                               snr[filter], ser[filter]);
+            }
+            printf("%7.1fms %-6s %14.1f %9.4f %14.1f %9.4f\n", symbolUs / 1000.0, backend == 0 ? "PWM" : "DAC", snr[0],
+                   ser[0], snr[1], ser[1]);
+        }
+    }
+    return ok;
+}
+
+int main() {
+    bool ok = testPacker();
+    ok = testWavRoundTrip() && ok;
+    ok = benchmarkSymbolErrorRate() && ok;
+    ok = benchmarkOutputBackends() && ok;
+    printf("%s\n", ok ? "ALL PASSED" : "FAILED");
+    return ok ? 0 : 1;
+}
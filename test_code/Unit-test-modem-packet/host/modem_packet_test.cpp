@@ -0,0 +1,288 @@
+// Host test and benchmark for ModemPacket: round trips, FEC correction of
+// single bits and bursts, and the residual error rate of the packet format
+// and of the old "1, 2, 3" frame over simulated noisy channels.
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include "modemPacket.hpp"
+
+static constexpr size_t PACKET_SIZE = ModemPacket::encodedSize(SessionMetadata::SIZE);
+static constexpr size_t LEAD_IN_BITS = 37;            // Noise before the packet, not byte aligned
+static constexpr size_t STREAM_BYTES = 64;
+static constexpr size_t LEGACY_SIZE = 11;
+static constexpr int TRIALS = 20000;
+
+static bool getBit(const uint8_t *data, size_t index) {
+    return (data[index >> 3] >> (index & 7)) & 1;
+}
+
+static void putBit(uint8_t *data, size_t index, bool value) {
+    if (value) {
+        data[index >> 3] |= (uint8_t)(1 << (index & 7));
+    } else {
+        data[index >> 3] &= (uint8_t)~(1 << (index & 7));
+    }
+}
+
+static SessionMetadata randomMetadata(std::mt19937 &rng) {
+    SessionMetadata m = {};
+    m.sessionId = (uint16_t)rng();
+    m.minute = rng() % 60;
+    m.hour = rng() % 24;
+    m.day = 1 + rng() % 31;
+    m.month = rng() % 12;
+    m.year = 125;
+    m.flags = SessionMetadata::FLAG_PATIENT;
+    m.patient[0] = '0' + rng() % 10;
+    m.patient[1] = '0' + rng() % 10;
+    return m;
+}
+
+/**
+ * @brief Place a packet after LEAD_IN_BITS random bits, the rest of the stream is random too.
+ * @return Number of bits in the stream.
+ */
+static size_t buildStream(std::mt19937 &rng, const uint8_t *packet, size_t packetSize, uint8_t *stream) {
+    for (size_t i = 0; i < STREAM_BYTES; i++) {
+        stream[i] = (uint8_t)rng();
+    }
+    for (size_t i = 0; i < packetSize * 8; i++) {
+        putBit(stream, LEAD_IN_BITS + i, getBit(packet, i));
+    }
+    return STREAM_BYTES * 8;
+}
+
+static bool sameMetadata(const SessionMetadata &a, const SessionMetadata &b) {
+    uint8_t x[SessionMetadata::SIZE], y[SessionMetadata::SIZE];
+    a.serialize(x);
+    b.serialize(y);
+    return memcmp(x, y, sizeof(x)) == 0;
+}
+
+static size_t encodeMetadata(const SessionMetadata &m, uint8_t *packet) {
+    uint8_t payload[SessionMetadata::SIZE];
+    m.serialize(payload);
+    return ModemPacket::encode(ModemPacket::Type::SessionMetadata, payload, sizeof(payload), packet, PACKET_SIZE);
+}
+
+static bool decodeMetadata(const uint8_t *stream, size_t bitCount, SessionMetadata &m, uint32_t *corrected = nullptr) {
+    ModemPacket::Decoded decoded;
+    if (ModemPacket::decode(stream, bitCount, decoded) != ModemPacket::Status::Ok ||
+        decoded.type != ModemPacket::Type::SessionMetadata) {
+        return false;
+    }
+    if (corrected != nullptr) {
+        *corrected = decoded.correctedBits;
+    }
+    return m.deserialize(decoded.payload, decoded.length);
+}
+
+static bool testRoundTrip() {
+    bool ok = ModemPacket::crc16((const uint8_t *)"123456789", 9) == 0x29B1; // CRC-16/CCITT-FALSE check value
+
+    uint8_t packet[ModemPacket::MAX_ENCODED_SIZE];
+    uint8_t payload[ModemPacket::MAX_PAYLOAD];
+    for (size_t length = 0; length <= ModemPacket::MAX_PAYLOAD; length++) {
+        for (size_t i = 0; i < length; i++) {
+            payload[i] = (uint8_t)(i * 37 + length);
+        }
+        size_t size = ModemPacket::encode(ModemPacket::Type::SessionMetadata, payload, length, packet, sizeof(packet));
+        ModemPacket::Decoded decoded;
+        ok = ok && size == ModemPacket::encodedSize(length) &&
+             ModemPacket::decode(packet, size * 8, decoded) == ModemPacket::Status::Ok && decoded.length == length &&
+             decoded.version == ModemPacket::VERSION && decoded.correctedBits == 0 &&
+             memcmp(decoded.payload, payload, length) == 0 && decoded.endBit == size * 8;
+    }
+    ok = ok && ModemPacket::encode(ModemPacket::Type::SessionMetadata, payload, ModemPacket::MAX_PAYLOAD + 1, packet,
+                                   sizeof(packet)) == 0;
+    ok = ok && ModemPacket::encode(ModemPacket::Type::SessionMetadata, payload, 10, packet, 10) == 0;
+
+    // Cut anywhere inside the packet
+    size_t size = ModemPacket::encode(ModemPacket::Type::SessionMetadata, payload, 10, packet, sizeof(packet));
+    ModemPacket::Decoded decoded;
+    ok = ok && ModemPacket::decode(packet, size * 8 - 1, decoded) != ModemPacket::Status::Ok;
+    printf("round trip: %s\n", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+static bool testBeacon() {
+    BeaconPayload beacon = {0xBEEF, 513, 3600000u * 5 + 7};
+    uint8_t payload[BeaconPayload::SIZE];
+    beacon.serialize(payload);
+    uint8_t packet[ModemPacket::encodedSize(BeaconPayload::SIZE)];
+    size_t size = ModemPacket::encode(ModemPacket::Type::Beacon, payload, sizeof(payload), packet, sizeof(packet));
+
+    ModemPacket::Decoded decoded;
+    BeaconPayload received = {};
+    bool ok = size == sizeof(packet) && size * 8 == 208 &&
+              ModemPacket::decode(packet, size * 8, decoded) == ModemPacket::Status::Ok &&
+              decoded.type == ModemPacket::Type::Beacon && received.deserialize(decoded.payload, decoded.length) &&
+              received.sessionId == beacon.sessionId && received.sequence == beacon.sequence &&
+              received.elapsedMs == beacon.elapsedMs && !received.deserialize(decoded.payload, BeaconPayload::SIZE - 1);
+    printf("beacon: %s\n", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+static bool testCorrection() {
+    std::mt19937 rng(1);
+    SessionMetadata sent = randomMetadata(rng);
+    uint8_t packet[PACKET_SIZE];
+    encodeMetadata(sent, packet);
+    uint8_t stream[STREAM_BYTES];
+    bool ok = true;
+
+    // Every single bit error after the preamble is corrected
+    for (size_t bit = ModemPacket::PREAMBLE_BITS; bit < PACKET_SIZE * 8; bit++) {
+        size_t bitCount = buildStream(rng, packet, PACKET_SIZE, stream);
+        putBit(stream, LEAD_IN_BITS + bit, !getBit(stream, LEAD_IN_BITS + bit));
+        SessionMetadata received;
+        uint32_t corrected = 0;
+        ok = ok && decodeMetadata(stream, bitCount, received, &corrected) && sameMetadata(sent, received) &&
+             corrected == 1;
+    }
+
+    // One preamble error is tolerated
+    size_t bitCount = buildStream(rng, packet, PACKET_SIZE, stream);
+    putBit(stream, LEAD_IN_BITS + 4, !getBit(stream, LEAD_IN_BITS + 4));
+    SessionMetadata received;
+    ok = ok && decodeMetadata(stream, bitCount, received) && sameMetadata(sent, received);
+
+    // A burst as long as the body interleaver depth is corrected anywhere in the body
+    size_t bodyStart = ModemPacket::PREAMBLE_BITS + ModemPacket::HEADER_BITS;
+    size_t depth = 2 * (SessionMetadata::SIZE + 2);
+    for (size_t start = bodyStart; start + depth <= PACKET_SIZE * 8; start++) {
+        bitCount = buildStream(rng, packet, PACKET_SIZE, stream);
+        for (size_t bit = start; bit < start + depth; bit++) {
+            putBit(stream, LEAD_IN_BITS + bit, !getBit(stream, LEAD_IN_BITS + bit));
+        }
+        ok = ok && decodeMetadata(stream, bitCount, received) && sameMetadata(sent, received);
+    }
+    printf("single bit and burst correction: %s\n", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+static bool benchmarkThroughput() {
+    std::mt19937 rng(2);
+    SessionMetadata m = randomMetadata(rng);
+    uint8_t packet[PACKET_SIZE];
+    uint8_t stream[STREAM_BYTES];
+    constexpr int ROUNDS = 200000;
+
+    auto start = std::chrono::steady_clock::now();
+    size_t sink = 0;
+    for (int i = 0; i < ROUNDS; i++) {
+        m.sessionId = (uint16_t)i;
+        sink += encodeMetadata(m, packet);
+    }
+    double encodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t bitCount = buildStream(rng, packet, PACKET_SIZE, stream);
+    int decodedCount = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; i++) {
+        SessionMetadata received;
+        decodedCount += decodeMetadata(stream, bitCount, received);
+    }
+    double decodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("encode %.2f M packets/s, decode %.2f M streams/s of %zu bits (%zu)\n", ROUNDS / encodeSeconds / 1e6,
+           ROUNDS / decodeSeconds / 1e6, bitCount, sink % 2);
+    printf("on air: packet %zu bits for %zu payload bytes, old frame %zu bits\n", PACKET_SIZE * 8,
+           SessionMetadata::SIZE, LEGACY_SIZE * 8);
+    return decodedCount == ROUNDS;
+}
+
+/**
+ * @class Channel
+ * @brief Gilbert-Elliott bit channel; with equal error rates it is a plain binary symmetric channel.
+ */
+class Channel {
+public:
+    Channel(double goodBer, double badBer, double enterBad, double leaveBad)
+        : goodBer(goodBer), badBer(badBer), enterBad(enterBad), leaveBad(leaveBad), bad(false), rng(3) {}
+
+    void apply(uint8_t *data, size_t bitCount) {
+        for (size_t i = 0; i < bitCount; i++) {
+            bad = bad ? uniform(rng) >= leaveBad : uniform(rng) < enterBad;
+            if (uniform(rng) < (bad ? badBer : goodBer)) {
+                putBit(data, i, !getBit(data, i));
+            }
+        }
+    }
+
+private:
+    double goodBer, badBer, enterBad, leaveBad;
+    bool bad;
+    std::mt19937 rng;
+    std::uniform_real_distribution<double> uniform{0.0, 1.0};
+};
+
+/**
+ * @brief Send TRIALS metadata messages in both formats and count the outcomes.
+ *
+ * The old frame has no check beyond the 1, 2, 3 sync bytes, so any corrupted
+ * field in an accepted frame is an undetected error.
+ */
+static bool benchmarkChannel(const char *name, Channel channel) {
+    std::mt19937 rng(4);
+    int packetOk = 0, packetLost = 0, packetWrong = 0;
+    int legacyOk = 0, legacyLost = 0, legacyWrong = 0;
+    uint64_t correctedBits = 0;
+
+    for (int trial = 0; trial < TRIALS; trial++) {
+        SessionMetadata sent = randomMetadata(rng);
+
+        uint8_t packet[PACKET_SIZE];
+        uint8_t stream[STREAM_BYTES];
+        encodeMetadata(sent, packet);
+        size_t bitCount = buildStream(rng, packet, PACKET_SIZE, stream);
+        channel.apply(stream, bitCount);
+        SessionMetadata received;
+        uint32_t corrected = 0;
+        if (!decodeMetadata(stream, bitCount, received, &corrected)) {
+            packetLost++;
+        } else if (sameMetadata(sent, received)) {
+            packetOk++;
+            correctedBits += corrected;
+        } else {
+            packetWrong++;
+        }
+
+        uint8_t legacy[LEGACY_SIZE] = {1, 2, 3, (uint8_t)sent.sessionId, sent.minute, sent.hour, sent.day,
+                                       sent.month, sent.year, 2, 3};
+        uint8_t original[LEGACY_SIZE];
+        memcpy(original, legacy, sizeof(legacy));
+        channel.apply(legacy, LEGACY_SIZE * 8);
+        if (legacy[0] != 1 || legacy[1] != 2 || legacy[2] != 3) {
+            legacyLost++;
+        } else if (memcmp(legacy, original, sizeof(legacy)) == 0) {
+            legacyOk++;
+        } else {
+            legacyWrong++;
+        }
+    }
+
+    printf("%-22s packet ok %6.2f%% lost %6.2f%% undetected %.4f%% (avg %.2f bits corrected) | "
+           "old frame ok %6.2f%% lost %6.2f%% undetected %6.2f%%\n",
+           name, 100.0 * packetOk / TRIALS, 100.0 * packetLost / TRIALS, 100.0 * packetWrong / TRIALS,
+           packetOk > 0 ? (double)correctedBits / packetOk : 0.0, 100.0 * legacyOk / TRIALS,
+           100.0 * legacyLost / TRIALS, 100.0 * legacyWrong / TRIALS);
+    // A wrong packet needs the FEC to miscorrect into a matching CRC, this must stay rare
+    return packetWrong * 1000 <= TRIALS;
+}
+
+int main() {
+    bool ok = testRoundTrip();
+    ok = testBeacon() && ok;
+    ok = testCorrection() && ok;
+    ok = benchmarkThroughput() && ok;
+    ok = benchmarkChannel("BSC ber 0.001", Channel(0.001, 0.001, 0, 1)) && ok;
+    ok = benchmarkChannel("BSC ber 0.01", Channel(0.01, 0.01, 0, 1)) && ok;
+    ok = benchmarkChannel("BSC ber 0.03", Channel(0.03, 0.03, 0, 1)) && ok;
+    ok = benchmarkChannel("BSC ber 0.05", Channel(0.05, 0.05, 0, 1)) && ok;
+    ok = benchmarkChannel("bursts of ~8 bits", Channel(0.001, 0.3, 0.004, 0.125)) && ok;
+    printf("%s\n", ok ? "ALL PASSED" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,463 @@
+// The NVS write cache against a mock flash store: typed round trips, read
+// caching, coalescing and write order of a flush, what survives a power loss,
+// failed flushes and writes during a flush, the flash operations on the
+// session start path before and after the cache, the configuration counter
+// that must survive a reset, and the flush policy of the firmware's
+// NvsFlushTask with a flusher thread.
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "nvsWriteCache.hpp"
+
+// Flash time of the NVS calls, rough ESP32 figures for a small item
+static constexpr double OPEN_MS = 0.3;
+static constexpr double READ_MS = 0.2;
+static constexpr double WRITE_MS = 2.5;
+static constexpr double COMMIT_MS = 0.5;
+
+/**
+ * @brief Flash with the semantics the cache relies on: a write is durable once committed, as a whole.
+ */
+class MockNvs : public NvsBoundaryAbstract {
+public:
+    struct Item {
+        char type;   // 'u', 's' or 'b'
+        std::string bytes;
+    };
+
+    size_t reads = 0;
+    size_t writes = 0;
+    size_t commits = 0;
+    size_t failCommits = 0;                   // Commits still to fail
+    std::vector<std::string> writeOrder;      // Keys in the order they reached the store
+    std::function<void()> duringCommit;       // Runs inside flush(), another task writing meanwhile
+
+    void writeUint64(const char* key, uint64_t value) override {
+        set(key, 'u', std::string((const char *)&value, sizeof(value)));
+    }
+
+    bool findUint64(const char* key, uint64_t &value) override {
+        const Item *item = get(key, 'u');
+        if (item == nullptr) {
+            return false;
+        }
+        memcpy(&value, item->bytes.data(), sizeof(value));
+        return true;
+    }
+
+    void writeString(const char* key, const char* value) override {
+        set(key, 's', std::string(value, strlen(value) + 1));
+    }
+
+    bool readString(const char* key, char* buffer, size_t &length) override {
+        return copy(get(key, 's'), buffer, length);
+    }
+
+    void writeBlob(const char* key, const void* data, size_t length) override {
+        set(key, 'b', std::string((const char *)data, length));
+    }
+
+    bool readBlob(const char* key, void* buffer, size_t &length) override {
+        return copy(get(key, 'b'), buffer, length);
+    }
+
+    void eraseData(const char* key) override {
+        writes++;
+        writeOrder.push_back(key);
+        pending[key] = Item{'-', ""};
+    }
+
+    bool flush() override {
+        if (duringCommit) {
+            duringCommit();
+        }
+        if (failCommits > 0) {
+            failCommits--;
+            pending.clear();
+            return false;
+        }
+        commits++;
+        for (const auto &written : pending) {
+            if (written.second.type == '-') {
+                committed.erase(written.first);
+            } else {
+                committed[written.first] = written.second;
+            }
+        }
+        pending.clear();
+        return true;
+    }
+
+    /** @brief Power loss: what was not committed is gone. */
+    void powerLoss() { pending.clear(); }
+
+    /** @brief Flash time of the operations so far, each call opening and closing like the old NvsBoundary did. */
+    double writeThroughMs() const { return (reads + writes + commits) * OPEN_MS + reads * READ_MS + writes * WRITE_MS + commits * COMMIT_MS; }
+
+    void resetCounters() {
+        reads = writes = commits = 0;
+        writeOrder.clear();
+    }
+
+private:
+    std::map<std::string, Item> committed;
+    std::map<std::string, Item> pending;
+
+    void set(const char *key, char type, const std::string &bytes) {
+        writes++;
+        writeOrder.push_back(key);
+        pending[key] = Item{type, bytes};
+    }
+
+    const Item *get(const char *key, char type) {
+        reads++;
+        // A read sees its own writes before the commit, like NVS
+        auto found = pending.find(key);
+        if (found == pending.end()) {
+            found = committed.find(key);
+            if (found == committed.end()) {
+                return nullptr;
+            }
+        }
+        return found->second.type == type ? &found->second : nullptr;
+    }
+
+    static bool copy(const Item *item, void *buffer, size_t &length) {
+        size_t size = length;
+        length = item == nullptr ? 0 : item->bytes.size();
+        if (item == nullptr || (buffer != nullptr && size < length)) {
+            return false;
+        }
+        if (buffer != nullptr) {
+            memcpy(buffer, item->bytes.data(), length);
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief The old NvsBoundary: every call went to flash, every write was committed on its own.
+ */
+class WriteThroughNvs : public NvsBoundaryAbstract {
+public:
+    explicit WriteThroughNvs(MockNvs &flash) : flash(flash) {}
+    void writeUint64(const char* key, uint64_t value) override { flash.writeUint64(key, value); flash.flush(); }
+    bool findUint64(const char* key, uint64_t &value) override { return flash.findUint64(key, value); }
+    void writeString(const char* key, const char* value) override { flash.writeString(key, value); flash.flush(); }
+    bool readString(const char* key, char* buffer, size_t &length) override { return flash.readString(key, buffer, length); }
+    void writeBlob(const char* key, const void* data, size_t length) override { flash.writeBlob(key, data, length); flash.flush(); }
+    bool readBlob(const char* key, void* buffer, size_t &length) override { return flash.readBlob(key, buffer, length); }
+    void eraseData(const char* key) override { flash.eraseData(key); flash.flush(); }
+    bool flush() override { return true; }
+
+private:
+    MockNvs &flash;
+};
+
+/**
+ * @brief Record of the last session as Storage writes it.
+ */
+struct SessionRecord {
+    uint64_t sessionId;
+    int64_t startTime;
+    char patient[24];
+};
+
+/**
+ * @brief What MenuController::startRecording() does with the store for a new session.
+ */
+static void startSession(NvsBoundaryAbstract &nvs, int64_t now) {
+    uint64_t sessionId = nvs.readUint64("session_id", 0) + 1;
+    nvs.writeUint64("session_id", sessionId);
+    SessionRecord record = {sessionId, now, "P-0042"};
+    nvs.writeBlob("last_session", &record, sizeof(record));
+    nvs.readUint64("beacon_int", 60);
+}
+
+static bool testRoundTrip() {
+    MockNvs flash;
+    NvsWriteCache cache(flash);
+    cache.writeUint64("count", 7);
+    cache.writeString("name", "YOD recorder");
+    uint8_t blob[5] = {1, 2, 3, 4, 5};
+    cache.writeBlob("blob", blob, sizeof(blob));
+
+    uint64_t value = 0;
+    char text[16];
+    size_t length = 0;
+    bool ok = cache.findUint64("count", value) && value == 7;
+    // The length alone, then too small, then the value
+    ok = ok && cache.readString("name", nullptr, length) && length == 13;
+    length = 4;
+    ok = ok && !cache.readString("name", text, length) && length == 13;
+    length = sizeof(text);
+    ok = ok && cache.readString("name", text, length) && strcmp(text, "YOD recorder") == 0;
+    uint8_t back[8] = {};
+    length = sizeof(back);
+    ok = ok && cache.readBlob("blob", back, length) && length == 5 && memcmp(back, blob, 5) == 0;
+    // Another type under the key is no value, a missing key takes the default
+    length = sizeof(text);
+    ok = ok && !cache.readString("count", text, length) && length == 0 && cache.readUint64("none", 9) == 9;
+    cache.eraseData("count");
+    ok = ok && !cache.findUint64("count", value);
+    // NVS refuses keys over 15 characters, the cache does not take them either
+    cache.writeUint64("a_key_that_is_too_long", 1);
+    ok = ok && cache.getStats().rejected == 1 && cache.readUint64("a_key_that_is_too_long", 2) == 2;
+
+    ok = ok && cache.flush() && flash.commits == 1;
+    NvsWriteCache reopened(flash);
+    length = sizeof(text);
+    ok = ok && !reopened.findUint64("count", value) && reopened.readString("name", text, length) &&
+         strcmp(text, "YOD recorder") == 0;
+    printf("uint64, string, blob and erase round trip over a flush: %s\n", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+static bool testReadCaching() {
+    MockNvs flash;
+    flash.writeUint64("session_id", 41);
+    flash.flush();
+    flash.resetCounters();
+    NvsWriteCache cache(flash);
+    bool ok = true;
+    for (int i = 0; i < 100; i++) {
+        ok = ok && cache.readUint64("session_id") == 41 && cache.readUint64("beacon_int", 60) == 60;
+    }
+    NvsWriteCache::Stats stats = cache.getStats();
+    // One store read per key, also for the key that is not there
+    ok = ok && flash.reads == 2 && stats.misses == 2 && stats.hits == 198;
+    printf("200 reads of 2 keys, %zu from flash: %s\n", flash.reads, ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+static bool testCoalescingAndOrder() {
+    MockNvs flash;
+    NvsWriteCache cache(flash);
+    for (uint64_t i = 0; i < 100; i++) {
+        cache.writeUint64("session_id", i);
+    }
+    cache.writeUint64("cfg_counter", 5);
+    cache.writeUint64("word_thresh", 6);
+    // Written last, so it follows the other two although it was dirty first
+    cache.writeUint64("session_id", 100);
+    bool ok = cache.flush() && flash.writes == 3 && flash.commits == 1 && cache.getStats().coalesced == 100;
+    ok = ok && flash.writeOrder == std::vector<std::string>({"cfg_counter", "word_thresh", "session_id"});
+    ok = ok && !cache.isDirty() && cache.flush() && flash.commits == 1;
+    printf("103 writes flushed as %zu store writes and %zu commit, in write order: %s\n", flash.writes, flash.commits,
+           ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+static bool testPowerLoss() {
+    MockNvs flash;
+    bool ok = true;
+    {
+        NvsWriteCache cache(flash);
+        startSession(cache, 1000);
+        ok = ok && cache.flush();
+        startSession(cache, 2000);
+        // Power lost before the flush task ran
+    }
+    flash.powerLoss();
+    NvsWriteCache afterReset(flash);
+    SessionRecord record;
+    size_t length = sizeof(record);
+    // Both keys are of the first session, the second one never reached flash
+    ok = ok && afterReset.readUint64("session_id") == 1 && afterReset.readBlob("last_session", &record, length) &&
+         length == sizeof(record) && record.sessionId == 1 && record.startTime == 1000;
+
+    // A flush that fails keeps the values dirty, the next one writes them again
+    startSession(afterReset, 3000);
+    flash.failCommits = 1;
+    ok = ok && !afterReset.flush() && afterReset.isDirty();
+    ok = ok && afterReset.flush() && !afterReset.isDirty();
+    flash.powerLoss();
+    NvsWriteCache again(flash);
+    ok = ok && again.readUint64("session_id") == 2 && again.getStats().misses == 1;
+    printf("power loss keeps the last flushed session, a failed flush is repeated: %s\n", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+/**
+ * @brief What Storage::commitConfigCounter() does: write the counter and flush it through.
+ */
+static bool commitConfigCounter(NvsBoundaryAbstract &nvs, uint32_t counter) {
+    nvs.writeUint64("cfg_counter", counter);
+    return nvs.flush();
+}
+
+static bool testConfigCounter() {
+    MockNvs flash;
+    bool ok = true;
+    {
+        NvsWriteCache cache(flash);
+        // Upload 100 accepted and the clock set, then a reset before the flush task ran
+        ok = ok && commitConfigCounter(cache, 100);
+        startSession(cache, 1000);
+    }
+    flash.powerLoss();
+    NvsWriteCache afterReset(flash);
+    // A replay of upload 100 still finds its counter
+    ok = ok && afterReset.readUint64("cfg_counter") == 100;
+
+    // Only written to the cache, as before, the counter is gone after the reset
+    afterReset.writeUint64("cfg_counter", 101);
+    flash.powerLoss();
+    NvsWriteCache cacheOnly(flash);
+    ok = ok && cacheOnly.readUint64("cfg_counter") == 100;
+
+    // A failed commit is reported, ConfigReceiver then does not apply the upload
+    flash.failCommits = 1;
+    ok = ok && !commitConfigCounter(cacheOnly, 102);
+    printf("the configuration counter survives a reset right after it was accepted: %s\n", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+static bool testWriteDuringFlush() {
+    MockNvs flash;
+    NvsWriteCache cache(flash);
+    cache.writeUint64("session_id", 1);
+    // Another task writes while the store commits
+    flash.duringCommit = [&] {
+        flash.duringCommit = nullptr;
+        cache.writeUint64("session_id", 2);
+    };
+    bool ok = cache.flush() && cache.isDirty() && cache.readUint64("session_id") == 2;
+    ok = ok && cache.flush() && !cache.isDirty();
+    NvsWriteCache reopened(flash);
+    ok = ok && reopened.readUint64("session_id") == 2;
+    printf("a write during a flush stays dirty for the next one: %s\n", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+static bool testStartPath() {
+    MockNvs oldFlash;
+    WriteThroughNvs writeThrough(oldFlash);
+    startSession(writeThrough, 0);
+    oldFlash.resetCounters();
+    startSession(writeThrough, 1);
+    size_t oldOps = oldFlash.reads + oldFlash.writes + oldFlash.commits;
+    double oldMs = oldFlash.writeThroughMs();
+
+    MockNvs flash;
+    NvsWriteCache cache(flash);
+    startSession(cache, 0);
+    cache.flush();
+    flash.resetCounters();
+    startSession(cache, 1);
+    size_t startOps = flash.reads + flash.writes + flash.commits;
+    cache.flush();
+    size_t flushOps = flash.writes + flash.commits;
+
+    bool ok = oldOps == 6 && startOps == 0 && flushOps == 3;
+    printf("session start: %zu flash operations (%.1f ms) before, %zu now, the flush task does %zu: %s\n", oldOps,
+           oldMs, startOps, flushOps, ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+/**
+ * @brief NvsFlushTask with a thread: woken by the write hook, flushes delayMs after the first write.
+ */
+class HostFlusher {
+public:
+    HostFlusher(NvsWriteCache &cache, int delayMs) : cache(cache), delayMs(delayMs) {
+        cache.setWriteHook([](void *context) { static_cast<HostFlusher *>(context)->notify(); }, this);
+        worker = std::thread([this] { run(); });
+    }
+
+    ~HostFlusher() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+        cache.setWriteHook(nullptr, nullptr);
+    }
+
+private:
+    NvsWriteCache &cache;
+    int delayMs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool notified = false;
+    bool stopping = false;
+    std::thread worker;
+
+    void notify() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            notified = true;
+        }
+        wake.notify_one();
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [this] { return notified || stopping; });
+            if (stopping) {
+                return;
+            }
+            lock.unlock();
+            do {
+                std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+                {
+                    std::lock_guard<std::mutex> taken(mutex);
+                    notified = false;
+                }
+                cache.flush();
+            } while (cache.isDirty());
+            lock.lock();
+        }
+    }
+};
+
+static bool testFlushPolicy() {
+    MockNvs flash;
+    NvsWriteCache cache(flash);
+    // The mock is not thread-safe: the reads go to it now, from then on the flusher is its only user
+    cache.readUint64("session_id");
+    cache.readUint64("beacon_int");
+    bool ok = true;
+    {
+        HostFlusher flusher(cache, 20);
+        // 10 bursts of 20 writes 1 ms apart, 50 ms between the bursts
+        for (int burst = 0; burst < 10; burst++) {
+            for (int i = 0; i < 20; i++) {
+                startSession(cache, burst * 100 + i);
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        ok = !cache.isDirty();
+    }
+    NvsWriteCache::Stats stats = cache.getStats();
+    NvsWriteCache reopened(flash);
+    ok = ok && reopened.readUint64("session_id") == 200 && flash.commits >= 10 && flash.commits <= 40 &&
+         stats.storeWrites < stats.writes / 5;
+    printf("flush task: %zu writes as %zu store writes in %zu commits: %s\n", stats.writes, stats.storeWrites,
+           flash.commits, ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+int main() {
+    bool ok = testRoundTrip();
+    ok = testReadCaching() && ok;
+    ok = testCoalescingAndOrder() && ok;
+    ok = testPowerLoss() && ok;
+    ok = testConfigCounter() && ok;
+    ok = testWriteDuringFlush() && ok;
+    ok = testStartPath() && ok;
+    ok = testFlushPolicy() && ok;
+    printf("%s\n", ok ? "ALL PASSED" : "FAILED");
+    return ok ? 0 : 1;
+}
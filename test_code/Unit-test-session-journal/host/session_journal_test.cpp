@@ -0,0 +1,427 @@
+// The session journal against a simulated NOR flash: records back after a
+// remount, page-sized batches, erasing ahead, wear across the ring, failed writes, a bad
+// CRC, power cuts in the middle of writes and erases followed by recovery,
+// and what the recovery and a full export read on a partition of the
+// firmware's size.
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "journalLog.hpp"
+
+static constexpr size_t PARTITION_SECTORS = 240;   // The journal partition, 0xF0000 bytes
+// SPI flash read cost on the ESP32, rough figures: a call and 40 MHz DIO
+static constexpr double READ_CALL_US = 15.0;
+static constexpr double READ_BYTE_US = 0.1;
+
+struct PowerCut {};
+
+/**
+ * @brief NOR flash: a write only clears bits, an erase sets a sector to 0xFF.
+ *
+ * A power cut during a write programs a random prefix and random bits in
+ * some of the slots after it; during an erase it leaves a random part of the sector erased.
+ * Then PowerCut is thrown and the JournalLog above it is abandoned.
+ */
+class MockFlash : public JournalFlashAbstract {
+public:
+    size_t reads = 0;
+    size_t bytesRead = 0;
+    size_t writes = 0;
+    size_t erases = 0;
+    size_t pageCrossings = 0;
+    size_t failWrites = 0;          // Writes still to fail
+    long opsUntilCut = -1;          // Writes and erases before the one the power goes in, -1 never
+    std::vector<size_t> eraseCounts;
+
+    explicit MockFlash(size_t sectors, uint32_t seed = 1)
+        : eraseCounts(sectors, 0), bytes(sectors * SECTOR_SIZE, 0xFF), random(seed) {}
+
+    size_t getSize() const override { return bytes.size(); }
+
+    bool read(size_t offset, void *buffer, size_t length) override {
+        reads++;
+        bytesRead += length;
+        if (offset + length > bytes.size()) {
+            return false;
+        }
+        memcpy(buffer, &bytes[offset], length);
+        return true;
+    }
+
+    bool write(size_t offset, const void *data, size_t length) override {
+        if (offset + length > bytes.size() || length == 0) {
+            return false;
+        }
+        writes++;
+        if (offset / PAGE_SIZE != (offset + length - 1) / PAGE_SIZE) {
+            pageCrossings++;
+        }
+        const uint8_t *in = static_cast<const uint8_t *>(data);
+        if (cutNow() || failWrites > 0) {
+            size_t prefix = random() % length;
+            bool touched = true;
+            for (size_t i = 0; i < length; i++) {
+                // Past the prefix some slots got part of their bits, others none
+                if (i >= prefix && i % 32 == 0) {
+                    touched = random() % 2 == 0;
+                }
+                uint8_t mask = i < prefix ? 0x00 : (touched ? (uint8_t)random() : 0xFF);
+                bytes[offset + i] &= in[i] | mask;
+            }
+            if (failWrites == 0) {
+                throw PowerCut();
+            }
+            failWrites--;
+            return false;
+        }
+        for (size_t i = 0; i < length; i++) {
+            bytes[offset + i] &= in[i];
+        }
+        return true;
+    }
+
+    bool eraseSector(size_t offset) override {
+        if (offset % SECTOR_SIZE != 0 || offset >= bytes.size()) {
+            return false;
+        }
+        erases++;
+        eraseCounts[offset / SECTOR_SIZE]++;
+        if (cutNow()) {
+            for (size_t i = 0; i < SECTOR_SIZE; i++) {
+                if (random() % 2 == 0) {
+                    bytes[offset + i] = 0xFF;
+                } else {
+                    bytes[offset + i] |= (uint8_t)random();
+                }
+            }
+            throw PowerCut();
+        }
+        memset(&bytes[offset], 0xFF, SECTOR_SIZE);
+        return true;
+    }
+
+    /** @brief Clear one bit, a slot that was programmed wrong. */
+    void clearBit(size_t offset, uint8_t bit) {
+        bytes[offset] &= (uint8_t)~(1u << bit);
+    }
+
+    void resetCounters() {
+        reads = bytesRead = writes = erases = pageCrossings = 0;
+    }
+
+private:
+    std::vector<uint8_t> bytes;
+    std::mt19937 random;
+
+    bool cutNow() {
+        if (opsUntilCut < 0) {
+            return false;
+        }
+        return opsUntilCut-- == 0;
+    }
+};
+
+/** @brief A record of every type in turn, the uptime is the id the tests recognise it by. */
+static JournalRecord sample(uint32_t id) {
+    switch (id % 7) {
+        case 0: return JournalRecord::boot(id, 3);
+        case 1: return JournalRecord::sessionStart(id, id / 7, 1760000000u + id);
+        case 2: return JournalRecord::patient(id, id / 7, "P-0042-ABCDEFGHIJK");
+        case 3: return JournalRecord::speech(id, 37, 240, 4, 60000);
+        case 4: return JournalRecord::button(id, 2);
+        case 5: return JournalRecord::fault(id, JournalFaultSource::Recorder, -2);
+        default: return JournalRecord::sessionStop(id, id / 7);
+    }
+}
+
+static std::vector<JournalRecord> readAll(JournalLog &log, uint32_t from = 0) {
+    std::vector<JournalRecord> records;
+    JournalRecord chunk[32];
+    size_t count;
+    while ((count = log.read(from, chunk, 32)) > 0) {
+        records.insert(records.end(), chunk, chunk + count);
+    }
+    return records;
+}
+
+static bool samePayload(const JournalRecord &a, const JournalRecord &b) {
+    return a.uptimeMs == b.uptimeMs && a.type == b.type && a.length == b.length &&
+           memcmp(a.payload, b.payload, sizeof(a.payload)) == 0;
+}
+
+static bool testRoundTrip() {
+    MockFlash flash(8);
+    JournalLog log(flash);
+    bool ok = log.mount() && log.getNextSequence() == 1 && log.getOldestSequence() == 1;
+    for (uint32_t id = 0; id < 100; id++) {
+        ok = log.append(sample(id)) && ok;
+    }
+    ok = log.flush() && ok;
+
+    JournalLog remounted(flash);
+    ok = remounted.mount() && ok;
+    std::vector<JournalRecord> records = readAll(remounted);
+    ok = ok && records.size() == 100 && remounted.getNextSequence() == 101;
+    for (size_t i = 0; ok && i < records.size(); i++) {
+        ok = samePayload(records[i], sample((uint32_t)i)) && records[i].sequence == i + 1;
+    }
+    // Payload layout as documented on JournalType
+    const JournalRecord &speech = records[3];
+    const JournalRecord &patient = records[2];
+    ok = ok && speech.get16(0) == 37 && speech.get16(2) == 240 && speech.get16(4) == 4 && speech.get32(6) == 60000 &&
+         strncmp((const char *)&patient.payload[4], "P-0042-ABCDEFGHI", JournalRecord::PATIENT_LENGTH) == 0;
+    // Reading on from the middle
+    uint32_t from = 60;
+    JournalRecord record;
+    ok = ok && remounted.read(from, &record, 1) == 1 && record.sequence == 60 && from == 61;
+    printf("100 records of every type back after a remount: %s\n", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+static bool testBatching() {
+    MockFlash flash(16);
+    JournalLog log(flash);
+    bool ok = log.mount();
+    size_t maxPending = 0;
+    for (uint32_t id = 0; id < 1000; id++) {
+        ok = log.append(sample(id)) && ok;
+        maxPending = std::max(maxPending, log.getPending());
+    }
+    size_t recordWrites = log.getStats().writes;
+    ok = ok && flash.pageCrossings == 0 && maxPending < JournalLog::BATCH_SIZE &&
+         log.getStats().written + log.getPending() == 1000 && recordWrites <= 1000 / (JournalLog::SLOTS_PER_PAGE - 1) + 1;
+    printf("1000 records in %zu page writes and %zu erases, at most %zu in RAM, none across a page: %s\n",
+           recordWrites, flash.erases, maxPending, ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+static bool testEraseAhead() {
+    MockFlash flash(4);
+    JournalLog log(flash);
+    bool ok = log.mount() && log.eraseAhead();
+    uint32_t id = 0;
+    for (; id < JournalLog::RECORDS_PER_SECTOR; id++) {
+        log.append(sample(id));
+    }
+    ok = log.flush() && ok;
+    size_t erases = flash.erases;
+    // Between sessions: the next sector is erased now, not when the first record of the session needs it
+    ok = log.eraseAhead() && log.eraseAhead() && flash.erases == erases + 1 && ok;
+    for (; id < JournalLog::RECORDS_PER_SECTOR + 10; id++) {
+        log.append(sample(id));
+    }
+    ok = log.flush() && flash.erases == erases + 1 && ok;
+    JournalLog remounted(flash);
+    ok = remounted.mount() && readAll(remounted).size() == id && ok;
+    printf("a sector erased ahead is opened without an erase: %s\n", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+static bool testWear() {
+    const size_t sectors = 8;
+    MockFlash flash(sectors);
+    JournalLog log(flash);
+    bool ok = log.mount();
+    uint32_t id = 0;
+    for (size_t lap = 0; lap < 10; lap++) {
+        for (size_t i = 0; i < sectors * JournalLog::RECORDS_PER_SECTOR; i++) {
+            ok = log.append(sample(id++)) && ok;
+            if (i % 5 == 0) {
+                ok = log.flush() && ok;
+            }
+        }
+    }
+    ok = log.flush() && ok;
+    auto range = std::minmax_element(flash.eraseCounts.begin(), flash.eraseCounts.end());
+    std::vector<JournalRecord> records = readAll(log);
+    ok = ok && *range.second - *range.first <= 1 && !records.empty() &&
+         records.back().uptimeMs == id - 1 && records.size() > (sectors - 1) * JournalLog::RECORDS_PER_SECTOR - 1 &&
+         log.getNextSequence() - log.getOldestSequence() == records.size();
+    printf("10 laps of %zu sectors: erased %zu to %zu times each, newest %zu records kept: %s\n", sectors,
+           *range.first, *range.second, records.size(), ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+static bool testFailedWrite() {
+    MockFlash flash(4);
+    JournalLog log(flash);
+    bool ok = log.mount();
+    for (uint32_t id = 0; id < 6; id++) {
+        log.append(sample(id));
+        if (id == 2 || id == 5) {
+            // The header of the first sector, then the records of the second flush
+            flash.failWrites = 1;
+            ok = ok && !log.flush() && log.getPending() == 3;
+            ok = ok && log.flush() && log.getPending() == 0;
+        }
+    }
+
+    JournalLog remounted(flash);
+    ok = remounted.mount() && ok;
+    std::vector<JournalRecord> records = readAll(remounted);
+    ok = ok && records.size() == 6 && log.getStats().failures == 2;
+    for (size_t i = 0; ok && i < records.size(); i++) {
+        // The slots of the failed write are not used again
+        ok = records[i].uptimeMs == i && records[i].sequence == (i < 3 ? i + 1 : i + 4);
+    }
+    printf("failed writes keep the records for the next flush, the lost slots are a gap: %s\n", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+static bool testBadCrc() {
+    MockFlash flash(4);
+    JournalLog log(flash);
+    bool ok = log.mount();
+    for (uint32_t id = 0; id < 20; id++) {
+        log.append(sample(id));
+    }
+    ok = log.flush() && ok;
+    // Payload byte of the fifth record, sector 0 slot 5, a button record with ObserverId 2
+    flash.clearBit(5 * JournalLog::SLOT_SIZE + 10, 1);
+
+    JournalLog remounted(flash);
+    ok = remounted.mount() && ok;
+    std::vector<JournalRecord> records = readAll(remounted);
+    bool gap = records.size() == 19 && records[3].sequence == 4 && records[4].sequence == 6;
+    ok = ok && gap && remounted.getStats().corrupt == 1;
+    printf("a record with a bad CRC is skipped, the rest read: %s\n", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+/**
+ * @brief Random appends and flushes with the power cut at a random write or erase, then recovery.
+ */
+static bool testPowerCuts() {
+    const size_t sectors = 6;
+    const size_t trials = 300;
+    const size_t kept = (sectors - 2) * JournalLog::RECORDS_PER_SECTOR;
+    size_t failed = 0;
+    size_t torn = 0;
+    size_t corrupt = 0;
+    size_t maxReads = 0;
+
+    for (uint32_t trial = 0; trial < trials; trial++) {
+        std::mt19937 random(trial);
+        MockFlash flash(sectors, trial);
+        uint32_t id = 0;
+        std::vector<uint32_t> durable;   // Ids on flash when the last call returned
+        {
+            // A journal that already wrapped, and a cut somewhere in what follows
+            JournalLog log(flash);
+            log.mount();
+            size_t before = random() % (3 * sectors * JournalLog::RECORDS_PER_SECTOR);
+            for (size_t i = 0; i < before; i++) {
+                log.append(sample(id++));
+            }
+            log.flush();
+            durable.clear();
+            for (uint32_t i = 0; i < id; i++) {
+                durable.push_back(i);
+            }
+            flash.opsUntilCut = (long)(random() % 200);
+            try {
+                while (true) {
+                    log.append(sample(id++));
+                    if (random() % 10 == 0) {
+                        log.flush();
+                    }
+                    if (random() % 50 == 0) {
+                        log.eraseAhead();
+                    }
+                    while (durable.size() < id - log.getPending()) {
+                        durable.push_back((uint32_t)durable.size());
+                    }
+                }
+            } catch (const PowerCut &) {
+            }
+        }
+        flash.opsUntilCut = -1;
+        flash.resetCounters();
+
+        JournalLog log(flash);
+        bool ok = log.mount();
+        maxReads = std::max(maxReads, log.getMountInfo().reads);
+        torn += log.getMountInfo().tornPage ? 1 : 0;
+        std::vector<JournalRecord> records = readAll(log);
+        corrupt += log.getStats().corrupt;
+
+        // Only records that were appended, in order, and the newest durable ones all there
+        for (size_t i = 0; ok && i < records.size(); i++) {
+            ok = records[i].uptimeMs < id && samePayload(records[i], sample(records[i].uptimeMs)) &&
+                 (i == 0 || (records[i].sequence > records[i - 1].sequence && records[i].uptimeMs > records[i - 1].uptimeMs));
+        }
+        size_t first = durable.size() > kept ? durable.size() - kept : 0;
+        size_t at = 0;
+        for (size_t i = first; ok && i < durable.size(); i++) {
+            while (at < records.size() && records[at].uptimeMs < durable[i]) {
+                at++;
+            }
+            ok = at < records.size() && records[at].uptimeMs == durable[i];
+        }
+
+        // Writing goes on after the newest record, and survives the next remount
+        uint32_t last = records.empty() ? 0 : records.back().sequence;
+        for (uint32_t i = 0; i < 50; i++) {
+            log.append(sample(id + i));
+        }
+        ok = log.flush() && ok;
+        JournalLog again(flash);
+        ok = again.mount() && ok;
+        std::vector<JournalRecord> after = readAll(again, last + 1);
+        ok = ok && after.size() == 50 && after.front().uptimeMs == id && after.front().sequence > last;
+        failed += ok ? 0 : 1;
+    }
+    bool ok = failed == 0;
+    printf("%zu power cuts in writes and erases: %zu torn pages skipped, %zu torn records rejected, "
+           "at most %zu reads to recover, %zu lost durable records: %s\n",
+           trials, torn, corrupt, maxReads, failed, ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+static bool testPartitionRecovery() {
+    MockFlash flash(PARTITION_SECTORS);
+    JournalLog log(flash);
+    bool ok = log.mount();
+    size_t total = PARTITION_SECTORS * JournalLog::RECORDS_PER_SECTOR + 1000;
+    for (uint32_t id = 0; id < total; id++) {
+        log.append(sample(id));
+    }
+    ok = log.flush() && ok;
+
+    flash.resetCounters();
+    JournalLog remounted(flash);
+    ok = remounted.mount() && ok;
+    const JournalLog::MountInfo &info = remounted.getMountInfo();
+    double mountMs = (info.reads * READ_CALL_US + info.bytesRead * READ_BYTE_US) / 1000.0;
+    double scanMs = (PARTITION_SECTORS * READ_CALL_US + flash.getSize() * READ_BYTE_US) / 1000.0;
+    ok = ok && info.sectors == PARTITION_SECTORS && remounted.getNextSequence() == total + 1 &&
+         info.reads <= PARTITION_SECTORS + 2 * JournalLog::SLOTS_PER_PAGE;
+    printf("recovery of a full %zu KB journal: %zu reads, %zu bytes, about %.1f ms (a full scan: %.0f ms): %s\n",
+           flash.getSize() / 1024, info.reads, info.bytesRead, mountMs, scanMs, ok ? "PASS" : "FAIL");
+
+    // The export reads whole runs of slots, as the serial command does
+    flash.resetCounters();
+    std::vector<JournalRecord> records = readAll(remounted);
+    bool exported = records.size() == remounted.getNextSequence() - remounted.getOldestSequence() &&
+                    records.size() > remounted.getCapacity() - JournalLog::RECORDS_PER_SECTOR &&
+                    records.back().uptimeMs == total - 1;
+    printf("export of %zu records: %zu flash reads, %zu bytes: %s\n", records.size(), flash.reads, flash.bytesRead,
+           exported ? "PASS" : "FAIL");
+    return ok && exported;
+}
+
+int main() {
+    bool ok = testRoundTrip();
+    ok = testBatching() && ok;
+    ok = testEraseAhead() && ok;
+    ok = testWear() && ok;
+    ok = testFailedWrite() && ok;
+    ok = testBadCrc() && ok;
+    ok = testPowerCuts() && ok;
+    ok = testPartitionRecovery() && ok;
+    printf("%s\n", ok ? "ALL PASSED" : "FAILED");
+    return ok ? 0 : 1;
+}
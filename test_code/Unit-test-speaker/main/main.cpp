@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <span>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "speaker.hpp"
+#include "audioModem.hpp"
+
+static const char *TAG = "Unit test speaker";
+
+// Same bytes as MenuController::startRecording() sends without a patient number
+static const uint8_t METADATA_FRAME[] = {1, 2, 3, 42, 30, 14, 18, 9, 125, 2, 3};
+
+static const Speaker::Tone PATTERN[] = {
+    {1000, 100, 50},
+    {1500, 100, 50},
+    {2000, 200, 0},
+    {0, 100, 0},
+    {1000, 50, 0},
+};
+
+/**
+ * @brief The beep as it was before the tone sequencer.
+ *
+ * Kept here only as the reference for the blocking time benchmark.
+ */
+class BlockingSpeaker : public PWMChannel {
+public:
+    explicit BlockingSpeaker(gpio_num_t gpioPin) : PWMChannel(gpioPin) {}
+
+    void beep(uint32_t freq) {
+        xSemaphoreTake(pwmMutex, portMAX_DELAY);
+        ledc_timer_resume(config.mode, config.timer);
+        ledc_set_freq(config.mode, config.timer, freq);
+        vTaskDelay(1500 / portTICK_PERIOD_MS);
+        ledc_timer_pause(config.mode, config.timer);
+        xSemaphoreGive(pwmMutex);
+    }
+};
+
+static uint32_t patternUs() {
+    uint32_t total = 0;
+    for (const Speaker::Tone &tone : PATTERN) {
+        total += (tone.durationMs + tone.gapMs) * 1000;
+    }
+    return total;
+}
+
+/**
+ * @brief How long beep() and play() keep the caller, and how long the sound lasts.
+ */
+static bool benchmarkBlockingTime(Speaker &speaker) {
+    BlockingSpeaker blocking(GPIO_NUM_26);
+    blocking.initialize();
+    int64_t start = esp_timer_get_time();
+    blocking.beep(1000);
+    int64_t blockingUs = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    speaker.beep(1000);
+    int64_t beepUs = esp_timer_get_time() - start;
+    speaker.waitUntilIdle(portMAX_DELAY);
+    int64_t beepOnAirUs = esp_timer_get_time() - start;
+
+    int64_t worstPlayUs = 0;
+    start = esp_timer_get_time();
+    for (int i = 0; i < 3; i++) {
+        int64_t callStart = esp_timer_get_time();
+        esp_err_t ret = speaker.play(PATTERN, sizeof(PATTERN) / sizeof(PATTERN[0]));
+        int64_t callUs = esp_timer_get_time() - callStart;
+        worstPlayUs = callUs > worstPlayUs ? callUs : worstPlayUs;
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "play() refused a pattern that fits: %s", esp_err_to_name(ret));
+            return false;
+        }
+    }
+    // Three patterns of five tones fill the queue, a fourth must be refused
+    bool full = speaker.play(PATTERN, sizeof(PATTERN) / sizeof(PATTERN[0])) == ESP_ERR_NO_MEM;
+    speaker.waitUntilIdle(portMAX_DELAY);
+    int64_t patternsUs = esp_timer_get_time() - start;
+
+    ESP_LOGI(TAG, "Caller blocking time:");
+    ESP_LOGI(TAG, "  blocking beep()          : %8lld us", blockingUs);
+    ESP_LOGI(TAG, "  queued beep()            : %8lld us, on air %lld us", beepUs, beepOnAirUs);
+    ESP_LOGI(TAG, "  play() of %u tones       : %8lld us worst of 3", (unsigned)(sizeof(PATTERN) / sizeof(PATTERN[0])),
+             worstPlayUs);
+    ESP_LOGI(TAG, "  3 patterns on air        : %8lld us, expected %lu us", patternsUs,
+             (unsigned long)(3 * patternUs()));
+    ESP_LOGI(TAG, "  full queue refused       : %s", full ? "yes" : "no");
+
+    // The timer steps run late by the esp_timer dispatch, a few hundred us per pattern at most
+    int64_t lateUs = patternsUs - 3 * (int64_t)patternUs();
+    bool ok = beepUs < 1000 && worstPlayUs < 1000 && full && lateUs >= 0 && lateUs < 5000;
+    ESP_LOGI(TAG, "%s", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+static void onModemIdle(void *context) {
+    *static_cast<int64_t *>(context) = esp_timer_get_time();
+}
+
+/**
+ * @brief A beep during a modem burst, neither waits for the other.
+ */
+static bool benchmarkConcurrency(Speaker &speaker, AudioModem &modem) {
+    volatile int64_t modemDoneAt = 0;
+    modem.setCompletionCallback(onModemIdle, (void *)&modemDoneAt);
+
+    int64_t start = esp_timer_get_time();
+    modem.transmitFrame(std::span<const uint8_t>(METADATA_FRAME, sizeof(METADATA_FRAME)));
+    vTaskDelay(pdMS_TO_TICKS(100));
+    int64_t beepStart = esp_timer_get_time();
+    speaker.beep(800);
+    int64_t beepUs = esp_timer_get_time() - beepStart;
+    speaker.waitUntilIdle(portMAX_DELAY);
+    int64_t speakerDoneAt = esp_timer_get_time();
+    modem.waitUntilIdle(portMAX_DELAY);
+    modem.setCompletionCallback(nullptr);
+
+    int64_t burstUs = modemDoneAt - start;
+    int64_t expectedUs = modem.getBurstUs(sizeof(METADATA_FRAME));
+    ESP_LOGI(TAG, "Beep during a modem burst:");
+    ESP_LOGI(TAG, "  beep() call              : %8lld us", beepUs);
+    ESP_LOGI(TAG, "  beep ended after         : %8lld us from the burst start", speakerDoneAt - start);
+    ESP_LOGI(TAG, "  burst on air             : %8lld us, expected %lld us", burstUs, expectedUs);
+
+    // Before, the beep waited for the burst or the burst for the beep, 1.5 s extra
+    bool ok = beepUs < 1000 && speakerDoneAt - beepStart < Speaker::BEEP_MS * 1000 + 5000 &&
+              burstUs < expectedUs + 5000;
+    ESP_LOGI(TAG, "%s", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+extern "C" void app_main(void)
+{
+    ESP_LOGI(TAG, "Hello from Unit test speaker!");
+    ESP_LOGI(TAG, "Free heap: %ld bytes", esp_get_free_heap_size());
+
+    AudioModem modem(2100, 2300, GPIO_NUM_25);
+    ESP_ERROR_CHECK(modem.initialize());
+    Speaker speaker(GPIO_NUM_27);
+    ESP_ERROR_CHECK(speaker.initialize());
+
+    bool ok = benchmarkBlockingTime(speaker);
+    ok = benchmarkConcurrency(speaker, modem) && ok;
+    ESP_LOGI(TAG, "%s", ok ? "ALL PASSED" : "FAILED");
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(5000));
+    }
+}
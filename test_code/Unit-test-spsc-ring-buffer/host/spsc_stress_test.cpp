@@ -0,0 +1,103 @@
+// Host stress test for SpscRingBuffer: one producer thread and one consumer
+// thread move a numbered stream through a small buffer, with single and
+// batch operations mixed, and the consumer checks that nothing is lost,
+// duplicated or reordered.
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+#include <thread>
+#include "spscRingBuffer.hpp"
+
+static constexpr uint64_t ITEMS = 20000000;
+
+struct Record {
+    uint64_t sequence;
+    uint64_t check;
+};
+
+static uint64_t checkOf(uint64_t sequence) {
+    return sequence * 0x9E3779B97F4A7C15ull;
+}
+
+static bool testBasics() {
+    SpscRingBuffer<int, 8> ring;
+    bool ok = ring.empty() && ring.capacity() == 7;
+    for (int i = 0; i < 7; i++) {
+        ok = ok && ring.push(i);
+    }
+    ok = ok && !ring.push(99) && ring.size() == 7;
+
+    int out[8];
+    ok = ok && ring.popBatch(out, 8) == 7;
+    for (int i = 0; i < 7; i++) {
+        ok = ok && out[i] == i;
+    }
+    int in[10] = {10, 11, 12, 13, 14, 15, 16, 17, 18, 19};
+    ok = ok && ring.pushBatch(in, 10) == 7 && ring.size() == 7;
+    int value = 0;
+    ok = ok && ring.pop(value) && value == 10;
+    printf("basics: %s\n", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+template <size_t N>
+static bool testStress(size_t batch) {
+    static SpscRingBuffer<Record, N> ring;
+    bool ok = true;
+    auto start = std::chrono::steady_clock::now();
+
+    std::thread producer([batch] {
+        Record records[64];
+        uint64_t next = 0;
+        while (next < ITEMS) {
+            size_t count = batch;
+            if (count > ITEMS - next) {
+                count = ITEMS - next;
+            }
+            for (size_t i = 0; i < count; i++) {
+                records[i] = {next + i, checkOf(next + i)};
+            }
+            size_t pushed = (count == 1) ? (ring.push(records[0]) ? 1 : 0) : ring.pushBatch(records, count);
+            if (pushed == 0) {
+                std::this_thread::yield();
+            }
+            next += pushed;
+        }
+    });
+
+    std::thread consumer([batch, &ok] {
+        Record records[64];
+        uint64_t expected = 0;
+        while (expected < ITEMS) {
+            size_t popped = (batch == 1) ? (ring.pop(records[0]) ? 1 : 0) : ring.popBatch(records, batch);
+            if (popped == 0) {
+                std::this_thread::yield();
+            }
+            for (size_t i = 0; i < popped; i++) {
+                if (records[i].sequence != expected || records[i].check != checkOf(expected)) {
+                    ok = false;
+                    return;
+                }
+                expected++;
+            }
+        }
+    });
+
+    producer.join();
+    consumer.join();
+    ok = ok && ring.empty();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("stress N=%zu batch=%zu: %s, %.1f M items/s\n", N, batch, ok ? "PASS" : "FAIL", ITEMS / seconds / 1e6);
+    return ok;
+}
+
+int main() {
+    bool ok = testBasics();
+    ok = testStress<16>(1) && ok;
+    ok = testStress<16>(7) && ok;
+    ok = testStress<1024>(1) && ok;
+    ok = testStress<1024>(64) && ok;
+    printf("%s\n", ok ? "ALL PASSED" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "spscRingBuffer.hpp"
+
+static const char *TAG = "Unit test spsc ring buffer";
+
+static constexpr uint32_t ITEMS = 200000;
+static constexpr size_t SLOTS = 64;
+static constexpr size_t BATCH = 16;
+
+struct Record {
+    uint32_t sequence;
+    uint32_t value;
+};
+
+struct BenchmarkContext {
+    QueueHandle_t queue;
+    SpscRingBuffer<Record, SLOTS> *ring;
+    size_t batch;
+    TaskHandle_t done;
+    bool ok;
+};
+
+// Producer runs on core 0, consumer on core 1, so every item crosses cores
+static void queueProducer(void *arg) {
+    BenchmarkContext *ctx = static_cast<BenchmarkContext *>(arg);
+    for (uint32_t i = 0; i < ITEMS; i++) {
+        Record r = {i, i ^ 0xA5A5A5A5};
+        xQueueSend(ctx->queue, &r, portMAX_DELAY);
+    }
+    vTaskDelete(NULL);
+}
+
+static void queueConsumer(void *arg) {
+    BenchmarkContext *ctx = static_cast<BenchmarkContext *>(arg);
+    Record r;
+    for (uint32_t i = 0; i < ITEMS; i++) {
+        xQueueReceive(ctx->queue, &r, portMAX_DELAY);
+        if (r.sequence != i || r.value != (i ^ 0xA5A5A5A5)) {
+            ctx->ok = false;
+        }
+    }
+    xTaskNotifyGive(ctx->done);
+    vTaskDelete(NULL);
+}
+
+static void ringProducer(void *arg) {
+    BenchmarkContext *ctx = static_cast<BenchmarkContext *>(arg);
+    Record records[BATCH];
+    uint32_t next = 0;
+    while (next < ITEMS) {
+        size_t count = ctx->batch;
+        if (count > ITEMS - next) {
+            count = ITEMS - next;
+        }
+        for (size_t i = 0; i < count; i++) {
+            records[i] = {next + (uint32_t)i, (next + (uint32_t)i) ^ 0xA5A5A5A5};
+        }
+        size_t pushed = (count == 1) ? (ctx->ring->push(records[0]) ? 1 : 0) : ctx->ring->pushBatch(records, count);
+        if (pushed == 0) {
+            taskYIELD();
+        }
+        next += pushed;
+    }
+    vTaskDelete(NULL);
+}
+
+static void ringConsumer(void *arg) {
+    BenchmarkContext *ctx = static_cast<BenchmarkContext *>(arg);
+    Record records[BATCH];
+    uint32_t expected = 0;
+    while (expected < ITEMS) {
+        size_t popped = (ctx->batch == 1) ? (ctx->ring->pop(records[0]) ? 1 : 0) : ctx->ring->popBatch(records, ctx->batch);
+        if (popped == 0) {
+            taskYIELD();
+        }
+        for (size_t i = 0; i < popped; i++) {
+            if (records[i].sequence != expected || records[i].value != (expected ^ 0xA5A5A5A5)) {
+                ctx->ok = false;
+            }
+            expected++;
+        }
+    }
+    xTaskNotifyGive(ctx->done);
+    vTaskDelete(NULL);
+}
+
+static void runBenchmark(const char *name, TaskFunction_t producer, TaskFunction_t consumer, BenchmarkContext &ctx) {
+    ctx.done = xTaskGetCurrentTaskHandle();
+    ctx.ok = true;
+    int64_t start = esp_timer_get_time();
+    xTaskCreatePinnedToCore(consumer, "consumer", 4096, &ctx, 5, NULL, 1);
+    xTaskCreatePinnedToCore(producer, "producer", 4096, &ctx, 5, NULL, 0);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    int64_t elapsed = esp_timer_get_time() - start;
+
+    ESP_LOGI(TAG, "%-22s %s, %lu items in %lld ms, %.2f us/item, %.0f items/s", name, ctx.ok ? "PASS" : "FAIL",
+             (unsigned long)ITEMS, elapsed / 1000, (double)elapsed / ITEMS, ITEMS * 1e6 / elapsed);
+}
+
+extern "C" void app_main(void)
+{
+    ESP_LOGI(TAG, "Hello from Unit test spsc ring buffer!");
+    ESP_LOGI(TAG, "ESP32 chip: %s", esp_get_idf_version());
+    ESP_LOGI(TAG, "Free heap: %ld bytes", esp_get_free_heap_size());
+
+    static SpscRingBuffer<Record, SLOTS> ring;
+    BenchmarkContext ctx = {};
+    ctx.queue = xQueueCreate(SLOTS - 1, sizeof(Record));
+    ctx.ring = &ring;
+
+    runBenchmark("xQueueSend/Receive", queueProducer, queueConsumer, ctx);
+    ctx.batch = 1;
+    runBenchmark("ring push/pop", ringProducer, ringConsumer, ctx);
+    ctx.batch = BATCH;
+    runBenchmark("ring pushBatch/popBatch", ringProducer, ringConsumer, ctx);
+
+    ESP_LOGI(TAG, "Benchmark finished.");
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(5000));
+    }
+}
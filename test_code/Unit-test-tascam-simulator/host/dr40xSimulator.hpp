@@ -0,0 +1,284 @@
+/**
+ * @file dr40xSimulator.hpp
+ * @brief A DR-40X on the other end of a simulated remote cable, in virtual time.
+ *
+ * The recorder model answers the remote keys the way tascamProtocol.hpp
+ * describes, with configurable transition times, dropped bytes, a menu that
+ * swallows the first stop, a missing or filling card and a status line that
+ * can be switched off. Its RecoderAbstract interface is the front panel, a
+ * person pressing the keys on the recorder itself.
+ *
+ * Nothing here sleeps or starts a thread: SimClock is advanced by the test and
+ * both ends are polled, so a run of minutes takes milliseconds and gives the
+ * same result every time.
+ */
+
+#ifndef DR40X_SIMULATOR_HPP
+#define DR40X_SIMULATOR_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+#include <random>
+#include "recoderAbstract.hpp"
+#include "tascamProtocol.hpp"
+
+/**
+ * @brief Virtual time shared by everything in one simulation.
+ */
+struct SimClock {
+    int64_t nowUs = 0;
+};
+
+/**
+ * @class UartPort
+ * @brief One end of a byte link, what the remote and the recorder see of the cable.
+ */
+class UartPort {
+public:
+    virtual ~UartPort() = default;
+
+    /** @brief Queue a byte for sending, it arrives one character time later at the earliest. */
+    virtual void write(uint8_t byte) = 0;
+
+    /**
+     * @brief Take a byte that has arrived.
+     * @return False when nothing is waiting.
+     */
+    virtual bool read(uint8_t &byte) = 0;
+};
+
+/**
+ * @class SimUartLink
+ * @brief Both directions of the remote cable at 9600 8E2, bytes may be dropped.
+ */
+class SimUartLink {
+public:
+    static constexpr int64_t CHARACTER_US = 12 * 1000000 / 9600;  ///< Start, 8 data, parity, 2 stop bits
+
+    /**
+     * @brief Constructs a SimUartLink.
+     * @param clock Time the bytes are stamped with.
+     * @param dropRate Chance that a byte is lost, in each direction.
+     * @param seed Seed of the losses.
+     */
+    SimUartLink(const SimClock &clock, double dropRate = 0.0, uint32_t seed = 1)
+        : remote(clock, toRecorder, toRemote, *this), recorder(clock, toRemote, toRecorder, *this),
+          dropRate(dropRate), random(seed) {}
+
+    /** @brief Change the chance of a lost byte. */
+    void setDropRate(double rate) { dropRate = rate; }
+
+    /** @brief Bytes lost so far, both directions. */
+    size_t getDropped() const { return dropped; }
+
+    /** @brief The ESP32 end. */
+    UartPort &remoteEnd() { return remote; }
+
+    /** @brief The recorder end. */
+    UartPort &recorderEnd() { return recorder; }
+
+private:
+    struct Line {
+        std::deque<std::pair<int64_t, uint8_t>> bytes;  ///< Arrival time and byte
+        int64_t freeUs = 0;                             ///< End of the last character on the wire
+    };
+
+    class End : public UartPort {
+    public:
+        End(const SimClock &clock, Line &tx, Line &rx, SimUartLink &link) : clock(clock), tx(tx), rx(rx), link(link) {}
+
+        void write(uint8_t byte) override {
+            int64_t startUs = clock.nowUs > tx.freeUs ? clock.nowUs : tx.freeUs;
+            tx.freeUs = startUs + CHARACTER_US;
+            if (link.lose()) {
+                return;
+            }
+            tx.bytes.emplace_back(tx.freeUs, byte);
+        }
+
+        bool read(uint8_t &byte) override {
+            if (rx.bytes.empty() || rx.bytes.front().first > clock.nowUs) {
+                return false;
+            }
+            byte = rx.bytes.front().second;
+            rx.bytes.pop_front();
+            return true;
+        }
+
+    private:
+        const SimClock &clock;
+        Line &tx;
+        Line &rx;
+        SimUartLink &link;
+    };
+
+    Line toRecorder;
+    Line toRemote;
+    End remote;
+    End recorder;
+    double dropRate;
+    std::mt19937 random;
+    size_t dropped = 0;
+
+    bool lose() {
+        if (dropRate <= 0.0 || std::uniform_real_distribution<double>(0.0, 1.0)(random) >= dropRate) {
+            return false;
+        }
+        dropped++;
+        return true;
+    }
+};
+
+/**
+ * @class Dr40xSimulator
+ * @brief The recorder: remote keys in, status bytes out.
+ *
+ * Record from stopped goes to record standby, record from standby starts a
+ * file. A record key is ignored while a transition is still settling, which
+ * is what the gaps of the timing table protect against. Stop is accepted at
+ * any time and ends stopped. The status byte of a transition is sent once it
+ * has settled, so an answer also means the next key is safe.
+ */
+class Dr40xSimulator : public RecoderAbstract {
+public:
+    /**
+     * @brief Behaviour of the recorder.
+     */
+    struct Config {
+        uint32_t stopMs = 400;         ///< Closing the file or leaving standby
+        uint32_t standbyMs = 600;      ///< Entering record standby
+        uint32_t recordMs = 300;       ///< Starting a file
+        uint32_t menuMs = 50;          ///< Closing a menu
+        bool answers = true;           ///< Status line connected, as with CONFIG_YOD_TASCAM_STATUS
+        bool card = true;              ///< SD card inserted
+        uint32_t cardSeconds = 0;      ///< Recording time until the card is full, 0 for no limit
+        bool menuOpen = false;         ///< A menu is open at the start, it takes the first stop
+        TascamState state = TascamState::Stopped;  ///< State at the start, before the ESP32 booted
+    };
+
+    Dr40xSimulator(UartPort &port, const SimClock &clock, const Config &config)
+        : port(port), clock(clock), config(config), state(config.state), menuOpen(config.menuOpen) {
+        if (state == TascamState::Recording) {
+            recordStartUs = clock.nowUs;
+        }
+    }
+
+    /** @brief Front panel record key. */
+    void startRecording() override { press(TASCAM_START_RECORDING); }
+
+    /** @brief Front panel stop key. */
+    void stopRecording() override { press(TASCAM_STOP_RECORDING); }
+
+    /** @brief Front panel record key from stopped, to record standby. */
+    void idle() override {
+        if (state == TascamState::Stopped) {
+            press(TASCAM_START_RECORDING);
+        }
+    }
+
+    /**
+     * @brief Take the keys that have arrived and finish a transition that has settled.
+     */
+    void step() {
+        uint8_t byte;
+        while (port.read(byte)) {
+            received++;
+            press(byte);
+        }
+        if (pending && clock.nowUs >= readyUs) {
+            pending = false;
+            state = pendingState;
+            if (state == TascamState::Recording) {
+                files++;
+                recordStartUs = clock.nowUs;
+            }
+            answer(TascamStatusParser::encode(state));
+        }
+        if (state == TascamState::Recording && config.cardSeconds > 0 &&
+            recordedUs + (clock.nowUs - recordStartUs) >= (int64_t)config.cardSeconds * 1000000) {
+            // The card is full, the file is closed and the recorder says so without a key
+            stopClock();
+            state = TascamState::Stopped;
+            answer(TascamStatusParser::encode(TascamFault::CardFull));
+        }
+    }
+
+    /** @brief State the recorder is in, the one being entered once it has settled. */
+    TascamState getState() const { return state; }
+
+    /** @brief True while a transition is settling. */
+    bool isSettling() const { return pending; }
+
+    /** @brief Files started. */
+    size_t getFiles() const { return files; }
+
+    /** @brief Bytes received on the remote input. */
+    size_t getReceived() const { return received; }
+
+    /** @brief Record keys that came while the recorder was not ready, and bytes that are no key. */
+    size_t getIgnoredKeys() const { return ignoredKeys; }
+
+    /** @brief Insert or remove the card. */
+    void setCard(bool inserted) { config.card = inserted; }
+
+private:
+    UartPort &port;
+    const SimClock &clock;
+    Config config;
+    TascamState state;
+    bool menuOpen;
+    bool pending = false;
+    TascamState pendingState = TascamState::Stopped;
+    int64_t readyUs = 0;
+    int64_t recordStartUs = 0;
+    int64_t recordedUs = 0;
+    size_t files = 0;
+    size_t received = 0;
+    size_t ignoredKeys = 0;
+
+    void press(uint8_t key) {
+        if (key == TASCAM_STOP_RECORDING) {
+            if (menuOpen) {
+                menuOpen = false;
+                begin(state, config.menuMs);
+                return;
+            }
+            if (state == TascamState::Recording) {
+                stopClock();
+            }
+            // A stop also ends a transition that is still settling
+            state = TascamState::Stopped;
+            begin(TascamState::Stopped, config.stopMs);
+            return;
+        }
+        if (key != TASCAM_START_RECORDING || menuOpen || pending || state == TascamState::Recording) {
+            ignoredKeys++;
+            return;
+        }
+        if (!config.card) {
+            answer(TascamStatusParser::encode(TascamFault::NoCard));
+            return;
+        }
+        begin(state == TascamState::Stopped ? TascamState::Standby : TascamState::Recording,
+              state == TascamState::Stopped ? config.standbyMs : config.recordMs);
+    }
+
+    void begin(TascamState to, uint32_t ms) {
+        pending = true;
+        pendingState = to;
+        readyUs = clock.nowUs + (int64_t)ms * 1000;
+    }
+
+    void stopClock() {
+        recordedUs += clock.nowUs - recordStartUs;
+    }
+
+    void answer(uint8_t status) {
+        if (config.answers) {
+            port.write(status);
+        }
+    }
+};
+
+#endif // DR40X_SIMULATOR_HPP
@@ -0,0 +1,101 @@
+/**
+ * @file hostTascamRemote.hpp
+ * @brief TascamBoundary's command task on the host, over a UartPort.
+ *
+ * The firmware task waits on a FreeRTOS queue set and the UART driver; here
+ * poll() is called on every tick of the simulation instead. What happens in
+ * between is the same: bytes go through TascamStatusParser into the
+ * TascamSequencer, and the keys it hands out are written to the port.
+ */
+
+#ifndef HOST_TASCAM_REMOTE_HPP
+#define HOST_TASCAM_REMOTE_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "dr40xSimulator.hpp"
+#include "recoderAbstract.hpp"
+#include "tascamProtocol.hpp"
+#include "tascamSequencer.hpp"
+
+/**
+ * @class HostTascamRemote
+ * @brief The ESP32 end of the remote cable.
+ */
+class HostTascamRemote : public RecoderAbstract {
+public:
+    /**
+     * @brief Constructs a HostTascamRemote.
+     * @param port The remote end of the link.
+     * @param clock Simulation time.
+     * @param acknowledged As CONFIG_YOD_TASCAM_STATUS.
+     * @param ackTimeoutMs As CONFIG_YOD_TASCAM_ACK_TIMEOUT_MS.
+     */
+    HostTascamRemote(UartPort &port, const SimClock &clock, bool acknowledged, uint32_t ackTimeoutMs = 1000)
+        : port(port), clock(clock), sequencer(acknowledged, ackTimeoutMs) {}
+
+    void startRecording() override { post(TascamState::Recording); }
+    void stopRecording() override { post(TascamState::Stopped); }
+    void idle() override { post(TascamState::Standby); }
+
+    /**
+     * @brief One pass of the command task at the current time.
+     */
+    void poll() {
+        uint8_t byte;
+        while (port.read(byte)) {
+            sequencer.report(parser.push(byte));
+        }
+        while (true) {
+            TascamSequencer::Action action = sequencer.next(clock.nowUs);
+            switch (action.kind) {
+                case TascamSequencer::Action::Kind::Send:
+                    port.write(action.key);
+                    keysSent++;
+                    lastKeyUs = clock.nowUs;
+                    break;
+                case TascamSequencer::Action::Kind::Fault:
+                    faults.push_back(action.fault);
+                    break;
+                case TascamSequencer::Action::Kind::Done:
+                    if (action.startLatencyUs > 0) {
+                        lastStartLatencyUs = action.startLatencyUs;
+                    }
+                    break;
+                case TascamSequencer::Action::Kind::Wait:
+                    return;
+            }
+        }
+    }
+
+    bool isBusy() const { return sequencer.isBusy(); }
+    TascamState getState() const { return sequencer.getState(); }
+    int64_t getLastStartLatencyUs() const { return lastStartLatencyUs; }
+    int64_t getLastRequestUs() const { return lastRequestUs; }
+    int64_t getLastKeyUs() const { return lastKeyUs; }
+    size_t getKeysSent() const { return keysSent; }
+    size_t getCancelled() const { return cancelled; }
+    const std::vector<TascamFault> &getFaults() const { return faults; }
+
+private:
+    UartPort &port;
+    const SimClock &clock;
+    TascamStatusParser parser;
+    TascamSequencer sequencer;
+    std::vector<TascamFault> faults;
+    int64_t lastStartLatencyUs = 0;
+    int64_t lastRequestUs = 0;
+    int64_t lastKeyUs = 0;
+    size_t keysSent = 0;
+    size_t cancelled = 0;
+
+    void post(TascamState target) {
+        lastRequestUs = clock.nowUs;
+        if (sequencer.request(target, clock.nowUs)) {
+            cancelled++;
+        }
+    }
+};
+
+#endif // HOST_TASCAM_REMOTE_HPP
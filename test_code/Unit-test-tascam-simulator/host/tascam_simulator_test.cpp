@@ -0,0 +1,273 @@
+// The firmware's TascamSequencer against a simulated DR-40X, in virtual time:
+// the latency of every session transition with the fixed gaps and with the
+// status line, bursts of random button presses that must never leave the
+// recorder in another state than the last press asked for, lost bytes, and
+// the front panel and card faults. See dr40xSimulator.hpp for the model.
+#include <stdio.h>
+#include <stdint.h>
+#include <functional>
+#include <random>
+#include "dr40xSimulator.hpp"
+#include "hostTascamRemote.hpp"
+
+static constexpr int64_t TICK_US = 250;          // Both ends are polled this often
+static constexpr uint32_t ACK_TIMEOUT_MS = 1000; // CONFIG_YOD_TASCAM_ACK_TIMEOUT_MS
+static constexpr int64_t QUIET_MS = 3000;        // Longer than any plan with its answers
+
+/**
+ * @brief A remote and a recorder on one cable.
+ */
+struct Simulation {
+    SimClock clock;
+    SimUartLink link;
+    Dr40xSimulator recorder;
+    HostTascamRemote remote;
+
+    Simulation(bool acknowledged, Dr40xSimulator::Config config, double dropRate = 0.0, uint32_t seed = 1)
+        : link(clock, dropRate, seed), recorder(link.recorderEnd(), clock, withStatus(config, acknowledged)),
+          remote(link.remoteEnd(), clock, acknowledged, ACK_TIMEOUT_MS) {}
+
+    void tick() {
+        remote.poll();
+        recorder.step();
+        clock.nowUs += TICK_US;
+    }
+
+    void run(int64_t ms) {
+        int64_t endUs = clock.nowUs + ms * 1000;
+        while (clock.nowUs < endUs) {
+            tick();
+        }
+    }
+
+    /**
+     * @brief Run until done holds.
+     * @return Milliseconds it took, -1 when maxMs passed first.
+     */
+    double runUntil(const std::function<bool()> &done, int64_t maxMs) {
+        int64_t startUs = clock.nowUs;
+        while (!done()) {
+            if (clock.nowUs - startUs > maxMs * 1000) {
+                return -1;
+            }
+            tick();
+        }
+        return (double)(clock.nowUs - startUs) / 1000.0;
+    }
+
+    /** @brief Recorder settled in state and the remote has nothing left to do. */
+    bool settledIn(TascamState state) const {
+        return recorder.getState() == state && !recorder.isSettling() && !remote.isBusy();
+    }
+
+private:
+    static Dr40xSimulator::Config withStatus(Dr40xSimulator::Config config, bool acknowledged) {
+        // The return line is only connected with the status option
+        config.answers = acknowledged;
+        return config;
+    }
+};
+
+static void press(RecoderAbstract &recorder, TascamState target) {
+    if (target == TascamState::Recording) {
+        recorder.startRecording();
+    } else if (target == TascamState::Stopped) {
+        recorder.stopRecording();
+    } else {
+        recorder.idle();
+    }
+}
+
+/**
+ * @brief Time of one transition.
+ */
+struct Transition {
+    const char *name;
+    TascamState target;
+    size_t keys;
+    double lastKeyMs;   // Request to the last key
+    double reachedMs;   // Request until the recorder settled in the target
+};
+
+/**
+ * @brief The session transitions in the order the menu asks for them, from a recorder with a menu open.
+ */
+static bool measure(bool acknowledged, Transition (&transitions)[5]) {
+    Dr40xSimulator::Config config;
+    config.menuOpen = true;
+    Simulation sim(acknowledged, config);
+    transitions[0] = {"Unknown to recording", TascamState::Recording, 0, 0, 0};
+    transitions[1] = {"Recording to stopped", TascamState::Stopped, 0, 0, 0};
+    transitions[2] = {"Stopped to recording", TascamState::Recording, 0, 0, 0};
+    transitions[3] = {"Recording to standby", TascamState::Standby, 0, 0, 0};
+    transitions[4] = {"Standby to recording", TascamState::Recording, 0, 0, 0};
+
+    bool ok = true;
+    for (Transition &transition : transitions) {
+        size_t keys = sim.remote.getKeysSent();
+        press(sim.remote, transition.target);
+        transition.reachedMs = sim.runUntil([&] { return sim.settledIn(transition.target); }, QUIET_MS);
+        transition.keys = sim.remote.getKeysSent() - keys;
+        transition.lastKeyMs = (double)(sim.remote.getLastKeyUs() - sim.remote.getLastRequestUs()) / 1000.0;
+        // The sequencer's own figure for a start, as MenuController logs it
+        if (transition.target == TascamState::Recording && transition.keys > 1) {
+            ok = ok && sim.remote.getLastStartLatencyUs() == sim.remote.getLastKeyUs() - sim.remote.getLastRequestUs();
+        }
+        ok = ok && transition.reachedMs >= 0;
+        // A session lasts, and the gap of the last key is over before the next button
+        sim.run(2000);
+    }
+    return ok && sim.recorder.getIgnoredKeys() == 0 && sim.remote.getFaults().empty();
+}
+
+static bool testLatency() {
+    Transition fixed[5];
+    Transition confirmed[5];
+    bool ok = measure(false, fixed) && measure(true, confirmed);
+
+    printf("%-22s | %-24s | %-24s\n", "Transition", "Fixed gaps: keys, key/on", "Status line: keys, key/on");
+    for (size_t i = 0; i < 5; i++) {
+        printf("%-22s | %zu, %7.1f / %7.1f ms   | %zu, %7.1f / %7.1f ms\n", fixed[i].name, fixed[i].keys,
+               fixed[i].lastKeyMs, fixed[i].reachedMs, confirmed[i].keys, confirmed[i].lastKeyMs,
+               confirmed[i].reachedMs);
+    }
+    // The fixed gaps are the timing table: stop, stop, record, record in 1.75 s
+    ok = ok && fixed[0].keys == 4 && fixed[0].lastKeyMs == 1750.0 && fixed[2].keys == 2 &&
+         fixed[2].lastKeyMs == 750.0;
+    // The answer to the first stop saves the second one, and every answer the rest of a gap
+    ok = ok && confirmed[0].keys == 3;
+    for (size_t i = 0; i < 5; i++) {
+        // Polled ends may see the same bytes a tick apart
+        ok = ok && confirmed[i].reachedMs <= fixed[i].reachedMs + (double)(SimUartLink::CHARACTER_US + TICK_US) / 1000.0;
+    }
+    printf("latency of the session transitions: %s\n", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+/**
+ * @brief Random bursts of presses, each followed by a quiet spell in which the last press must win.
+ * @param silentMismatches Quiet spells that ended in another state without a fault.
+ * @param retries Presses repeated after a fault, like the "Start: retry" of the menu.
+ * @return Quiet spells that did not end in the last state asked for, after the retries.
+ */
+static size_t pressBursts(Simulation &sim, size_t bursts, uint32_t seed, size_t &presses, size_t &silentMismatches,
+                          size_t &retries) {
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> burstLength(1, 12);
+    std::uniform_int_distribution<int> gapMs(10, 900);
+    std::discrete_distribution<int> choice({45, 45, 10});
+    const TascamState targets[] = {TascamState::Recording, TascamState::Stopped, TascamState::Standby};
+
+    size_t lost = 0;
+    for (size_t burst = 0; burst < bursts; burst++) {
+        TascamState target = TascamState::Stopped;
+        size_t faults = sim.remote.getFaults().size();
+        for (int i = burstLength(random); i > 0; i--) {
+            target = targets[choice(random)];
+            press(sim.remote, target);
+            presses++;
+            sim.run(gapMs(random));
+        }
+        sim.run(QUIET_MS);
+        if (sim.settledIn(target)) {
+            continue;
+        }
+        if (sim.remote.getFaults().size() == faults) {
+            silentMismatches++;
+        }
+        bool reached = false;
+        for (int retry = 0; retry < 3 && !reached; retry++) {
+            retries++;
+            press(sim.remote, target);
+            sim.run(QUIET_MS);
+            reached = sim.settledIn(target);
+        }
+        lost += reached ? 0 : 1;
+    }
+    return lost;
+}
+
+static bool testRapidPresses(bool acknowledged) {
+    Simulation sim(acknowledged, Dr40xSimulator::Config());
+    size_t presses = 0;
+    size_t silent = 0;
+    size_t retries = 0;
+    size_t lost = pressBursts(sim, 200, 7, presses, silent, retries);
+    bool ok = lost == 0 && silent == 0 && retries == 0 && sim.recorder.getIgnoredKeys() == 0 &&
+              sim.remote.getFaults().empty();
+    printf("%s: %zu presses in 200 bursts, %zu sequences cancelled, %zu keys, %zu files, none lost: %s\n",
+           acknowledged ? "status line" : "fixed gaps", presses, sim.remote.getCancelled(), sim.remote.getKeysSent(),
+           sim.recorder.getFiles(), ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+/**
+ * @brief Lost bytes: with the status line every loss is a fault and a retry recovers.
+ *
+ * With the fixed gaps a lost key goes unnoticed, that count is only printed.
+ */
+static bool testDroppedBytes() {
+    bool ok = true;
+    for (bool acknowledged : {false, true}) {
+        Simulation sim(acknowledged, Dr40xSimulator::Config(), 0.03, 11);
+        size_t presses = 0;
+        size_t silent = 0;
+        size_t retries = 0;
+        size_t lost = pressBursts(sim, 200, 13, presses, silent, retries);
+        bool pass = !acknowledged || (lost == 0 && silent == 0 && !sim.remote.getFaults().empty());
+        printf("%s, 3%% of the bytes lost: %zu lost, %zu faults, %zu silently wrong, %zu retries, %zu still wrong%s\n",
+               acknowledged ? "status line" : "fixed gaps", sim.link.getDropped(), sim.remote.getFaults().size(),
+               silent, retries, lost, acknowledged ? (pass ? ": PASS" : ": FAIL") : "");
+        ok = ok && pass;
+    }
+    return ok;
+}
+
+static bool hasFault(const HostTascamRemote &remote, TascamFault fault) {
+    for (TascamFault raised : remote.getFaults()) {
+        if (raised == fault) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool testFrontPanelAndCard() {
+    Dr40xSimulator::Config config;
+    config.cardSeconds = 20;
+    Simulation sim(true, config);
+
+    sim.remote.startRecording();
+    bool ok = sim.runUntil([&] { return sim.settledIn(TascamState::Recording); }, QUIET_MS) >= 0;
+    // Someone presses stop on the recorder, the remote follows
+    sim.recorder.stopRecording();
+    ok = ok && sim.runUntil([&] { return sim.remote.getState() == TascamState::Stopped; }, QUIET_MS) >= 0;
+    size_t keys = sim.remote.getKeysSent();
+    sim.remote.startRecording();
+    ok = ok && sim.runUntil([&] { return sim.settledIn(TascamState::Recording); }, QUIET_MS) >= 0 &&
+         sim.remote.getKeysSent() - keys == 2;
+    printf("stop on the front panel followed, restart with two keys: %s\n", ok ? "PASS" : "FAIL");
+
+    bool full = sim.runUntil([&] { return hasFault(sim.remote, TascamFault::CardFull); }, 30000) >= 0 &&
+                sim.remote.getState() == TascamState::Stopped && sim.recorder.getState() == TascamState::Stopped;
+    printf("card full after %u s of recording: %s\n", config.cardSeconds, full ? "PASS" : "FAIL");
+
+    sim.recorder.setCard(false);
+    sim.remote.startRecording();
+    bool noCard = sim.runUntil([&] { return hasFault(sim.remote, TascamFault::NoCard) && !sim.remote.isBusy(); },
+                               QUIET_MS) >= 0 &&
+                  sim.recorder.getState() == TascamState::Stopped;
+    printf("record without a card ends the request as \"%s\": %s\n", tascamFaultName(TascamFault::NoCard),
+           noCard ? "PASS" : "FAIL");
+    return ok && full && noCard;
+}
+
+int main() {
+    bool ok = testLatency();
+    ok = testRapidPresses(false) && ok;
+    ok = testRapidPresses(true) && ok;
+    ok = testDroppedBytes() && ok;
+    ok = testFrontPanelAndCard() && ok;
+    printf("%s\n", ok ? "ALL PASSED" : "FAILED");
+    return ok ? 0 : 1;
+}
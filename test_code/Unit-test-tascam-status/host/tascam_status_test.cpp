@@ -0,0 +1,260 @@
+// Status acknowledgement of the Tascam remote without the recorder: a
+// stand-in thread on the slave side of a pseudo-terminal answers the remote
+// keys like a DR-40X, and the test drives the master side the way the
+// TascamBoundary command task does, parsing the answers with the firmware's
+// TascamStatusParser.
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include "tascamProtocol.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr int ANSWER_MS = 30;        // Time the stand-in takes to answer a key
+static constexpr int ACK_TIMEOUT_MS = 300;  // As CONFIG_YOD_TASCAM_ACK_TIMEOUT_MS, shortened for the test
+static constexpr int FIXED_GAPS_MS = 1750;  // Unknown to recording with the gaps of the timing table
+
+static long elapsedMs(Clock::time_point start) {
+    return (long)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+}
+
+static void makeRaw(int fd) {
+    struct termios tio;
+    tcgetattr(fd, &tio);
+    cfmakeraw(&tio);
+    // 9600 8E2 like the firmware, a pseudo-terminal keeps the setting but does not time the bytes
+    cfsetispeed(&tio, B9600);
+    cfsetospeed(&tio, B9600);
+    tio.c_cflag |= PARENB | CSTOPB;
+    tcsetattr(fd, TCSANOW, &tio);
+}
+
+/**
+ * @brief The recorder end of the remote cable.
+ *
+ * Record from stopped goes to standby, record from standby starts a file,
+ * stop always ends stopped. Every key is answered with the state, or with a
+ * fault when there is no card.
+ */
+class Dr40xStandIn {
+public:
+    std::atomic<bool> noCard{false};   ///< Refuse record keys
+    std::atomic<bool> silent{false};   ///< Cable out, nothing is answered
+    std::atomic<bool> noisy{false};    ///< Put a stray byte before every answer
+
+    explicit Dr40xStandIn(int fd) : fd(fd), worker([this] { run(); }) {}
+
+    ~Dr40xStandIn() {
+        running = false;
+        worker.join();
+    }
+
+    /** @brief The card filled up, the recorder stops and says so without a key. */
+    void fillCard() {
+        std::lock_guard<std::mutex> lock(mutex);
+        state = TascamState::Stopped;
+        answer(TascamStatusParser::encode(TascamFault::CardFull));
+    }
+
+    TascamState getState() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return state;
+    }
+
+private:
+    int fd;
+    std::atomic<bool> running{true};
+    std::mutex mutex;
+    TascamState state = TascamState::Recording;   // Left recording before the ESP32 booted
+    std::thread worker;
+
+    void answer(uint8_t status) {
+        if (noisy) {
+            uint8_t stray = 0x5a;
+            (void)!write(fd, &stray, 1);
+        }
+        (void)!write(fd, &status, 1);
+    }
+
+    void run() {
+        while (running) {
+            struct pollfd pfd = {fd, POLLIN, 0};
+            if (poll(&pfd, 1, 10) <= 0) {
+                continue;
+            }
+            uint8_t key;
+            if (read(fd, &key, 1) != 1 || silent) {
+                continue;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(ANSWER_MS));
+            std::lock_guard<std::mutex> lock(mutex);
+            if (key == TASCAM_STOP_RECORDING) {
+                state = TascamState::Stopped;
+            } else if (key == TASCAM_START_RECORDING) {
+                if (noCard) {
+                    answer(TascamStatusParser::encode(TascamFault::NoCard));
+                    continue;
+                }
+                state = (state == TascamState::Stopped) ? TascamState::Standby : TascamState::Recording;
+            } else {
+                continue;
+            }
+            answer(TascamStatusParser::encode(state));
+        }
+    }
+};
+
+/**
+ * @brief Wait for a report, like the command task after a key.
+ * @return False after the timeout.
+ */
+static bool waitReport(int fd, TascamStatusParser &parser, int timeoutMs, TascamStatusParser::Report &report) {
+    Clock::time_point start = Clock::now();
+    while (elapsedMs(start) < timeoutMs) {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, timeoutMs - (int)elapsedMs(start)) <= 0) {
+            continue;
+        }
+        uint8_t byte;
+        if (read(fd, &byte, 1) != 1) {
+            continue;
+        }
+        report = parser.push(byte);
+        if (report.kind != TascamStatusParser::Report::Kind::None) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool sendKey(int fd, TascamStatusParser &parser, uint8_t key, TascamStatusParser::Report &report) {
+    (void)!write(fd, &key, 1);
+    return waitReport(fd, parser, ACK_TIMEOUT_MS, report);
+}
+
+static bool isState(const TascamStatusParser::Report &report, TascamState state) {
+    return report.kind == TascamStatusParser::Report::Kind::State && report.state == state;
+}
+
+static bool isFault(const TascamStatusParser::Report &report, TascamFault fault) {
+    return report.kind == TascamStatusParser::Report::Kind::Fault && report.fault == fault;
+}
+
+/**
+ * @brief Every status byte decodes to what was encoded, keys and noise are ignored.
+ */
+static bool testParser() {
+    TascamStatusParser parser;
+    bool ok = parser.getLastState() == TascamState::Unknown;
+    for (TascamState state : {TascamState::Stopped, TascamState::Standby, TascamState::Recording}) {
+        ok = ok && isState(parser.push(TascamStatusParser::encode(state)), state) && parser.getLastState() == state;
+    }
+    for (TascamFault fault : {TascamFault::NoCard, TascamFault::CardFull, TascamFault::CardError}) {
+        TascamStatusParser::Report report = parser.push(TascamStatusParser::encode(fault));
+        ok = ok && isFault(report, fault) && report.state == TascamState::Stopped;
+    }
+    size_t ignored = 0;
+    for (int byte = 0; byte < 256; byte++) {
+        if (parser.push((uint8_t)byte).kind == TascamStatusParser::Report::Kind::None) {
+            ignored++;
+        }
+    }
+    // Three states and three faults out of 256 byte values
+    ok = ok && ignored == 250 && parser.getIgnoredBytes() == 250;
+    ok = ok && parser.push(TASCAM_STOP_RECORDING).kind == TascamStatusParser::Report::Kind::None &&
+         parser.push(TASCAM_START_RECORDING).kind == TascamStatusParser::Report::Kind::None;
+    printf("parser: states, faults and 250 ignored byte values: %s\n", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+/**
+ * @brief A start from an unknown state, confirmed key by key.
+ *
+ * The first stop is answered with "stopped", so the second stop of the
+ * blind sequence is not needed.
+ */
+static bool testConfirmedStart(int master, Dr40xStandIn &recorder) {
+    TascamStatusParser parser;
+    TascamStatusParser::Report report;
+    Clock::time_point start = Clock::now();
+    bool ok = sendKey(master, parser, TASCAM_STOP_RECORDING, report) && isState(report, TascamState::Stopped);
+    ok = ok && sendKey(master, parser, TASCAM_START_RECORDING, report) && isState(report, TascamState::Standby);
+    ok = ok && sendKey(master, parser, TASCAM_START_RECORDING, report) && isState(report, TascamState::Recording);
+    long ms = elapsedMs(start);
+    ok = ok && recorder.getState() == TascamState::Recording && ms < FIXED_GAPS_MS / 2;
+    printf("start confirmed in %ld ms, %d ms with the fixed gaps: %s\n", ms, FIXED_GAPS_MS, ok ? "PASS" : "FAIL");
+
+    start = Clock::now();
+    bool stopped = sendKey(master, parser, TASCAM_STOP_RECORDING, report) && isState(report, TascamState::Stopped);
+    printf("stop confirmed in %ld ms: %s\n", elapsedMs(start), stopped ? "PASS" : "FAIL");
+    return ok && stopped;
+}
+
+static bool testFaults(int master, Dr40xStandIn &recorder) {
+    TascamStatusParser parser;
+    TascamStatusParser::Report report;
+
+    recorder.noCard = true;
+    bool noCard = sendKey(master, parser, TASCAM_START_RECORDING, report) && isFault(report, TascamFault::NoCard);
+    recorder.noCard = false;
+    printf("record without a card reported as \"%s\": %s\n", tascamFaultName(report.fault), noCard ? "PASS" : "FAIL");
+
+    // Noise on the line does not hide the answer
+    recorder.noisy = true;
+    bool noisy = sendKey(master, parser, TASCAM_START_RECORDING, report) && isState(report, TascamState::Standby) &&
+                 sendKey(master, parser, TASCAM_START_RECORDING, report) && isState(report, TascamState::Recording) &&
+                 parser.getIgnoredBytes() == 2;
+    recorder.noisy = false;
+    printf("answers behind stray bytes: %s\n", noisy ? "PASS" : "FAIL");
+
+    // Reported without a key, while the command task is idle
+    recorder.fillCard();
+    bool full = waitReport(master, parser, ACK_TIMEOUT_MS, report) && isFault(report, TascamFault::CardFull) &&
+                parser.getLastState() == TascamState::Stopped;
+    printf("card full during a recording reported without a key: %s\n", full ? "PASS" : "FAIL");
+
+    recorder.silent = true;
+    Clock::time_point start = Clock::now();
+    bool answered = sendKey(master, parser, TASCAM_START_RECORDING, report);
+    long ms = elapsedMs(start);
+    recorder.silent = false;
+    bool cableOut = !answered && ms >= ACK_TIMEOUT_MS && ms < ACK_TIMEOUT_MS + 100;
+    printf("cable out: no answer, \"%s\" after %ld ms: %s\n", tascamFaultName(TascamFault::NoResponse), ms,
+           cableOut ? "PASS" : "FAIL");
+    return noCard && noisy && full && cableOut;
+}
+
+int main() {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        perror("posix_openpt");
+        return 1;
+    }
+    int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    if (slave < 0) {
+        perror("open slave");
+        return 1;
+    }
+    makeRaw(master);
+    makeRaw(slave);
+
+    bool ok = testParser();
+    {
+        Dr40xStandIn recorder(slave);
+        ok = testConfirmedStart(master, recorder) && ok;
+        ok = testFaults(master, recorder) && ok;
+    }
+    close(slave);
+    close(master);
+    printf("%s\n", ok ? "ALL PASSED" : "FAILED");
+    return ok ? 0 : 1;
+}
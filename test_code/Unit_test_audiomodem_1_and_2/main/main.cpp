@@ -1,12 +1,195 @@
 #include <stdio.h>
+#include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 #include "esp_system.h"
+#include "esp_timer.h"
+#include "nvs_flash.h"
+#include "nvs.h"
 #include "audioModem.hpp"
 
 static const char *TAG = "Unit test audiomodem";
 
+// Same bytes as MenuController::startRecording() sends without a patient number
+static const uint8_t METADATA_FRAME[] = {1, 2, 3, 42, 30, 14, 18, 9, 125, 2, 3};
+static const gpio_num_t BLOCKING_PIN = GPIO_NUM_27;
+static const uint32_t FLASH_FRAMES = 10;         ///< Frames sent while NVS is being written
+static const uint32_t FLASH_JITTER_MAX_US = 1000; ///< Latest boundary accepted during flash writes
+
+/**
+ * @brief The transmit loop as it was before the modem became asynchronous.
+ *
+ * Kept here only as the reference for the blocking time benchmark. It has
+ * its own LEDC timer and channel, so it plays on a spare pin and leaves the
+ * routing of the modem pins alone.
+ */
+class BlockingAudioModem : public PWMChannel {
+public:
+    BlockingAudioModem(uint32_t highFreq, uint32_t lowFreq, gpio_num_t gpioPin)
+        : PWMChannel(gpioPin), highFreq(highFreq), lowFreq(lowFreq) {}
+
+    void transmit(uint8_t data, AudioModem::JitterStatistics *jitter = nullptr) {
+        xSemaphoreTake(pwmMutex, portMAX_DELAY);
+        ledc_timer_resume(config.mode, config.timer);
+        int64_t startUs = esp_timer_get_time();
+        for (uint8_t i = 0; i < 8; i++) {
+            ledc_set_freq(config.mode, config.timer, (data & (1 << i)) ? highFreq : lowFreq);
+            vTaskDelay(pdMS_TO_TICKS(20));
+            if (jitter != nullptr) {
+                // Same measurement as the gptimer ISR: deviation of the boundary from start + n symbols
+                int64_t deviation = esp_timer_get_time() - (startUs + (int64_t)(i + 1) * 20000);
+                uint32_t absoluteUs = (uint32_t)(deviation < 0 ? -deviation : deviation);
+                jitter->symbols++;
+                jitter->sumUs += absoluteUs;
+                if (absoluteUs > jitter->maxUs) {
+                    jitter->maxUs = absoluteUs;
+                }
+            }
+        }
+        ledc_timer_pause(config.mode, config.timer);
+        xSemaphoreGive(pwmMutex);
+    }
+
+private:
+    uint32_t highFreq;
+    uint32_t lowFreq;
+};
+
+static void onTransmitDone(void *context) {
+    *static_cast<int64_t *>(context) = esp_timer_get_time();
+}
+
+static void benchmarkBlockingTime(AudioModem &modem) {
+    BlockingAudioModem blockingModem(2100, 2300, BLOCKING_PIN);
+    ESP_ERROR_CHECK(blockingModem.initialize());
+
+    int64_t start = esp_timer_get_time();
+    for (uint8_t byte : METADATA_FRAME) {
+        blockingModem.transmit(byte);
+    }
+    int64_t blockingUs = esp_timer_get_time() - start;
+
+    volatile int64_t doneAt = 0;
+    modem.setCompletionCallback(onTransmitDone, (void *)&doneAt);
+
+    start = esp_timer_get_time();
+    for (uint8_t byte : METADATA_FRAME) {
+        modem.transmit(byte);
+    }
+    int64_t perByteUs = esp_timer_get_time() - start;
+    modem.waitUntilIdle(portMAX_DELAY);
+
+    start = esp_timer_get_time();
+    modem.transmitFrame(METADATA_FRAME);
+    int64_t frameUs = esp_timer_get_time() - start;
+    modem.waitUntilIdle(portMAX_DELAY);
+    int64_t burstUs = doneAt - start;
+    modem.setCompletionCallback(nullptr);
+
+    ESP_LOGI(TAG, "Caller blocking time for %u bytes:", (unsigned)sizeof(METADATA_FRAME));
+    ESP_LOGI(TAG, "  blocking transmit() loop : %8lld us", blockingUs);
+    ESP_LOGI(TAG, "  async transmit() loop    : %8lld us", perByteUs);
+    ESP_LOGI(TAG, "  async transmitFrame()    : %8lld us", frameUs);
+    ESP_LOGI(TAG, "  burst on air (async)     : %8lld us, expected %lu us", burstUs,
+             (unsigned long)modem.getBurstUs(sizeof(METADATA_FRAME)));
+}
+
+static void logJitter(const char *name, const AudioModem::JitterStatistics &jitter) {
+    if (jitter.symbols == 0) {
+        ESP_LOGW(TAG, "  %-24s : no symbols measured", name);
+        return;
+    }
+    ESP_LOGI(TAG, "  %-24s : %4lu symbols, avg %5llu us, max %5lu us", name, (unsigned long)jitter.symbols,
+             jitter.sumUs / jitter.symbols, (unsigned long)jitter.maxUs);
+}
+
+/**
+ * @brief Compare the symbol boundary jitter of vTaskDelay and the gptimer ISR.
+ *
+ * The tick based loop is late by up to one tick plus the ledc_set_freq call,
+ * the ISR should stay within a few microseconds.
+ */
+static void benchmarkSymbolJitter(AudioModem &modem) {
+    BlockingAudioModem blockingModem(2100, 2300, BLOCKING_PIN);
+    ESP_ERROR_CHECK(blockingModem.initialize());
+    AudioModem::JitterStatistics legacy = {};
+    for (uint8_t byte : METADATA_FRAME) {
+        blockingModem.transmit(byte, &legacy);
+    }
+
+    modem.getJitterStatistics(true);
+    modem.transmitFrame(METADATA_FRAME);
+    modem.waitUntilIdle(portMAX_DELAY);
+    AudioModem::JitterStatistics timer = modem.getJitterStatistics();
+
+    ESP_LOGI(TAG, "Symbol boundary jitter, %lu us per symbol:", (unsigned long)modem.getSymbolUs());
+    logJitter("vTaskDelay loop", legacy);
+    logJitter("gptimer ISR", timer);
+}
+
+struct NvsChurn {
+    volatile bool running;
+    uint32_t commits;
+    SemaphoreHandle_t done;
+};
+
+/**
+ * @brief Commits a changing blob until stopped, like the NVS flush task but without pause.
+ *
+ * Every commit writes flash, and once the pages are full the NVS garbage
+ * collection erases a sector, the longest flash operation there is.
+ */
+static void nvsChurnTask(void *pvParameters) {
+    NvsChurn *churn = static_cast<NvsChurn *>(pvParameters);
+    static uint8_t blob[1024];
+    nvs_handle_t handle;
+    ESP_ERROR_CHECK(nvs_open("jitter", NVS_READWRITE, &handle));
+    while (churn->running) {
+        memset(blob, (uint8_t)churn->commits, sizeof(blob));
+        ESP_ERROR_CHECK(nvs_set_blob(handle, "churn", blob, sizeof(blob)));
+        ESP_ERROR_CHECK(nvs_commit(handle));
+        churn->commits++;
+    }
+    nvs_close(handle);
+    xSemaphoreGive(churn->done);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Check the symbol boundaries while NVS writes and erases flash.
+ *
+ * The cache is off during a flash operation. Only an IRAM safe gptimer ISR
+ * keeps clocking symbols then, otherwise an erase stretches a symbol by tens
+ * of milliseconds.
+ */
+static void benchmarkJitterDuringFlash(AudioModem &modem) {
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(ret);
+
+    NvsChurn churn = {true, 0, xSemaphoreCreateBinary()};
+    modem.getJitterStatistics(true);
+    xTaskCreatePinnedToCore(nvsChurnTask, "NvsChurn", 3072, &churn, 1, NULL, 0);
+    for (uint32_t i = 0; i < FLASH_FRAMES; i++) {
+        modem.transmitFrame(METADATA_FRAME);
+        modem.waitUntilIdle(portMAX_DELAY);
+    }
+    churn.running = false;
+    xSemaphoreTake(churn.done, portMAX_DELAY);
+    vSemaphoreDelete(churn.done);
+    AudioModem::JitterStatistics jitter = modem.getJitterStatistics();
+
+    bool ok = jitter.symbols > 0 && jitter.maxUs <= FLASH_JITTER_MAX_US;
+    ESP_LOGI(TAG, "Symbol boundary jitter during %lu NVS commits:", (unsigned long)churn.commits);
+    logJitter("gptimer ISR, flash busy", jitter);
+    ESP_LOGI(TAG, "%s, limit %lu us", ok ? "PASS" : "FAIL", (unsigned long)FLASH_JITTER_MAX_US);
+}
+
 extern "C" void app_main(void)
 {
     ESP_LOGI(TAG, "Hello from Unit test audiomodem!");
@@ -15,12 +198,15 @@ extern "C" void app_main(void)
     
     // Initialize AudioModem
     AudioModem audioModem(2100, 2300, GPIO_NUM_25);
-    audioModem.initialize();
+    ESP_ERROR_CHECK(audioModem.initialize());
     AudioModem audioModem2(2100, 2300, GPIO_NUM_26);
-    audioModem2.initialize();
+    ESP_ERROR_CHECK(audioModem2.initialize());
 
 
     ESP_LOGI(TAG, "AudioModem initialized. Starting test loop.");
+    benchmarkBlockingTime(audioModem);
+    benchmarkSymbolJitter(audioModem);
+    benchmarkJitterDuringFlash(audioModem);
 
     while (1)
     {
@@ -5,6 +5,7 @@
 set(SHARED_SRCS
     "../../../code_esp32/main/src/speaker.cpp"
     "../../../code_esp32/main/src/pwmChannel.cpp"
+    "../../../code_esp32/main/src/ledcAllocator.cpp"
     "../../../code_esp32/main/src/audioAnalyzer.cpp"
     "../../../code_esp32/main/src/audioModem.cpp"
     "../../../code_esp32/main/src/buttonBoundary.cpp"
@@ -15,7 +16,10 @@ set(SHARED_SRCS
     "../../../code_esp32/main/src/m5ScannerController.cpp"
     "../../../code_esp32/main/src/menuController.cpp"
     "../../../code_esp32/main/src/RealTimeClock.cpp"
+    "../../../code_esp32/main/src/i2cBusManager.cpp"
     "../../../code_esp32/main/src/storage.cpp"
+    "../../../code_esp32/main/src/sessionJournal.cpp"
+    "../../../code_esp32/main/src/sessionAnalytics.cpp"
     "../../../code_esp32/main/src/tascamBoundary.cpp"
     "../../../code_esp32/main/src/taskHandler.cpp"
     "../../../code_esp32/main/src/WordCountQueueObserver.cpp"
@@ -26,6 +30,9 @@ set(SHARED_SRCS
 # Common include directories
 set(SHARED_INCLUDES
     "../../../code_esp32/main/headers"
+    "../../../code_esp32/components/modem_codec/include"
+    "../../../code_esp32/components/tascam_protocol/include"
+    "../../../code_esp32/components/session_analytics/include"
     
 )
 list(APPEND EXTRA_COMPONENT_DIRS "${CMAKE_SOURCE_DIR}/../../managed_components")